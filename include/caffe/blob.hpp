@@ -262,6 +262,16 @@ class Blob {
    * shared_ptr calls its destructor when reset with the "=" operator.
    */
   void ShareDiff(const Blob& other);
+  /**
+   * @brief Set the data_ shared_ptr to point to the given SyncedMemory, which
+   *        must be large enough to hold count() elements -- used by Net to let
+   *        activations with disjoint lifetimes share memory.
+   *
+   * The Blob may later be reshaped up to the size of data without
+   * reallocating. If diff_ is smaller than that, it is replaced by a new
+   * (lazily allocated) SyncedMemory of matching size.
+   */
+  void set_data(const shared_ptr<SyncedMemory>& data);
 
   bool ShapeEquals(const BlobProto& other);
 
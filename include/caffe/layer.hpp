@@ -38,7 +38,8 @@ class Layer {
    * layer.
    */
   explicit Layer(const LayerParameter& param)
-    : layer_param_(param), is_shared_(false) {
+    : layer_param_(param), inference_only_(false), inference_saved_bytes_(0),
+      is_shared_(false) {
       // Set phase and copy blobs (if there are any).
       phase_ = param.phase();
       if (layer_param_.blobs_size() > 0) {
@@ -116,6 +117,137 @@ class Layer {
     is_shared_ = is_shared;
   }
 
+  /** @brief Return whether this layer only ever runs forward. */
+  inline bool inference_only() const { return inference_only_; }
+
+  /**
+   * @brief Set whether this layer only ever runs forward, before SetUp.
+   *        Inference-only layers may leave out state that only Backward
+   *        needs, and cannot run Backward. Layers built from internal layers
+   *        or nets, such as LRN, SPP and the recurrent layers, pass it on to
+   *        them.
+   */
+  inline void set_inference_only(bool inference_only) {
+    inference_only_ = inference_only;
+  }
+
+  /**
+   * @brief Returns the bytes of backward-only state that the layer left out
+   *        at its current shape because it is inference only.
+   */
+  inline size_t inference_saved_bytes() const {
+    return inference_saved_bytes_;
+  }
+
+  /**
+   * @brief Take over the forward pass of the activation layer that runs in
+   *        place on this layer's only top, after SetUp of both, and return
+   *        whether the layer did. Forward_cpu then applies the activation,
+   *        and the activation layer no longer needs to run forward on the
+   *        CPU (see NetParameter.fuse_activations). By default, layers do
+   *        not fuse activations.
+   *
+   * @param activation the activation layer, which still runs Backward
+   * @param need_backward whether the activation layer will run Backward
+   */
+  virtual bool FuseActivation(Layer<Dtype>* activation,
+      const bool need_backward) {
+    return false;
+  }
+
+  /**
+   * @brief Makes Forward_cpu leave out the activation taken over by
+   *        FuseActivation, or apply it again, for forward passes that stop
+   *        before the activation layer (see Net::ForwardFromTo).
+   */
+  virtual void SuspendFusedActivation(const bool suspend) {}
+
+  /**
+   * @brief Loads param i from the proto of a trained layer of the same
+   *        shape (see Net::CopyTrainedLayersFrom). Layers that derive another
+   *        form of a param, such as quantized weights, may load the stored
+   *        form of it directly.
+   */
+  virtual void ParamFromProto(const int i, const BlobProto& proto) {
+    blobs_[i]->FromProto(proto, false);
+  }
+
+  /**
+   * @brief Makes this layer, which shares the params of source (see
+   *        Net::CreateExecutor), also share what source derives from them,
+   *        such as quantized weights, rather than derive a copy of its own.
+   *        Both must be set up. Source derives them first, so that Forward
+   *        only reads them and never derives them again (see
+   *        RefreshDerivedParams). By default, layers derive nothing.
+   */
+  virtual void ShareDerivedParams(Layer<Dtype>* source) {}
+
+  /**
+   * @brief Derives anew what Forward_cpu reads from the params, if they
+   *        changed since. Forward_cpu calls it, unless the layer shares what
+   *        it derives with a source layer; then Net::RefreshDerivedParams
+   *        must run on the net of source. By default, layers derive nothing.
+   */
+  virtual void RefreshDerivedParams() {}
+
+  /**
+   * @brief Returns whether the layer points its tops or its internal blobs at
+   *        the memory of other blobs (e.g. with Blob::ShareData), so that
+   *        its tops and bottoms must keep their memory rather than move to
+   *        the shared activation memory of the net (see
+   *        NetParameter.optimize_memory). By default, layers do not.
+   */
+  virtual inline bool SharesInternalData() const { return false; }
+
+  /**
+   * @brief Returns whether the layer freed the Dtype data of a param that it
+   *        reads only in another form, such as 16-bit weights, so that the
+   *        param holds no values and must be neither saved nor read (see
+   *        NetParameter.inference_only). By default, layers do not.
+   */
+  virtual inline bool ParamsReleased() const { return false; }
+
+  /**
+   * @brief Returns whether Forward_cpu is elementwise: the only top has the
+   *        count of each bottom, each of its values depends only on the
+   *        bottom values at the same index (and on the layer's parameters),
+   *        and the layer computes them in ForwardElements. The net may then
+   *        run the layer one tile of the blobs at a time, together with the
+   *        elementwise layers next to it (see NetParameter.fuse_elementwise).
+   *        By default, layers are not elementwise.
+   *
+   * @param need_backward whether the layer will run Backward
+   */
+  virtual inline bool ElementwiseForward(const bool need_backward) const {
+    return false;
+  }
+  /**
+   * @brief Returns whether Backward_cpu is elementwise as well: the layer has
+   *        one bottom and no parameters, and computes the bottom diff in
+   *        BackwardElements.
+   */
+  virtual inline bool ElementwiseBackward() const { return false; }
+
+  /**
+   * @brief Computes the top values of index begin up to end from those of
+   *        the bottoms, after Reshape. top_data may be one of bottom_data.
+   *        Runs concurrently on disjoint ranges.
+   */
+  virtual void ForwardElements(const Dtype* const* bottom_data,
+      Dtype* top_data, const int begin, const int end) const {
+    NOT_IMPLEMENTED;
+  }
+  /**
+   * @brief Computes the bottom diffs of index begin up to end, like
+   *        ForwardElements. bottom_diff may be top_diff, and bottom_data may
+   *        be top_data.
+   */
+  virtual void BackwardElements(const Dtype* top_data, const Dtype* top_diff,
+      const Dtype* bottom_data, Dtype* bottom_diff, const int begin,
+      const int end) const {
+    NOT_IMPLEMENTED;
+  }
+
   /**
    * @brief Adjust the shapes of top blobs and internal buffers to accommodate
    *        the shapes of the bottom blobs.
@@ -330,6 +462,10 @@ class Layer {
   /** The vector that indicates whether each top blob has a non-zero weight in
    *  the objective function. */
   vector<Dtype> loss_;
+  /** Whether the layer only ever runs forward. */
+  bool inference_only_;
+  /** The bytes of backward-only state left out; set by Reshape. */
+  size_t inference_saved_bytes_;
 
   /** @brief Using the CPU device, compute the layer output. */
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -490,6 +626,8 @@ template <typename Dtype>
 inline void Layer<Dtype>::Backward(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
+  CHECK(!inference_only_) << type() << " layer " << layer_param_.name()
+      << " is inference only and cannot run Backward.";
   switch (Caffe::mode()) {
   case Caffe::CPU:
     Backward_cpu(top, propagate_down, bottom);
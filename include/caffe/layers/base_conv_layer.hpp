@@ -6,7 +6,12 @@
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/fused_activation.hpp"
+#include "caffe/util/half.hpp"
 #include "caffe/util/im2col.hpp"
+#include "caffe/util/quantization.hpp"
+#include "caffe/util/sparse.hpp"
+#include "caffe/util/workspace.hpp"
 
 namespace caffe {
 
@@ -19,6 +24,7 @@ class BaseConvolutionLayer : public Layer<Dtype> {
  public:
   explicit BaseConvolutionLayer(const LayerParameter& param)
       : Layer<Dtype>(param) {}
+  virtual ~BaseConvolutionLayer();
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
@@ -35,11 +41,35 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   void forward_cpu_gemm(const Dtype* input, const Dtype* weights,
       Dtype* output, bool skip_im2col = false);
   void forward_cpu_bias(Dtype* output, const Dtype* bias);
+  // Adds the bias to the output of image n in top_data and applies the fused
+  // activation, if any, in one pass.
+  void forward_cpu_epilogue(Dtype* top_data, const int n);
+  // Version of forward_cpu_gemm on 8-bit integers, with the input quantized
+  // by input_scale (see QuantizationParameter).
+  void forward_cpu_quantized(const Dtype* input,
+      const QuantizedWeights<Dtype>& weights, const Dtype input_scale,
+      Dtype* output);
+  // Version of forward_cpu_gemm for 16-bit weights, which it converts a
+  // panel of outputs at a time.
+  void forward_cpu_half(const Dtype* input, const HalfWeights<Dtype>& weights,
+      Dtype* output);
+  // Version of forward_cpu_gemm for weights in compressed sparse rows.
+  void forward_cpu_sparse(const Dtype* input,
+      const SparseWeights<Dtype>& weights, Dtype* output);
   void backward_cpu_gemm(const Dtype* input, const Dtype* weights,
       Dtype* output);
   void weight_cpu_gemm(const Dtype* input, const Dtype* output, Dtype*
       weights);
   void backward_cpu_bias(Dtype* bias, const Dtype* input);
+  // Versions of the helpers above for batch consecutive images, which are
+  // lowered together and multiplied with one GEMM per group (see
+  // ConvolutionParameter.batch_lowering_bytes).
+  void forward_cpu_gemm_batch(const Dtype* input, const Dtype* weights,
+      Dtype* output, int batch);
+  void backward_cpu_gemm_batch(const Dtype* output, const Dtype* weights,
+      Dtype* input, int batch);
+  void weight_cpu_gemm_batch(const Dtype* input, const Dtype* output,
+      Dtype* weights, int batch);
 
 #ifndef CPU_ONLY
   void forward_gpu_gemm(const Dtype* col_input, const Dtype* weights,
@@ -59,6 +89,10 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   // reverse_dimensions should return true iff we are implementing deconv, so
   // that conv helpers know which dimensions are which.
   virtual bool reverse_dimensions() = 0;
+  // lowers_input should return false if the CPU implementation computes the
+  // convolution without the column buffer, which is then only reserved when
+  // a helper needs it.
+  virtual inline bool lowers_input() { return true; }
   // Compute height_out_ and width_out_ from other parameters.
   virtual void compute_output_shape() = 0;
 
@@ -92,6 +126,15 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   bool bias_term_;
   bool is_1x1_;
   bool force_nd_im2col_;
+  /// @brief The number of images the batched helpers should lower together.
+  int lowering_batch_;
+  /// @brief The bias and activation applied by forward_cpu_epilogue.
+  FusedActivation<Dtype> activation_;
+  /// @brief The quantized columns and the sums of forward_cpu_quantized.
+  vector<int8_t> quantized_col_, quantized_col_group_;
+  vector<int32_t> quantized_sums_;
+  /// @brief The weights forward_cpu_half converted back to Dtype.
+  vector<Dtype> half_panel_;
 
  private:
   // wrap im2col/col2im so we don't have to remember the (long) argument lists
@@ -123,6 +166,19 @@ class BaseConvolutionLayer : public Layer<Dtype> {
           pad_.cpu_data(), stride_.cpu_data(), dilation_.cpu_data(), data);
     }
   }
+  // Lowers batch images into the batched column buffer, whose rows hold the
+  // columns of all the images side by side, and returns it.
+  Dtype* lower_cpu_batch(const Dtype* input, int batch);
+
+  // The column buffer lives in the Workspace shared by all layers running on
+  // the calling thread; point col_buffer_ at it before every use.
+  inline void attach_col_buffer() {
+    const shared_ptr<SyncedMemory>& workspace = Workspace::Get().Reserve(this,
+        col_buffer_bytes_);
+    if (col_buffer_.data() != workspace) {
+      col_buffer_.set_data(workspace);
+    }
+  }
 #ifndef CPU_ONLY
   inline void conv_im2col_gpu(const Dtype* data, Dtype* col_buff) {
     if (!force_nd_im2col_ && num_spatial_axes_ == 2) {
@@ -164,6 +220,9 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   int kernel_dim_;
   int col_offset_;
   int output_offset_;
+  // The bytes of scratch memory reserved for the column buffer and, when
+  // lowering images in batches, the batched column and output buffers.
+  size_t col_buffer_bytes_;
 
   Blob<Dtype> col_buffer_;
   Blob<Dtype> bias_multiplier_;
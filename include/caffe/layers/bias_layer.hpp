@@ -32,6 +32,12 @@ class BiasLayer : public Layer<Dtype> {
   virtual inline int MinBottomBlobs() const { return 1; }
   virtual inline int MaxBottomBlobs() const { return 2; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  /// A learned bias is elementwise.
+  virtual inline bool ElementwiseForward(const bool need_backward) const {
+    return this->layer_param_.bottom_size() == 1;
+  }
+  virtual void ForwardElements(const Dtype* const* bottom_data,
+      Dtype* top_data, const int begin, const int end) const;
 
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
@@ -60,11 +60,35 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
    *  - bias_term (\b optional, default true). Whether to have a bias.
    *  - engine: convolution has CAFFE (matrix multiplication) and CUDNN (library
    *    kernels + stream parallelism) engines.
+   *
+   *  With layout NHWC, the 2D convolution reads and writes (num, height,
+   *  width, channels) blobs on the CPU and runs forward only. It needs no
+   *  im2col: the channels of each input pixel are already a contiguous row of
+   *  the input matrix, so each kernel offset multiplies a strided block of
+   *  rows by its filter slice directly ("implicit GEMM").
    */
   explicit ConvolutionLayer(const LayerParameter& param)
-      : BaseConvolutionLayer<Dtype>(param) {}
+      : BaseConvolutionLayer<Dtype>(param), arranged_weights_version_(0),
+        quantized_weights_(new QuantizedWeights<Dtype>()),
+        half_weights_(new HalfWeights<Dtype>()),
+        sparse_weights_(new SparseWeights<Dtype>()),
+        shares_derived_params_(false) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
 
   virtual inline const char* type() const { return "Convolution"; }
+  virtual bool FuseActivation(Layer<Dtype>* activation,
+      const bool need_backward);
+  virtual void SuspendFusedActivation(const bool suspend);
+  /// Quantized layers load stored 8-bit weights as they are.
+  virtual void ParamFromProto(const int i, const BlobProto& proto);
+  virtual void ShareDerivedParams(Layer<Dtype>* source);
+  virtual void RefreshDerivedParams();
+  virtual inline bool ParamsReleased() const {
+    return half_weights_->released() || quantized_weights_->released();
+  }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -76,7 +100,79 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual inline bool reverse_dimensions() { return false; }
+  virtual inline bool lowers_input() {
+    return quantized() || half() || (!use_direct() && !channels_last());
+  }
   virtual void compute_output_shape();
+
+  /**
+   * @brief Whether the CPU implementation convolves directly instead of with
+   *        im2col and GEMM, which it does for 2D convolutions whose groups have
+   *        so few channels that the GEMMs would be tiny, such as depthwise
+   *        (one channel per group) and ResNeXt-style convolutions.
+   */
+  bool use_direct();
+  // Direct versions of forward_cpu_gemm, backward_cpu_gemm and
+  // weight_cpu_gemm for one image.
+  void forward_cpu_direct(const Dtype* input, const Dtype* weights,
+      Dtype* output);
+  void backward_cpu_direct(const Dtype* output, const Dtype* weights,
+      Dtype* input);
+  void weight_cpu_direct(const Dtype* input, const Dtype* output,
+      Dtype* weights);
+
+  /**
+   * @brief Whether the CPU implementation runs forward on 8-bit integers;
+   *        see QuantizationParameter.
+   */
+  inline bool quantized() const {
+    return this->layer_param_.has_quantization_param();
+  }
+
+  /**
+   * @brief Whether the CPU implementation reads 16-bit weights; see
+   *        ConvolutionParameter.weight_precision.
+   */
+  inline bool half() const {
+    return this->layer_param_.convolution_param().weight_precision() !=
+        FLOAT32;
+  }
+
+  /// @brief Whether the blobs are NHWC; see LayerParameter.layout.
+  inline bool channels_last() const {
+    return this->layer_param_.layout() == NHWC;
+  }
+  /**
+   * @brief Points logical_bottom_vec_ and logical_top_vec_ at NCHW-shaped
+   *        stand-ins for the NHWC bottom, for the shape logic of
+   *        BaseConvolutionLayer.
+   */
+  void ReshapeLogical(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  /// @brief Rearranges the weights into channels_last_weights_ if they
+  ///        changed since the last call.
+  void ArrangeChannelsLastWeights();
+  void forward_cpu_channels_last(const Dtype* input, Dtype* output);
+
+  /// NCHW-shaped blobs that never allocate memory.
+  Blob<Dtype> logical_bottom_, logical_top_;
+  vector<Blob<Dtype>*> logical_bottom_vec_, logical_top_vec_;
+  /// The weights of NHWC convolutions, kernel_h x kernel_w x group x
+  /// channels / group x num_output / group. The derived weights below are
+  /// shared with executors; see ShareDerivedParams.
+  Blob<Dtype> channels_last_weights_;
+  /// The weights and their version when channels_last_weights_ was arranged.
+  shared_ptr<SyncedMemory> arranged_weights_;
+  uint64_t arranged_weights_version_;
+  /// The weights of quantized convolutions.
+  shared_ptr<QuantizedWeights<Dtype> > quantized_weights_;
+  /// The 16-bit weights.
+  shared_ptr<HalfWeights<Dtype> > half_weights_;
+  /// The weights in compressed sparse rows when sparse enough.
+  shared_ptr<SparseWeights<Dtype> > sparse_weights_;
+  /// Whether the derived weights are those of a source layer, which only
+  /// its net refreshes.
+  bool shares_derived_params_;
 };
 
 }  // namespace caffe
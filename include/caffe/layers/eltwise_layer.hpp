@@ -28,6 +28,13 @@ class EltwiseLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "Eltwise"; }
   virtual inline int MinBottomBlobs() const { return 2; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  /// PROD and SUM are elementwise; MAX also stores the argmax.
+  virtual inline bool ElementwiseForward(const bool need_backward) const {
+    return this->layer_param_.eltwise_param().operation() !=
+        EltwiseParameter_EltwiseOp_MAX;
+  }
+  virtual void ForwardElements(const Dtype* const* bottom_data,
+      Dtype* top_data, const int begin, const int end) const;
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
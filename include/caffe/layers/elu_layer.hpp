@@ -33,6 +33,15 @@ class ELULayer : public NeuronLayer<Dtype> {
       : NeuronLayer<Dtype>(param) {}
 
   virtual inline const char* type() const { return "ELU"; }
+  virtual inline bool ElementwiseForward(const bool need_backward) const {
+    return true;
+  }
+  virtual inline bool ElementwiseBackward() const { return true; }
+  virtual void ForwardElements(const Dtype* const* bottom_data,
+      Dtype* top_data, const int begin, const int end) const;
+  virtual void BackwardElements(const Dtype* top_data, const Dtype* top_diff,
+      const Dtype* bottom_data, Dtype* bottom_diff, const int begin,
+      const int end) const;
 
  protected:
   /**
@@ -0,0 +1,96 @@
+#ifndef CAFFE_FFT_CONV_LAYER_HPP_
+#define CAFFE_FFT_CONV_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/fft.hpp"
+
+#include "caffe/layers/conv_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Computes 2D convolutions with large kernels on the CPU through the
+ *        fast Fourier transform.
+ *
+ * Each padded input channel is transformed once, zero-padded to a power of
+ * two so that the circular correlation does not wrap into the outputs. The
+ * correlation with a filter then is an elementwise product in the frequency
+ * domain, summed over the channels of a group, and one inverse transform per
+ * output channel yields all its outputs; strided outputs are sampled from
+ * it. The cost no longer grows with the kernel area, which pays off for
+ * kernels of 7x7 and up. The transformed filters are cached until the
+ * weights change, and executors share them (see Net::CreateExecutor). The
+ * input spectra of several images are kept together so that each filter
+ * spectrum is applied to all of them while it is in cache.
+ *
+ * Select it with engine: FFT. Setup compares the multiply-adds of the FFT
+ * with those of im2col and GEMM for the input shape and keeps the
+ * ConvolutionLayer implementation where the FFT would be slower, as it is for
+ * small kernels and large strides, or where the filter spectra would take
+ * too much memory, as they do for many channels on large inputs. GPU mode,
+ * non-2D convolutions and Backward also use the ConvolutionLayer
+ * implementation.
+ */
+template <typename Dtype>
+class FFTConvolutionLayer : public ConvolutionLayer<Dtype> {
+ public:
+  explicit FFTConvolutionLayer(const LayerParameter& param)
+      : ConvolutionLayer<Dtype>(param), use_fft_(false), chosen_height_(-1),
+        chosen_width_(-1), fft_height_(0), fft_width_(0),
+        shares_filter_spectra_(false), images_per_batch_(1),
+        transformed_weights_version_(0) {}
+  virtual ~FFTConvolutionLayer();
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  /// Also shares the filter spectra of source.
+  virtual void ShareDerivedParams(Layer<Dtype>* source);
+  virtual void RefreshDerivedParams();
+
+  /// @brief Returns whether Forward_cpu uses the FFT for the current shape.
+  inline bool use_fft() const { return use_fft_; }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  // Forward needs no column buffer; Backward reserves it when called.
+  virtual inline bool lowers_input() { return !use_fft_; }
+
+  /// @brief Decides with the cost model whether to use the FFT for inputs of
+  ///        height x width, and prepares the transforms if so.
+  void ChooseAlgorithm(int height, int width);
+  /// @brief Transforms the filters into filter_spectra_ if the weights
+  ///        changed since the last call.
+  void TransformFilters();
+  /// @brief Transforms the channels of one image into spectra of
+  ///        2 x fft_height_ x fft_width_ values each: real, then imaginary.
+  void TransformInput(const Dtype* input, Dtype* spectra);
+
+  /// Whether the FFT is faster than GEMM for the current shape.
+  bool use_fft_;
+  /// The input height and width the choice was made for.
+  int chosen_height_, chosen_width_;
+  /// The transform sizes, powers of two covering the padded input.
+  int fft_height_, fft_width_;
+  shared_ptr<FFT<Dtype> > row_fft_, col_fft_;
+  /// The filter spectra, num_output x channels / group x 2 x fft_height_ x
+  /// fft_width_.
+  Blob<Dtype> filter_spectra_;
+  /// Whether filter_spectra_ are those of a source layer, which only its net
+  /// refreshes.
+  bool shares_filter_spectra_;
+  /// The number of images whose input spectra are kept together.
+  int images_per_batch_;
+  /// The weights and their version when filter_spectra_ was computed.
+  shared_ptr<SyncedMemory> transformed_weights_;
+  uint64_t transformed_weights_version_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_FFT_CONV_LAYER_HPP_
@@ -6,6 +6,10 @@
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/fused_activation.hpp"
+#include "caffe/util/half.hpp"
+#include "caffe/util/quantization.hpp"
+#include "caffe/util/sparse.hpp"
 
 namespace caffe {
 
@@ -19,7 +23,10 @@ template <typename Dtype>
 class InnerProductLayer : public Layer<Dtype> {
  public:
   explicit InnerProductLayer(const LayerParameter& param)
-      : Layer<Dtype>(param) {}
+      : Layer<Dtype>(param), quantized_weights_(new QuantizedWeights<Dtype>()),
+        half_weights_(new HalfWeights<Dtype>()),
+        sparse_weights_(new SparseWeights<Dtype>()),
+        shares_derived_params_(false) {}
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
@@ -28,6 +35,16 @@ class InnerProductLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "InnerProduct"; }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  virtual bool FuseActivation(Layer<Dtype>* activation,
+      const bool need_backward);
+  virtual void SuspendFusedActivation(const bool suspend);
+  /// Quantized layers load stored 8-bit weights as they are.
+  virtual void ParamFromProto(const int i, const BlobProto& proto);
+  virtual void ShareDerivedParams(Layer<Dtype>* source);
+  virtual void RefreshDerivedParams();
+  virtual inline bool ParamsReleased() const {
+    return half_weights_->released() || quantized_weights_->released();
+  }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -39,12 +56,44 @@ class InnerProductLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  /**
+   * @brief Whether the CPU implementation runs forward on 8-bit integers;
+   *        see QuantizationParameter.
+   */
+  inline bool quantized() const {
+    return this->layer_param_.has_quantization_param();
+  }
+  void forward_cpu_quantized(const Dtype* input, Dtype* output);
+  /// @brief Computes the inner product of the input with the weights read
+  ///        in InnerProductParameter.weight_precision.
+  void forward_cpu_half(const Dtype* input, Dtype* output);
+  /// @brief Computes the inner product of the input with sparse_weights_.
+  void forward_cpu_sparse(const Dtype* input, Dtype* output);
+
   int M_;
   int K_;
   int N_;
   bool bias_term_;
   Blob<Dtype> bias_multiplier_;
   bool transpose_;  ///< if true, assume transposed weights
+  /// The bias and activation applied to the outputs when fused.
+  FusedActivation<Dtype> activation_;
+  /// The quantized weights, inputs and sums of quantized layers. The
+  /// derived weights below are shared with executors; see
+  /// ShareDerivedParams.
+  shared_ptr<QuantizedWeights<Dtype> > quantized_weights_;
+  vector<int8_t> quantized_input_;
+  vector<int32_t> quantized_sums_;
+  /// The 16-bit weights, and a panel of them converted back to Dtype.
+  shared_ptr<HalfWeights<Dtype> > half_weights_;
+  vector<Dtype> half_panel_;
+  /// The weights in compressed sparse rows when sparse enough, and the
+  /// transposed inputs and outputs of their product.
+  shared_ptr<SparseWeights<Dtype> > sparse_weights_;
+  vector<Dtype> sparse_input_, sparse_output_;
+  /// Whether the derived weights are those of a source layer, which only
+  /// its net refreshes.
+  bool shares_derived_params_;
 };
 
 }  // namespace caffe
@@ -0,0 +1,49 @@
+#ifndef CAFFE_LAYOUT_LAYER_HPP_
+#define CAFFE_LAYOUT_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Converts a 4D Blob between the NCHW and NHWC layouts.
+ *
+ * The top is in the layout given by the layer's layout field and the bottom
+ * in the other one. Blobs of other dimensions have the same layout either
+ * way and are copied. Nets with channels_last insert these layers at the
+ * boundaries of their NHWC parts.
+ */
+template <typename Dtype>
+class LayoutLayer : public Layer<Dtype> {
+ public:
+  explicit LayoutLayer(const LayerParameter& param)
+      : Layer<Dtype>(param) {}
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual inline const char* type() const { return "Layout"; }
+  virtual inline int ExactNumBottomBlobs() const { return 1; }
+  virtual inline int ExactNumTopBlobs() const { return 1; }
+
+ protected:
+  /**
+   * @param bottom input Blob vector (length 1)
+   *   -# @f$ (N \times C \times H \times W) @f$ for an NHWC top, or
+   *      @f$ (N \times H \times W \times C) @f$ for an NCHW top
+   * @param top output Blob vector (length 1)
+   *   -# @f$ (N \times H \times W \times C) @f$ or
+   *      @f$ (N \times C \times H \times W) @f$: the same values reordered
+   */
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_LAYOUT_LAYER_HPP_
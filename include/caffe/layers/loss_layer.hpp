@@ -46,6 +46,22 @@ class LossLayer : public Layer<Dtype> {
   virtual inline bool AllowForceBackward(const int bottom_index) const {
     return bottom_index != 1;
   }
+
+ protected:
+  /**
+   * @brief The normalization of loss_param, or if it has none, that which the
+   *        deprecated normalize flag stands for.
+   */
+  LossParameter_NormalizationMode normalization_mode() const;
+  /**
+   * @brief The normalizer of the summed loss of outer_num x inner_num
+   *        outputs. If normalization_mode is VALID, the count of valid
+   *        outputs will be read from valid_count, unless it is -1 in which
+   *        case all outputs are assumed to be valid.
+   */
+  static Dtype GetNormalizer(
+      const LossParameter_NormalizationMode normalization_mode,
+      const int outer_num, const int inner_num, const int valid_count);
 };
 
 }  // namespace caffe
@@ -17,6 +17,12 @@ namespace caffe {
 /**
  * @brief Normalize the input in a local region across or within feature maps.
  *
+ * The CPU implementation computes the sliding sums of squares and their
+ * power in one pass, in parallel over images and channels, and keeps
+ * scale_ for Backward only in the TRAIN phase; Backward otherwise computes
+ * it again. On the GPU, WITHIN_CHANNEL normalization runs an internal net
+ * of split, power, pooling and eltwise layers.
+ *
  * TODO(dox): thorough documentation for Forward, Backward, and proto params.
  */
 template <typename Dtype>
@@ -55,6 +61,27 @@ class LRNLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void WithinChannelBackward(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  virtual void WithinChannelForward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void WithinChannelBackward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  /// @brief Whether CrossChannelForward_cpu keeps scale_ for Backward.
+  inline bool cpu_scale() const {
+    return this->phase_ == TRAIN && !this->inference_only();
+  }
+  /**
+   * @brief Normalizes all images across channels into top_data, and stores
+   *        the scale into scale_data, either of which may be NULL.
+   */
+  void cross_channel_cpu(const Dtype* bottom_data, Dtype* top_data,
+      Dtype* scale_data) const;
+  /**
+   * @brief Sums in plane the size x size squares around each value, zero
+   *        padded, using buffer of the size of a plane.
+   */
+  void within_channel_sum_cpu(const Dtype* plane, Dtype* buffer,
+      Dtype* sum) const;
 
   int size_;
   int pre_pad_;
@@ -12,6 +12,15 @@ namespace caffe {
 /**
  * @brief Pools the input image by taking the max, average, etc. within regions.
  *
+ * The CPU implementation pools the channels of the images in parallel, whole
+ * rows of outputs at once for unpadded 2x2 and 3x3 windows of stride 2 and
+ * as a single reduction for global pooling. Outside the TRAIN phase max
+ * pooling keeps no mask of the maxima, and Backward finds them again.
+ *
+ * With layout NHWC, max and average pooling read and write (num, height,
+ * width, channels) blobs, pool all the channels of a window at once, and run
+ * forward only.
+ *
  * TODO(dox): thorough documentation for Forward, Backward, and proto params.
  */
 template <typename Dtype>
@@ -44,6 +53,35 @@ class PoolingLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  /// @brief Whether the blobs are NHWC; see LayerParameter.layout.
+  inline bool channels_last() const {
+    return this->layer_param_.layout() == NHWC;
+  }
+  void forward_cpu_channels_last(const Dtype* bottom_data, const int num,
+      Dtype* top_data);
+  /// @brief Whether Forward_cpu records the maxima of max pooling in max_idx_.
+  inline bool cpu_max_idx() const {
+    return this->phase_ == TRAIN && !this->inference_only();
+  }
+  /**
+   * @brief Max pools one channel of an image, storing the index of each
+   *        maximum in mask unless it is NULL.
+   */
+  template <typename Mask>
+  void max_pool_cpu(const Dtype* bottom_data, Dtype* top_data,
+      Mask* mask) const;
+  void ave_pool_cpu(const Dtype* bottom_data, Dtype* top_data) const;
+  /// @brief The maximum of the window of output (ph, pw) and its index.
+  Dtype max_pool_window(const Dtype* bottom_data, const int ph, const int pw,
+      int* index) const;
+  Dtype ave_pool_window(const Dtype* bottom_data, const int ph,
+      const int pw) const;
+  /// @brief Whether the window is an unpadded 2x2 or 3x3 of stride 2.
+  inline bool strided_window() const {
+    return pad_h_ == 0 && pad_w_ == 0 && stride_h_ == 2 && stride_w_ == 2 &&
+        kernel_h_ == kernel_w_ && (kernel_h_ == 2 || kernel_h_ == 3);
+  }
+
   int kernel_h_, kernel_w_;
   int stride_h_, stride_w_;
   int pad_h_, pad_w_;
@@ -41,6 +41,9 @@ class PReLULayer : public NeuronLayer<Dtype> {
 
   virtual inline const char* type() const { return "PReLU"; }
 
+  /// @brief The copy of the inputs that Backward reads when run in place.
+  inline Blob<Dtype>* bottom_memory() { return &bottom_memory_; }
+
  protected:
   /**
    * @param bottom input Blob vector (length 1)
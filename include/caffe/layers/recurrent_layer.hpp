@@ -58,6 +58,8 @@ class RecurrentLayer : public Layer<Dtype> {
     // Can't propagate to sequence continuation indicators.
     return bottom_index != 1;
   }
+  /// The tops and bottoms share data with blobs of the unrolled net.
+  virtual inline bool SharesInternalData() const { return true; }
 
  protected:
   /**
@@ -0,0 +1,101 @@
+#ifndef CAFFE_SAMPLED_SOFTMAX_LOSS_LAYER_HPP_
+#define CAFFE_SAMPLED_SOFTMAX_LOSS_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/loss_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Computes the softmax loss of an inner product over very many
+ *        classes, in the TRAIN phase over the label and a sample of the
+ *        other classes only.
+ *
+ * Equivalent to an InnerProductLayer with num_output classes followed by a
+ * SoftmaxWithLossLayer, whose time and memory grow with the number of
+ * classes. In the TRAIN phase, the layer instead draws num_sampled classes
+ * (see SampledSoftmaxParameter) for each batch, and the softmax of each
+ * example covers its label and those, with the logits of class k lowered by
+ * log(num_sampled Q(k)) for the probability Q(k) of sampling it. This
+ * estimates the full softmax loss, and its gradient only touches the weights
+ * of the classes involved. In other phases, the softmax covers all classes.
+ *
+ * The weights are num_output x the input dimension, as those of an
+ * InnerProductLayer (without transpose) or an EmbedLayer over the same
+ * classes, so a param name can share them with either; an EmbedLayer has no
+ * bias per class, so share its weights with bias_term false.
+ *
+ * @param bottom input Blob vector (length 2)
+ *   -# @f$ (N \times D) @f$
+ *      the features @f$ x @f$ of each example, lumped from the axis of
+ *      sampled_softmax_param on, as in an InnerProductLayer
+ *   -# @f$ (N \times 1 \times 1 \times 1) @f$
+ *      the labels @f$ l @f$, an integer-valued Blob with values
+ *      @f$ l_n \in [0, 1, 2, ..., K - 1] @f$ among the @f$ K @f$ classes
+ * @param top output Blob vector (length 1)
+ *   -# @f$ (1 \times 1 \times 1 \times 1) @f$
+ *      the cross-entropy loss, summed over the examples whose label is not
+ *      the ignore_label of loss_param and normalized as its normalization
+ *      says, by default averaged over them
+ */
+template <typename Dtype>
+class SampledSoftmaxLossLayer : public LossLayer<Dtype> {
+ public:
+  explicit SampledSoftmaxLossLayer(const LayerParameter& param)
+      : LossLayer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual inline const char* type() const { return "SampledSoftmaxLoss"; }
+
+  /// The classes sampled for the last TRAIN batch.
+  inline const vector<int>& samples() const { return samples_; }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  /// Draws samples_ and their log expected counts.
+  void Sample();
+  /// The log of the expected count of class k among the samples.
+  Dtype LogExpectedCount(const int k) const;
+  /// Whether examples with the label are left out of the loss.
+  inline bool Ignored(const int label) const {
+    return has_ignore_label_ && label == ignore_label_;
+  }
+
+  int M_;
+  int K_;
+  int N_;
+  bool bias_term_;
+  int num_sampled_;
+  bool sampled_;
+  bool has_ignore_label_;
+  int ignore_label_;
+  /// How to normalize the output loss.
+  LossParameter_NormalizationMode normalization_;
+  /// The sampled classes, and the log of their expected counts.
+  vector<int> samples_;
+  vector<Dtype> sample_log_counts_;
+  /// The weights of the sampled classes, and the logits over them.
+  Blob<Dtype> sample_weight_;
+  Blob<Dtype> sample_logits_;
+  /// The logits of each example: over its label (first) and the samples in
+  /// the TRAIN phase, over all classes otherwise.
+  Blob<Dtype> logits_;
+  /// The log of the softmax normalizer of each example.
+  Blob<Dtype> log_sum_exp_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_SAMPLED_SOFTMAX_LOSS_LAYER_HPP_
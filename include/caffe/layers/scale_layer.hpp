@@ -37,6 +37,14 @@ class ScaleLayer: public Layer<Dtype> {
   virtual inline int MinBottomBlobs() const { return 1; }
   virtual inline int MaxBottomBlobs() const { return 2; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  /// A learned scale is elementwise, unless in place and Backward needs the
+  /// input.
+  virtual inline bool ElementwiseForward(const bool need_backward) const {
+    return this->layer_param_.bottom_size() == 1 && (!need_backward ||
+        this->layer_param_.bottom(0) != this->layer_param_.top(0));
+  }
+  virtual void ForwardElements(const Dtype* const* bottom_data,
+      Dtype* top_data, const int begin, const int end) const;
 
  protected:
   /**
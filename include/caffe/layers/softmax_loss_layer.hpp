@@ -62,6 +62,8 @@ class SoftmaxWithLossLayer : public LossLayer<Dtype> {
   virtual inline int ExactNumTopBlobs() const { return -1; }
   virtual inline int MinTopBlobs() const { return 1; }
   virtual inline int MaxTopBlobs() const { return 2; }
+  /// The optional prob top shares data with prob_.
+  virtual inline bool SharesInternalData() const { return true; }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -110,7 +112,11 @@ class SoftmaxWithLossLayer : public LossLayer<Dtype> {
   /// The internal SoftmaxLayer used to map predictions to a distribution.
   shared_ptr<Layer<Dtype> > softmax_layer_;
   /// prob stores the output probability predictions from the SoftmaxLayer.
+  /// On the CPU, it is only computed if it is output.
   Blob<Dtype> prob_;
+  /// The log of the softmax normalizer of each prediction, which the CPU
+  /// computes instead of prob_ for the loss alone.
+  Blob<Dtype> log_sum_exp_;
   /// bottom vector holder used in call to the underlying SoftmaxLayer::Forward
   vector<Blob<Dtype>*> softmax_bottom_vec_;
   /// top vector holder used in call to the underlying SoftmaxLayer::Forward
@@ -14,6 +14,11 @@ namespace caffe {
  *        by taking the max, average, etc. within regions
  *        so that the result vector of different sized
  *        images are of the same size.
+ *
+ * The CPU implementation pools all the levels of the pyramid in one pass
+ * over each channel, straight into the concatenated top, and runs Backward
+ * the same way. On the GPU the layer runs an internal split, pooling,
+ * flatten and concat net.
  */
 template <typename Dtype>
 class SPPLayer : public Layer<Dtype> {
@@ -32,13 +37,30 @@ class SPPLayer : public Layer<Dtype> {
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
+  virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
   virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   // calculates the kernel and stride dimensions for the pooling layer,
   // returns a correctly configured LayerParameter for a PoolingLayer
   virtual LayerParameter GetPoolingParam(const int pyramid_level,
       const int bottom_h, const int bottom_w, const SPPParameter spp_param);
 
+  /// @brief Whether Forward_cpu records the maxima of max pooling in max_idx_.
+  inline bool cpu_max_idx() const {
+    return this->phase_ == TRAIN && !this->inference_only();
+  }
+  /**
+   * @brief Pools channel c of an image into all levels of top_data, the
+   *        outputs of an image with the given number of channels, storing
+   *        the index of each maximum in mask (laid out alike) unless it is
+   *        NULL.
+   */
+  void pool_channel_cpu(const Dtype* bottom_data, const int channels,
+      const int c, Dtype* top_data, int* mask) const;
+
   int pyramid_height_;
   int bottom_h_, bottom_w_;
   int num_;
@@ -47,6 +69,19 @@ class SPPLayer : public Layer<Dtype> {
   int pad_h_, pad_w_;
   bool reshaped_first_time_;
 
+  /// the bins of each level along the height and width
+  vector<int> bins_h_, bins_w_;
+  /// where the bins of each level start among those of all levels
+  vector<int> level_offset_;
+  /// the bin row of each input row, level by level
+  vector<int> bin_of_h_;
+  /// the first input column of each bin column, and the width, per level
+  vector<vector<int> > bin_w_begin_;
+  /// the size of each bin for average pooling, padding included
+  vector<int> bin_size_;
+  /// the index of the maximum of each output
+  Blob<int> max_idx_;
+
   /// the internal Split layer that feeds the pooling layers
   shared_ptr<SplitLayer<Dtype> > split_layer_;
   /// top vector holder used in call to the underlying SplitLayer::Forward
@@ -0,0 +1,79 @@
+#ifndef CAFFE_WINOGRAD_CONV_LAYER_HPP_
+#define CAFFE_WINOGRAD_CONV_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/conv_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Computes 3x3, stride 1 convolutions on the CPU with Winograd's
+ *        minimal filtering algorithm F(m x m, 3 x 3) (Lavin and Gray, "Fast
+ *        Algorithms for Convolutional Neural Networks", 2015).
+ *
+ * The input is cut into overlapping (m + 2) x (m + 2) tiles. Transforming
+ * the tiles and the filters turns the convolution of a tile into an
+ * elementwise product, so that all channels and tiles of an image reduce to
+ * (m + 2)^2 independent GEMMs; the products are transformed back into
+ * m x m output tiles. This takes 2.25x (m = 2) or 4x (m = 4) fewer
+ * multiplications than direct convolution and needs no im2col. The
+ * transformed filters are cached until the weights change, and executors
+ * share them (see Net::CreateExecutor).
+ *
+ * Select it with engine: WINOGRAD and pick m with winograd_tile. Other
+ * kernel shapes, strides and dilations, GPU mode and Backward use the
+ * ConvolutionLayer implementation.
+ */
+template <typename Dtype>
+class WinogradConvolutionLayer : public ConvolutionLayer<Dtype> {
+ public:
+  explicit WinogradConvolutionLayer(const LayerParameter& param)
+      : ConvolutionLayer<Dtype>(param), use_winograd_(false),
+        transformed_weights_version_(0) {}
+  virtual ~WinogradConvolutionLayer();
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  /// Also shares the transformed filters of source.
+  virtual void ShareDerivedParams(Layer<Dtype>* source);
+  virtual void RefreshDerivedParams();
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  // Forward needs no column buffer; Backward reserves it when called.
+  virtual inline bool lowers_input() { return !use_winograd_; }
+
+  /// @brief Transforms the filters into transformed_filters_ if the weights
+  ///        changed since the last call.
+  void TransformFilters();
+  /// @brief Transforms the tiles of the channels of one image and group.
+  void TransformInput(const Dtype* input, Dtype* transformed_input);
+  /// @brief Transforms the products back into the outputs of one image and
+  ///        group.
+  void TransformOutput(const Dtype* transformed_output, Dtype* output);
+
+  /// Whether the shape allows Winograd convolution.
+  bool use_winograd_;
+  /// The output tile size m and the input tile size m + 2.
+  int tile_, alpha_;
+  /// The number of tiles along the height and width of the output.
+  int tiles_h_, tiles_w_;
+  /// The transforms B^T, G and A^T, row major.
+  vector<Dtype> input_transform_, filter_transform_, output_transform_;
+  /// The transformed filters, (m + 2)^2 x num_output x channels / group.
+  Blob<Dtype> transformed_filters_;
+  /// The weights and their version when transformed_filters_ was computed.
+  shared_ptr<SyncedMemory> transformed_weights_;
+  uint64_t transformed_weights_version_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_WINOGRAD_CONV_LAYER_HPP_
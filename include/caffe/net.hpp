@@ -11,6 +11,7 @@
 #include "caffe/common.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/mapped_file.hpp"
 
 namespace caffe {
 
@@ -29,6 +30,27 @@ class Net {
       const Net* root_net = NULL);
   virtual ~Net() {}
 
+  /**
+   * @brief Creates an executor of this net: a net with the same layers that
+   *        reads this net's params and owns only its activations.
+   *
+   * Executors let several threads serve one model: give each thread its own
+   * executor and call Forward on it, with no locking. The params are not
+   * copied, so weight memory does not grow with the number of threads, and
+   * convolution scratch memory comes from the Workspace of the calling
+   * thread. Executors are inference only, must not modify the params, and
+   * must not outlive this net, which must be a TEST net. After the params
+   * change, call RefreshDerivedParams before the executors run again.
+   */
+  shared_ptr<Net<Dtype> > CreateExecutor() const;
+  /**
+   * @brief Derives anew what the layers derive from the params, such as
+   *        quantized weights, which the executors of this net share and only
+   *        read; see Layer::RefreshDerivedParams. Must not run concurrently
+   *        with the executors.
+   */
+  void RefreshDerivedParams();
+
   /// @brief Initialize a network with a NetParameter.
   void Init(const NetParameter& param);
 
@@ -50,7 +72,9 @@ class Net {
    * networks, note that (1) computing from one layer to another might entail
    * extra computation on unrelated branches, and (2) computation starting in
    * the middle may be incorrect if all of the layers of a fan-in are not
-   * included.
+   * included. Ranges that begin or end between a layer and the activation
+   * fused into it (see NetParameter.fuse_activations) compute what the
+   * unfused layers would.
    */
   Dtype ForwardFromTo(int start, int end);
   Dtype ForwardFrom(int start);
@@ -115,10 +139,29 @@ class Net {
   void CopyTrainedLayersFrom(const string trained_filename);
   void CopyTrainedLayersFromBinaryProto(const string trained_filename);
   void CopyTrainedLayersFromHDF5(const string trained_filename);
+  /**
+   * @brief Points the params at the values stored in a file written by
+   *        ToMappedFile(), without copying them.
+   *
+   * The file is memory-mapped copy-on-write and stays mapped until the net
+   * is destroyed or every param it holds is mapped from another file, so
+   * processes loading the same file share one copy of the weights in the
+   * page cache. Params shared with another net through
+   * ShareTrainedLayersWith() must not outlive this net.
+   */
+  void CopyTrainedLayersFromMappedFile(const string trained_filename);
   /// @brief Writes the net to a proto.
   void ToProto(NetParameter* param, bool write_diff = false) const;
   /// @brief Writes the net to an HDF5 file.
   void ToHDF5(const string& filename, bool write_diff = false) const;
+  /**
+   * @brief Writes the param values of the net to a file that
+   *        CopyTrainedLayersFromMappedFile() can map.
+   *
+   * The file holds a NetParameter index with the layer names and param shapes
+   * followed by the raw values of each param, aligned for direct use.
+   */
+  void ToMappedFile(const string& filename) const;
 
   /// @brief returns the network name.
   inline const string& name() const { return name_; }
@@ -136,6 +179,8 @@ class Net {
   }
   /// @brief returns the phase: TRAIN or TEST
   inline Phase phase() const { return phase_; }
+  /// @brief returns whether the net only runs forward
+  inline bool inference_only() const { return inference_only_; }
   /**
    * @brief returns the bottom vecs for each layer -- usually you won't
    *        need this unless you do per-layer checks such as gradients.
@@ -242,6 +287,33 @@ class Net {
   void AppendParam(const NetParameter& param, const int layer_id,
                    const int param_id);
 
+  /**
+   * @brief Packs the activations that are neither net inputs nor outputs into
+   *        a few shared arenas, based on the span of layers each blob is used
+   *        by. Only done for TEST nets and nets that need no backward pass.
+   */
+  void PlanActivationMemory();
+  /// @brief Logs the memory each layer saves by being inference only.
+  void ReportInferenceSavings() const;
+  /**
+   * @brief Lets each layer take over the forward pass of the in-place
+   *        activation layer right after it; see Layer::FuseActivation.
+   */
+  void FuseActivations();
+  /**
+   * @brief Finds the runs of consecutive elementwise layers that each consume
+   *        the top of the layer before; see Layer::ElementwiseForward.
+   */
+  void FuseElementwise();
+  /// @brief Runs the forward passes of layers first to last tile by tile.
+  void ForwardElementwise(const int first, const int last);
+  /// @brief Runs the backward passes of layers last to first tile by tile.
+  void BackwardElementwise(const int first, const int last);
+  /// @brief Fails if a layer freed its params; see Layer::ParamsReleased.
+  void CheckParamsHeld() const;
+
+  /// @brief Constructs an executor of params_net; see CreateExecutor.
+  Net(const Net* params_net, const NetParameter& param);
   /// @brief Helper for displaying debug info in Forward.
   void ForwardDebugInfo(const int layer_id);
   /// @brief Helper for displaying debug info in Backward.
@@ -258,6 +330,14 @@ class Net {
   vector<string> layer_names_;
   map<string, int> layer_names_index_;
   vector<bool> layer_need_backward_;
+  /// @brief Whether the layer before runs each layer's forward pass on the CPU.
+  vector<bool> layer_fused_;
+  /// @brief For the first layer of each run of layers that run forward tile
+  /// by tile, the last one; otherwise the layer itself.
+  vector<int> forward_run_last_;
+  /// @brief For the last layer of each run of layers that run backward tile
+  /// by tile, the first one; otherwise the layer itself.
+  vector<int> backward_run_first_;
   /// @brief the blobs storing intermediate results between the layer.
   vector<shared_ptr<Blob<Dtype> > > blobs_;
   vector<string> blob_names_;
@@ -304,10 +384,26 @@ class Net {
   vector<bool> has_params_decay_;
   /// The bytes of memory used by this net
   size_t memory_used_;
+  /// Whether the net was asked to force backward for all layers.
+  bool force_backward_;
+  /// Whether activations share memory according to PlanActivationMemory.
+  bool optimize_memory_;
+  /// Whether the net was asked to fuse activations and elementwise layers.
+  bool fuse_activations_;
+  bool fuse_elementwise_;
+  /// Whether the net only runs forward; see NetParameter.inference_only.
+  bool inference_only_;
+  /// The shared memory arenas backing the planned activations.
+  vector<shared_ptr<SyncedMemory> > activation_arenas_;
+  /// The file each layer param was last mapped from, if any. A file stays
+  /// mapped until no param points into it.
+  vector<vector<shared_ptr<MappedFile> > > mapped_files_;
   /// Whether to compute and display debug info for the net.
   bool debug_info_;
   /// The root net that actually holds the shared layers in data parallelism
   const Net* const root_net_;
+  /// The net whose params an executor uses, or NULL
+  const Net* const params_net_;
   DISABLE_COPY_AND_ASSIGN(Net);
 };
 
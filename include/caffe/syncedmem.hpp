@@ -4,6 +4,7 @@
 #include <cstdlib>
 
 #include "caffe/common.hpp"
+#include "caffe/util/host_memory_pool.hpp"
 
 namespace caffe {
 
@@ -12,20 +13,39 @@ namespace caffe {
 // The improvement in performance seems negligible in the single GPU case,
 // but might be more significant for parallel training. Most importantly,
 // it improved stability for large models on many GPUs.
-inline void CaffeMallocHost(void** ptr, size_t size, bool* use_cuda) {
+// While the HostMemoryPool caches freed blocks, allocations are served by it,
+// so the size passed to CaffeFreeHost must match the one given to
+// CaffeMallocHost; otherwise they go straight to the system.
+inline void CaffeMallocHost(void** ptr, size_t size, bool* use_cuda,
+    bool* use_pool) {
 #ifndef CPU_ONLY
   if (Caffe::mode() == Caffe::GPU) {
-    CUDA_CHECK(cudaMallocHost(ptr, size));
     *use_cuda = true;
+    *use_pool = HostMemoryPool::Get(true).caching();
+    if (*use_pool) {
+      *ptr = HostMemoryPool::Get(true).Allocate(size);
+    } else {
+      CUDA_CHECK(cudaMallocHost(ptr, size));
+    }
     return;
   }
 #endif
-  *ptr = malloc(size);
   *use_cuda = false;
+  *use_pool = HostMemoryPool::Get(false).caching();
+  if (*use_pool) {
+    *ptr = HostMemoryPool::Get(false).Allocate(size);
+    return;
+  }
+  *ptr = malloc(size);
   CHECK(*ptr) << "host allocation of size " << size << " failed";
 }
 
-inline void CaffeFreeHost(void* ptr, bool use_cuda) {
+inline void CaffeFreeHost(void* ptr, size_t size, bool use_cuda,
+    bool use_pool) {
+  if (use_pool) {
+    HostMemoryPool::Get(use_cuda).Deallocate(ptr, size);
+    return;
+  }
 #ifndef CPU_ONLY
   if (use_cuda) {
     CUDA_CHECK(cudaFreeHost(ptr));
@@ -46,12 +66,14 @@ class SyncedMemory {
  public:
   SyncedMemory()
       : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(0), head_(UNINITIALIZED),
-        own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false),
-        gpu_device_(-1) {}
+        own_cpu_data_(false), cpu_malloc_use_cuda_(false),
+        cpu_malloc_use_pool_(false), own_gpu_data_(false), gpu_device_(-1),
+        version_(0) {}
   explicit SyncedMemory(size_t size)
       : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(size), head_(UNINITIALIZED),
-        own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false),
-        gpu_device_(-1) {}
+        own_cpu_data_(false), cpu_malloc_use_cuda_(false),
+        cpu_malloc_use_pool_(false), own_gpu_data_(false), gpu_device_(-1),
+        version_(0) {}
   ~SyncedMemory();
   const void* cpu_data();
   void set_cpu_data(void* data);
@@ -62,6 +84,9 @@ class SyncedMemory {
   enum SyncedHead { UNINITIALIZED, HEAD_AT_CPU, HEAD_AT_GPU, SYNCED };
   SyncedHead head() { return head_; }
   size_t size() { return size_; }
+  /// @brief Returns a counter that changes whenever the data may be written,
+  ///        e.g. to know when values derived from it must be recomputed.
+  uint64_t version() { return version_; }
 
 #ifndef CPU_ONLY
   void async_gpu_push(const cudaStream_t& stream);
@@ -76,8 +101,10 @@ class SyncedMemory {
   SyncedHead head_;
   bool own_cpu_data_;
   bool cpu_malloc_use_cuda_;
+  bool cpu_malloc_use_pool_;
   bool own_gpu_data_;
   int gpu_device_;
+  uint64_t version_;
 
   DISABLE_COPY_AND_ASSIGN(SyncedMemory);
 };  // class SyncedMemory
@@ -0,0 +1,45 @@
+#ifndef CAFFE_TEST_LAYER_VARIANT_UTIL_H_
+#define CAFFE_TEST_LAYER_VARIANT_UTIL_H_
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// Checks that a variant of a layer, such as one computing with quantized,
+// 16-bit or sparse weights, gives the outputs of the reference layer it
+// stands in for. The reference must be set up on bottom with the weights to
+// compare with, which the variant gets a copy of. The outputs may differ by
+// tolerance, taken relative to the largest output of the reference if
+// relative.
+template <typename Dtype>
+void CheckLayerVariant(Layer<Dtype>* reference, Layer<Dtype>* variant,
+    const vector<Blob<Dtype>*>& bottom, const Dtype tolerance,
+    const bool relative = false) {
+  Blob<Dtype> reference_top, variant_top;
+  vector<Blob<Dtype>*> reference_top_vec(1, &reference_top);
+  vector<Blob<Dtype>*> variant_top_vec(1, &variant_top);
+  reference->Forward(bottom, reference_top_vec);
+  variant->SetUp(bottom, variant_top_vec);
+  ASSERT_EQ(reference->blobs().size(), variant->blobs().size());
+  for (int i = 0; i < reference->blobs().size(); ++i) {
+    variant->blobs()[i]->CopyFrom(*reference->blobs()[i]);
+  }
+  variant->Forward(bottom, variant_top_vec);
+  ASSERT_EQ(reference_top.shape(), variant_top.shape());
+  const Dtype threshold = relative ? tolerance * caffe_cpu_amax(
+      reference_top.count(), reference_top.cpu_data()) : tolerance;
+  for (int i = 0; i < reference_top.count(); ++i) {
+    EXPECT_NEAR(reference_top.cpu_data()[i], variant_top.cpu_data()[i],
+        threshold);
+  }
+}
+
+}  // namespace caffe
+
+#endif  // CAFFE_TEST_LAYER_VARIANT_UTIL_H_
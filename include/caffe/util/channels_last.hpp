@@ -0,0 +1,19 @@
+#ifndef CAFFE_UTIL_CHANNELS_LAST_HPP_
+#define CAFFE_UTIL_CHANNELS_LAST_HPP_
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Copy NetParameters with the convolution and pooling layers set to the NHWC
+// layout (see NetParameter.channels_last). Layers that compute the same in
+// either layout (elementwise, and concat, scale and bias along the channels)
+// take the layout of their first input; the others stay NCHW. Layout layers
+// are added wherever a layer reads a blob in the other layout, and to convert
+// NHWC outputs back. NHWC blobs are named with the suffix "_nhwc".
+void ConvertToChannelsLast(const NetParameter& param,
+    NetParameter* param_channels_last);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_CHANNELS_LAST_HPP_
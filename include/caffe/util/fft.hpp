@@ -0,0 +1,57 @@
+#ifndef CAFFE_UTIL_FFT_HPP_
+#define CAFFE_UTIL_FFT_HPP_
+
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Radix-2 fast Fourier transforms of one power-of-two size.
+ *
+ * Complex values are split into separate real and imaginary arrays, which
+ * keeps the butterflies and the pointwise products of their users simple
+ * loops the compiler can vectorize. A transform can run over width
+ * interleaved sequences at once: element i of sequence j is at
+ * i * width + j. With width set to the row length this transforms all the
+ * columns of a row-major matrix while streaming through whole rows.
+ */
+template <typename Dtype>
+class FFT {
+ public:
+  /// @brief Prepares the transforms of size elements, a power of two.
+  explicit FFT(int size);
+
+  inline int size() const { return size_; }
+
+  /**
+   * @brief Transforms width interleaved sequences in place.
+   *
+   * The forward transform computes X[k] = sum_n x[n] exp(-2 pi i k n / size);
+   * the inverse uses exp(+2 pi i k n / size) and is not scaled by 1 / size.
+   */
+  void Transform(Dtype* real, Dtype* imag, int width, bool inverse) const;
+
+  /// @brief Returns the smallest power of two that is at least n.
+  static int RoundUp(int n);
+
+ private:
+  int size_;
+  /// The position each element moves to before the butterflies.
+  vector<int> bit_reverse_;
+  /// cos and sin of 2 pi t / size for t < size / 2.
+  vector<Dtype> cos_, sin_;
+};
+
+/**
+ * @brief Transforms a row-major height x width matrix in place, the rows
+ *        with row_fft and the columns with col_fft.
+ */
+template <typename Dtype>
+void fft_2d(const FFT<Dtype>& row_fft, const FFT<Dtype>& col_fft,
+    Dtype* real, Dtype* imag, bool inverse);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_FFT_HPP_
@@ -0,0 +1,19 @@
+#ifndef CAFFE_UTIL_FOLD_BATCH_NORM_HPP_
+#define CAFFE_UTIL_FOLD_BATCH_NORM_HPP_
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Copy NetParameters with the BatchNorm, Scale and Bias layers that follow a
+// Convolution or InnerProduct layer folded into its weights and bias, for
+// inference. A BatchNorm layer folds when it uses the stored statistics, and
+// a Scale or Bias layer when it is learned along the channels; either must be
+// the only reader of its input. The layers must carry their blobs (as in a
+// caffemodel or the output of Net::ToProto), and layers with include or
+// exclude rules are left alone. Returns the number of layers removed.
+int FoldBatchNorm(const NetParameter& param, NetParameter* param_folded);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_FOLD_BATCH_NORM_HPP_
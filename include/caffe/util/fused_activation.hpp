@@ -0,0 +1,76 @@
+#ifndef CAFFE_UTIL_FUSED_ACTIVATION_HPP_
+#define CAFFE_UTIL_FUSED_ACTIVATION_HPP_
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief The bias and the fused activation of a layer's output, applied
+ *        together in one pass (see Layer::FuseActivation).
+ *
+ * Without a fused activation, only the bias is added. A fused ReLU layer
+ * reads its outputs in Backward, so it needs nothing more; a fused PReLU
+ * layer that runs Backward also gets a copy of its inputs.
+ */
+template <typename Dtype>
+class FusedActivation {
+ public:
+  FusedActivation()
+      : fused_(false), suspended_(false), negative_slope_(0),
+        channel_shared_(false), bottom_memory_(NULL) {}
+
+  /**
+   * @brief Fuses a ReLU layer, or a PReLU layer with channels slopes (or a
+   *        shared one). Returns false for other layers.
+   */
+  bool Fuse(Layer<Dtype>* activation, const int channels,
+      const bool need_backward);
+
+  /// @brief Whether Forward applies a fused activation.
+  inline bool fused() const { return fused_ && !suspended_; }
+  /**
+   * @brief Makes Forward only add the bias, as if no activation were fused,
+   *        until resumed; see Layer::SuspendFusedActivation.
+   */
+  inline void set_suspended(const bool suspended) { suspended_ = suspended; }
+  inline bool suspended() const { return suspended_; }
+
+  /**
+   * @brief Sizes the copy of the inputs a fused PReLU layer keeps like top,
+   *        the output of the layer it is fused into. That layer's Reshape
+   *        calls this, since Forward writes the copy before the PReLU layer
+   *        itself would be reshaped.
+   */
+  void Reshape(const Blob<Dtype>& top) {
+    if (bottom_memory_) {
+      bottom_memory_->ReshapeLike(top);
+    }
+  }
+
+  /**
+   * @brief Adds bias (unless NULL) and applies the activation to the
+   *        num x channels x inner_dim values in data, which start at offset
+   *        in their blob.
+   */
+  void Forward(const int num, const int channels, const int inner_dim,
+      const Dtype* bias, Dtype* data, const int offset) const;
+
+ private:
+  bool fused_;
+  bool suspended_;
+  Dtype negative_slope_;
+  /// The slopes of a PReLU layer.
+  shared_ptr<Blob<Dtype> > slopes_;
+  bool channel_shared_;
+  /// Where a PReLU layer running Backward keeps its inputs.
+  Blob<Dtype>* bottom_memory_;
+
+  DISABLE_COPY_AND_ASSIGN(FusedActivation);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_FUSED_ACTIVATION_HPP_
@@ -0,0 +1,135 @@
+#ifndef CAFFE_UTIL_GEMM_TUNER_HPP_
+#define CAFFE_UTIL_GEMM_TUNER_HPP_
+
+#include <map>
+#include <set>
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/util/mkl_alternate.hpp"
+
+/**
+ Forward declare boost::shared_mutex instead of including boost/thread.hpp
+ to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+ */
+namespace boost { class shared_mutex; }
+
+namespace caffe {
+
+/// @brief The problem a caffe_cpu_gemm call solves, as GemmTuner keys it.
+struct GemmShape {
+  GemmShape()
+      : is_double(false), trans_a(false), trans_b(false), M(0), N(0), K(0) {}
+  bool is_double;
+  bool trans_a;
+  bool trans_b;
+  int M;
+  int N;
+  int K;
+
+  bool operator<(const GemmShape& other) const;
+  /// @brief E.g. "float NT 64x128x27" for a transposed B.
+  string ToString() const;
+};
+
+/**
+ * @brief Chooses, by measuring, which kernel computes caffe_cpu_gemm for each
+ *        shape.
+ *
+ * The best way to multiply differs with the shape: the BLAS Caffe was built
+ * with is hard to beat for the large products of fully connected layers, but
+ * its threading and blocking overheads dominate the tiny ones of grouped
+ * convolutions or recurrent steps. When enabled, caffe_cpu_gemm looks up the
+ * kernel for the shape of each call here. The first call of a shape times
+ * every candidate kernel (see Kernel) on copies of its operands, then keeps
+ * the fastest for all later calls of that shape. Other calls of the shape
+ * use BLAS while it is being tuned, and so do calls from within an OpenMP
+ * parallel region until their shape has been tuned elsewhere, since their
+ * timings would not be representative.
+ *
+ * The choices can be saved in a cache file so that later runs start tuned;
+ * the choices depend on the machine and its thread count, so the file should
+ * not be shared between them. decisions() exposes them for inspection.
+ *
+ * Tuning is off by default, which keeps every call on BLAS; results then do
+ * not depend on timings. The tuner is process-wide and thread safe: calls
+ * only share a read lock to look up their kernel, and tuning runs unlocked.
+ */
+class GemmTuner {
+ public:
+  enum Kernel {
+    /// The BLAS Caffe was built with, with its own threading.
+    BLAS = 0,
+    /// The same BLAS limited to the calling thread (MKL only, whose thread
+    /// count can be set for one thread).
+    BLAS_SERIAL = 1,
+    /// A simple kernel for small products, on the calling thread.
+    SMALL = 2,
+    /// The same kernel with the rows of C split among OpenMP threads.
+    SMALL_PARALLEL = 3
+  };
+  static const int kNumKernels = 4;
+
+  /// @brief Returns the process-wide tuner.
+  static GemmTuner& Get();
+
+  bool enabled() const { return enabled_; }
+  void set_enabled(bool enabled) { enabled_ = enabled; }
+
+  /**
+   * @brief Loads the choices saved in path, if it exists, and appends the
+   *        choices made from now on to it. An empty path stops saving.
+   */
+  void set_cache_file(const string& path);
+  const string& cache_file() const { return cache_file_; }
+
+  /// @brief The kernel chosen for each shape tuned so far.
+  std::map<GemmShape, Kernel> decisions() const;
+  /// @brief Forgets the choices made, without touching the cache file.
+  void Clear();
+
+  /**
+   * @brief Computes caffe_cpu_gemm with the kernel chosen for its shape,
+   *        tuning the shape first if it is new.
+   */
+  template <typename Dtype>
+  void Gemm(const CBLAS_TRANSPOSE TransA, const CBLAS_TRANSPOSE TransB,
+      const int M, const int N, const int K, const Dtype alpha,
+      const Dtype* A, const int lda, const Dtype* B, const int ldb,
+      const Dtype beta, Dtype* C, const int ldc);
+
+  /// @brief Computes caffe_cpu_gemm with the given kernel.
+  template <typename Dtype>
+  static void RunKernel(const Kernel kernel, const CBLAS_TRANSPOSE TransA,
+      const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+      const Dtype alpha, const Dtype* A, const int lda, const Dtype* B,
+      const int ldb, const Dtype beta, Dtype* C, const int ldc);
+
+  /// @brief Whether the kernel may be chosen for the shape in this build.
+  static bool Candidate(const Kernel kernel, const GemmShape& shape);
+  static const char* KernelName(const Kernel kernel);
+
+ private:
+  GemmTuner();
+
+  template <typename Dtype>
+  Kernel Tune(const GemmShape& shape, const CBLAS_TRANSPOSE TransA,
+      const CBLAS_TRANSPOSE TransB, const Dtype alpha, const Dtype* A,
+      const int lda, const Dtype* B, const int ldb, const Dtype beta,
+      const Dtype* C, const int ldc);
+  void LoadCacheFile();
+  void SaveDecision(const GemmShape& shape, const Kernel kernel);
+
+  bool enabled_;
+  string cache_file_;
+  std::map<GemmShape, Kernel> decisions_;
+  /// The shapes being tuned.
+  std::set<GemmShape> tuning_;
+  shared_ptr<boost::shared_mutex> mutex_;
+
+  DISABLE_COPY_AND_ASSIGN(GemmTuner);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_GEMM_TUNER_HPP_
@@ -0,0 +1,86 @@
+#ifndef CAFFE_UTIL_HALF_HPP_
+#define CAFFE_UTIL_HALF_HPP_
+
+#include <stdint.h>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/syncedmem.hpp"
+
+namespace caffe {
+
+/// @brief Converts x to IEEE 754 half precision, rounding to nearest even.
+uint16_t float_to_half(const float x);
+float half_to_float(const uint16_t x);
+/// @brief Converts x to bfloat16, rounding to nearest even.
+uint16_t float_to_bfloat16(const float x);
+float bfloat16_to_float(const uint16_t x);
+
+/**
+ * @brief Converts the n values of x to 16 bits in the given precision,
+ *        which must be FLOAT16 or BFLOAT16.
+ */
+template <typename Dtype>
+void caffe_cpu_to_half(const int n, const Dtype* x, const Precision precision,
+    uint16_t* y);
+template <typename Dtype>
+void caffe_cpu_from_half(const int n, const uint16_t* x,
+    const Precision precision, Dtype* y);
+
+/**
+ * @brief The weights of a layer stored in 16 bits, which follow the weight
+ *        blob they are computed from.
+ */
+template <typename Dtype>
+class HalfWeights {
+ public:
+  HalfWeights() : precision_(FLOAT32), source_version_(0), released_(false) {}
+
+  /**
+   * @brief Converts weights to the given precision, unless they did not
+   *        change since the last call.
+   */
+  void Update(const Blob<Dtype>& weights, const Precision precision);
+  /**
+   * @brief Frees the Dtype data of weights, which keep their shape, once
+   *        Update converted them. Until the weights are written again (e.g.
+   *        loaded), Update keeps the 16-bit weights, and the data of weights
+   *        must not be read, as it no longer holds the values.
+   */
+  void Release(Blob<Dtype>* weights);
+  /**
+   * @brief Returns whether Release freed the Dtype data of the weights and
+   *        they were not written since, so that they hold no values.
+   */
+  inline bool released() const {
+    return released_ && source_->version() == source_version_;
+  }
+
+  /// @brief Converts the count weights from offset back to Dtype into y.
+  void Unpack(const int offset, const int count, Dtype* y) const;
+
+ private:
+  vector<uint16_t> data_;
+  Precision precision_;
+  /// The weights and their version when converted.
+  shared_ptr<SyncedMemory> source_;
+  uint64_t source_version_;
+  /// Whether source_ is the empty data Release left the weights with.
+  bool released_;
+
+  DISABLE_COPY_AND_ASSIGN(HalfWeights);
+};
+
+/**
+ * @brief Stores the data of a blob in 16 bits (see BlobProto.half_data),
+ *        which halves its size, unless a value is out of the range of the
+ *        precision, such as the running sums of a BatchNorm layer often are
+ *        for FLOAT16. Returns whether it did.
+ */
+bool HalfBlobProto(const Precision precision, BlobProto* proto);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_HALF_HPP_
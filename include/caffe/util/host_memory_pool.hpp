@@ -0,0 +1,119 @@
+#ifndef CAFFE_UTIL_HOST_MEMORY_POOL_HPP_
+#define CAFFE_UTIL_HOST_MEMORY_POOL_HPP_
+
+#include <map>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+/**
+ Forward declare boost::mutex instead of including boost/thread.hpp
+ to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+ */
+namespace boost { class mutex; }
+
+namespace caffe {
+
+/// @brief Counters describing the state of a HostMemoryPool.
+struct HostMemoryPoolStats {
+  HostMemoryPoolStats()
+      : bytes_live(0), bytes_cached(0), peak_bytes_live(0), hits(0),
+        misses(0), releases(0) {}
+  /// Bytes currently handed out, rounded up to their size class.
+  size_t bytes_live;
+  /// Bytes held in the free lists, ready to be handed out again.
+  size_t bytes_cached;
+  /// High-water mark of bytes_live.
+  size_t peak_bytes_live;
+  /// Allocations served from the cache.
+  uint64_t hits;
+  /// Allocations that had to go to the system allocator.
+  uint64_t misses;
+  /// Blocks returned to the system allocator (by Trim or the cache limit).
+  uint64_t releases;
+
+  double hit_rate() const {
+    const uint64_t total = hits + misses;
+    return total ? static_cast<double>(hits) / total : 0.;
+  }
+};
+
+/**
+ * @brief A size-bucketed caching allocator for host memory.
+ *
+ * SyncedMemory draws its host buffers from here (through CaffeMallocHost)
+ * instead of calling malloc / cudaMallocHost directly. Requests are rounded
+ * up to a size class -- four classes per power of two, so at most 25% of a
+ * block is slack -- and freed blocks are kept on a per-class free list to be
+ * handed out again. This removes allocator churn and page faults when blobs
+ * are reshaped repeatedly, e.g. when serving variable-shape inputs.
+ *
+ * There is one pool for pageable memory and, in GPU builds, one for pinned
+ * memory. Both are process-wide and thread safe, since blobs may be freed on
+ * a different thread than the one that allocated them.
+ *
+ * The cache never holds more than max_cached_bytes(); a block freed while the
+ * cache is full goes straight back to the system. Trim() releases cached
+ * blocks on demand. Caching is off until set_max_cached_bytes() enables it
+ * (the caffe tool does so with -host_cache_mb), so that processes do not
+ * keep freed memory from the system unless asked to; until then,
+ * CaffeMallocHost bypasses the pool and its lock and allocates the exact size.
+ */
+class HostMemoryPool {
+ public:
+  /// @brief Returns the process-wide pool for pinned or pageable memory.
+  static HostMemoryPool& Get(bool pinned);
+
+  /// @brief Returns a block of at least size bytes. Never returns NULL.
+  void* Allocate(size_t size);
+  /// @brief Returns a block obtained from Allocate(size) to the pool.
+  void Deallocate(void* ptr, size_t size);
+
+  /**
+   * @brief Releases cached blocks to the system until at most target_bytes
+   *        remain cached. Returns the number of bytes released.
+   */
+  size_t Trim(size_t target_bytes = 0);
+
+  HostMemoryPoolStats stats() const;
+  void ResetStats();
+
+  size_t max_cached_bytes() const;
+  /**
+   * @brief Sets the cache limit, trimming if necessary. 0 disables caching.
+   *        Set it before other threads allocate host memory, as caching()
+   *        reads it without the lock.
+   */
+  void set_max_cached_bytes(size_t bytes);
+  /// @brief Returns whether max_cached_bytes() is nonzero, without locking.
+  bool caching() const { return caching_; }
+
+  bool pinned() const { return pinned_; }
+
+  /// @brief Returns the size class that a request of size bytes maps to.
+  static size_t SizeClass(size_t size);
+
+  /// @brief Trims both the pageable and pinned pools.
+  static size_t TrimAll(size_t target_bytes = 0);
+
+ private:
+  explicit HostMemoryPool(bool pinned);
+
+  void* SystemAllocate(size_t size);
+  void SystemFree(void* ptr);
+  size_t TrimLocked(size_t target_bytes);
+
+  const bool pinned_;
+  size_t max_cached_bytes_;
+  bool caching_;
+  HostMemoryPoolStats stats_;
+  // Free blocks keyed by size class.
+  std::map<size_t, std::vector<void*> > free_blocks_;
+  shared_ptr<boost::mutex> mutex_;
+
+  DISABLE_COPY_AND_ASSIGN(HostMemoryPool);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_HOST_MEMORY_POOL_HPP_
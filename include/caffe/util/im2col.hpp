@@ -1,8 +1,20 @@
 #ifndef _CAFFE_UTIL_IM2COL_HPP_
 #define _CAFFE_UTIL_IM2COL_HPP_
 
+#include <algorithm>
+
 namespace caffe {
 
+// Sets [*begin, *end) to the output positions d in [0, count) along an axis
+// whose input position offset + d * stride lies in [0, size), so that the
+// inner loops need no padding checks.
+inline void valid_output_range(const int offset, const int stride,
+    const int size, const int count, int* begin, int* end) {
+  *begin = offset >= 0 ? 0 : std::min(count, (stride - 1 - offset) / stride);
+  *end = offset < size ? std::min(count, (size - 1 - offset) / stride + 1) : 0;
+  *end = std::max(*end, *begin);
+}
+
 template <typename Dtype>
 void im2col_nd_cpu(const Dtype* data_im, const int num_spatial_axes,
     const int* im_shape, const int* col_shape,
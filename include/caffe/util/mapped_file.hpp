@@ -0,0 +1,36 @@
+#ifndef CAFFE_UTIL_MAPPED_FILE_HPP_
+#define CAFFE_UTIL_MAPPED_FILE_HPP_
+
+#include <string>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A file mapped into memory for as long as the object lives.
+ *
+ * The mapping is private and copy-on-write: pages are shared with the page
+ * cache (and with every other process mapping the same file) until they are
+ * written to, and writes never reach the file.
+ */
+class MappedFile {
+ public:
+  explicit MappedFile(const string& filename);
+  ~MappedFile();
+
+  void* data() const { return data_; }
+  size_t size() const { return size_; }
+  const string& filename() const { return filename_; }
+
+ private:
+  const string filename_;
+  void* data_;
+  size_t size_;
+
+  DISABLE_COPY_AND_ASSIGN(MappedFile);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_MAPPED_FILE_HPP_
@@ -12,6 +12,13 @@
 
 namespace caffe {
 
+// The CPU kernels that split their work among OpenMP threads only do so
+// above this many inputs; below it, starting the threads costs more than
+// they save.
+const int kParallelMinInputs = 1 << 16;
+// The same for the convolution kernels, counted in multiply-adds.
+const int kParallelMinMultiplyAdds = 1 << 16;
+
 // Caffe gemm provides a simpler interface to the gemm functions, with the
 // limitation that the data has to be contiguous in memory.
 template <typename Dtype>
@@ -20,6 +27,30 @@ void caffe_cpu_gemm(const CBLAS_TRANSPOSE TransA,
     const Dtype alpha, const Dtype* A, const Dtype* B, const Dtype beta,
     Dtype* C);
 
+// The same with explicit leading dimensions (row strides), for matrices that
+// are blocks of larger ones. Both call the BLAS Caffe was built with, or the
+// kernel GemmTuner chose for the shape when it is enabled.
+template <typename Dtype>
+void caffe_cpu_gemm(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const Dtype alpha, const Dtype* A, const int lda, const Dtype* B,
+    const int ldb, const Dtype beta, Dtype* C, const int ldc);
+
+// C = A B^T for the 8-bit integer matrices A (M x K) and B (N x K), with
+// 32-bit sums. Both operands run along K, so that the inner loop is a dot
+// product of contiguous rows.
+void caffe_cpu_gemm_s8(const int M, const int N, const int K,
+    const int8_t* A, const int8_t* B, int32_t* C);
+
+// C = A B for the sparse matrix A (M x K) in compressed sparse rows and the
+// dense matrix B (K x N): row m of A has the nonzero values
+// values[row_begin[m]] to values[row_begin[m + 1] - 1], in the columns at
+// the same positions of columns.
+template <typename Dtype>
+void caffe_cpu_csrmm(const int M, const int N, const int K,
+    const Dtype* values, const int* columns, const int* row_begin,
+    const Dtype* B, Dtype* C);
+
 template <typename Dtype>
 void caffe_cpu_gemv(const CBLAS_TRANSPOSE TransA, const int M, const int N,
     const Dtype alpha, const Dtype* A, const Dtype* x, const Dtype beta,
@@ -91,6 +122,13 @@ void caffe_exp(const int n, const Dtype* a, Dtype* y);
 template <typename Dtype>
 void caffe_log(const int n, const Dtype* a, Dtype* y);
 
+template <typename Dtype>
+void caffe_tanh(const int n, const Dtype* a, Dtype* y);
+
+// y[i] = 1 / (1 + exp(-a[i]))
+template <typename Dtype>
+void caffe_sigmoid(const int n, const Dtype* a, Dtype* y);
+
 template <typename Dtype>
 void caffe_abs(const int n, const Dtype* a, Dtype* y);
 
@@ -105,6 +143,16 @@ Dtype caffe_cpu_strided_dot(const int n, const Dtype* x, const int incx,
 template <typename Dtype>
 Dtype caffe_cpu_asum(const int n, const Dtype* x);
 
+// Returns the largest absolute value of the elements of vector x
+template <typename Dtype>
+Dtype caffe_cpu_amax(const int n, const Dtype* x);
+
+// Rounds x / scale to the nearest 8-bit integer, saturating at +/-127 so that
+// the range is symmetric.
+template <typename Dtype>
+void caffe_cpu_quantize(const int n, const Dtype scale, const Dtype* x,
+    int8_t* y);
+
 // the branchless, type-safe version from
 // http://stackoverflow.com/questions/1903954/is-there-a-standard-sign-function-signum-sgn-in-c-c
 template<typename Dtype>
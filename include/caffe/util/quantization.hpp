@@ -0,0 +1,89 @@
+#ifndef CAFFE_UTIL_QUANTIZATION_HPP_
+#define CAFFE_UTIL_QUANTIZATION_HPP_
+
+#include <stdint.h>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/syncedmem.hpp"
+
+namespace caffe {
+
+/// @brief The largest 8-bit value; quantization is symmetric around 0.
+const int kQuantizedMax = 127;
+
+/**
+ * @brief Returns the scale that maps the inputs of a quantized layer onto
+ *        8-bit integers: the calibrated input range, or else the largest
+ *        magnitude of the n inputs x, over kQuantizedMax.
+ */
+template <typename Dtype>
+Dtype QuantizationInputScale(const QuantizationParameter& param, const int n,
+    const Dtype* x);
+
+/**
+ * @brief The weights of a layer quantized to 8 bits, with one scale per
+ *        output, which follow the weight blob they are computed from.
+ */
+template <typename Dtype>
+class QuantizedWeights {
+ public:
+  QuantizedWeights() : source_version_(0), released_(false) {}
+
+  /**
+   * @brief Quantizes weights as outputs rows of inputs values each (or,
+   *        if transpose, inputs rows of outputs values), unless they did not
+   *        change since the last call. The quantized rows always run along
+   *        the inputs.
+   */
+  void Update(const Blob<Dtype>& weights, const int outputs,
+      const bool transpose);
+  /**
+   * @brief Loads the 8-bit weights of a trained layer as they are stored
+   *        (see BlobProto.int8_data) rather than quantizing them again from
+   *        weights, which need not give back the same values. The stored
+   *        scales must be those of the outputs, so transpose weights are not
+   *        loaded; returns whether they were. The values are loaded into
+   *        weights too if keep_weights, and weights keep only their shape
+   *        otherwise, as the layer then reads only the 8-bit weights.
+   */
+  bool FromProto(const BlobProto& proto, const int outputs,
+      const bool transpose, const bool keep_weights, Blob<Dtype>* weights);
+  /**
+   * @brief Returns whether FromProto left the weights without values and
+   *        they were not written since.
+   */
+  inline bool released() const {
+    return released_ && source_->version() == source_version_;
+  }
+
+  /// @brief The outputs x inputs quantized weights.
+  inline const int8_t* data() const { return &data_[0]; }
+  /// @brief The scale of each output.
+  inline const Dtype* scales() const { return &scales_[0]; }
+
+ private:
+  vector<int8_t> data_;
+  vector<Dtype> scales_;
+  /// The weights and their version when quantized.
+  shared_ptr<SyncedMemory> source_;
+  uint64_t source_version_;
+  /// Whether source_ is the empty data FromProto left the weights with.
+  bool released_;
+
+  DISABLE_COPY_AND_ASSIGN(QuantizedWeights);
+};
+
+/**
+ * @brief Stores the data of a blob as 8-bit integers with one scale per
+ *        slice along the first axis (see BlobProto.int8_data). The scales
+ *        match those of QuantizedWeights, so that the layers recover the
+ *        exact same 8-bit weights.
+ */
+void QuantizeBlobProto(BlobProto* proto);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_QUANTIZATION_HPP_
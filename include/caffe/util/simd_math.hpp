@@ -0,0 +1,41 @@
+#ifndef CAFFE_UTIL_SIMD_MATH_HPP_
+#define CAFFE_UTIL_SIMD_MATH_HPP_
+
+namespace caffe {
+
+/**
+ * @brief Vectorized single-precision transcendental functions, which
+ *        caffe_exp, caffe_log, caffe_powx, caffe_tanh and caffe_sigmoid use
+ *        for floats instead of scalar libm loops (unless Caffe uses MKL, for
+ *        exp, log and pow).
+ *
+ * They are plain C++ loops over branch-free Cephes polynomials that the
+ * compiler vectorizes. With GCC on x86-64 Linux, each is compiled for
+ * AVX-512, AVX2 and the SSE2 baseline, and the loader picks the widest one
+ * the CPU supports; elsewhere, e.g. NEON on ARM, they are vectorized for the
+ * target of the build. None of the variants contracts into FMAs, so all give
+ * the same results.
+ *
+ * The largest errors, against double-precision libm over all finite floats
+ * (see test_simd_math.cpp), are:
+ *   - exp: 1.03 ULP, gradual underflow included (also for pow and sigmoid);
+ *   - log: 0.83 ULP;
+ *   - tanh: 1.51 ULP;
+ *   - sigmoid: 2.41 ULP;
+ *   - pow: 1.93 ULP for a > 0 with the exponents tried (-11 to 7.3), as b *
+ *     log(a) is mostly carried in double precision; other bases, and b of 0,
+ *     0.5 and 1, use libm.
+ * Infinities and NaNs propagate as in libm.
+ */
+void caffe_simd_exp(const int n, const float* x, float* y);
+void caffe_simd_log(const int n, const float* x, float* y);
+void caffe_simd_powx(const int n, const float* x, const float b, float* y);
+void caffe_simd_tanh(const int n, const float* x, float* y);
+void caffe_simd_sigmoid(const int n, const float* x, float* y);
+
+/// @brief Returns the instruction set the functions above run with.
+const char* caffe_simd_isa();
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_SIMD_MATH_HPP_
@@ -0,0 +1,32 @@
+#ifndef CAFFE_UTIL_SOFTMAX_HPP_
+#define CAFFE_UTIL_SOFTMAX_HPP_
+
+namespace caffe {
+
+/**
+ * @brief The softmax of outer_num x inner_num rows of channels values each,
+ *        inner_num apart, as SoftmaxLayer and SoftmaxWithLossLayer compute it
+ *        on the CPU.
+ *
+ * Writes the probabilities to y (which may be x) unless it is NULL, and the
+ * log of each row's normalizer, log(sum(exp(x))), to log_sum_exp unless it
+ * is NULL. Without y, contiguous rows (inner_num of 1) are read once, keeping
+ * a running max and rescaling the sum when it grows; no probabilities are
+ * stored. Otherwise the max is found first, within blocks of rows small
+ * enough to stay in cache for the pass that exponentiates them.
+ */
+template <typename Dtype>
+void caffe_cpu_softmax(const int outer_num, const int channels,
+    const int inner_num, const Dtype* x, Dtype* y, Dtype* log_sum_exp);
+
+/**
+ * @brief The gradient of softmax: dx = y (dy - dot(dy, y)) for each row of y
+ *        as caffe_cpu_softmax lays them out. dx may be dy.
+ */
+template <typename Dtype>
+void caffe_cpu_softmax_backward(const int outer_num, const int channels,
+    const int inner_num, const Dtype* y, const Dtype* dy, Dtype* dx);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_SOFTMAX_HPP_
@@ -0,0 +1,66 @@
+#ifndef CAFFE_UTIL_SPARSE_HPP_
+#define CAFFE_UTIL_SPARSE_HPP_
+
+#include <stdint.h>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/syncedmem.hpp"
+
+namespace caffe {
+
+/**
+ * @brief The weights of a layer in compressed sparse rows, one row per
+ *        output, for caffe_cpu_csrmm, which follow the weight blob they are
+ *        computed from. They are only kept while sparse enough to pay off.
+ */
+template <typename Dtype>
+class SparseWeights {
+ public:
+  SparseWeights() : sparse_(false), threshold_(0), source_version_(0) {}
+
+  /**
+   * @brief Stores weights of outputs rows of inputs values each (or, if
+   *        transpose, inputs rows of outputs values) in compressed sparse
+   *        rows along the inputs if at most a threshold fraction of them is
+   *        nonzero, unless they did not change since the last call. Returns
+   *        whether they are sparse.
+   */
+  bool Update(const Blob<Dtype>& weights, const int outputs,
+      const bool transpose, const float threshold);
+
+  inline bool sparse() const { return sparse_; }
+  inline int nonzeros() const { return values_.size(); }
+  inline const Dtype* values() const {
+    return values_.empty() ? NULL : &values_[0];
+  }
+  inline const int* columns() const {
+    return columns_.empty() ? NULL : &columns_[0];
+  }
+  inline const int* row_begin() const { return &row_begin_[0]; }
+
+ private:
+  bool sparse_;
+  float threshold_;
+  vector<Dtype> values_;
+  vector<int> columns_;
+  vector<int> row_begin_;
+  /// The weights and their version when last checked.
+  shared_ptr<SyncedMemory> source_;
+  uint64_t source_version_;
+
+  DISABLE_COPY_AND_ASSIGN(SparseWeights);
+};
+
+/**
+ * @brief Stores the data of a blob as its nonzero values (see
+ *        BlobProto.sparse) if at most half of it is nonzero, which makes it
+ *        smaller. Returns whether it did.
+ */
+bool SparseBlobProto(BlobProto* proto);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_SPARSE_HPP_
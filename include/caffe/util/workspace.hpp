@@ -0,0 +1,68 @@
+#ifndef CAFFE_UTIL_WORKSPACE_HPP_
+#define CAFFE_UTIL_WORKSPACE_HPP_
+
+#include <map>
+
+#include "caffe/common.hpp"
+#include "caffe/syncedmem.hpp"
+
+/**
+ Forward declare boost::mutex instead of including boost/thread.hpp
+ to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+ */
+namespace boost { class mutex; }
+
+namespace caffe {
+
+/**
+ * @brief Scratch memory shared by all the layers running on one thread.
+ *
+ * Layers such as convolution need a large temporary buffer (the im2col column
+ * buffer) only while they compute. Since the layers of a net run one after
+ * another, a single buffer per thread, as large as the largest request,
+ * serves all of them. A client (usually a layer) calls Reserve() with the
+ * size it needs right before each use, and must not expect the contents to
+ * survive calls into other clients. A client may reserve on several threads,
+ * e.g. set up on one and run on another, and is released from all of them.
+ */
+class Workspace {
+ public:
+  /// @brief Returns the workspace of the calling thread.
+  static Workspace& Get();
+  ~Workspace();
+
+  /**
+   * @brief Records that client needs size bytes of scratch memory and returns
+   *        the shared buffer, grown to at least that size if necessary.
+   */
+  const shared_ptr<SyncedMemory>& Reserve(const void* client, size_t size);
+  /**
+   * @brief Forgets the requests of client in the workspaces of all threads,
+   *        e.g. when it is destroyed, whichever thread that happens on.
+   */
+  static void Release(const void* client);
+
+  /// @brief Returns the size of the shared buffer in bytes.
+  size_t size() const { return memory_ ? memory_->size() : 0; }
+  /// @brief Returns the bytes the clients would use with buffers of their own.
+  size_t requested_bytes() const;
+  /// @brief Returns the bytes saved by sharing the buffer.
+  size_t saved_bytes() const {
+    const size_t requested = requested_bytes();
+    return requested > size() ? requested - size() : 0;
+  }
+
+ private:
+  Workspace();
+
+  shared_ptr<SyncedMemory> memory_;
+  std::map<const void*, size_t> requests_;
+  /// Guards requests_, which Release() may change from other threads.
+  shared_ptr<boost::mutex> mutex_;
+
+  DISABLE_COPY_AND_ASSIGN(Workspace);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_WORKSPACE_HPP_
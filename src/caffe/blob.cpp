@@ -4,6 +4,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/syncedmem.hpp"
+#include "caffe/util/half.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
@@ -146,6 +147,19 @@ void Blob<Dtype>::ShareDiff(const Blob& other) {
   diff_ = other.diff();
 }
 
+template <typename Dtype>
+void Blob<Dtype>::set_data(const shared_ptr<SyncedMemory>& data) {
+  CHECK(data);
+  CHECK_GE(data->size(), count_ * sizeof(Dtype));
+  data_ = data;
+  capacity_ = data->size() / sizeof(Dtype);
+  // Keep diff_ at least as large as the new capacity; it is only allocated
+  // if it is actually used.
+  if (!diff_ || diff_->size() < capacity_ * sizeof(Dtype)) {
+    diff_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+  }
+}
+
 // The "update" method is used for parameter blobs in a Net, which are stored
 // as Blob<float> or Blob<double> -- hence we do not define it for
 // Blob<int> or Blob<unsigned int>.
@@ -469,7 +483,39 @@ void Blob<Dtype>::FromProto(const BlobProto& proto, bool reshape) {
   }
   // copy data
   Dtype* data_vec = mutable_cpu_data();
-  if (proto.double_data_size() > 0) {
+  if (proto.has_int8_data()) {
+    CHECK_EQ(count_, proto.int8_data().size());
+    CHECK_GT(proto.int8_scale_size(), 0);
+    CHECK_EQ(count_ % proto.int8_scale_size(), 0);
+    const int slice_size = count_ / proto.int8_scale_size();
+    const int8_t* int8_data =
+        reinterpret_cast<const int8_t*>(proto.int8_data().data());
+    for (int i = 0; i < count_; ++i) {
+      data_vec[i] = int8_data[i] * Dtype(proto.int8_scale(i / slice_size));
+    }
+  } else if (proto.sparse()) {
+    const bool double_data = proto.sparse_double_data_size() > 0;
+    const int nonzeros = double_data ? proto.sparse_double_data_size() :
+        proto.sparse_data_size();
+    CHECK_EQ(nonzeros, proto.sparse_gap_size());
+    caffe_memset(count_ * sizeof(Dtype), 0, data_vec);
+    int index = 0;
+    for (int i = 0; i < nonzeros; ++i) {
+      index += proto.sparse_gap(i);
+      CHECK_LT(index, count_);
+      data_vec[index] = double_data ? proto.sparse_double_data(i) :
+          proto.sparse_data(i);
+    }
+  } else if (proto.has_half_data()) {
+    CHECK_EQ(count_ * sizeof(uint16_t), proto.half_data().size());
+    const uint16_t* half_data =
+        reinterpret_cast<const uint16_t*>(proto.half_data().data());
+    const bool bfloat16 = proto.half_precision() == BFLOAT16;
+    for (int i = 0; i < count_; ++i) {
+      data_vec[i] = bfloat16 ? bfloat16_to_float(half_data[i]) :
+          half_to_float(half_data[i]);
+    }
+  } else if (proto.double_data_size() > 0) {
     CHECK_EQ(count_, proto.double_data_size());
     for (int i = 0; i < count_; ++i) {
       data_vec[i] = proto.double_data(i);
@@ -1,3 +1,4 @@
+#include <cmath>
 #include <vector>
 
 #include "caffe/layers/absval_layer.hpp"
@@ -14,23 +15,40 @@ void AbsValLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
 }
 
 template <typename Dtype>
-void AbsValLayer<Dtype>::Forward_cpu(
-    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  const int count = top[0]->count();
-  Dtype* top_data = top[0]->mutable_cpu_data();
-  caffe_abs(count, bottom[0]->cpu_data(), top_data);
+void AbsValLayer<Dtype>::ForwardElements(const Dtype* const* bottom_data,
+    Dtype* top_data, const int begin, const int end) const {
+  const Dtype* x = bottom_data[0];
+  for (int i = begin; i < end; ++i) {
+    top_data[i] = std::fabs(x[i]);
+  }
+}
+
+template <typename Dtype>
+void AbsValLayer<Dtype>::BackwardElements(const Dtype* top_data,
+    const Dtype* top_diff, const Dtype* bottom_data, Dtype* bottom_diff,
+    const int begin, const int end) const {
+  for (int i = begin; i < end; ++i) {
+    bottom_diff[i] = top_diff[i] *
+        ((Dtype(0) < bottom_data[i]) - (bottom_data[i] < Dtype(0)));
+  }
+}
+
+template <typename Dtype>
+void AbsValLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  ForwardElements(&bottom_data, top[0]->mutable_cpu_data(), 0,
+      bottom[0]->count());
 }
 
 template <typename Dtype>
 void AbsValLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
-    const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
-  const int count = top[0]->count();
-  const Dtype* top_diff = top[0]->cpu_diff();
+    const vector<bool>& propagate_down,
+    const vector<Blob<Dtype>*>& bottom) {
   if (propagate_down[0]) {
-    const Dtype* bottom_data = bottom[0]->cpu_data();
-    Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-    caffe_cpu_sign(count, bottom_data, bottom_diff);
-    caffe_mul(count, bottom_diff, top_diff, bottom_diff);
+    BackwardElements(top[0]->cpu_data(), top[0]->cpu_diff(),
+        bottom[0]->cpu_data(), bottom[0]->mutable_cpu_diff(), 0,
+        bottom[0]->count());
   }
 }
 
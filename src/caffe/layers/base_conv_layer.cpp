@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <climits>
 #include <vector>
 
 #include "caffe/filler.hpp"
@@ -8,6 +9,11 @@
 
 namespace caffe {
 
+template <typename Dtype>
+BaseConvolutionLayer<Dtype>::~BaseConvolutionLayer() {
+  Workspace::Release(this);
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -228,7 +234,8 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
   // The im2col result buffer will only hold one image at a time to avoid
   // overly large memory usage. In the special case of 1x1 convolution
-  // it goes lazily unused to save memory.
+  // it goes unused to save memory. Its memory is shared with the other layers
+  // running on the same thread (see Workspace).
   col_buffer_shape_.clear();
   col_buffer_shape_.push_back(kernel_dim_ * group_);
   for (int i = 0; i < num_spatial_axes_; ++i) {
@@ -239,6 +246,22 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     }
   }
   col_buffer_.Reshape(col_buffer_shape_);
+  // Optionally lower several images at once into a batched column buffer,
+  // along with a buffer for their outputs, as long as both fit in
+  // batch_lowering_bytes. The batched buffers follow the column buffer.
+  const size_t image_count =
+      col_buffer_.count() + conv_out_channels_ * conv_out_spatial_dim_;
+  const size_t max_batch = std::min<size_t>(
+      this->layer_param_.convolution_param().batch_lowering_bytes() /
+      (image_count * sizeof(Dtype)), INT_MAX / image_count);
+  lowering_batch_ = std::max<int>(1, std::min<size_t>(num_, max_batch));
+  col_buffer_bytes_ = is_1x1_ ? 0 : col_buffer_.count() * sizeof(Dtype);
+  if (lowering_batch_ > 1) {
+    col_buffer_bytes_ += lowering_batch_ * image_count * sizeof(Dtype);
+  }
+  if (col_buffer_bytes_ > 0 && lowers_input()) {
+    Workspace::Get().Reserve(this, col_buffer_bytes_);
+  }
   bottom_dim_ = bottom[0]->count(channel_axis_);
   top_dim_ = top[0]->count(channel_axis_);
   num_kernels_im2col_ = conv_in_channels_ * conv_out_spatial_dim_;
@@ -258,6 +281,7 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
     const Dtype* weights, Dtype* output, bool skip_im2col) {
   const Dtype* col_buff = input;
   if (!is_1x1_) {
+    attach_col_buffer();
     if (!skip_im2col) {
       conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
     }
@@ -279,12 +303,118 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_bias(Dtype* output,
       (Dtype)1., output);
 }
 
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_epilogue(Dtype* top_data,
+    const int n) {
+  if (!activation_.fused()) {
+    if (bias_term_) {
+      forward_cpu_bias(top_data + n * top_dim_, this->blobs_[1]->cpu_data());
+    }
+    return;
+  }
+  activation_.Forward(1, num_output_, out_spatial_dim_,
+      bias_term_ ? this->blobs_[1]->cpu_data() : NULL,
+      top_data + n * top_dim_, n * top_dim_);
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_quantized(const Dtype* input,
+    const QuantizedWeights<Dtype>& weights, const Dtype input_scale,
+    Dtype* output) {
+  const Dtype* col_buff = input;
+  if (!is_1x1_) {
+    attach_col_buffer();
+    conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
+    col_buff = col_buffer_.cpu_data();
+  }
+  const int outputs = conv_out_channels_ / group_;
+  const int spatial_dim = conv_out_spatial_dim_;
+  quantized_col_.resize(kernel_dim_ * group_ * spatial_dim);
+  quantized_col_group_.resize(spatial_dim * kernel_dim_);
+  quantized_sums_.resize(outputs * spatial_dim);
+  caffe_cpu_quantize(kernel_dim_ * group_ * spatial_dim, input_scale,
+      col_buff, &quantized_col_[0]);
+  for (int g = 0; g < group_; ++g) {
+    // caffe_cpu_gemm_s8 wants the columns of the group to run along
+    // kernel_dim_, like the weights.
+    const int8_t* col = &quantized_col_[col_offset_ * g];
+    for (int k = 0; k < kernel_dim_; ++k) {
+      for (int p = 0; p < spatial_dim; ++p) {
+        quantized_col_group_[p * kernel_dim_ + k] = col[k * spatial_dim + p];
+      }
+    }
+    caffe_cpu_gemm_s8(outputs, spatial_dim, kernel_dim_,
+        weights.data() + weight_offset_ * g, &quantized_col_group_[0],
+        &quantized_sums_[0]);
+    const Dtype* scales = weights.scales() + outputs * g;
+    Dtype* group_output = output + output_offset_ * g;
+    for (int o = 0; o < outputs; ++o) {
+      const Dtype scale = scales[o] * input_scale;
+      for (int p = 0; p < spatial_dim; ++p) {
+        group_output[o * spatial_dim + p] =
+            quantized_sums_[o * spatial_dim + p] * scale;
+      }
+    }
+  }
+}
+
+// The bytes of weights forward_cpu_half converts at a time, sized to stay in
+// the L2 cache for the GEMM that reads them.
+static const int kHalfPanelBytes = 1 << 18;
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_half(const Dtype* input,
+    const HalfWeights<Dtype>& weights, Dtype* output) {
+  const Dtype* col_buff = input;
+  if (!is_1x1_) {
+    attach_col_buffer();
+    conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
+    col_buff = col_buffer_.cpu_data();
+  }
+  // The weights of each group are outputs x kernel_dim_, and each panel of
+  // outputs makes the same rows of the output.
+  const int outputs = conv_out_channels_ / group_;
+  const int panel_rows = std::min(outputs, std::max(1,
+      kHalfPanelBytes / static_cast<int>(kernel_dim_ * sizeof(Dtype))));
+  half_panel_.resize(panel_rows * kernel_dim_);
+  for (int g = 0; g < group_; ++g) {
+    for (int r = 0; r < outputs; r += panel_rows) {
+      const int panel = std::min(panel_rows, outputs - r);
+      weights.Unpack(weight_offset_ * g + r * kernel_dim_,
+          panel * kernel_dim_, &half_panel_[0]);
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, panel,
+          conv_out_spatial_dim_, kernel_dim_, (Dtype)1., &half_panel_[0],
+          col_buff + col_offset_ * g, (Dtype)0.,
+          output + output_offset_ * g + r * conv_out_spatial_dim_);
+    }
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_sparse(const Dtype* input,
+    const SparseWeights<Dtype>& weights, Dtype* output) {
+  const Dtype* col_buff = input;
+  if (!is_1x1_) {
+    attach_col_buffer();
+    conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
+    col_buff = col_buffer_.cpu_data();
+  }
+  const int outputs = conv_out_channels_ / group_;
+  for (int g = 0; g < group_; ++g) {
+    caffe_cpu_csrmm(outputs, conv_out_spatial_dim_, kernel_dim_,
+        weights.values(),
+        weights.columns(), weights.row_begin() + outputs * g,
+        col_buff + col_offset_ * g, output + output_offset_ * g);
+  }
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::backward_cpu_gemm(const Dtype* output,
     const Dtype* weights, Dtype* input) {
-  Dtype* col_buff = col_buffer_.mutable_cpu_data();
-  if (is_1x1_) {
-    col_buff = input;
+  Dtype* col_buff = input;
+  if (!is_1x1_) {
+    attach_col_buffer();
+    col_buff = col_buffer_.mutable_cpu_data();
   }
   for (int g = 0; g < group_; ++g) {
     caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, kernel_dim_,
@@ -302,6 +432,7 @@ void BaseConvolutionLayer<Dtype>::weight_cpu_gemm(const Dtype* input,
     const Dtype* output, Dtype* weights) {
   const Dtype* col_buff = input;
   if (!is_1x1_) {
+    attach_col_buffer();
     conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
     col_buff = col_buffer_.cpu_data();
   }
@@ -320,6 +451,130 @@ void BaseConvolutionLayer<Dtype>::backward_cpu_bias(Dtype* bias,
       input, bias_multiplier_.cpu_data(), 1., bias);
 }
 
+// Copies rows x cols values from in to out, whose consecutive rows are
+// in_stride and out_stride values apart.
+template <typename Dtype>
+static void copy_rows(const Dtype* in, const int rows, const int cols,
+    const int in_stride, Dtype* out, const int out_stride) {
+  for (int r = 0; r < rows; ++r) {
+    caffe_copy(cols, in + r * in_stride, out + r * out_stride);
+  }
+}
+
+template <typename Dtype>
+Dtype* BaseConvolutionLayer<Dtype>::lower_cpu_batch(const Dtype* input,
+    int batch) {
+  attach_col_buffer();
+  Dtype* col_buff = col_buffer_.mutable_cpu_data();
+  Dtype* batch_col_buff = is_1x1_ ? col_buff : col_buff + col_buffer_.count();
+  const int input_dim = reverse_dimensions() ? top_dim_ : bottom_dim_;
+  const int rows = kernel_dim_ * group_;
+  for (int n = 0; n < batch; ++n) {
+    const Dtype* image_col_buff = input + n * input_dim;
+    if (!is_1x1_) {
+      conv_im2col_cpu(input + n * input_dim, col_buff);
+      image_col_buff = col_buff;
+    }
+    copy_rows(image_col_buff, rows, conv_out_spatial_dim_,
+        conv_out_spatial_dim_, batch_col_buff + n * conv_out_spatial_dim_,
+        batch * conv_out_spatial_dim_);
+  }
+  return batch_col_buff;
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_gemm_batch(const Dtype* input,
+    const Dtype* weights, Dtype* output, int batch) {
+  if (batch == 1) {
+    forward_cpu_gemm(input, weights, output);
+    return;
+  }
+  const Dtype* col_buff = lower_cpu_batch(input, batch);
+  Dtype* output_buff = col_buffer_.mutable_cpu_data() +
+      (is_1x1_ ? 0 : col_buffer_.count()) + batch * col_buffer_.count();
+  const int batch_spatial_dim = batch * conv_out_spatial_dim_;
+  for (int g = 0; g < group_; ++g) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_channels_ /
+        group_, batch_spatial_dim, kernel_dim_,
+        (Dtype)1., weights + weight_offset_ * g,
+        col_buff + col_offset_ * batch * g,
+        (Dtype)0., output_buff + output_offset_ * batch * g);
+  }
+  const int output_dim = reverse_dimensions() ? bottom_dim_ : top_dim_;
+  for (int n = 0; n < batch; ++n) {
+    copy_rows(output_buff + n * conv_out_spatial_dim_, conv_out_channels_,
+        conv_out_spatial_dim_, batch_spatial_dim, output + n * output_dim,
+        conv_out_spatial_dim_);
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::backward_cpu_gemm_batch(const Dtype* output,
+    const Dtype* weights, Dtype* input, int batch) {
+  if (batch == 1) {
+    backward_cpu_gemm(output, weights, input);
+    return;
+  }
+  attach_col_buffer();
+  Dtype* col_buff = col_buffer_.mutable_cpu_data();
+  Dtype* batch_col_buff = is_1x1_ ? col_buff : col_buff + col_buffer_.count();
+  Dtype* output_buff = batch_col_buff + batch * col_buffer_.count();
+  const int batch_spatial_dim = batch * conv_out_spatial_dim_;
+  const int output_dim = reverse_dimensions() ? bottom_dim_ : top_dim_;
+  for (int n = 0; n < batch; ++n) {
+    copy_rows(output + n * output_dim, conv_out_channels_,
+        conv_out_spatial_dim_, conv_out_spatial_dim_,
+        output_buff + n * conv_out_spatial_dim_, batch_spatial_dim);
+  }
+  for (int g = 0; g < group_; ++g) {
+    caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, kernel_dim_,
+        batch_spatial_dim, conv_out_channels_ / group_,
+        (Dtype)1., weights + weight_offset_ * g,
+        output_buff + output_offset_ * batch * g,
+        (Dtype)0., batch_col_buff + col_offset_ * batch * g);
+  }
+  const int input_dim = reverse_dimensions() ? top_dim_ : bottom_dim_;
+  const int rows = kernel_dim_ * group_;
+  for (int n = 0; n < batch; ++n) {
+    if (is_1x1_) {
+      copy_rows(batch_col_buff + n * conv_out_spatial_dim_, rows,
+          conv_out_spatial_dim_, batch_spatial_dim, input + n * input_dim,
+          conv_out_spatial_dim_);
+    } else {
+      copy_rows(batch_col_buff + n * conv_out_spatial_dim_, rows,
+          conv_out_spatial_dim_, batch_spatial_dim, col_buff,
+          conv_out_spatial_dim_);
+      conv_col2im_cpu(col_buff, input + n * input_dim);
+    }
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::weight_cpu_gemm_batch(const Dtype* input,
+    const Dtype* output, Dtype* weights, int batch) {
+  if (batch == 1) {
+    weight_cpu_gemm(input, output, weights);
+    return;
+  }
+  const Dtype* col_buff = lower_cpu_batch(input, batch);
+  Dtype* output_buff = col_buffer_.mutable_cpu_data() +
+      (is_1x1_ ? 0 : col_buffer_.count()) + batch * col_buffer_.count();
+  const int batch_spatial_dim = batch * conv_out_spatial_dim_;
+  const int output_dim = reverse_dimensions() ? bottom_dim_ : top_dim_;
+  for (int n = 0; n < batch; ++n) {
+    copy_rows(output + n * output_dim, conv_out_channels_,
+        conv_out_spatial_dim_, conv_out_spatial_dim_,
+        output_buff + n * conv_out_spatial_dim_, batch_spatial_dim);
+  }
+  for (int g = 0; g < group_; ++g) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, conv_out_channels_ / group_,
+        kernel_dim_, batch_spatial_dim,
+        (Dtype)1., output_buff + output_offset_ * batch * g,
+        col_buff + col_offset_ * batch * g,
+        (Dtype)1., weights + weight_offset_ * g);
+  }
+}
+
 #ifndef CPU_ONLY
 
 template <typename Dtype>
@@ -327,6 +582,7 @@ void BaseConvolutionLayer<Dtype>::forward_gpu_gemm(const Dtype* input,
     const Dtype* weights, Dtype* output, bool skip_im2col) {
   const Dtype* col_buff = input;
   if (!is_1x1_) {
+    attach_col_buffer();
     if (!skip_im2col) {
       conv_im2col_gpu(input, col_buffer_.mutable_gpu_data());
     }
@@ -351,9 +607,10 @@ void BaseConvolutionLayer<Dtype>::forward_gpu_bias(Dtype* output,
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::backward_gpu_gemm(const Dtype* output,
     const Dtype* weights, Dtype* input) {
-  Dtype* col_buff = col_buffer_.mutable_gpu_data();
-  if (is_1x1_) {
-    col_buff = input;
+  Dtype* col_buff = input;
+  if (!is_1x1_) {
+    attach_col_buffer();
+    col_buff = col_buffer_.mutable_gpu_data();
   }
   for (int g = 0; g < group_; ++g) {
     caffe_gpu_gemm<Dtype>(CblasTrans, CblasNoTrans, kernel_dim_,
@@ -371,6 +628,7 @@ void BaseConvolutionLayer<Dtype>::weight_gpu_gemm(const Dtype* input,
     const Dtype* output, Dtype* weights) {
   const Dtype* col_buff = input;
   if (!is_1x1_) {
+    attach_col_buffer();
     conv_im2col_gpu(input, col_buffer_.mutable_gpu_data());
     col_buff = col_buffer_.gpu_data();
   }
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <vector>
 
 #include "caffe/filler.hpp"
@@ -78,6 +79,14 @@ void BiasLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const Dtype* bottom_data = bottom[0]->cpu_data();
     caffe_copy(bottom[0]->count(), bottom_data, top_data);
   }
+  if (inner_dim_ == 1) {
+    // The biased axis is the last one, e.g. the channels of NHWC blobs.
+    for (int n = 0; n < outer_dim_; ++n) {
+      caffe_axpy(bias_dim_, Dtype(1), bias_data, top_data);
+      top_data += dim_;
+    }
+    return;
+  }
   for (int n = 0; n < outer_dim_; ++n) {
     caffe_cpu_gemm(CblasNoTrans, CblasNoTrans, bias_dim_,
         inner_dim_, 1, Dtype(1), bias_data,
@@ -86,6 +95,25 @@ void BiasLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+void BiasLayer<Dtype>::ForwardElements(const Dtype* const* bottom_data,
+    Dtype* top_data, const int begin, const int end) const {
+  const Dtype* x = bottom_data[0];
+  const Dtype* bias_data = this->blobs_[0]->cpu_data();
+  // Each run of inner_dim_ values shares a bias.
+  for (int run = begin / inner_dim_; run * inner_dim_ < end; ++run) {
+    const int run_begin = std::max(begin, run * inner_dim_);
+    const int run_end = std::min(end, (run + 1) * inner_dim_);
+    const Dtype bias = bias_data[run % bias_dim_];
+#ifdef _OPENMP
+    #pragma omp simd
+#endif
+    for (int i = run_begin; i < run_end; ++i) {
+      top_data[i] = x[i] + bias;
+    }
+  }
+}
+
 template <typename Dtype>
 void BiasLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
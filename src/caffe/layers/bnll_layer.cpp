@@ -7,17 +7,34 @@ namespace caffe {
 
 const float kBNLL_THRESHOLD = 50.;
 
+template <typename Dtype>
+void BNLLLayer<Dtype>::ForwardElements(const Dtype* const* bottom_data,
+    Dtype* top_data, const int begin, const int end) const {
+  const Dtype* x = bottom_data[0];
+  for (int i = begin; i < end; ++i) {
+    top_data[i] = x[i] > 0 ?
+        x[i] + log(1. + exp(-x[i])) :
+        log(1. + exp(x[i]));
+  }
+}
+
+template <typename Dtype>
+void BNLLLayer<Dtype>::BackwardElements(const Dtype* top_data,
+    const Dtype* top_diff, const Dtype* bottom_data, Dtype* bottom_diff,
+    const int begin, const int end) const {
+  Dtype expval;
+  for (int i = begin; i < end; ++i) {
+    expval = exp(std::min(bottom_data[i], Dtype(kBNLL_THRESHOLD)));
+    bottom_diff[i] = top_diff[i] * expval / (expval + 1.);
+  }
+}
+
 template <typename Dtype>
 void BNLLLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
-  Dtype* top_data = top[0]->mutable_cpu_data();
-  const int count = bottom[0]->count();
-  for (int i = 0; i < count; ++i) {
-    top_data[i] = bottom_data[i] > 0 ?
-        bottom_data[i] + log(1. + exp(-bottom_data[i])) :
-        log(1. + exp(bottom_data[i]));
-  }
+  ForwardElements(&bottom_data, top[0]->mutable_cpu_data(), 0,
+      bottom[0]->count());
 }
 
 template <typename Dtype>
@@ -25,15 +42,9 @@ void BNLLLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
   if (propagate_down[0]) {
-    const Dtype* bottom_data = bottom[0]->cpu_data();
-    const Dtype* top_diff = top[0]->cpu_diff();
-    Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-    const int count = bottom[0]->count();
-    Dtype expval;
-    for (int i = 0; i < count; ++i) {
-      expval = exp(std::min(bottom_data[i], Dtype(kBNLL_THRESHOLD)));
-      bottom_diff[i] = top_diff[i] * expval / (expval + 1.);
-    }
+    BackwardElements(top[0]->cpu_data(), top[0]->cpu_diff(),
+        bottom[0]->cpu_data(), bottom[0]->mutable_cpu_diff(), 0,
+        bottom[0]->count());
   }
 }
 
@@ -1,6 +1,8 @@
+#include <algorithm>
 #include <vector>
 
 #include "caffe/layers/conv_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
@@ -21,19 +23,502 @@ void ConvolutionLayer<Dtype>::compute_output_shape() {
   }
 }
 
+// Groups with at most this many input channels are convolved directly.
+static const int kMaxDirectGroupChannels = 8;
+
+template <typename Dtype>
+bool ConvolutionLayer<Dtype>::use_direct() {
+  return this->num_spatial_axes_ == 2 && this->group_ > 1 &&
+      this->channels_ / this->group_ <= kMaxDirectGroupChannels;
+}
+
+// The geometry of a 2D convolution, with the ranges of the output rows and
+// columns that read inside the input for each offset of the kernel. These
+// let the inner loops run over contiguous output rows without any padding
+// checks.
+struct DirectConvolution {
+  DirectConvolution(const int input_h, const int input_w,
+      const int output_h, const int output_w, const int* kernel_shape,
+      const int* pad, const int* stride, const int* dilation)
+      : height(input_h), width(input_w), height_out(output_h),
+        width_out(output_w), kernel_h(kernel_shape[0]),
+        kernel_w(kernel_shape[1]), stride_h(stride[0]), stride_w(stride[1]),
+        offset_h(kernel_h), offset_w(kernel_w), h_begin(kernel_h),
+        h_end(kernel_h), w_begin(kernel_w), w_end(kernel_w) {
+    for (int i = 0; i < kernel_h; ++i) {
+      offset_h[i] = i * dilation[0] - pad[0];
+      valid_output_range(offset_h[i], stride_h, height, height_out,
+          &h_begin[i], &h_end[i]);
+    }
+    for (int j = 0; j < kernel_w; ++j) {
+      offset_w[j] = j * dilation[1] - pad[1];
+      valid_output_range(offset_w[j], stride_w, width, width_out,
+          &w_begin[j], &w_end[j]);
+    }
+  }
+  // The index of the input read by output (h, 0) at kernel offset (i, j).
+  inline int input_index(const int i, const int j, const int h) const {
+    return (offset_h[i] + h * stride_h) * width + offset_w[j];
+  }
+
+  const int height, width, height_out, width_out;
+  const int kernel_h, kernel_w, stride_h, stride_w;
+  vector<int> offset_h, offset_w, h_begin, h_end, w_begin, w_end;
+};
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::forward_cpu_direct(const Dtype* input,
+    const Dtype* weights, Dtype* output) {
+  const DirectConvolution conv(this->input_shape(1), this->input_shape(2),
+      this->output_shape_[0], this->output_shape_[1],
+      this->kernel_shape_.cpu_data(), this->pad_.cpu_data(),
+      this->stride_.cpu_data(), this->dilation_.cpu_data());
+  const int channels_per_group = this->channels_ / this->group_;
+  const int outputs_per_group = this->num_output_ / this->group_;
+  const int input_size = conv.height * conv.width;
+  const int output_size = conv.height_out * conv.width_out;
+  const int kernel_size = conv.kernel_h * conv.kernel_w;
+  // Every output channel is computed independently.
+#ifdef _OPENMP
+  #pragma omp parallel for if (static_cast<int64_t>(this->num_output_) * \
+      output_size * channels_per_group * kernel_size >= \
+      kParallelMinMultiplyAdds)
+#endif
+  for (int o = 0; o < this->num_output_; ++o) {
+    const int g = o / outputs_per_group;
+    Dtype* output_channel = output + o * output_size;
+    std::fill(output_channel, output_channel + output_size, Dtype(0));
+    for (int c = 0; c < channels_per_group; ++c) {
+      const Dtype* input_channel =
+          input + (g * channels_per_group + c) * input_size;
+      const Dtype* weight =
+          weights + (o * channels_per_group + c) * kernel_size;
+      for (int i = 0; i < conv.kernel_h; ++i) {
+        for (int j = 0; j < conv.kernel_w; ++j) {
+          const Dtype w = weight[i * conv.kernel_w + j];
+          for (int h = conv.h_begin[i]; h < conv.h_end[i]; ++h) {
+            const int index = conv.input_index(i, j, h);
+            Dtype* output_row = output_channel + h * conv.width_out;
+            for (int x = conv.w_begin[j]; x < conv.w_end[j]; ++x) {
+              output_row[x] += w * input_channel[index + x * conv.stride_w];
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::backward_cpu_direct(const Dtype* output,
+    const Dtype* weights, Dtype* input) {
+  const DirectConvolution conv(this->input_shape(1), this->input_shape(2),
+      this->output_shape_[0], this->output_shape_[1],
+      this->kernel_shape_.cpu_data(), this->pad_.cpu_data(),
+      this->stride_.cpu_data(), this->dilation_.cpu_data());
+  const int channels_per_group = this->channels_ / this->group_;
+  const int outputs_per_group = this->num_output_ / this->group_;
+  const int input_size = conv.height * conv.width;
+  const int output_size = conv.height_out * conv.width_out;
+  const int kernel_size = conv.kernel_h * conv.kernel_w;
+  // Every input channel accumulates its gradient independently.
+#ifdef _OPENMP
+  #pragma omp parallel for if (static_cast<int64_t>(this->num_output_) * \
+      output_size * channels_per_group * kernel_size >= \
+      kParallelMinMultiplyAdds)
+#endif
+  for (int c = 0; c < this->channels_; ++c) {
+    const int g = c / channels_per_group;
+    Dtype* input_channel = input + c * input_size;
+    std::fill(input_channel, input_channel + input_size, Dtype(0));
+    for (int k = 0; k < outputs_per_group; ++k) {
+      const int o = g * outputs_per_group + k;
+      const Dtype* output_channel = output + o * output_size;
+      const Dtype* weight = weights +
+          (o * channels_per_group + c % channels_per_group) * kernel_size;
+      for (int i = 0; i < conv.kernel_h; ++i) {
+        for (int j = 0; j < conv.kernel_w; ++j) {
+          const Dtype w = weight[i * conv.kernel_w + j];
+          for (int h = conv.h_begin[i]; h < conv.h_end[i]; ++h) {
+            const int index = conv.input_index(i, j, h);
+            const Dtype* output_row = output_channel + h * conv.width_out;
+            for (int x = conv.w_begin[j]; x < conv.w_end[j]; ++x) {
+              input_channel[index + x * conv.stride_w] += w * output_row[x];
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::weight_cpu_direct(const Dtype* input,
+    const Dtype* output, Dtype* weights) {
+  const DirectConvolution conv(this->input_shape(1), this->input_shape(2),
+      this->output_shape_[0], this->output_shape_[1],
+      this->kernel_shape_.cpu_data(), this->pad_.cpu_data(),
+      this->stride_.cpu_data(), this->dilation_.cpu_data());
+  const int channels_per_group = this->channels_ / this->group_;
+  const int outputs_per_group = this->num_output_ / this->group_;
+  const int input_size = conv.height * conv.width;
+  const int output_size = conv.height_out * conv.width_out;
+  const int kernel_size = conv.kernel_h * conv.kernel_w;
+  // Every filter accumulates its gradient independently.
+#ifdef _OPENMP
+  #pragma omp parallel for if (static_cast<int64_t>(this->num_output_) * \
+      output_size * channels_per_group * kernel_size >= \
+      kParallelMinMultiplyAdds)
+#endif
+  for (int o = 0; o < this->num_output_; ++o) {
+    const int g = o / outputs_per_group;
+    const Dtype* output_channel = output + o * output_size;
+    for (int c = 0; c < channels_per_group; ++c) {
+      const Dtype* input_channel =
+          input + (g * channels_per_group + c) * input_size;
+      Dtype* weight = weights + (o * channels_per_group + c) * kernel_size;
+      for (int i = 0; i < conv.kernel_h; ++i) {
+        for (int j = 0; j < conv.kernel_w; ++j) {
+          Dtype sum = 0;
+          for (int h = conv.h_begin[i]; h < conv.h_end[i]; ++h) {
+            const int index = conv.input_index(i, j, h);
+            const Dtype* output_row = output_channel + h * conv.width_out;
+            for (int x = conv.w_begin[j]; x < conv.w_end[j]; ++x) {
+              sum += output_row[x] * input_channel[index + x * conv.stride_w];
+            }
+          }
+          weight[i * conv.kernel_w + j] += sum;
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::ReshapeLogical(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  CHECK_EQ(4, bottom[0]->num_axes()) << "Channels-last convolution takes "
+      << "(num, height, width, channels) inputs.";
+  CHECK_EQ(1, bottom[0]->CanonicalAxisIndex(
+      this->layer_param_.convolution_param().axis()))
+      << "Channels-last convolution needs the default axis.";
+  for (int i = 1; i < bottom.size(); ++i) {
+    CHECK(bottom[0]->shape() == bottom[i]->shape())
+        << "All inputs must have the same shape.";
+  }
+  logical_bottom_.Reshape(bottom[0]->shape(0), bottom[0]->shape(3),
+      bottom[0]->shape(1), bottom[0]->shape(2));
+  logical_bottom_vec_.assign(bottom.size(), &logical_bottom_);
+  logical_top_vec_.assign(top.size(), &logical_top_);
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  CHECK(!quantized() || !channels_last())
+      << "Quantized convolutions must be NCHW.";
+  CHECK(!half() || !channels_last())
+      << "Convolutions with 16-bit weights must be NCHW.";
+  if (!channels_last()) {
+    BaseConvolutionLayer<Dtype>::LayerSetUp(bottom, top);
+    return;
+  }
+  ReshapeLogical(bottom, top);
+  BaseConvolutionLayer<Dtype>::LayerSetUp(logical_bottom_vec_,
+      logical_top_vec_);
+  vector<int> weight_shape(5);
+  weight_shape[0] = this->kernel_shape_.cpu_data()[0];
+  weight_shape[1] = this->kernel_shape_.cpu_data()[1];
+  weight_shape[2] = this->group_;
+  weight_shape[3] = this->channels_ / this->group_;
+  weight_shape[4] = this->num_output_ / this->group_;
+  channels_last_weights_.Reshape(weight_shape);
+  arranged_weights_.reset();
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  if (!channels_last()) {
+    BaseConvolutionLayer<Dtype>::Reshape(bottom, top);
+  } else {
+    ReshapeLogical(bottom, top);
+    BaseConvolutionLayer<Dtype>::Reshape(logical_bottom_vec_,
+        logical_top_vec_);
+    for (int i = 0; i < top.size(); ++i) {
+      top[i]->Reshape(this->num_, this->output_shape_[0],
+          this->output_shape_[1], this->num_output_);
+    }
+  }
+  this->activation_.Reshape(*top[0]);
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::ArrangeChannelsLastWeights() {
+  const shared_ptr<SyncedMemory>& weights = this->blobs_[0]->data();
+  if (weights == arranged_weights_ &&
+      weights->version() == arranged_weights_version_) {
+    return;
+  }
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  Dtype* arranged = channels_last_weights_.mutable_cpu_data();
+  const int kernel_h = this->kernel_shape_.cpu_data()[0];
+  const int kernel_w = this->kernel_shape_.cpu_data()[1];
+  const int channels_per_group = this->channels_ / this->group_;
+  const int outputs_per_group = this->num_output_ / this->group_;
+  for (int o = 0; o < this->num_output_; ++o) {
+    const int g = o / outputs_per_group;
+    const int k = o % outputs_per_group;
+    for (int c = 0; c < channels_per_group; ++c) {
+      for (int i = 0; i < kernel_h; ++i) {
+        for (int j = 0; j < kernel_w; ++j) {
+          arranged[(((i * kernel_w + j) * this->group_ + g) *
+              channels_per_group + c) * outputs_per_group + k] =
+              weight[((o * channels_per_group + c) * kernel_h + i) *
+                  kernel_w + j];
+        }
+      }
+    }
+  }
+  arranged_weights_ = weights;
+  arranged_weights_version_ = weights->version();
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::forward_cpu_channels_last(const Dtype* input,
+    Dtype* output) {
+  const DirectConvolution conv(this->input_shape(1), this->input_shape(2),
+      this->output_shape_[0], this->output_shape_[1],
+      this->kernel_shape_.cpu_data(), this->pad_.cpu_data(),
+      this->stride_.cpu_data(), this->dilation_.cpu_data());
+  const int channels = this->channels_;
+  const int num_output = this->num_output_;
+  const int channels_per_group = channels / this->group_;
+  const int outputs_per_group = num_output / this->group_;
+  const int input_size = conv.height * conv.width;
+  const int output_size = conv.height_out * conv.width_out;
+  const Dtype* weights = channels_last_weights_.cpu_data();
+  if (conv.kernel_h == 1 && conv.kernel_w == 1 && conv.stride_h == 1 &&
+      conv.stride_w == 1 && conv.offset_h[0] == 0 && conv.offset_w[0] == 0) {
+    // The outputs of all the pixels of the batch are one product per group.
+    for (int g = 0; g < this->group_; ++g) {
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans,
+          this->num_ * input_size, outputs_per_group, channels_per_group,
+          (Dtype)1., input + g * channels_per_group, channels,
+          weights + g * channels_per_group * outputs_per_group,
+          outputs_per_group, (Dtype)0., output + g * outputs_per_group,
+          num_output);
+    }
+  } else if (channels_per_group == 1) {
+    // Depthwise: each kernel offset scales the pixels channel by channel.
+    caffe_set(this->num_ * output_size * num_output, Dtype(0), output);
+    for (int n = 0; n < this->num_; ++n) {
+      const Dtype* image = input + n * input_size * channels;
+      Dtype* image_out = output + n * output_size * num_output;
+#ifdef _OPENMP
+      #pragma omp parallel for if (static_cast<int64_t>(output_size) * \
+          num_output * conv.kernel_h * conv.kernel_w >= \
+          kParallelMinMultiplyAdds)
+#endif
+      for (int h = 0; h < conv.height_out; ++h) {
+        for (int i = 0; i < conv.kernel_h; ++i) {
+          if (h < conv.h_begin[i] || h >= conv.h_end[i]) {
+            continue;
+          }
+          for (int j = 0; j < conv.kernel_w; ++j) {
+            const Dtype* w = weights + (i * conv.kernel_w + j) * num_output;
+            for (int x = conv.w_begin[j]; x < conv.w_end[j]; ++x) {
+              const Dtype* in = image + (conv.input_index(i, j, h) +
+                  x * conv.stride_w) * channels;
+              Dtype* out = image_out + (h * conv.width_out + x) * num_output;
+              if (outputs_per_group == 1) {
+                for (int c = 0; c < channels; ++c) {
+                  out[c] += in[c] * w[c];
+                }
+              } else {
+                for (int c = 0; c < channels; ++c) {
+                  for (int k = 0; k < outputs_per_group; ++k) {
+                    out[c * outputs_per_group + k] +=
+                        in[c] * w[c * outputs_per_group + k];
+                  }
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  } else {
+    // Implicit GEMM: the pixels an output row reads at one kernel offset are
+    // rows of the input, stride_w * channels apart.
+    caffe_set(this->num_ * output_size * num_output, Dtype(0), output);
+    for (int n = 0; n < this->num_; ++n) {
+      const Dtype* image = input + n * input_size * channels;
+      Dtype* image_out = output + n * output_size * num_output;
+      for (int i = 0; i < conv.kernel_h; ++i) {
+        for (int j = 0; j < conv.kernel_w; ++j) {
+          const int width = conv.w_end[j] - conv.w_begin[j];
+          if (width <= 0) {
+            continue;
+          }
+          for (int h = conv.h_begin[i]; h < conv.h_end[i]; ++h) {
+            const Dtype* in = image + (conv.input_index(i, j, h) +
+                conv.w_begin[j] * conv.stride_w) * channels;
+            Dtype* out = image_out +
+                (h * conv.width_out + conv.w_begin[j]) * num_output;
+            for (int g = 0; g < this->group_; ++g) {
+              caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, width,
+                  outputs_per_group, channels_per_group, (Dtype)1.,
+                  in + g * channels_per_group, conv.stride_w * channels,
+                  weights + ((i * conv.kernel_w + j) * this->group_ + g) *
+                      channels_per_group * outputs_per_group,
+                  outputs_per_group, (Dtype)1., out + g * outputs_per_group,
+                  num_output);
+            }
+          }
+        }
+      }
+    }
+  }
+  this->activation_.Forward(this->num_ * output_size, num_output, 1,
+      this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL, output, 0);
+}
+
+template <typename Dtype>
+bool ConvolutionLayer<Dtype>::FuseActivation(Layer<Dtype>* activation,
+    const bool need_backward) {
+  return this->activation_.Fuse(activation, this->num_output_,
+      need_backward);
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::SuspendFusedActivation(const bool suspend) {
+  this->activation_.set_suspended(suspend);
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::ParamFromProto(const int i,
+    const BlobProto& proto) {
+  // Inference-only nets on the CPU never read the Dtype weights of quantized
+  // layers, so they skip them.
+  const bool keep_weights =
+      !this->inference_only() || Caffe::mode() != Caffe::CPU;
+  if (i != 0 || !quantized() || !quantized_weights_->FromProto(proto,
+      this->num_output_, false, keep_weights, this->blobs_[0].get())) {
+    Layer<Dtype>::ParamFromProto(i, proto);
+  }
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::ShareDerivedParams(Layer<Dtype>* source) {
+  ConvolutionLayer<Dtype>* layer =
+      dynamic_cast<ConvolutionLayer<Dtype>*>(source);
+  CHECK(layer) << "Cannot share the params of a " << source->type()
+      << " layer.";
+  // Derive what Forward_cpu will use.
+  layer->RefreshDerivedParams();
+  if (channels_last()) {
+    channels_last_weights_.ShareData(layer->channels_last_weights_);
+    arranged_weights_ = layer->arranged_weights_;
+    arranged_weights_version_ = layer->arranged_weights_version_;
+  }
+  quantized_weights_ = layer->quantized_weights_;
+  half_weights_ = layer->half_weights_;
+  sparse_weights_ = layer->sparse_weights_;
+  shares_derived_params_ = true;
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::RefreshDerivedParams() {
+  if (quantized()) {
+    quantized_weights_->Update(*this->blobs_[0], this->num_output_, false);
+  } else if (half()) {
+    half_weights_->Update(*this->blobs_[0],
+        this->layer_param_.convolution_param().weight_precision());
+    // Only the 16-bit weights are read from now on.
+    if (this->inference_only() && Caffe::mode() == Caffe::CPU) {
+      half_weights_->Release(this->blobs_[0].get());
+    }
+  } else if (channels_last()) {
+    ArrangeChannelsLastWeights();
+  } else if (!use_direct()) {
+    // Direct convolutions are small enough already.
+    sparse_weights_->Update(*this->blobs_[0], this->num_output_, false,
+        this->layer_param_.convolution_param().sparse_threshold());
+  }
+}
+
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+  if (!shares_derived_params_) {
+    RefreshDerivedParams();
+  }
+  if (quantized()) {
+    for (int i = 0; i < bottom.size(); ++i) {
+      const Dtype* bottom_data = bottom[i]->cpu_data();
+      Dtype* top_data = top[i]->mutable_cpu_data();
+      const Dtype input_scale = QuantizationInputScale(
+          this->layer_param_.quantization_param(), bottom[i]->count(),
+          bottom_data);
+      for (int n = 0; n < this->num_; ++n) {
+        this->forward_cpu_quantized(bottom_data + n * this->bottom_dim_,
+            *quantized_weights_, input_scale,
+            top_data + n * this->top_dim_);
+        this->forward_cpu_epilogue(top_data, n);
+      }
+    }
+    return;
+  }
+  if (half()) {
+    for (int i = 0; i < bottom.size(); ++i) {
+      const Dtype* bottom_data = bottom[i]->cpu_data();
+      Dtype* top_data = top[i]->mutable_cpu_data();
+      for (int n = 0; n < this->num_; ++n) {
+        this->forward_cpu_half(bottom_data + n * this->bottom_dim_,
+            *half_weights_, top_data + n * this->top_dim_);
+        this->forward_cpu_epilogue(top_data, n);
+      }
+    }
+    return;
+  }
+  if (channels_last()) {
+    for (int i = 0; i < bottom.size(); ++i) {
+      forward_cpu_channels_last(bottom[i]->cpu_data(),
+          top[i]->mutable_cpu_data());
+    }
+    return;
+  }
+  if (!use_direct() && sparse_weights_->sparse()) {
+    for (int i = 0; i < bottom.size(); ++i) {
+      const Dtype* bottom_data = bottom[i]->cpu_data();
+      Dtype* top_data = top[i]->mutable_cpu_data();
+      for (int n = 0; n < this->num_; ++n) {
+        this->forward_cpu_sparse(bottom_data + n * this->bottom_dim_,
+            *sparse_weights_, top_data + n * this->top_dim_);
+        this->forward_cpu_epilogue(top_data, n);
+      }
+    }
+    return;
+  }
   const Dtype* weight = this->blobs_[0]->cpu_data();
   for (int i = 0; i < bottom.size(); ++i) {
     const Dtype* bottom_data = bottom[i]->cpu_data();
     Dtype* top_data = top[i]->mutable_cpu_data();
-    for (int n = 0; n < this->num_; ++n) {
-      this->forward_cpu_gemm(bottom_data + n * this->bottom_dim_, weight,
-          top_data + n * this->top_dim_);
-      if (this->bias_term_) {
-        const Dtype* bias = this->blobs_[1]->cpu_data();
-        this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
+    if (use_direct()) {
+      for (int n = 0; n < this->num_; ++n) {
+        forward_cpu_direct(bottom_data + n * this->bottom_dim_, weight,
+            top_data + n * this->top_dim_);
+        this->forward_cpu_epilogue(top_data, n);
+      }
+    } else {
+      for (int n = 0; n < this->num_; n += this->lowering_batch_) {
+        const int batch = std::min(this->lowering_batch_, this->num_ - n);
+        this->forward_cpu_gemm_batch(bottom_data + n * this->bottom_dim_,
+            weight, top_data + n * this->top_dim_, batch);
+        for (int b = n; b < n + batch; ++b) {
+          this->forward_cpu_epilogue(top_data, b);
+        }
       }
     }
   }
@@ -42,6 +527,8 @@ void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  CHECK(!channels_last()) << "Channels-last convolutions only run forward.";
+  CHECK(!quantized()) << "Quantized convolutions only run forward.";
   const Dtype* weight = this->blobs_[0]->cpu_data();
   Dtype* weight_diff = this->blobs_[0]->mutable_cpu_diff();
   for (int i = 0; i < top.size(); ++i) {
@@ -55,19 +542,31 @@ void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
         this->backward_cpu_bias(bias_diff, top_diff + n * this->top_dim_);
       }
     }
-    if (this->param_propagate_down_[0] || propagate_down[i]) {
+    if (use_direct()) {
       for (int n = 0; n < this->num_; ++n) {
-        // gradient w.r.t. weight. Note that we will accumulate diffs.
         if (this->param_propagate_down_[0]) {
-          this->weight_cpu_gemm(bottom_data + n * this->bottom_dim_,
+          weight_cpu_direct(bottom_data + n * this->bottom_dim_,
               top_diff + n * this->top_dim_, weight_diff);
         }
-        // gradient w.r.t. bottom data, if necessary.
         if (propagate_down[i]) {
-          this->backward_cpu_gemm(top_diff + n * this->top_dim_, weight,
+          backward_cpu_direct(top_diff + n * this->top_dim_, weight,
               bottom_diff + n * this->bottom_dim_);
         }
       }
+    } else if (this->param_propagate_down_[0] || propagate_down[i]) {
+      for (int n = 0; n < this->num_; n += this->lowering_batch_) {
+        const int batch = std::min(this->lowering_batch_, this->num_ - n);
+        // gradient w.r.t. weight. Note that we will accumulate diffs.
+        if (this->param_propagate_down_[0]) {
+          this->weight_cpu_gemm_batch(bottom_data + n * this->bottom_dim_,
+              top_diff + n * this->top_dim_, weight_diff, batch);
+        }
+        // gradient w.r.t. bottom data, if necessary.
+        if (propagate_down[i]) {
+          this->backward_cpu_gemm_batch(top_diff + n * this->top_dim_, weight,
+              bottom_diff + n * this->bottom_dim_, batch);
+        }
+      }
     }
   }
 }
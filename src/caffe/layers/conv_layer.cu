@@ -7,6 +7,16 @@ namespace caffe {
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+  if (channels_last() || quantized()) {
+    // The net runs the fused activation layer itself in GPU mode.
+    const bool suspended = this->activation_.suspended();
+    this->activation_.set_suspended(true);
+    Forward_cpu(bottom, top);
+    this->activation_.set_suspended(suspended);
+    return;
+  }
+  CHECK(!this->ParamsReleased()) << "Layer " << this->layer_param_.name()
+      << " freed its weights on the CPU; load them again to run on the GPU.";
   const Dtype* weight = this->blobs_[0]->gpu_data();
   for (int i = 0; i < bottom.size(); ++i) {
     const Dtype* bottom_data = bottom[i]->gpu_data();
@@ -22,9 +22,14 @@ template <typename Dtype>
 void DropoutLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   NeuronLayer<Dtype>::Reshape(bottom, top);
-  // Set up the cache for random number generation
+  // Set up the cache for random number generation, unless the layer is
+  // inference only and never draws a mask.
   // ReshapeLike does not work because rand_vec_ is of Dtype uint
-  rand_vec_.Reshape(bottom[0]->shape());
+  if (!this->inference_only()) {
+    rand_vec_.Reshape(bottom[0]->shape());
+  } else {
+    this->inference_saved_bytes_ = bottom[0]->count() * sizeof(unsigned int);
+  }
 }
 
 template <typename Dtype>
@@ -32,9 +37,9 @@ void DropoutLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  unsigned int* mask = rand_vec_.mutable_cpu_data();
   const int count = bottom[0]->count();
   if (this->phase_ == TRAIN) {
+    unsigned int* mask = rand_vec_.mutable_cpu_data();
     // Create random numbers
     caffe_rng_bernoulli(count, 1. - threshold_, mask);
     for (int i = 0; i < count; ++i) {
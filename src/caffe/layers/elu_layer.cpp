@@ -2,20 +2,49 @@
 #include <vector>
 
 #include "caffe/layers/elu_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
+// The number of values exponentiated at once, through a buffer on the stack.
+static const int kELUChunk = 256;
+
+template <typename Dtype>
+void ELULayer<Dtype>::ForwardElements(const Dtype* const* bottom_data,
+    Dtype* top_data, const int begin, const int end) const {
+  const Dtype* x = bottom_data[0];
+  Dtype alpha = this->layer_param_.elu_param().alpha();
+  Dtype negative[kELUChunk];
+  for (int chunk = begin; chunk < end; chunk += kELUChunk) {
+    const int n = std::min(kELUChunk, end - chunk);
+    for (int i = 0; i < n; ++i) {
+      negative[i] = x[chunk + i] < 0 ? x[chunk + i] : Dtype(0);
+    }
+    caffe_exp(n, negative, negative);
+    for (int i = 0; i < n; ++i) {
+      const Dtype positive = x[chunk + i] > 0 ? x[chunk + i] : Dtype(0);
+      top_data[chunk + i] = positive + alpha * (negative[i] - Dtype(1));
+    }
+  }
+}
+
+template <typename Dtype>
+void ELULayer<Dtype>::BackwardElements(const Dtype* top_data,
+    const Dtype* top_diff, const Dtype* bottom_data, Dtype* bottom_diff,
+    const int begin, const int end) const {
+  Dtype alpha = this->layer_param_.elu_param().alpha();
+  for (int i = begin; i < end; ++i) {
+    bottom_diff[i] = top_diff[i] * ((bottom_data[i] > 0)
+        + (alpha + top_data[i]) * (bottom_data[i] <= 0));
+  }
+}
+
 template <typename Dtype>
 void ELULayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
-  Dtype* top_data = top[0]->mutable_cpu_data();
-  const int count = bottom[0]->count();
-  Dtype alpha = this->layer_param_.elu_param().alpha();
-  for (int i = 0; i < count; ++i) {
-    top_data[i] = std::max(bottom_data[i], Dtype(0))
-        + alpha * (exp(std::min(bottom_data[i], Dtype(0))) - Dtype(1));
-  }
+  ForwardElements(&bottom_data, top[0]->mutable_cpu_data(), 0,
+      bottom[0]->count());
 }
 
 template <typename Dtype>
@@ -23,20 +52,12 @@ void ELULayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
   if (propagate_down[0]) {
-    const Dtype* bottom_data = bottom[0]->cpu_data();
-    const Dtype* top_data = top[0]->cpu_data();
-    const Dtype* top_diff = top[0]->cpu_diff();
-    Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-    const int count = bottom[0]->count();
-    Dtype alpha = this->layer_param_.elu_param().alpha();
-    for (int i = 0; i < count; ++i) {
-      bottom_diff[i] = top_diff[i] * ((bottom_data[i] > 0)
-          + (alpha + top_data[i]) * (bottom_data[i] <= 0));
-    }
+    BackwardElements(top[0]->cpu_data(), top[0]->cpu_diff(),
+        bottom[0]->cpu_data(), bottom[0]->mutable_cpu_diff(), 0,
+        bottom[0]->count());
   }
 }
 
-
 #ifdef CPU_ONLY
 STUB_GPU(ELULayer);
 #endif
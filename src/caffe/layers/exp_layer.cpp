@@ -28,33 +28,43 @@ void ExpLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
 }
 
 template <typename Dtype>
-void ExpLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
-    const vector<Blob<Dtype>*>& top) {
-  const int count = bottom[0]->count();
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  Dtype* top_data = top[0]->mutable_cpu_data();
-  if (inner_scale_ == Dtype(1)) {
-    caffe_exp(count, bottom_data, top_data);
-  } else {
-    caffe_cpu_scale(count, inner_scale_, bottom_data, top_data);
-    caffe_exp(count, top_data, top_data);
+void ExpLayer<Dtype>::ForwardElements(const Dtype* const* bottom_data,
+    Dtype* top_data, const int begin, const int end) const {
+  const Dtype* x = bottom_data[0];
+  for (int i = begin; i < end; ++i) {
+    top_data[i] = inner_scale_ * x[i];
   }
+  caffe_exp(end - begin, top_data + begin, top_data + begin);
   if (outer_scale_ != Dtype(1)) {
-    caffe_scal(count, outer_scale_, top_data);
+    caffe_scal(end - begin, outer_scale_, top_data + begin);
+  }
+}
+
+template <typename Dtype>
+void ExpLayer<Dtype>::BackwardElements(const Dtype* top_data,
+    const Dtype* top_diff, const Dtype* bottom_data, Dtype* bottom_diff,
+    const int begin, const int end) const {
+  for (int i = begin; i < end; ++i) {
+    bottom_diff[i] = top_data[i] * top_diff[i] * inner_scale_;
   }
 }
 
+template <typename Dtype>
+void ExpLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  ForwardElements(&bottom_data, top[0]->mutable_cpu_data(), 0,
+      bottom[0]->count());
+}
+
 template <typename Dtype>
 void ExpLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
-    const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
-  if (!propagate_down[0]) { return; }
-  const int count = bottom[0]->count();
-  const Dtype* top_data = top[0]->cpu_data();
-  const Dtype* top_diff = top[0]->cpu_diff();
-  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-  caffe_mul(count, top_data, top_diff, bottom_diff);
-  if (inner_scale_ != Dtype(1)) {
-    caffe_scal(count, inner_scale_, bottom_diff);
+    const vector<bool>& propagate_down,
+    const vector<Blob<Dtype>*>& bottom) {
+  if (propagate_down[0]) {
+    BackwardElements(top[0]->cpu_data(), top[0]->cpu_diff(),
+        bottom[0]->cpu_data(), bottom[0]->mutable_cpu_diff(), 0,
+        bottom[0]->count());
   }
 }
 
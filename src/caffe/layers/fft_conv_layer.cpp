@@ -0,0 +1,312 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "caffe/layers/fft_conv_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/workspace.hpp"
+
+namespace caffe {
+
+// Multiply-adds per element and level of a radix-2 complex transform: a
+// butterfly of two elements takes one complex multiplication and two
+// additions.
+static const double kFFTMultiplyAdds = 2.5;
+// im2col with a tuned GEMM runs about twice as many multiply-adds per second
+// as the transform and product loops here.
+static const double kGemmSpeedup = 2;
+// Bounds the spectra kept in memory: those of the filters and of the images
+// transformed together. Layers whose filter spectra and the spectra of one
+// image exceed it use GEMM.
+static const size_t kMaxSpectraBytes = 64 << 20;
+
+template <typename Dtype>
+FFTConvolutionLayer<Dtype>::~FFTConvolutionLayer() {
+  Workspace::Release(&filter_spectra_);
+}
+
+template <typename Dtype>
+void FFTConvolutionLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  ConvolutionLayer<Dtype>::LayerSetUp(bottom, top);
+  if (this->quantized() || this->half()) {
+    // The 8-bit and 16-bit weights are only read by the GEMM implementation.
+    LOG(INFO) << "Layer " << this->layer_param_.name() << " has 8-bit or "
+        << "16-bit weights; falling back to GEMM.";
+    return;
+  }
+  if (this->num_spatial_axes_ != 2) {
+    LOG(INFO) << "Layer " << this->layer_param_.name() << " is not a 2D "
+        << "convolution; falling back to GEMM.";
+    return;
+  }
+  ChooseAlgorithm(bottom[0]->shape(this->channel_axis_ + 1),
+      bottom[0]->shape(this->channel_axis_ + 2));
+}
+
+template <typename Dtype>
+void FFTConvolutionLayer<Dtype>::ChooseAlgorithm(int height, int width) {
+  chosen_height_ = height;
+  chosen_width_ = width;
+  const int* kernel = this->kernel_shape_.cpu_data();
+  const int* stride = this->stride_.cpu_data();
+  const int* pad = this->pad_.cpu_data();
+  const int* dilation = this->dilation_.cpu_data();
+  const int padded_height = height + 2 * pad[0];
+  const int padded_width = width + 2 * pad[1];
+  const int height_out =
+      (padded_height - (dilation[0] * (kernel[0] - 1) + 1)) / stride[0] + 1;
+  const int width_out =
+      (padded_width - (dilation[1] * (kernel[1] - 1) + 1)) / stride[1] + 1;
+  const int fft_height = FFT<Dtype>::RoundUp(padded_height);
+  const int fft_width = FFT<Dtype>::RoundUp(padded_width);
+  // Per image: the GEMM multiplies every output with every kernel element of
+  // its group, while the FFT transforms every input and output channel and
+  // multiplies the spectra of every input and output channel pair. The
+  // filter transforms are cached.
+  const double channels_per_group = this->channels_ / this->group_;
+  const double spectrum_size = static_cast<double>(fft_height) * fft_width;
+  const double spectra_bytes = sizeof(Dtype) * 2 * spectrum_size *
+      (this->num_output_ * channels_per_group + this->channels_);
+  const double gemm_cost = static_cast<double>(this->num_output_) *
+      channels_per_group * kernel[0] * kernel[1] * height_out * width_out;
+  const double fft_cost = kFFTMultiplyAdds * spectrum_size *
+      std::log(spectrum_size) / std::log(2.) *
+      (this->channels_ + this->num_output_) +
+      4 * this->num_output_ * channels_per_group * spectrum_size;
+  const bool spectra_fit = spectra_bytes <= kMaxSpectraBytes;
+  use_fft_ = spectra_fit && fft_cost * kGemmSpeedup < gemm_cost;
+  LOG(INFO) << "Layer " << this->layer_param_.name() << " uses "
+      << (use_fft_ ? "the FFT" : "GEMM") << " for " << height << "x" << width
+      << " inputs (estimated FFT / GEMM cost " << fft_cost * kGemmSpeedup /
+      gemm_cost << (spectra_fit ? "" : ", spectra too large") << ").";
+  if (!use_fft_) {
+    return;
+  }
+  if (fft_height != fft_height_ || fft_width != fft_width_) {
+    fft_height_ = fft_height;
+    fft_width_ = fft_width;
+    row_fft_.reset(new FFT<Dtype>(fft_width_));
+    col_fft_.reset(new FFT<Dtype>(fft_height_));
+    vector<int> spectra_shape(4);
+    spectra_shape[0] = this->num_output_;
+    spectra_shape[1] = this->channels_ / this->group_;
+    spectra_shape[2] = 2;
+    spectra_shape[3] = fft_height_ * fft_width_;
+    filter_spectra_.Reshape(spectra_shape);
+    // The old spectra may be shared (see ShareDerivedParams); these are the
+    // layer's own.
+    filter_spectra_.set_data(shared_ptr<SyncedMemory>(
+        new SyncedMemory(filter_spectra_.count() * sizeof(Dtype))));
+    shares_filter_spectra_ = false;
+    transformed_weights_.reset();
+  }
+}
+
+template <typename Dtype>
+void FFTConvolutionLayer<Dtype>::Reshape(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  // Choose before the base class reserves its column buffer, which only GEMM
+  // needs.
+  if (this->num_spatial_axes_ == 2 && !this->quantized() && !this->half() &&
+      (bottom[0]->shape(this->channel_axis_ + 1) != chosen_height_ ||
+       bottom[0]->shape(this->channel_axis_ + 2) != chosen_width_)) {
+    ChooseAlgorithm(bottom[0]->shape(this->channel_axis_ + 1),
+        bottom[0]->shape(this->channel_axis_ + 2));
+  }
+  ConvolutionLayer<Dtype>::Reshape(bottom, top);
+  if (!use_fft_) {
+    Workspace::Release(&filter_spectra_);
+    return;
+  }
+  // ChooseAlgorithm made sure that the spectra of one image fit beside those
+  // of the filters.
+  const size_t image_bytes =
+      sizeof(Dtype) * 2 * this->channels_ * fft_height_ * fft_width_;
+  const size_t filter_bytes = sizeof(Dtype) * filter_spectra_.count();
+  images_per_batch_ = static_cast<int>(std::max<size_t>(1, std::min<size_t>(
+      this->num_, (kMaxSpectraBytes - filter_bytes) / image_bytes)));
+  Workspace::Get().Reserve(&filter_spectra_,
+      images_per_batch_ * image_bytes);
+}
+
+template <typename Dtype>
+void FFTConvolutionLayer<Dtype>::ShareDerivedParams(Layer<Dtype>* source) {
+  ConvolutionLayer<Dtype>::ShareDerivedParams(source);
+  FFTConvolutionLayer<Dtype>* layer =
+      dynamic_cast<FFTConvolutionLayer<Dtype>*>(source);
+  CHECK(layer) << "Cannot share the params of a " << source->type()
+      << " layer.";
+  if (!use_fft_ || !layer->use_fft_ || layer->fft_height_ != fft_height_ ||
+      layer->fft_width_ != fft_width_) {
+    return;
+  }
+  // The filter spectra take up to kMaxSpectraBytes; source transforms
+  // them once, and executors read them from there.
+  filter_spectra_.ShareData(layer->filter_spectra_);
+  shares_filter_spectra_ = true;
+  transformed_weights_ = layer->transformed_weights_;
+  transformed_weights_version_ = layer->transformed_weights_version_;
+}
+
+template <typename Dtype>
+void FFTConvolutionLayer<Dtype>::RefreshDerivedParams() {
+  if (use_fft_) {
+    TransformFilters();
+  } else {
+    ConvolutionLayer<Dtype>::RefreshDerivedParams();
+  }
+}
+
+template <typename Dtype>
+void FFTConvolutionLayer<Dtype>::TransformFilters() {
+  const shared_ptr<SyncedMemory>& weights = this->blobs_[0]->data();
+  if (weights == transformed_weights_ &&
+      weights->version() == transformed_weights_version_) {
+    return;
+  }
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  Dtype* spectra = filter_spectra_.mutable_cpu_data();
+  const int kernel_h = this->kernel_shape_.cpu_data()[0];
+  const int kernel_w = this->kernel_shape_.cpu_data()[1];
+  const int dilation_h = this->dilation_.cpu_data()[0];
+  const int dilation_w = this->dilation_.cpu_data()[1];
+  const int spectrum_size = fft_height_ * fft_width_;
+  const int filters = this->blobs_[0]->count(0, 2);
+#ifdef _OPENMP
+  #pragma omp parallel for if (static_cast<int64_t>(filters) * \
+      spectrum_size >= kParallelMinMultiplyAdds)
+#endif
+  for (int f = 0; f < filters; ++f) {
+    Dtype* real = spectra + f * 2 * spectrum_size;
+    Dtype* imag = real + spectrum_size;
+    std::fill(real, real + 2 * spectrum_size, Dtype(0));
+    // Place the dilated kernel at the origin of the grid.
+    for (int i = 0; i < kernel_h; ++i) {
+      for (int j = 0; j < kernel_w; ++j) {
+        real[i * dilation_h * fft_width_ + j * dilation_w] =
+            weight[(f * kernel_h + i) * kernel_w + j];
+      }
+    }
+    fft_2d(*row_fft_, *col_fft_, real, imag, false);
+  }
+  transformed_weights_ = weights;
+  transformed_weights_version_ = weights->version();
+}
+
+template <typename Dtype>
+void FFTConvolutionLayer<Dtype>::TransformInput(const Dtype* input,
+    Dtype* spectra) {
+  const int height = this->input_shape(1);
+  const int width = this->input_shape(2);
+  const int pad_h = this->pad_.cpu_data()[0];
+  const int pad_w = this->pad_.cpu_data()[1];
+  const int spectrum_size = fft_height_ * fft_width_;
+#ifdef _OPENMP
+  #pragma omp parallel for if (static_cast<int64_t>(this->channels_) * \
+      spectrum_size >= kParallelMinMultiplyAdds)
+#endif
+  for (int c = 0; c < this->channels_; ++c) {
+    Dtype* real = spectra + c * 2 * spectrum_size;
+    Dtype* imag = real + spectrum_size;
+    std::fill(real, real + 2 * spectrum_size, Dtype(0));
+    const Dtype* channel = input + c * height * width;
+    for (int h = 0; h < height; ++h) {
+      std::copy(channel + h * width, channel + (h + 1) * width,
+          real + (h + pad_h) * fft_width_ + pad_w);
+    }
+    fft_2d(*row_fft_, *col_fft_, real, imag, false);
+  }
+}
+
+template <typename Dtype>
+void FFTConvolutionLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  if (!use_fft_) {
+    ConvolutionLayer<Dtype>::Forward_cpu(bottom, top);
+    return;
+  }
+  if (!shares_filter_spectra_) {
+    TransformFilters();
+  }
+  const int channels_per_group = this->channels_ / this->group_;
+  const int outputs_per_group = this->num_output_ / this->group_;
+  const int spectrum_size = fft_height_ * fft_width_;
+  const int image_spectra = 2 * this->channels_ * spectrum_size;
+  const int height_out = this->output_shape_[0];
+  const int width_out = this->output_shape_[1];
+  const int stride_h = this->stride_.cpu_data()[0];
+  const int stride_w = this->stride_.cpu_data()[1];
+  const Dtype scale = Dtype(1) / spectrum_size;
+  const shared_ptr<SyncedMemory> workspace = Workspace::Get().Reserve(
+      &filter_spectra_, sizeof(Dtype) * images_per_batch_ * image_spectra);
+  Dtype* input_spectra = static_cast<Dtype*>(workspace->mutable_cpu_data());
+  const Dtype* filter_spectra = filter_spectra_.cpu_data();
+  for (int i = 0; i < bottom.size(); ++i) {
+    const Dtype* bottom_data = bottom[i]->cpu_data();
+    Dtype* top_data = top[i]->mutable_cpu_data();
+    for (int n0 = 0; n0 < this->num_; n0 += images_per_batch_) {
+      const int batch = std::min(images_per_batch_, this->num_ - n0);
+      for (int b = 0; b < batch; ++b) {
+        TransformInput(bottom_data + (n0 + b) * this->bottom_dim_,
+            input_spectra + b * image_spectra);
+      }
+      // Each output channel sums the products of its filter spectra with the
+      // input spectra of its group, applying them to the whole batch while
+      // they are in cache.
+#ifdef _OPENMP
+      #pragma omp parallel if (static_cast<int64_t>(batch) * \
+          this->num_output_ * channels_per_group * spectrum_size >= \
+          kParallelMinMultiplyAdds)
+#endif
+      {
+        // The summed products of one output channel, for each thread.
+        vector<Dtype> product(2 * spectrum_size);
+        Dtype* product_real = &product[0];
+        Dtype* product_imag = product_real + spectrum_size;
+#ifdef _OPENMP
+        #pragma omp for
+#endif
+        for (int o = 0; o < this->num_output_; ++o) {
+          const int g = o / outputs_per_group;
+          for (int b = 0; b < batch; ++b) {
+            std::fill(product.begin(), product.end(), Dtype(0));
+            for (int c = 0; c < channels_per_group; ++c) {
+              const Dtype* x_real = input_spectra + b * image_spectra +
+                  (g * channels_per_group + c) * 2 * spectrum_size;
+              const Dtype* x_imag = x_real + spectrum_size;
+              const Dtype* w_real = filter_spectra +
+                  (o * channels_per_group + c) * 2 * spectrum_size;
+              const Dtype* w_imag = w_real + spectrum_size;
+              // Correlation multiplies by the conjugate filter spectrum.
+              for (int k = 0; k < spectrum_size; ++k) {
+                product_real[k] +=
+                    x_real[k] * w_real[k] + x_imag[k] * w_imag[k];
+                product_imag[k] +=
+                    x_imag[k] * w_real[k] - x_real[k] * w_imag[k];
+              }
+            }
+            fft_2d(*row_fft_, *col_fft_, product_real, product_imag, true);
+            // Output (h, w) correlates the padded input from
+            // (h * stride_h, w * stride_w) on.
+            Dtype* output = top_data + (n0 + b) * this->top_dim_ +
+                o * height_out * width_out;
+            for (int h = 0; h < height_out; ++h) {
+              const Dtype* row = product_real + h * stride_h * fft_width_;
+              for (int w = 0; w < width_out; ++w) {
+                output[h * width_out + w] = row[w * stride_w] * scale;
+              }
+            }
+          }
+        }
+      }
+      for (int b = 0; b < batch; ++b) {
+        this->forward_cpu_epilogue(top_data, n0 + b);
+      }
+    }
+  }
+}
+
+INSTANTIATE_CLASS(FFTConvolutionLayer);
+
+}  // namespace caffe
@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <string>
 #include <vector>
 
 #include "caffe/filler.hpp"
@@ -72,6 +74,7 @@ void InnerProductLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   top_shape.resize(axis + 1);
   top_shape[axis] = N_;
   top[0]->Reshape(top_shape);
+  activation_.Reshape(*top[0]);
   // Set up the bias multiplier
   if (bias_term_) {
     vector<int> bias_shape(1, M_);
@@ -85,21 +88,183 @@ void InnerProductLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  const Dtype* weight = this->blobs_[0]->cpu_data();
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, transpose_ ? CblasNoTrans : CblasTrans,
-      M_, N_, K_, (Dtype)1.,
-      bottom_data, weight, (Dtype)0., top_data);
-  if (bias_term_) {
+  if (!shares_derived_params_) {
+    RefreshDerivedParams();
+  }
+  if (quantized()) {
+    forward_cpu_quantized(bottom_data, top_data);
+    return;
+  }
+  if (this->layer_param_.inner_product_param().weight_precision() !=
+      FLOAT32) {
+    forward_cpu_half(bottom_data, top_data);
+  } else if (sparse_weights_->sparse()) {
+    forward_cpu_sparse(bottom_data, top_data);
+  } else {
+    const Dtype* weight = this->blobs_[0]->cpu_data();
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, transpose_ ? CblasNoTrans : CblasTrans,
+        M_, N_, K_, (Dtype)1.,
+        bottom_data, weight, (Dtype)0., top_data);
+  }
+  if (activation_.fused()) {
+    activation_.Forward(M_, N_, 1,
+        bias_term_ ? this->blobs_[1]->cpu_data() : NULL, top_data, 0);
+  } else if (bias_term_) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, N_, 1, (Dtype)1.,
         bias_multiplier_.cpu_data(),
         this->blobs_[1]->cpu_data(), (Dtype)1., top_data);
   }
 }
 
+template <typename Dtype>
+void InnerProductLayer<Dtype>::ParamFromProto(const int i,
+    const BlobProto& proto) {
+  // Inference-only nets on the CPU never read the Dtype weights of quantized
+  // layers, so they skip them.
+  const bool keep_weights =
+      !this->inference_only() || Caffe::mode() != Caffe::CPU;
+  if (i != 0 || !quantized() || !quantized_weights_->FromProto(proto,
+      N_, transpose_, keep_weights, this->blobs_[0].get())) {
+    Layer<Dtype>::ParamFromProto(i, proto);
+  }
+}
+
+template <typename Dtype>
+void InnerProductLayer<Dtype>::ShareDerivedParams(Layer<Dtype>* source) {
+  InnerProductLayer<Dtype>* layer =
+      dynamic_cast<InnerProductLayer<Dtype>*>(source);
+  CHECK(layer) << "Cannot share the params of a " << source->type()
+      << " layer.";
+  // Derive what Forward_cpu will use.
+  layer->RefreshDerivedParams();
+  quantized_weights_ = layer->quantized_weights_;
+  half_weights_ = layer->half_weights_;
+  sparse_weights_ = layer->sparse_weights_;
+  shares_derived_params_ = true;
+}
+
+template <typename Dtype>
+void InnerProductLayer<Dtype>::RefreshDerivedParams() {
+  const InnerProductParameter& param =
+      this->layer_param_.inner_product_param();
+  if (quantized()) {
+    quantized_weights_->Update(*this->blobs_[0], N_, transpose_);
+  } else if (param.weight_precision() != FLOAT32) {
+    half_weights_->Update(*this->blobs_[0], param.weight_precision());
+    // Only the 16-bit weights are read from now on.
+    if (this->inference_only() && Caffe::mode() == Caffe::CPU) {
+      half_weights_->Release(this->blobs_[0].get());
+    }
+  } else {
+    sparse_weights_->Update(*this->blobs_[0], N_, transpose_,
+        param.sparse_threshold());
+  }
+}
+
+// The bytes of weights forward_cpu_half converts at a time, sized to stay in
+// the L2 cache for the GEMM that reads them.
+static const int kHalfPanelBytes = 1 << 18;
+
+template <typename Dtype>
+void InnerProductLayer<Dtype>::forward_cpu_half(const Dtype* input,
+    Dtype* output) {
+  // The weights are rows x cols: outputs x inputs, or the transpose.
+  const int rows = transpose_ ? K_ : N_;
+  const int cols = transpose_ ? N_ : K_;
+  const int panel_rows = std::min(rows, std::max(1,
+      kHalfPanelBytes / static_cast<int>(cols * sizeof(Dtype))));
+  half_panel_.resize(panel_rows * cols);
+  for (int r = 0; r < rows; r += panel_rows) {
+    const int panel = std::min(panel_rows, rows - r);
+    half_weights_->Unpack(r * cols, panel * cols, &half_panel_[0]);
+    if (transpose_) {
+      // A panel of inputs adds to every output.
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, N_, panel,
+          (Dtype)1., input + r, K_, &half_panel_[0], N_,
+          r == 0 ? (Dtype)0. : (Dtype)1., output, N_);
+    } else {
+      // A panel of outputs.
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, M_, panel, K_,
+          (Dtype)1., input, K_, &half_panel_[0], K_, (Dtype)0., output + r,
+          N_);
+    }
+  }
+}
+
+template <typename Dtype>
+void InnerProductLayer<Dtype>::forward_cpu_sparse(const Dtype* input,
+    Dtype* output) {
+  // The sparse weights are N_ x K_, so they multiply the K_ x M_ transpose
+  // of the input into the N_ x M_ transpose of the output; with one input
+  // there is nothing to transpose.
+  const Dtype* input_t = input;
+  Dtype* output_t = output;
+  if (M_ > 1) {
+    sparse_input_.resize(K_ * M_);
+    sparse_output_.resize(N_ * M_);
+    for (int m = 0; m < M_; ++m) {
+      for (int k = 0; k < K_; ++k) {
+        sparse_input_[k * M_ + m] = input[m * K_ + k];
+      }
+    }
+    input_t = &sparse_input_[0];
+    output_t = &sparse_output_[0];
+  }
+  caffe_cpu_csrmm(N_, M_, K_, sparse_weights_->values(),
+      sparse_weights_->columns(), sparse_weights_->row_begin(), input_t,
+      output_t);
+  if (M_ > 1) {
+    for (int n = 0; n < N_; ++n) {
+      for (int m = 0; m < M_; ++m) {
+        output[m * N_ + n] = output_t[n * M_ + m];
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void InnerProductLayer<Dtype>::forward_cpu_quantized(const Dtype* input,
+    Dtype* output) {
+  const Dtype input_scale = QuantizationInputScale(
+      this->layer_param_.quantization_param(), M_ * K_, input);
+  quantized_input_.resize(M_ * K_);
+  quantized_sums_.resize(M_ * N_);
+  caffe_cpu_quantize(M_ * K_, input_scale, input, &quantized_input_[0]);
+  caffe_cpu_gemm_s8(M_, N_, K_, &quantized_input_[0],
+      quantized_weights_->data(), &quantized_sums_[0]);
+  const Dtype* scales = quantized_weights_->scales();
+  for (int m = 0; m < M_; ++m) {
+    for (int n = 0; n < N_; ++n) {
+      output[m * N_ + n] = quantized_sums_[m * N_ + n] * scales[n] *
+          input_scale;
+    }
+  }
+  // Adds the bias even when no activation is fused.
+  activation_.Forward(M_, N_, 1,
+      bias_term_ ? this->blobs_[1]->cpu_data() : NULL, output, 0);
+}
+
+template <typename Dtype>
+bool InnerProductLayer<Dtype>::FuseActivation(Layer<Dtype>* activation,
+    const bool need_backward) {
+  // A PReLU layer takes its channels from the second axis of the output.
+  if (this->layer_param_.inner_product_param().axis() != 1 &&
+      activation->type() == string("PReLU")) {
+    return false;
+  }
+  return activation_.Fuse(activation, N_, need_backward);
+}
+
+template <typename Dtype>
+void InnerProductLayer<Dtype>::SuspendFusedActivation(const bool suspend) {
+  activation_.set_suspended(suspend);
+}
+
 template <typename Dtype>
 void InnerProductLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
+  CHECK(!quantized()) << "Quantized inner products only run forward.";
   if (this->param_propagate_down_[0]) {
     const Dtype* top_diff = top[0]->cpu_diff();
     const Dtype* bottom_data = bottom[0]->cpu_data();
@@ -9,6 +9,16 @@ namespace caffe {
 template <typename Dtype>
 void InnerProductLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
+  if (quantized()) {
+    // The net runs the fused activation layer itself in GPU mode.
+    const bool suspended = activation_.suspended();
+    activation_.set_suspended(true);
+    Forward_cpu(bottom, top);
+    activation_.set_suspended(suspended);
+    return;
+  }
+  CHECK(!this->ParamsReleased()) << "Layer " << this->layer_param_.name()
+      << " freed its weights on the CPU; load them again to run on the GPU.";
   const Dtype* bottom_data = bottom[0]->gpu_data();
   Dtype* top_data = top[0]->mutable_gpu_data();
   const Dtype* weight = this->blobs_[0]->gpu_data();
@@ -0,0 +1,97 @@
+#include <algorithm>
+#include <vector>
+
+#include "caffe/layers/layout_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// The side of the square blocks transposed at a time, which keeps both the
+// rows read and the rows written in cache.
+static const int kTransposeBlock = 32;
+
+// Transposes num consecutive rows x cols matrices in into cols x rows
+// matrices out.
+template <typename Dtype>
+static void transpose(const int num, const int rows, const int cols,
+    const Dtype* in, Dtype* out) {
+  for (int n = 0; n < num; ++n) {
+    for (int i0 = 0; i0 < rows; i0 += kTransposeBlock) {
+      const int i1 = std::min(i0 + kTransposeBlock, rows);
+      for (int j0 = 0; j0 < cols; j0 += kTransposeBlock) {
+        const int j1 = std::min(j0 + kTransposeBlock, cols);
+        for (int i = i0; i < i1; ++i) {
+          for (int j = j0; j < j1; ++j) {
+            out[j * rows + i] = in[i * cols + j];
+          }
+        }
+      }
+    }
+    in += rows * cols;
+    out += rows * cols;
+  }
+}
+
+template <typename Dtype>
+void LayoutLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  CHECK_NE(top[0], bottom[0]) << this->type() << " Layer does not "
+      "allow in-place computation.";
+  if (bottom[0]->num_axes() != 4) {
+    top[0]->ReshapeLike(*bottom[0]);
+    return;
+  }
+  vector<int> top_shape(4);
+  top_shape[0] = bottom[0]->shape(0);
+  if (this->layer_param_.layout() == NHWC) {
+    top_shape[1] = bottom[0]->shape(2);
+    top_shape[2] = bottom[0]->shape(3);
+    top_shape[3] = bottom[0]->shape(1);
+  } else {
+    top_shape[1] = bottom[0]->shape(3);
+    top_shape[2] = bottom[0]->shape(1);
+    top_shape[3] = bottom[0]->shape(2);
+  }
+  top[0]->Reshape(top_shape);
+}
+
+template <typename Dtype>
+void LayoutLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  if (bottom[0]->num_axes() != 4) {
+    caffe_copy(bottom[0]->count(), bottom_data, top_data);
+  } else if (this->layer_param_.layout() == NHWC) {
+    // Each image goes from channels x pixels to pixels x channels.
+    transpose(bottom[0]->shape(0), bottom[0]->shape(1), bottom[0]->count(2),
+        bottom_data, top_data);
+  } else {
+    transpose(bottom[0]->shape(0), bottom[0]->count(1, 3),
+        bottom[0]->shape(3), bottom_data, top_data);
+  }
+}
+
+template <typename Dtype>
+void LayoutLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  if (!propagate_down[0]) {
+    return;
+  }
+  const Dtype* top_diff = top[0]->cpu_diff();
+  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+  if (bottom[0]->num_axes() != 4) {
+    caffe_copy(top[0]->count(), top_diff, bottom_diff);
+  } else if (this->layer_param_.layout() == NHWC) {
+    transpose(top[0]->shape(0), top[0]->count(1, 3), top[0]->shape(3),
+        top_diff, bottom_diff);
+  } else {
+    transpose(top[0]->shape(0), top[0]->shape(1), top[0]->count(2),
+        top_diff, bottom_diff);
+  }
+}
+
+INSTANTIATE_CLASS(LayoutLayer);
+REGISTER_LAYER_CLASS(Layout);
+
+}  // namespace caffe
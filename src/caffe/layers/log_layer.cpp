@@ -31,48 +31,45 @@ void LogLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
 }
 
 template <typename Dtype>
-void LogLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
-    const vector<Blob<Dtype>*>& top) {
-  const int count = bottom[0]->count();
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  Dtype* top_data = top[0]->mutable_cpu_data();
-  if (input_scale_ == Dtype(1) && input_shift_ == Dtype(0)) {
-    caffe_log(count, bottom_data, top_data);
-  } else {
-    caffe_copy(count, bottom_data, top_data);
-    if (input_scale_ != Dtype(1)) {
-      caffe_scal(count, input_scale_, top_data);
-    }
-    if (input_shift_ != Dtype(0)) {
-      caffe_add_scalar(count, input_shift_, top_data);
-    }
-    caffe_log(count, top_data, top_data);
+void LogLayer<Dtype>::ForwardElements(const Dtype* const* bottom_data,
+    Dtype* top_data, const int begin, const int end) const {
+  const Dtype* x = bottom_data[0];
+  for (int i = begin; i < end; ++i) {
+    top_data[i] = input_scale_ * x[i] + input_shift_;
   }
+  caffe_log(end - begin, top_data + begin, top_data + begin);
   if (base_scale_ != Dtype(1)) {
-    caffe_scal(count, base_scale_, top_data);
+    caffe_scal(end - begin, base_scale_, top_data + begin);
   }
 }
 
 template <typename Dtype>
-void LogLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
-    const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
-  if (!propagate_down[0]) { return; }
-  const int count = bottom[0]->count();
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  const Dtype* top_diff = top[0]->cpu_diff();
-  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-  caffe_copy(count, bottom_data, bottom_diff);
-  if (input_scale_ != Dtype(1)) {
-    caffe_scal(count, input_scale_, bottom_diff);
-  }
-  if (input_shift_ != Dtype(0)) {
-    caffe_add_scalar(count, input_shift_, bottom_diff);
+void LogLayer<Dtype>::BackwardElements(const Dtype* top_data,
+    const Dtype* top_diff, const Dtype* bottom_data, Dtype* bottom_diff,
+    const int begin, const int end) const {
+  for (int i = begin; i < end; ++i) {
+    bottom_diff[i] = top_diff[i] * (backward_num_scale_ /
+        (input_scale_ * bottom_data[i] + input_shift_));
   }
-  caffe_powx(count, bottom_diff, Dtype(-1), bottom_diff);
-  if (backward_num_scale_ != Dtype(1)) {
-    caffe_scal(count, backward_num_scale_, bottom_diff);
+}
+
+template <typename Dtype>
+void LogLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  ForwardElements(&bottom_data, top[0]->mutable_cpu_data(), 0,
+      bottom[0]->count());
+}
+
+template <typename Dtype>
+void LogLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
+    const vector<bool>& propagate_down,
+    const vector<Blob<Dtype>*>& bottom) {
+  if (propagate_down[0]) {
+    BackwardElements(top[0]->cpu_data(), top[0]->cpu_diff(),
+        bottom[0]->cpu_data(), bottom[0]->mutable_cpu_diff(), 0,
+        bottom[0]->count());
   }
-  caffe_mul(count, top_diff, bottom_diff, bottom_diff);
 }
 
 #ifdef CPU_ONLY
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <vector>
 
 #include "caffe/layers/loss_layer.hpp"
@@ -22,6 +23,47 @@ void LossLayer<Dtype>::Reshape(
   top[0]->Reshape(loss_shape);
 }
 
+template <typename Dtype>
+LossParameter_NormalizationMode LossLayer<Dtype>::normalization_mode() const {
+  const LossParameter& loss_param = this->layer_param_.loss_param();
+  if (!loss_param.has_normalization() && loss_param.has_normalize()) {
+    return loss_param.normalize() ? LossParameter_NormalizationMode_VALID :
+                                    LossParameter_NormalizationMode_BATCH_SIZE;
+  }
+  return loss_param.normalization();
+}
+
+template <typename Dtype>
+Dtype LossLayer<Dtype>::GetNormalizer(
+    const LossParameter_NormalizationMode normalization_mode,
+    const int outer_num, const int inner_num, const int valid_count) {
+  Dtype normalizer;
+  switch (normalization_mode) {
+    case LossParameter_NormalizationMode_FULL:
+      normalizer = Dtype(outer_num * inner_num);
+      break;
+    case LossParameter_NormalizationMode_VALID:
+      if (valid_count == -1) {
+        normalizer = Dtype(outer_num * inner_num);
+      } else {
+        normalizer = Dtype(valid_count);
+      }
+      break;
+    case LossParameter_NormalizationMode_BATCH_SIZE:
+      normalizer = Dtype(outer_num);
+      break;
+    case LossParameter_NormalizationMode_NONE:
+      normalizer = Dtype(1);
+      break;
+    default:
+      LOG(FATAL) << "Unknown normalization mode: "
+          << LossParameter_NormalizationMode_Name(normalization_mode);
+  }
+  // Some users will have no labels for some examples in order to 'turn off' a
+  // particular loss in a multi-task setup. The max prevents NaNs in that case.
+  return std::max(Dtype(1.0), normalizer);
+}
+
 INSTANTIATE_CLASS(LossLayer);
 
 }  // namespace caffe
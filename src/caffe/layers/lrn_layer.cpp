@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cmath>
 #include <vector>
 
 #include "caffe/layers/lrn_layer.hpp"
@@ -5,6 +7,29 @@
 
 namespace caffe {
 
+// Normalization across channels slides its window along the channels of
+// this many pixels at a time.
+static const int kCrossChannelPixels = 256;
+
+// y = x scale^-beta. The beta of 0.75 of AlexNet and GoogLeNet takes square
+// roots, which vectorize, rather than pow.
+template <typename Dtype>
+static void lrn_normalize(const int n, const Dtype* x, const Dtype* scale,
+    const Dtype beta, Dtype* y) {
+  if (beta == Dtype(0.75)) {
+#ifdef _OPENMP
+    #pragma omp simd
+#endif
+    for (int i = 0; i < n; ++i) {
+      y[i] = x[i] / std::sqrt(scale[i] * std::sqrt(scale[i]));
+    }
+  } else {
+    for (int i = 0; i < n; ++i) {
+      y[i] = x[i] * std::pow(scale[i], -beta);
+    }
+  }
+}
+
 template <typename Dtype>
 void LRNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -16,12 +41,14 @@ void LRNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   k_ = this->layer_param_.lrn_param().k();
   if (this->layer_param_.lrn_param().norm_region() ==
       LRNParameter_NormRegion_WITHIN_CHANNEL) {
+    // The internal layers only run forward if this layer does.
     // Set up split_layer_ to use inputs in the numerator and denominator.
     split_top_vec_.clear();
     split_top_vec_.push_back(&product_input_);
     split_top_vec_.push_back(&square_input_);
     LayerParameter split_param;
     split_layer_.reset(new SplitLayer<Dtype>(split_param));
+    split_layer_->set_inference_only(this->inference_only());
     split_layer_->SetUp(bottom, split_top_vec_);
     // Set up square_layer_ to square the inputs.
     square_bottom_vec_.clear();
@@ -31,6 +58,7 @@ void LRNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     LayerParameter square_param;
     square_param.mutable_power_param()->set_power(Dtype(2));
     square_layer_.reset(new PowerLayer<Dtype>(square_param));
+    square_layer_->set_inference_only(this->inference_only());
     square_layer_->SetUp(square_bottom_vec_, square_top_vec_);
     // Set up pool_layer_ to sum over square neighborhoods of the input.
     pool_top_vec_.clear();
@@ -41,6 +69,7 @@ void LRNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     pool_param.mutable_pooling_param()->set_pad(pre_pad_);
     pool_param.mutable_pooling_param()->set_kernel_size(size_);
     pool_layer_.reset(new PoolingLayer<Dtype>(pool_param));
+    pool_layer_->set_inference_only(this->inference_only());
     pool_layer_->SetUp(square_top_vec_, pool_top_vec_);
     // Set up power_layer_ to compute (1 + alpha_/N^2 s)^-beta_, where s is
     // the sum of a squared neighborhood (the output of pool_layer_).
@@ -51,6 +80,7 @@ void LRNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     power_param.mutable_power_param()->set_scale(alpha_);
     power_param.mutable_power_param()->set_shift(Dtype(1));
     power_layer_.reset(new PowerLayer<Dtype>(power_param));
+    power_layer_->set_inference_only(this->inference_only());
     power_layer_->SetUp(pool_top_vec_, power_top_vec_);
     // Set up a product_layer_ to compute outputs by multiplying inputs by the
     // inverse demoninator computed by the power layer.
@@ -61,6 +91,7 @@ void LRNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     EltwiseParameter* eltwise_param = product_param.mutable_eltwise_param();
     eltwise_param->set_operation(EltwiseParameter_EltwiseOp_PROD);
     product_layer_.reset(new EltwiseLayer<Dtype>(product_param));
+    product_layer_->set_inference_only(this->inference_only());
     product_layer_->SetUp(product_bottom_vec_, top);
   }
 }
@@ -77,7 +108,15 @@ void LRNLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   switch (this->layer_param_.lrn_param().norm_region()) {
   case LRNParameter_NormRegion_ACROSS_CHANNELS:
     top[0]->Reshape(num_, channels_, height_, width_);
-    scale_.Reshape(num_, channels_, height_, width_);
+    // Backward reuses the scale of every image; inference-only layers keep
+    // the scale of one image at a time on the GPU, and none on the CPU.
+    if (this->inference_only()) {
+      scale_.Reshape(1, channels_, height_, width_);
+      this->inference_saved_bytes_ =
+          (num_ - 1) * channels_ * height_ * width_ * sizeof(Dtype);
+    } else {
+      scale_.Reshape(num_, channels_, height_, width_);
+    }
     break;
   case LRNParameter_NormRegion_WITHIN_CHANNEL:
     split_layer_->Reshape(bottom, split_top_vec_);
@@ -97,58 +136,148 @@ void LRNLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     CrossChannelForward_cpu(bottom, top);
     break;
   case LRNParameter_NormRegion_WITHIN_CHANNEL:
-    WithinChannelForward(bottom, top);
+    WithinChannelForward_cpu(bottom, top);
     break;
   default:
     LOG(FATAL) << "Unknown normalization region.";
   }
 }
 
+template <typename Dtype>
+void LRNLayer<Dtype>::cross_channel_cpu(const Dtype* bottom_data,
+    Dtype* top_data, Dtype* scale_data) const {
+  const int spatial_dim = height_ * width_;
+  const int blocks = (spatial_dim + kCrossChannelPixels - 1) /
+      kCrossChannelPixels;
+  const Dtype alpha_over_size = alpha_ / size_;
+#ifdef _OPENMP
+  #pragma omp parallel for \
+      if (static_cast<int64_t>(num_) * channels_ * spatial_dim >= \
+          kParallelMinInputs)
+#endif
+  for (int task = 0; task < num_ * blocks; ++task) {
+    const int begin = (task % blocks) * kCrossChannelPixels;
+    const int count = std::min(kCrossChannelPixels, spatial_dim - begin);
+    const int offset = task / blocks * channels_ * spatial_dim + begin;
+    const Dtype* x = bottom_data + offset;
+    // The sum of the squares in the window of the current channel.
+    Dtype sum[kCrossChannelPixels];
+    Dtype block_scale[kCrossChannelPixels];
+    std::fill(sum, sum + count, Dtype(0));
+    for (int c = 0; c < pre_pad_ && c < channels_; ++c) {
+      const Dtype* head = x + c * spatial_dim;
+      for (int i = 0; i < count; ++i) {
+        sum[i] += head[i] * head[i];
+      }
+    }
+    for (int c = 0; c < channels_; ++c) {
+      if (c + pre_pad_ < channels_) {
+        const Dtype* head = x + (c + pre_pad_) * spatial_dim;
+        for (int i = 0; i < count; ++i) {
+          sum[i] += head[i] * head[i];
+        }
+      }
+      Dtype* scale = scale_data ? scale_data + offset + c * spatial_dim :
+          block_scale;
+      for (int i = 0; i < count; ++i) {
+        scale[i] = k_ + alpha_over_size * sum[i];
+      }
+      if (top_data) {
+        lrn_normalize(count, x + c * spatial_dim, scale, beta_,
+            top_data + offset + c * spatial_dim);
+      }
+      if (c >= pre_pad_) {
+        const Dtype* tail = x + (c - pre_pad_) * spatial_dim;
+        for (int i = 0; i < count; ++i) {
+          sum[i] -= tail[i] * tail[i];
+        }
+      }
+    }
+  }
+}
+
 template <typename Dtype>
 void LRNLayer<Dtype>::CrossChannelForward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  Dtype* top_data = top[0]->mutable_cpu_data();
-  Dtype* scale_data = scale_.mutable_cpu_data();
-  // start with the constant value
-  for (int i = 0; i < scale_.count(); ++i) {
-    scale_data[i] = k_;
-  }
-  Blob<Dtype> padded_square(1, channels_ + size_ - 1, height_, width_);
-  Dtype* padded_square_data = padded_square.mutable_cpu_data();
-  caffe_set(padded_square.count(), Dtype(0), padded_square_data);
-  Dtype alpha_over_size = alpha_ / size_;
-  // go through the images
-  for (int n = 0; n < num_; ++n) {
-    // compute the padded square
-    caffe_sqr(channels_ * height_ * width_,
-        bottom_data + bottom[0]->offset(n),
-        padded_square_data + padded_square.offset(0, pre_pad_));
-    // Create the first channel scale
-    for (int c = 0; c < size_; ++c) {
-      caffe_axpy<Dtype>(height_ * width_, alpha_over_size,
-          padded_square_data + padded_square.offset(0, c),
-          scale_data + scale_.offset(n, 0));
+  cross_channel_cpu(bottom[0]->cpu_data(), top[0]->mutable_cpu_data(),
+      cpu_scale() ? scale_.mutable_cpu_data() : NULL);
+}
+
+template <typename Dtype>
+void LRNLayer<Dtype>::within_channel_sum_cpu(const Dtype* plane,
+    Dtype* buffer, Dtype* sum) const {
+  // Sum along the rows into buffer, then along the columns into sum, which
+  // may be plane.
+  for (int h = 0; h < height_; ++h) {
+    const Dtype* in = plane + h * width_;
+    Dtype* out = buffer + h * width_;
+    Dtype running = 0;
+    for (int w = 0; w < pre_pad_ && w < width_; ++w) {
+      running += in[w];
+    }
+    for (int w = 0; w < width_; ++w) {
+      if (w + pre_pad_ < width_) {
+        running += in[w + pre_pad_];
+      }
+      out[w] = running;
+      if (w >= pre_pad_) {
+        running -= in[w - pre_pad_];
+      }
     }
-    for (int c = 1; c < channels_; ++c) {
-      // copy previous scale
-      caffe_copy<Dtype>(height_ * width_,
-          scale_data + scale_.offset(n, c - 1),
-          scale_data + scale_.offset(n, c));
-      // add head
-      caffe_axpy<Dtype>(height_ * width_, alpha_over_size,
-          padded_square_data + padded_square.offset(0, c + size_ - 1),
-          scale_data + scale_.offset(n, c));
-      // subtract tail
-      caffe_axpy<Dtype>(height_ * width_, -alpha_over_size,
-          padded_square_data + padded_square.offset(0, c - 1),
-          scale_data + scale_.offset(n, c));
+  }
+  caffe_set(width_, Dtype(0), sum);
+  for (int h = 0; h <= pre_pad_ && h < height_; ++h) {
+    caffe_axpy(width_, Dtype(1), buffer + h * width_, sum);
+  }
+  for (int h = 1; h < height_; ++h) {
+    const Dtype* previous = sum + (h - 1) * width_;
+    const Dtype* head = h + pre_pad_ < height_ ?
+        buffer + (h + pre_pad_) * width_ : NULL;
+    const Dtype* tail = h > pre_pad_ ?
+        buffer + (h - 1 - pre_pad_) * width_ : NULL;
+    Dtype* out = sum + h * width_;
+#ifdef _OPENMP
+    #pragma omp simd
+#endif
+    for (int w = 0; w < width_; ++w) {
+      out[w] = previous[w] + (head ? head[w] : Dtype(0)) -
+          (tail ? tail[w] : Dtype(0));
     }
   }
+}
 
-  // In the end, compute output
-  caffe_powx<Dtype>(scale_.count(), scale_data, -beta_, top_data);
-  caffe_mul<Dtype>(scale_.count(), top_data, bottom_data, top_data);
+template <typename Dtype>
+void LRNLayer<Dtype>::WithinChannelForward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  const int spatial_dim = height_ * width_;
+  // The pooling of the squares averages over size x size windows, padding
+  // included.
+  const Dtype alpha_over_area = alpha_ / (size_ * size_);
+#ifdef _OPENMP
+  #pragma omp parallel if (bottom[0]->count() >= kParallelMinInputs)
+#endif
+  {
+    // The scale of a plane and the row sums it takes, for each thread.
+    vector<Dtype> scale(spatial_dim);
+    vector<Dtype> buffer(spatial_dim);
+#ifdef _OPENMP
+    #pragma omp for
+#endif
+    for (int i = 0; i < num_ * channels_; ++i) {
+      const Dtype* x = bottom_data + i * spatial_dim;
+      for (int j = 0; j < spatial_dim; ++j) {
+        scale[j] = x[j] * x[j];
+      }
+      within_channel_sum_cpu(&scale[0], &buffer[0], &scale[0]);
+      for (int j = 0; j < spatial_dim; ++j) {
+        scale[j] = 1 + alpha_over_area * scale[j];
+      }
+      lrn_normalize(spatial_dim, x, &scale[0], beta_,
+          top_data + i * spatial_dim);
+    }
+  }
 }
 
 template <typename Dtype>
@@ -169,7 +298,7 @@ void LRNLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     CrossChannelBackward_cpu(top, propagate_down, bottom);
     break;
   case LRNParameter_NormRegion_WITHIN_CHANNEL:
-    WithinChannelBackward(top, propagate_down, bottom);
+    WithinChannelBackward_cpu(top, propagate_down, bottom);
     break;
   default:
     LOG(FATAL) << "Unknown normalization region.";
@@ -183,6 +312,10 @@ void LRNLayer<Dtype>::CrossChannelBackward_cpu(
   const Dtype* top_diff = top[0]->cpu_diff();
   const Dtype* top_data = top[0]->cpu_data();
   const Dtype* bottom_data = bottom[0]->cpu_data();
+  if (!cpu_scale()) {
+    // Forward kept no scale, so compute it again.
+    cross_channel_cpu(bottom_data, NULL, scale_.mutable_cpu_data());
+  }
   const Dtype* scale_data = scale_.cpu_data();
   Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
   Blob<Dtype> padded_ratio(1, channels_ + size_ - 1, height_, width_);
@@ -246,6 +379,55 @@ void LRNLayer<Dtype>::WithinChannelBackward(
   }
 }
 
+template <typename Dtype>
+void LRNLayer<Dtype>::WithinChannelBackward_cpu(
+    const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+    const vector<Blob<Dtype>*>& bottom) {
+  if (!propagate_down[0]) {
+    return;
+  }
+  const Dtype* top_diff = top[0]->cpu_diff();
+  const Dtype* top_data = top[0]->cpu_data();
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+  const int spatial_dim = height_ * width_;
+  const Dtype alpha_over_area = alpha_ / (size_ * size_);
+  const Dtype cache_ratio_value = 2 * alpha_over_area * beta_;
+#ifdef _OPENMP
+  #pragma omp parallel if (bottom[0]->count() >= kParallelMinInputs)
+#endif
+  {
+    // The scale and ratios of a plane and the row sums they take, for each
+    // thread.
+    vector<Dtype> scale(spatial_dim);
+    vector<Dtype> ratio(spatial_dim);
+    vector<Dtype> buffer(spatial_dim);
+#ifdef _OPENMP
+    #pragma omp for
+#endif
+    for (int i = 0; i < num_ * channels_; ++i) {
+      const int offset = i * spatial_dim;
+      const Dtype* x = bottom_data + offset;
+      for (int j = 0; j < spatial_dim; ++j) {
+        scale[j] = x[j] * x[j];
+      }
+      within_channel_sum_cpu(&scale[0], &buffer[0], &scale[0]);
+      for (int j = 0; j < spatial_dim; ++j) {
+        scale[j] = 1 + alpha_over_area * scale[j];
+        ratio[j] = top_diff[offset + j] * top_data[offset + j] / scale[j];
+      }
+      // The windows are symmetric, so the outputs whose windows hold a value
+      // are those in its own window, and the same sums gather their ratios.
+      within_channel_sum_cpu(&ratio[0], &buffer[0], &ratio[0]);
+      lrn_normalize(spatial_dim, top_diff + offset, &scale[0], beta_,
+          bottom_diff + offset);
+      for (int j = 0; j < spatial_dim; ++j) {
+        bottom_diff[offset + j] -= cache_ratio_value * x[j] * ratio[j];
+      }
+    }
+  }
+}
+
 #ifdef CPU_ONLY
 STUB_GPU(LRNLayer);
 STUB_GPU_FORWARD(LRNLayer, CrossChannelForward);
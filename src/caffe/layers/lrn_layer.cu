@@ -83,6 +83,25 @@ void LRNLayer<Dtype>::CrossChannelForward_gpu(
   const Dtype* bottom_data = bottom[0]->gpu_data();
   Dtype* top_data = top[0]->mutable_gpu_data();
   Dtype* scale_data = scale_.mutable_gpu_data();
+  if (this->inference_only()) {
+    // scale_ only holds one image: compute the images one after another.
+    const int image_count = channels_ * height_ * width_;
+    for (int n = 0; n < num_; ++n) {
+      int n_threads = height_ * width_;
+      // NOLINT_NEXT_LINE(whitespace/operators)
+      LRNFillScale<<<CAFFE_GET_BLOCKS(n_threads), CAFFE_CUDA_NUM_THREADS>>>(
+          n_threads, bottom_data + bottom[0]->offset(n), 1, channels_,
+          height_, width_, size_, alpha_ / size_, k_, scale_data);
+      CUDA_POST_KERNEL_CHECK;
+      n_threads = image_count;
+      // NOLINT_NEXT_LINE(whitespace/operators)
+      LRNComputeOutput<<<CAFFE_GET_BLOCKS(n_threads), CAFFE_CUDA_NUM_THREADS>>>(
+          n_threads, bottom_data + bottom[0]->offset(n), scale_data, -beta_,
+          top_data + top[0]->offset(n));
+      CUDA_POST_KERNEL_CHECK;
+    }
+    return;
+  }
   // We will launch one kernel for each pixel location, and have the kernel
   // go through all the channels.
   int n_threads = num_ * height_ * width_;
@@ -35,9 +35,17 @@ void PoolingLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       || (!pool_param.has_stride_h() && !pool_param.has_stride_w()))
       << "Stride is stride OR stride_h and stride_w are required.";
   global_pooling_ = pool_param.global_pooling();
+  if (channels_last()) {
+    CHECK_EQ(4, bottom[0]->num_axes()) << "Channels-last pooling takes "
+        << "(num, height, width, channels) inputs.";
+    CHECK_EQ(top.size(), 1) << "Channels-last pooling outputs no mask.";
+    CHECK(pool_param.pool() == PoolingParameter_PoolMethod_MAX ||
+          pool_param.pool() == PoolingParameter_PoolMethod_AVE)
+        << "Channels-last pooling supports MAX and AVE only.";
+  }
   if (global_pooling_) {
-    kernel_h_ = bottom[0]->height();
-    kernel_w_ = bottom[0]->width();
+    kernel_h_ = bottom[0]->shape(channels_last() ? 1 : 2);
+    kernel_w_ = bottom[0]->shape(channels_last() ? 2 : 3);
   } else {
     if (pool_param.has_kernel_size()) {
       kernel_h_ = kernel_w_ = pool_param.kernel_size();
@@ -80,12 +88,18 @@ void PoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   CHECK_EQ(4, bottom[0]->num_axes()) << "Input must have 4 axes, "
       << "corresponding to (num, channels, height, width)";
-  channels_ = bottom[0]->channels();
-  height_ = bottom[0]->height();
-  width_ = bottom[0]->width();
+  if (channels_last()) {
+    height_ = bottom[0]->shape(1);
+    width_ = bottom[0]->shape(2);
+    channels_ = bottom[0]->shape(3);
+  } else {
+    channels_ = bottom[0]->channels();
+    height_ = bottom[0]->height();
+    width_ = bottom[0]->width();
+  }
   if (global_pooling_) {
-    kernel_h_ = bottom[0]->height();
-    kernel_w_ = bottom[0]->width();
+    kernel_h_ = height_;
+    kernel_w_ = width_;
   }
   pooled_height_ = static_cast<int>(ceil(static_cast<float>(
       height_ + 2 * pad_h_ - kernel_h_) / stride_h_)) + 1;
@@ -103,16 +117,27 @@ void PoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     CHECK_LT((pooled_height_ - 1) * stride_h_, height_ + pad_h_);
     CHECK_LT((pooled_width_ - 1) * stride_w_, width_ + pad_w_);
   }
+  if (channels_last()) {
+    // Forward only, so max pooling needs no mask.
+    top[0]->Reshape(bottom[0]->num(), pooled_height_, pooled_width_,
+        channels_);
+    return;
+  }
   top[0]->Reshape(bottom[0]->num(), channels_, pooled_height_,
       pooled_width_);
   if (top.size() > 1) {
     top[1]->ReshapeLike(*top[0]);
   }
-  // If max pooling, we will initialize the vector index part.
+  // If max pooling, we will initialize the vector index part. It is only
+  // needed by Backward, so inference-only layers go without.
   if (this->layer_param_.pooling_param().pool() ==
       PoolingParameter_PoolMethod_MAX && top.size() == 1) {
-    max_idx_.Reshape(bottom[0]->num(), channels_, pooled_height_,
-        pooled_width_);
+    if (this->inference_only()) {
+      this->inference_saved_bytes_ = top[0]->count() * sizeof(int);
+    } else {
+      max_idx_.Reshape(bottom[0]->num(), channels_, pooled_height_,
+          pooled_width_);
+    }
   }
   // If stochastic pooling, we will initialize the random index part.
   if (this->layer_param_.pooling_param().pool() ==
@@ -122,14 +147,233 @@ void PoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
-// TODO(Yangqing): Is there a faster way to do pooling in the channel-first
-// case?
+template <typename Dtype>
+void PoolingLayer<Dtype>::forward_cpu_channels_last(const Dtype* bottom_data,
+    const int num, Dtype* top_data) {
+  const bool max_pool = this->layer_param_.pooling_param().pool() ==
+      PoolingParameter_PoolMethod_MAX;
+  for (int n = 0; n < num; ++n) {
+    for (int ph = 0; ph < pooled_height_; ++ph) {
+      for (int pw = 0; pw < pooled_width_; ++pw) {
+        int hstart = ph * stride_h_ - pad_h_;
+        int wstart = pw * stride_w_ - pad_w_;
+        int hend = min(hstart + kernel_h_, height_ + pad_h_);
+        int wend = min(wstart + kernel_w_, width_ + pad_w_);
+        const int pool_size = (hend - hstart) * (wend - wstart);
+        hstart = max(hstart, 0);
+        wstart = max(wstart, 0);
+        hend = min(hend, height_);
+        wend = min(wend, width_);
+        Dtype* out = top_data +
+            ((n * pooled_height_ + ph) * pooled_width_ + pw) * channels_;
+        std::fill(out, out + channels_, max_pool ? Dtype(-FLT_MAX) : Dtype(0));
+        // The channels of a pixel are contiguous, so each window position
+        // updates all the outputs of the window at once.
+        for (int h = hstart; h < hend; ++h) {
+          for (int w = wstart; w < wend; ++w) {
+            const Dtype* in = bottom_data +
+                ((n * height_ + h) * width_ + w) * channels_;
+            if (max_pool) {
+              for (int c = 0; c < channels_; ++c) {
+                out[c] = in[c] > out[c] ? in[c] : out[c];
+              }
+            } else {
+              for (int c = 0; c < channels_; ++c) {
+                out[c] += in[c];
+              }
+            }
+          }
+        }
+        if (!max_pool) {
+          caffe_scal(channels_, Dtype(1) / pool_size, out);
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+static inline Dtype max_value(const Dtype a, const Dtype b) {
+  return a > b ? a : b;
+}
+
+template <typename Dtype>
+Dtype PoolingLayer<Dtype>::max_pool_window(const Dtype* bottom_data,
+    const int ph, const int pw, int* index) const {
+  const int hstart = max(ph * stride_h_ - pad_h_, 0);
+  const int wstart = max(pw * stride_w_ - pad_w_, 0);
+  const int hend = min(ph * stride_h_ - pad_h_ + kernel_h_, height_);
+  const int wend = min(pw * stride_w_ - pad_w_ + kernel_w_, width_);
+  Dtype value = -FLT_MAX;
+  int max_index = -1;
+  // Selecting rather than branching keeps unpredictable comparisons cheap.
+  for (int h = hstart; h < hend; ++h) {
+    for (int w = wstart; w < wend; ++w) {
+      const Dtype x = bottom_data[h * width_ + w];
+      const bool greater = x > value;
+      value = greater ? x : value;
+      max_index = greater ? h * width_ + w : max_index;
+    }
+  }
+  *index = max_index;
+  return value;
+}
+
+template <typename Dtype>
+Dtype PoolingLayer<Dtype>::ave_pool_window(const Dtype* bottom_data,
+    const int ph, const int pw) const {
+  int hstart = ph * stride_h_ - pad_h_;
+  int wstart = pw * stride_w_ - pad_w_;
+  int hend = min(hstart + kernel_h_, height_ + pad_h_);
+  int wend = min(wstart + kernel_w_, width_ + pad_w_);
+  const int pool_size = (hend - hstart) * (wend - wstart);
+  hstart = max(hstart, 0);
+  wstart = max(wstart, 0);
+  hend = min(hend, height_);
+  wend = min(wend, width_);
+  Dtype sum = 0;
+  for (int h = hstart; h < hend; ++h) {
+    for (int w = wstart; w < wend; ++w) {
+      sum += bottom_data[h * width_ + w];
+    }
+  }
+  return sum / pool_size;
+}
+
+template <typename Dtype>
+template <typename Mask>
+void PoolingLayer<Dtype>::max_pool_cpu(const Dtype* bottom_data,
+    Dtype* top_data, Mask* mask) const {
+  if (global_pooling_ && !mask) {
+    const int count = height_ * width_;
+    Dtype value = -FLT_MAX;
+#ifdef _OPENMP
+    #pragma omp simd reduction(max : value)
+#endif
+    for (int i = 0; i < count; ++i) {
+      value = max_value(bottom_data[i], value);
+    }
+    top_data[0] = value;
+    return;
+  }
+  // The outputs [0, full_h) x [0, full_w) have whole windows, which the
+  // strided window path pools a row at a time.
+  int full_h = 0;
+  int full_w = 0;
+  if (!mask && strided_window() && height_ >= kernel_h_ &&
+      width_ >= kernel_w_) {
+    full_h = (height_ - kernel_h_) / 2 + 1;
+    full_w = (width_ - kernel_w_) / 2 + 1;
+    for (int ph = 0; ph < full_h; ++ph) {
+      const Dtype* row0 = bottom_data + 2 * ph * width_;
+      const Dtype* row1 = row0 + width_;
+      const Dtype* row2 = row1 + width_;
+      Dtype* out = top_data + ph * pooled_width_;
+      if (kernel_h_ == 2) {
+#ifdef _OPENMP
+        #pragma omp simd
+#endif
+        for (int pw = 0; pw < full_w; ++pw) {
+          out[pw] = max_value(
+              max_value(row0[2 * pw], row0[2 * pw + 1]),
+              max_value(row1[2 * pw], row1[2 * pw + 1]));
+        }
+      } else {
+#ifdef _OPENMP
+        #pragma omp simd
+#endif
+        for (int pw = 0; pw < full_w; ++pw) {
+          const Dtype m0 = max_value(max_value(row0[2 * pw],
+              row0[2 * pw + 1]), row0[2 * pw + 2]);
+          const Dtype m1 = max_value(max_value(row1[2 * pw],
+              row1[2 * pw + 1]), row1[2 * pw + 2]);
+          const Dtype m2 = max_value(max_value(row2[2 * pw],
+              row2[2 * pw + 1]), row2[2 * pw + 2]);
+          out[pw] = max_value(max_value(m0, m1), m2);
+        }
+      }
+    }
+  }
+  for (int ph = 0; ph < pooled_height_; ++ph) {
+    for (int pw = ph < full_h ? full_w : 0; pw < pooled_width_; ++pw) {
+      const int pool_index = ph * pooled_width_ + pw;
+      int index;
+      top_data[pool_index] = max_pool_window(bottom_data, ph, pw, &index);
+      if (mask) {
+        mask[pool_index] = index;
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void PoolingLayer<Dtype>::ave_pool_cpu(const Dtype* bottom_data,
+    Dtype* top_data) const {
+  if (global_pooling_) {
+    const int count = height_ * width_;
+    Dtype sum = 0;
+#ifdef _OPENMP
+    #pragma omp simd reduction(+ : sum)
+#endif
+    for (int i = 0; i < count; ++i) {
+      sum += bottom_data[i];
+    }
+    top_data[0] = sum / count;
+    return;
+  }
+  int full_h = 0;
+  int full_w = 0;
+  if (strided_window() && height_ >= kernel_h_ && width_ >= kernel_w_) {
+    full_h = (height_ - kernel_h_) / 2 + 1;
+    full_w = (width_ - kernel_w_) / 2 + 1;
+    const Dtype pool_size = kernel_h_ * kernel_w_;
+    for (int ph = 0; ph < full_h; ++ph) {
+      const Dtype* row0 = bottom_data + 2 * ph * width_;
+      const Dtype* row1 = row0 + width_;
+      const Dtype* row2 = row1 + width_;
+      Dtype* out = top_data + ph * pooled_width_;
+      if (kernel_h_ == 2) {
+#ifdef _OPENMP
+        #pragma omp simd
+#endif
+        for (int pw = 0; pw < full_w; ++pw) {
+          out[pw] = (row0[2 * pw] + row0[2 * pw + 1] +
+              row1[2 * pw] + row1[2 * pw + 1]) / pool_size;
+        }
+      } else {
+#ifdef _OPENMP
+        #pragma omp simd
+#endif
+        for (int pw = 0; pw < full_w; ++pw) {
+          out[pw] = (row0[2 * pw] + row0[2 * pw + 1] + row0[2 * pw + 2] +
+              row1[2 * pw] + row1[2 * pw + 1] + row1[2 * pw + 2] +
+              row2[2 * pw] + row2[2 * pw + 1] + row2[2 * pw + 2]) /
+              pool_size;
+        }
+      }
+    }
+  }
+  for (int ph = 0; ph < pooled_height_; ++ph) {
+    for (int pw = ph < full_h ? full_w : 0; pw < pooled_width_; ++pw) {
+      top_data[ph * pooled_width_ + pw] =
+          ave_pool_window(bottom_data, ph, pw);
+    }
+  }
+}
+
 template <typename Dtype>
 void PoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  const int top_count = top[0]->count();
+  if (channels_last()) {
+    forward_cpu_channels_last(bottom_data, bottom[0]->num(), top_data);
+    return;
+  }
+  // Each channel of each image pools independently.
+  const int planes = bottom[0]->num() * channels_;
+  const int bottom_plane = height_ * width_;
+  const int top_plane = pooled_height_ * pooled_width_;
   // We'll output the mask to top[1] if it's of size >1.
   const bool use_top_mask = top.size() > 1;
   int* mask = NULL;  // suppress warnings about uninitalized variables
@@ -138,84 +382,30 @@ void PoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   // loop to save time, although this results in more code.
   switch (this->layer_param_.pooling_param().pool()) {
   case PoolingParameter_PoolMethod_MAX:
-    // Initialize
     if (use_top_mask) {
       top_mask = top[1]->mutable_cpu_data();
-      caffe_set(top_count, Dtype(-1), top_mask);
-    } else {
+    } else if (cpu_max_idx()) {
       mask = max_idx_.mutable_cpu_data();
-      caffe_set(top_count, -1, mask);
     }
-    caffe_set(top_count, Dtype(-FLT_MAX), top_data);
-    // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_);
-            int wend = min(wstart + kernel_w_, width_);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            const int pool_index = ph * pooled_width_ + pw;
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                const int index = h * width_ + w;
-                if (bottom_data[index] > top_data[pool_index]) {
-                  top_data[pool_index] = bottom_data[index];
-                  if (use_top_mask) {
-                    top_mask[pool_index] = static_cast<Dtype>(index);
-                  } else {
-                    mask[pool_index] = index;
-                  }
-                }
-              }
-            }
-          }
-        }
-        // compute offset
-        bottom_data += bottom[0]->offset(0, 1);
-        top_data += top[0]->offset(0, 1);
-        if (use_top_mask) {
-          top_mask += top[0]->offset(0, 1);
-        } else {
-          mask += top[0]->offset(0, 1);
-        }
+#ifdef _OPENMP
+    #pragma omp parallel for if (bottom[0]->count() >= kParallelMinInputs)
+#endif
+    for (int i = 0; i < planes; ++i) {
+      if (use_top_mask) {
+        max_pool_cpu(bottom_data + i * bottom_plane, top_data + i * top_plane,
+            top_mask + i * top_plane);
+      } else {
+        max_pool_cpu(bottom_data + i * bottom_plane, top_data + i * top_plane,
+            mask ? mask + i * top_plane : NULL);
       }
     }
     break;
   case PoolingParameter_PoolMethod_AVE:
-    for (int i = 0; i < top_count; ++i) {
-      top_data[i] = 0;
-    }
-    // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_ + pad_h_);
-            int wend = min(wstart + kernel_w_, width_ + pad_w_);
-            int pool_size = (hend - hstart) * (wend - wstart);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            hend = min(hend, height_);
-            wend = min(wend, width_);
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                top_data[ph * pooled_width_ + pw] +=
-                    bottom_data[h * width_ + w];
-              }
-            }
-            top_data[ph * pooled_width_ + pw] /= pool_size;
-          }
-        }
-        // compute offset
-        bottom_data += bottom[0]->offset(0, 1);
-        top_data += top[0]->offset(0, 1);
-      }
+#ifdef _OPENMP
+    #pragma omp parallel for if (bottom[0]->count() >= kParallelMinInputs)
+#endif
+    for (int i = 0; i < planes; ++i) {
+      ave_pool_cpu(bottom_data + i * bottom_plane, top_data + i * top_plane);
     }
     break;
   case PoolingParameter_PoolMethod_STOCHASTIC:
@@ -229,6 +419,7 @@ void PoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void PoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  CHECK(!channels_last()) << "Channels-last pooling only runs forward.";
   if (!propagate_down[0]) {
     return;
   }
@@ -241,21 +432,31 @@ void PoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   const bool use_top_mask = top.size() > 1;
   const int* mask = NULL;  // suppress warnings about uninitialized variables
   const Dtype* top_mask = NULL;
+  const Dtype* bottom_data = NULL;
   switch (this->layer_param_.pooling_param().pool()) {
   case PoolingParameter_PoolMethod_MAX:
     // The main loop
     if (use_top_mask) {
       top_mask = top[1]->cpu_data();
-    } else {
+    } else if (cpu_max_idx()) {
       mask = max_idx_.cpu_data();
+    } else {
+      // Forward kept no mask, so find the maxima again.
+      bottom_data = bottom[0]->cpu_data();
     }
     for (int n = 0; n < top[0]->num(); ++n) {
       for (int c = 0; c < channels_; ++c) {
         for (int ph = 0; ph < pooled_height_; ++ph) {
           for (int pw = 0; pw < pooled_width_; ++pw) {
             const int index = ph * pooled_width_ + pw;
-            const int bottom_index =
-                use_top_mask ? top_mask[index] : mask[index];
+            int bottom_index;
+            if (use_top_mask) {
+              bottom_index = top_mask[index];
+            } else if (mask) {
+              bottom_index = mask[index];
+            } else {
+              max_pool_window(bottom_data, ph, pw, &bottom_index);
+            }
             bottom_diff[bottom_index] += top_diff[index];
           }
         }
@@ -263,8 +464,10 @@ void PoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
         top_diff += top[0]->offset(0, 1);
         if (use_top_mask) {
           top_mask += top[0]->offset(0, 1);
-        } else {
+        } else if (mask) {
           mask += top[0]->offset(0, 1);
+        } else {
+          bottom_data += bottom[0]->offset(0, 1);
         }
       }
     }
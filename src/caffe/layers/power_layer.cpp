@@ -17,78 +17,93 @@ void PowerLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
 
 // Compute y = (shift + scale * x)^power
 template <typename Dtype>
-void PowerLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
-    const vector<Blob<Dtype>*>& top) {
-  Dtype* top_data = top[0]->mutable_cpu_data();
-  const int count = bottom[0]->count();
+void PowerLayer<Dtype>::ForwardElements(const Dtype* const* bottom_data,
+    Dtype* top_data, const int begin, const int end) const {
   // Special case where we can ignore the input: scale or power is 0.
   if (diff_scale_ == Dtype(0)) {
     Dtype value = (power_ == 0) ? Dtype(1) : pow(shift_, power_);
-    caffe_set(count, value, top_data);
+    for (int i = begin; i < end; ++i) {
+      top_data[i] = value;
+    }
     return;
   }
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  caffe_copy(count, bottom_data, top_data);
-  if (scale_ != Dtype(1)) {
-    caffe_scal(count, scale_, top_data);
-  }
-  if (shift_ != Dtype(0)) {
-    caffe_add_scalar(count, shift_, top_data);
+  const Dtype* x = bottom_data[0];
+  if (power_ == Dtype(1)) {
+#ifdef _OPENMP
+    #pragma omp simd
+#endif
+    for (int i = begin; i < end; ++i) {
+      top_data[i] = scale_ * x[i] + shift_;
+    }
+  } else if (power_ == Dtype(2)) {
+#ifdef _OPENMP
+    #pragma omp simd
+#endif
+    for (int i = begin; i < end; ++i) {
+      const Dtype value = scale_ * x[i] + shift_;
+      top_data[i] = value * value;
+    }
+  } else {
+    for (int i = begin; i < end; ++i) {
+      top_data[i] = pow(scale_ * x[i] + shift_, power_);
+    }
   }
-  if (power_ != Dtype(1)) {
-    caffe_powx(count, top_data, power_, top_data);
+}
+
+template <typename Dtype>
+void PowerLayer<Dtype>::BackwardElements(const Dtype* top_data,
+    const Dtype* top_diff, const Dtype* bottom_data, Dtype* bottom_diff,
+    const int begin, const int end) const {
+  if (diff_scale_ == Dtype(0)) {
+    for (int i = begin; i < end; ++i) {
+      bottom_diff[i] = 0;
+    }
+  } else if (power_ == Dtype(1)) {
+    for (int i = begin; i < end; ++i) {
+      bottom_diff[i] = diff_scale_ * top_diff[i];
+    }
+  } else if (power_ == Dtype(2)) {
+    // Special case for y = (shift + scale * x)^2
+    //     -> dy/dx = 2 * scale * (shift + scale * x)
+    //              = diff_scale * shift + diff_scale * scale * x
+    for (int i = begin; i < end; ++i) {
+      bottom_diff[i] = top_diff[i] *
+          (diff_scale_ * scale_ * bottom_data[i] + diff_scale_ * shift_);
+    }
+  } else if (shift_ == Dtype(0)) {
+    // Special case for y = (scale * x)^power
+    //     -> dy/dx = scale * power * (scale * x)^(power - 1)
+    //              = scale * power * (scale * x)^power * (scale * x)^(-1)
+    //              = power * y / x
+    for (int i = begin; i < end; ++i) {
+      bottom_diff[i] = top_diff[i] * (top_data[i] / bottom_data[i] * power_);
+    }
+  } else {
+    // Compute dy/dx = scale * power * (shift + scale * x)^(power - 1)
+    //               = diff_scale * y / (shift + scale * x)
+    for (int i = begin; i < end; ++i) {
+      bottom_diff[i] = top_diff[i] * (top_data[i] /
+          (scale_ * bottom_data[i] + shift_) * diff_scale_);
+    }
   }
 }
 
+template <typename Dtype>
+void PowerLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  ForwardElements(&bottom_data, top[0]->mutable_cpu_data(), 0,
+      bottom[0]->count());
+}
+
 template <typename Dtype>
 void PowerLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
   if (propagate_down[0]) {
-    Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-    const int count = bottom[0]->count();
-    const Dtype* top_diff = top[0]->cpu_diff();
-    if (diff_scale_ == Dtype(0) || power_ == Dtype(1)) {
-      caffe_set(count, diff_scale_, bottom_diff);
-    } else {
-      const Dtype* bottom_data = bottom[0]->cpu_data();
-      // Compute dy/dx = scale * power * (shift + scale * x)^(power - 1)
-      //               = diff_scale * y / (shift + scale * x)
-      if (power_ == Dtype(2)) {
-        // Special case for y = (shift + scale * x)^2
-        //     -> dy/dx = 2 * scale * (shift + scale * x)
-        //              = diff_scale * shift + diff_scale * scale * x
-        caffe_cpu_axpby(count, diff_scale_ * scale_, bottom_data,
-            Dtype(0), bottom_diff);
-        if (shift_ != Dtype(0)) {
-          caffe_add_scalar(count, diff_scale_ * shift_, bottom_diff);
-        }
-      } else if (shift_ == Dtype(0)) {
-        // Special case for y = (scale * x)^power
-        //     -> dy/dx = scale * power * (scale * x)^(power - 1)
-        //              = scale * power * (scale * x)^power * (scale * x)^(-1)
-        //              = power * y / x
-        const Dtype* top_data = top[0]->cpu_data();
-        caffe_div(count, top_data, bottom_data, bottom_diff);
-        caffe_scal(count, power_, bottom_diff);
-      } else {
-        caffe_copy(count, bottom_data, bottom_diff);
-        if (scale_ != Dtype(1)) {
-          caffe_scal(count, scale_, bottom_diff);
-        }
-        if (shift_ != Dtype(0)) {
-          caffe_add_scalar(count, shift_, bottom_diff);
-        }
-        const Dtype* top_data = top[0]->cpu_data();
-        caffe_div<Dtype>(count, top_data, bottom_diff, bottom_diff);
-        if (diff_scale_ != Dtype(1)) {
-          caffe_scal(count, diff_scale_, bottom_diff);
-        }
-      }
-    }
-    if (diff_scale_ != Dtype(0)) {
-      caffe_mul(count, top_diff, bottom_diff, bottom_diff);
-    }
+    BackwardElements(top[0]->cpu_data(), top[0]->cpu_diff(),
+        bottom[0]->cpu_data(), bottom[0]->mutable_cpu_diff(), 0,
+        bottom[0]->count());
   }
 }
 
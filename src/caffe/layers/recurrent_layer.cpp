@@ -93,8 +93,16 @@ void RecurrentLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   // Add "pseudo-losses" to all outputs to force backpropagation.
   // (Setting force_backward is too aggressive as we may not need to backprop to
   // all inputs, e.g., the sequence continuation indicators.)
-  vector<string> pseudo_losses(output_names.size());
-  for (int i = 0; i < output_names.size(); ++i) {
+  // Inference-only layers unroll into an inference-only net instead, which
+  // never backpropagates.
+  vector<string> pseudo_losses;
+  if (this->inference_only()) {
+    net_param.set_inference_only(true);
+    net_param.mutable_state()->set_phase(TEST);
+  } else {
+    pseudo_losses.resize(output_names.size());
+  }
+  for (int i = 0; i < pseudo_losses.size(); ++i) {
     LayerParameter* layer = net_param.add_layer();
     pseudo_losses[i] = output_names[i] + "_pseudoloss";
     layer->set_name(pseudo_losses[i]);
@@ -153,8 +161,10 @@ void RecurrentLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     }
   }
   // Check that param_propagate_down is set for all of the parameters in the
-  // unrolled net; set param_propagate_down to true in this layer.
-  for (int i = 0; i < unrolled_net_->layers().size(); ++i) {
+  // unrolled net, unless it is inference only; set param_propagate_down to
+  // true in this layer.
+  for (int i = 0; i < unrolled_net_->layers().size() &&
+       !this->inference_only(); ++i) {
     for (int j = 0; j < unrolled_net_->layers()[i]->blobs().size(); ++j) {
       CHECK(unrolled_net_->layers()[i]->param_propagate_down(j))
           << "param_propagate_down not set for layer " << i << ", param " << j;
@@ -164,10 +174,12 @@ void RecurrentLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   this->param_propagate_down_.resize(this->blobs_.size(), true);
 
   // Set the diffs of recurrent outputs to 0 -- we can't backpropagate across
-  // batches.
-  for (int i = 0; i < recur_output_blobs_.size(); ++i) {
-    caffe_set(recur_output_blobs_[i]->count(), Dtype(0),
-              recur_output_blobs_[i]->mutable_cpu_diff());
+  // batches. Inference-only layers never backpropagate and need no diffs.
+  if (!this->inference_only()) {
+    for (int i = 0; i < recur_output_blobs_.size(); ++i) {
+      caffe_set(recur_output_blobs_[i]->count(), Dtype(0),
+                recur_output_blobs_[i]->mutable_cpu_diff());
+    }
   }
 
   // Check that the last output_names.size() layers are the pseudo-losses;
@@ -0,0 +1,310 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+#include "caffe/filler.hpp"
+#include "caffe/layers/sampled_softmax_loss_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/softmax.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void SampledSoftmaxLossLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  LossLayer<Dtype>::LayerSetUp(bottom, top);
+  const SampledSoftmaxParameter& param =
+      this->layer_param_.sampled_softmax_param();
+  N_ = param.num_output();
+  CHECK_GT(N_, 0) << "SampledSoftmaxLossLayer num_output must be positive.";
+  num_sampled_ = param.num_sampled();
+  CHECK_GT(num_sampled_, 0)
+      << "SampledSoftmaxLossLayer num_sampled must be positive.";
+  bias_term_ = param.bias_term();
+  const int axis = bottom[0]->CanonicalAxisIndex(param.axis());
+  K_ = bottom[0]->count(axis);
+  has_ignore_label_ = this->layer_param_.loss_param().has_ignore_label();
+  if (has_ignore_label_) {
+    ignore_label_ = this->layer_param_.loss_param().ignore_label();
+  }
+  normalization_ = this->normalization_mode();
+  // Check if we need to set up the weights
+  if (this->blobs_.size() > 0) {
+    LOG(INFO) << "Skipping parameter initialization";
+  } else {
+    if (bias_term_) {
+      this->blobs_.resize(2);
+    } else {
+      this->blobs_.resize(1);
+    }
+    // Initialize the weights, laid out as those of InnerProductLayer
+    vector<int> weight_shape(2);
+    weight_shape[0] = N_;
+    weight_shape[1] = K_;
+    this->blobs_[0].reset(new Blob<Dtype>(weight_shape));
+    shared_ptr<Filler<Dtype> > weight_filler(
+        GetFiller<Dtype>(param.weight_filler()));
+    weight_filler->Fill(this->blobs_[0].get());
+    if (bias_term_) {
+      vector<int> bias_shape(1, N_);
+      this->blobs_[1].reset(new Blob<Dtype>(bias_shape));
+      shared_ptr<Filler<Dtype> > bias_filler(
+          GetFiller<Dtype>(param.bias_filler()));
+      bias_filler->Fill(this->blobs_[1].get());
+    }
+  }  // parameter initialization
+  this->param_propagate_down_.resize(this->blobs_.size(), true);
+}
+
+template <typename Dtype>
+void SampledSoftmaxLossLayer<Dtype>::Reshape(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  LossLayer<Dtype>::Reshape(bottom, top);
+  const int axis = bottom[0]->CanonicalAxisIndex(
+      this->layer_param_.sampled_softmax_param().axis());
+  CHECK_EQ(K_, bottom[0]->count(axis))
+      << "Input size incompatible with sampled softmax parameters.";
+  M_ = bottom[0]->count(0, axis);
+  CHECK_EQ(M_, bottom[1]->count())
+      << "SampledSoftmaxLossLayer needs one label per example.";
+  sampled_ = this->phase_ == TRAIN;
+  vector<int> logits_shape(2, M_);
+  logits_shape[1] = sampled_ ? num_sampled_ + 1 : N_;
+  logits_.Reshape(logits_shape);
+  vector<int> log_sum_exp_shape(1, M_);
+  log_sum_exp_.Reshape(log_sum_exp_shape);
+  if (sampled_) {
+    vector<int> sample_shape(2, num_sampled_);
+    sample_shape[1] = K_;
+    sample_weight_.Reshape(sample_shape);
+    sample_shape[0] = M_;
+    sample_shape[1] = num_sampled_;
+    sample_logits_.Reshape(sample_shape);
+  }
+}
+
+template <typename Dtype>
+Dtype SampledSoftmaxLossLayer<Dtype>::LogExpectedCount(const int k) const {
+  switch (this->layer_param_.sampled_softmax_param().sampler()) {
+  case SampledSoftmaxParameter_Sampler_UNIFORM:
+    return log(Dtype(num_sampled_) / N_);
+  case SampledSoftmaxParameter_Sampler_LOG_UNIFORM:
+    return log(num_sampled_ * (log((k + 2.) / (k + 1.)) / log(N_ + 1.)));
+  default:
+    LOG(FATAL) << "Unknown sampler.";
+  }
+  return 0;
+}
+
+template <typename Dtype>
+void SampledSoftmaxLossLayer<Dtype>::Sample() {
+  samples_.resize(num_sampled_);
+  sample_log_counts_.resize(num_sampled_);
+  if (this->layer_param_.sampled_softmax_param().sampler() ==
+      SampledSoftmaxParameter_Sampler_UNIFORM) {
+    for (int s = 0; s < num_sampled_; ++s) {
+      samples_[s] = caffe_rng_rand() % N_;
+    }
+  } else {
+    // k = exp(u log(N + 1)) - 1, rounded down, for u uniform in [0, 1).
+    vector<double> uniform(num_sampled_);
+    caffe_rng_uniform<double>(num_sampled_, 0, 1, &uniform[0]);
+    const double log_range = log(N_ + 1.);
+    for (int s = 0; s < num_sampled_; ++s) {
+      const int k = static_cast<int>(exp(uniform[s] * log_range)) - 1;
+      samples_[s] = std::min(std::max(k, 0), N_ - 1);
+    }
+  }
+  for (int s = 0; s < num_sampled_; ++s) {
+    sample_log_counts_[s] = LogExpectedCount(samples_[s]);
+  }
+}
+
+template <typename Dtype>
+void SampledSoftmaxLossLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  const Dtype* label = bottom[1]->cpu_data();
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  const Dtype* bias = bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  Dtype* logits = logits_.mutable_cpu_data();
+  const int columns = logits_.shape(1);
+  if (!sampled_) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, M_, N_, K_, (Dtype)1.,
+        bottom_data, weight, (Dtype)0., logits);
+    if (bias_term_) {
+      for (int m = 0; m < M_; ++m) {
+        caffe_axpy<Dtype>(N_, (Dtype)1., bias, logits + m * N_);
+      }
+    }
+  } else {
+    Sample();
+    // The logits over the samples, from their gathered weights.
+    Dtype* sample_weight = sample_weight_.mutable_cpu_data();
+    for (int s = 0; s < num_sampled_; ++s) {
+      caffe_copy(K_, weight + samples_[s] * K_, sample_weight + s * K_);
+    }
+    Dtype* sample_logits = sample_logits_.mutable_cpu_data();
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, M_, num_sampled_, K_,
+        (Dtype)1., bottom_data, sample_weight, (Dtype)0., sample_logits);
+    const bool remove_accidental_hits =
+        this->layer_param_.sampled_softmax_param().remove_accidental_hits();
+    for (int m = 0; m < M_; ++m) {
+      const int label_value = static_cast<int>(label[m]);
+      Dtype* row = logits + m * columns;
+      if (Ignored(label_value)) {
+        caffe_set(columns, Dtype(0), row);
+        continue;
+      }
+      DCHECK_GE(label_value, 0);
+      DCHECK_LT(label_value, N_);
+      row[0] = caffe_cpu_dot(K_, bottom_data + m * K_,
+          weight + label_value * K_) - LogExpectedCount(label_value);
+      if (bias_term_) {
+        row[0] += bias[label_value];
+      }
+      for (int s = 0; s < num_sampled_; ++s) {
+        row[s + 1] = sample_logits[m * num_sampled_ + s] -
+            sample_log_counts_[s];
+        if (bias_term_) {
+          row[s + 1] += bias[samples_[s]];
+        }
+        if (remove_accidental_hits && samples_[s] == label_value) {
+          row[s + 1] = -FLT_MAX;
+        }
+      }
+    }
+  }
+  Dtype* log_sum_exp = log_sum_exp_.mutable_cpu_data();
+  caffe_cpu_softmax(M_, columns, 1, logits, static_cast<Dtype*>(NULL),
+      log_sum_exp);
+  int count = 0;
+  Dtype loss = 0;
+  for (int m = 0; m < M_; ++m) {
+    const int label_value = static_cast<int>(label[m]);
+    if (Ignored(label_value)) {
+      continue;
+    }
+    const int column = sampled_ ? 0 : label_value;
+    loss -= std::max(logits[m * columns + column] - log_sum_exp[m],
+                     Dtype(log(FLT_MIN)));
+    ++count;
+  }
+  top[0]->mutable_cpu_data()[0] =
+      loss / this->GetNormalizer(normalization_, M_, 1, count);
+}
+
+template <typename Dtype>
+void SampledSoftmaxLossLayer<Dtype>::Backward_cpu(
+    const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+    const vector<Blob<Dtype>*>& bottom) {
+  if (propagate_down[1]) {
+    LOG(FATAL) << this->type()
+               << " Layer cannot backpropagate to label inputs.";
+  }
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  const Dtype* label = bottom[1]->cpu_data();
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  const int columns = logits_.shape(1);
+  // The gradient of the loss for the logits, (softmax - one hot label)
+  // scaled, from exp(logits - log_sum_exp).
+  const Dtype* logits = logits_.cpu_data();
+  const Dtype* log_sum_exp = log_sum_exp_.cpu_data();
+  Dtype* logits_diff = logits_.mutable_cpu_diff();
+  int count = 0;
+  for (int m = 0; m < M_; ++m) {
+    count += !Ignored(static_cast<int>(label[m]));
+  }
+  const Dtype scale = top[0]->cpu_diff()[0] /
+      this->GetNormalizer(normalization_, M_, 1, count);
+  for (int m = 0; m < M_; ++m) {
+    const int label_value = static_cast<int>(label[m]);
+    Dtype* row_diff = logits_diff + m * columns;
+    if (Ignored(label_value)) {
+      caffe_set(columns, Dtype(0), row_diff);
+      continue;
+    }
+    const Dtype* row = logits + m * columns;
+    for (int c = 0; c < columns; ++c) {
+      row_diff[c] = row[c] - log_sum_exp[m];
+    }
+    caffe_exp(columns, row_diff, row_diff);
+    row_diff[sampled_ ? 0 : label_value] -= 1;
+    caffe_scal(columns, scale, row_diff);
+  }
+  if (!sampled_) {
+    if (this->param_propagate_down_[0]) {
+      caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, N_, K_, M_, (Dtype)1.,
+          logits_diff, bottom_data, (Dtype)1.,
+          this->blobs_[0]->mutable_cpu_diff());
+    }
+    if (bias_term_ && this->param_propagate_down_[1]) {
+      for (int m = 0; m < M_; ++m) {
+        caffe_axpy<Dtype>(N_, (Dtype)1., logits_diff + m * N_,
+            this->blobs_[1]->mutable_cpu_diff());
+      }
+    }
+    if (propagate_down[0]) {
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, K_, N_, (Dtype)1.,
+          logits_diff, weight, (Dtype)0., bottom[0]->mutable_cpu_diff());
+    }
+    return;
+  }
+  // Sampled: the label's logit comes first, then those of the samples, whose
+  // gradient goes through their gathered weights.
+  Dtype* sample_logits_diff = sample_logits_.mutable_cpu_diff();
+  for (int m = 0; m < M_; ++m) {
+    caffe_copy(num_sampled_, logits_diff + m * columns + 1,
+        sample_logits_diff + m * num_sampled_);
+  }
+  if (this->param_propagate_down_[0]) {
+    Dtype* weight_diff = this->blobs_[0]->mutable_cpu_diff();
+    Dtype* sample_weight_diff = sample_weight_.mutable_cpu_diff();
+    caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, num_sampled_, K_, M_,
+        (Dtype)1., sample_logits_diff, bottom_data, (Dtype)0.,
+        sample_weight_diff);
+    for (int s = 0; s < num_sampled_; ++s) {
+      caffe_axpy<Dtype>(K_, (Dtype)1., sample_weight_diff + s * K_,
+          weight_diff + samples_[s] * K_);
+    }
+    for (int m = 0; m < M_; ++m) {
+      const int label_value = static_cast<int>(label[m]);
+      if (!Ignored(label_value)) {
+        caffe_axpy<Dtype>(K_, logits_diff[m * columns],
+            bottom_data + m * K_, weight_diff + label_value * K_);
+      }
+    }
+  }
+  if (bias_term_ && this->param_propagate_down_[1]) {
+    Dtype* bias_diff = this->blobs_[1]->mutable_cpu_diff();
+    for (int m = 0; m < M_; ++m) {
+      const int label_value = static_cast<int>(label[m]);
+      if (Ignored(label_value)) {
+        continue;
+      }
+      bias_diff[label_value] += logits_diff[m * columns];
+      for (int s = 0; s < num_sampled_; ++s) {
+        bias_diff[samples_[s]] += logits_diff[m * columns + s + 1];
+      }
+    }
+  }
+  if (propagate_down[0]) {
+    Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, K_, num_sampled_,
+        (Dtype)1., sample_logits_diff, sample_weight_.cpu_data(), (Dtype)0.,
+        bottom_diff);
+    for (int m = 0; m < M_; ++m) {
+      const int label_value = static_cast<int>(label[m]);
+      if (!Ignored(label_value)) {
+        caffe_axpy<Dtype>(K_, logits_diff[m * columns],
+            weight + label_value * K_, bottom_diff + m * K_);
+      }
+    }
+  }
+}
+
+INSTANTIATE_CLASS(SampledSoftmaxLossLayer);
+REGISTER_LAYER_CLASS(SampledSoftmaxLoss);
+
+}  // namespace caffe
@@ -128,12 +128,21 @@ void ScaleLayer<Dtype>::Forward_cpu(
   const Dtype* scale_data =
       ((bottom.size() > 1) ? bottom[1] : this->blobs_[0].get())->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  for (int n = 0; n < outer_dim_; ++n) {
-    for (int d = 0; d < scale_dim_; ++d) {
-      const Dtype factor = scale_data[d];
-      caffe_cpu_scale(inner_dim_, factor, bottom_data, top_data);
-      bottom_data += inner_dim_;
-      top_data += inner_dim_;
+  if (inner_dim_ == 1) {
+    // The scaled axis is the last one, e.g. the channels of NHWC blobs.
+    for (int n = 0; n < outer_dim_; ++n) {
+      caffe_mul(scale_dim_, bottom_data, scale_data, top_data);
+      bottom_data += scale_dim_;
+      top_data += scale_dim_;
+    }
+  } else {
+    for (int n = 0; n < outer_dim_; ++n) {
+      for (int d = 0; d < scale_dim_; ++d) {
+        const Dtype factor = scale_data[d];
+        caffe_cpu_scale(inner_dim_, factor, bottom_data, top_data);
+        bottom_data += inner_dim_;
+        top_data += inner_dim_;
+      }
     }
   }
   if (bias_layer_) {
@@ -141,6 +150,28 @@ void ScaleLayer<Dtype>::Forward_cpu(
   }
 }
 
+template <typename Dtype>
+void ScaleLayer<Dtype>::ForwardElements(const Dtype* const* bottom_data,
+    Dtype* top_data, const int begin, const int end) const {
+  const Dtype* x = bottom_data[0];
+  const Dtype* scale_data = this->blobs_[0]->cpu_data();
+  const Dtype* bias_data =
+      bias_layer_ ? this->blobs_[bias_param_id_]->cpu_data() : NULL;
+  // Each run of inner_dim_ values shares a factor and bias.
+  for (int run = begin / inner_dim_; run * inner_dim_ < end; ++run) {
+    const int run_begin = std::max(begin, run * inner_dim_);
+    const int run_end = std::min(end, (run + 1) * inner_dim_);
+    const Dtype factor = scale_data[run % scale_dim_];
+    const Dtype bias = bias_data ? bias_data[run % scale_dim_] : Dtype(0);
+#ifdef _OPENMP
+    #pragma omp simd
+#endif
+    for (int i = run_begin; i < run_end; ++i) {
+      top_data[i] = x[i] * factor + bias;
+    }
+  }
+}
+
 template <typename Dtype>
 void ScaleLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
@@ -4,6 +4,7 @@
 
 #include "caffe/layers/softmax_loss_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/softmax.hpp"
 
 namespace caffe {
 
@@ -13,6 +14,8 @@ void SoftmaxWithLossLayer<Dtype>::LayerSetUp(
   LossLayer<Dtype>::LayerSetUp(bottom, top);
   LayerParameter softmax_param(this->layer_param_);
   softmax_param.set_type("Softmax");
+  // The loss weights are for the tops of this layer, not the softmax.
+  softmax_param.clear_loss_weight();
   softmax_layer_ = LayerRegistry<Dtype>::CreateLayer(softmax_param);
   softmax_bottom_vec_.clear();
   softmax_bottom_vec_.push_back(bottom[0]);
@@ -25,14 +28,7 @@ void SoftmaxWithLossLayer<Dtype>::LayerSetUp(
   if (has_ignore_label_) {
     ignore_label_ = this->layer_param_.loss_param().ignore_label();
   }
-  if (!this->layer_param_.loss_param().has_normalization() &&
-      this->layer_param_.loss_param().has_normalize()) {
-    normalization_ = this->layer_param_.loss_param().normalize() ?
-                     LossParameter_NormalizationMode_VALID :
-                     LossParameter_NormalizationMode_BATCH_SIZE;
-  } else {
-    normalization_ = this->layer_param_.loss_param().normalization();
-  }
+  normalization_ = this->normalization_mode();
 }
 
 template <typename Dtype>
@@ -49,6 +45,9 @@ void SoftmaxWithLossLayer<Dtype>::Reshape(
       << "e.g., if softmax axis == 1 and prediction shape is (N, C, H, W), "
       << "label count (number of labels) must be N*H*W, "
       << "with integer values in {0, 1, ..., C-1}.";
+  vector<int> log_sum_exp_shape = bottom[0]->shape();
+  log_sum_exp_shape[softmax_axis_] = 1;
+  log_sum_exp_.Reshape(log_sum_exp_shape);
   if (top.size() >= 2) {
     // softmax output
     top[1]->ReshapeLike(*bottom[0]);
@@ -58,41 +57,30 @@ void SoftmaxWithLossLayer<Dtype>::Reshape(
 template <typename Dtype>
 Dtype SoftmaxWithLossLayer<Dtype>::get_normalizer(
     LossParameter_NormalizationMode normalization_mode, int valid_count) {
-  Dtype normalizer;
-  switch (normalization_mode) {
-    case LossParameter_NormalizationMode_FULL:
-      normalizer = Dtype(outer_num_ * inner_num_);
-      break;
-    case LossParameter_NormalizationMode_VALID:
-      if (valid_count == -1) {
-        normalizer = Dtype(outer_num_ * inner_num_);
-      } else {
-        normalizer = Dtype(valid_count);
-      }
-      break;
-    case LossParameter_NormalizationMode_BATCH_SIZE:
-      normalizer = Dtype(outer_num_);
-      break;
-    case LossParameter_NormalizationMode_NONE:
-      normalizer = Dtype(1);
-      break;
-    default:
-      LOG(FATAL) << "Unknown normalization mode: "
-          << LossParameter_NormalizationMode_Name(normalization_mode);
-  }
-  // Some users will have no labels for some examples in order to 'turn off' a
-  // particular loss in a multi-task setup. The max prevents NaNs in that case.
-  return std::max(Dtype(1.0), normalizer);
+  return LossLayer<Dtype>::GetNormalizer(normalization_mode, outer_num_,
+      inner_num_, valid_count);
 }
 
 template <typename Dtype>
 void SoftmaxWithLossLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  // The forward pass computes the softmax prob values.
-  softmax_layer_->Forward(softmax_bottom_vec_, softmax_top_vec_);
-  const Dtype* prob_data = prob_.cpu_data();
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  const Dtype* prob_data = NULL;
+  const Dtype* log_sum_exp = NULL;
+  if (top.size() >= 2) {
+    // The forward pass computes the softmax prob values.
+    softmax_layer_->Forward(softmax_bottom_vec_, softmax_top_vec_);
+    prob_data = prob_.cpu_data();
+  } else {
+    // Only the loss is output, which log(prob) = x - log(sum(exp(x))) gives
+    // without storing the probabilities.
+    caffe_cpu_softmax(outer_num_, bottom[0]->shape(softmax_axis_), inner_num_,
+        bottom_data, static_cast<Dtype*>(NULL),
+        log_sum_exp_.mutable_cpu_data());
+    log_sum_exp = log_sum_exp_.cpu_data();
+  }
   const Dtype* label = bottom[1]->cpu_data();
-  int dim = prob_.count() / outer_num_;
+  int dim = bottom[0]->count() / outer_num_;
   int count = 0;
   Dtype loss = 0;
   for (int i = 0; i < outer_num_; ++i) {
@@ -102,9 +90,13 @@ void SoftmaxWithLossLayer<Dtype>::Forward_cpu(
         continue;
       }
       DCHECK_GE(label_value, 0);
-      DCHECK_LT(label_value, prob_.shape(softmax_axis_));
-      loss -= log(std::max(prob_data[i * dim + label_value * inner_num_ + j],
-                           Dtype(FLT_MIN)));
+      DCHECK_LT(label_value, bottom[0]->shape(softmax_axis_));
+      const int index = i * dim + label_value * inner_num_ + j;
+      const Dtype log_prob = prob_data ?
+          log(std::max(prob_data[index], Dtype(FLT_MIN))) :
+          std::max(bottom_data[index] - log_sum_exp[i * inner_num_ + j],
+                   Dtype(log(FLT_MIN)));
+      loss -= log_prob;
       ++count;
     }
   }
@@ -123,10 +115,45 @@ void SoftmaxWithLossLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   }
   if (propagate_down[0]) {
     Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-    const Dtype* prob_data = prob_.cpu_data();
-    caffe_copy(prob_.count(), prob_data, bottom_diff);
+    if (top.size() >= 2) {
+      caffe_copy(prob_.count(), prob_.cpu_data(), bottom_diff);
+    } else {
+      // Forward did not store the probabilities; compute them straight into
+      // the gradient as exp(x - log(sum(exp(x)))).
+      const Dtype* bottom_data = bottom[0]->cpu_data();
+      const Dtype* log_sum_exp = log_sum_exp_.cpu_data();
+      const int channels = bottom[0]->shape(softmax_axis_);
+      const int dim = bottom[0]->count() / outer_num_;
+#ifdef _OPENMP
+      #pragma omp parallel for if (bottom[0]->count() >= kParallelMinInputs)
+#endif
+      for (int i = 0; i < outer_num_; ++i) {
+        const Dtype* x = bottom_data + i * dim;
+        const Dtype* row_log_sum_exp = log_sum_exp + i * inner_num_;
+        Dtype* diff = bottom_diff + i * dim;
+        if (inner_num_ == 1) {
+#ifdef _OPENMP
+          #pragma omp simd
+#endif
+          for (int c = 0; c < channels; ++c) {
+            diff[c] = x[c] - row_log_sum_exp[0];
+          }
+        } else {
+          for (int c = 0; c < channels; ++c) {
+#ifdef _OPENMP
+            #pragma omp simd
+#endif
+            for (int j = 0; j < inner_num_; ++j) {
+              diff[c * inner_num_ + j] = x[c * inner_num_ + j] -
+                  row_log_sum_exp[j];
+            }
+          }
+        }
+        caffe_exp(dim, diff, diff);
+      }
+    }
     const Dtype* label = bottom[1]->cpu_data();
-    int dim = prob_.count() / outer_num_;
+    int dim = bottom[0]->count() / outer_num_;
     int count = 0;
     for (int i = 0; i < outer_num_; ++i) {
       for (int j = 0; j < inner_num_; ++j) {
@@ -144,7 +171,7 @@ void SoftmaxWithLossLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     // Scale gradient
     Dtype loss_weight = top[0]->cpu_diff()[0] /
                         get_normalizer(normalization_, count);
-    caffe_scal(prob_.count(), loss_weight, bottom_diff);
+    caffe_scal(bottom[0]->count(), loss_weight, bottom_diff);
   }
 }
 
@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <cfloat>
 #include <vector>
 
 #include "caffe/layer.hpp"
@@ -7,12 +8,23 @@
 #include "caffe/layers/pooling_layer.hpp"
 #include "caffe/layers/split_layer.hpp"
 #include "caffe/layers/spp_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
 using std::min;
 using std::max;
 
+// The outputs of pooling size inputs with windows of stride kernel, as
+// PoolingLayer::Reshape counts them.
+static int pooled_size(const int size, const int kernel, const int pad) {
+  int pooled = (size + 2 * pad - 1) / kernel + 1;
+  if (pad && (pooled - 1) * kernel >= size + pad) {
+    --pooled;
+  }
+  return pooled;
+}
+
 template <typename Dtype>
 LayerParameter SPPLayer<Dtype>::GetPoolingParam(const int pyramid_level,
       const int bottom_h, const int bottom_w, const SPPParameter spp_param) {
@@ -91,6 +103,7 @@ void SPPLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
         spp_param);
     pooling_layers_.push_back(shared_ptr<PoolingLayer<Dtype> > (
         new PoolingLayer<Dtype>(pooling_param)));
+    pooling_layers_[0]->set_inference_only(this->inference_only());
     pooling_layers_[0]->SetUp(bottom, top);
     return;
   }
@@ -120,6 +133,7 @@ void SPPLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
 
     pooling_layers_.push_back(shared_ptr<PoolingLayer<Dtype> > (
         new PoolingLayer<Dtype>(pooling_param)));
+    pooling_layers_[i]->set_inference_only(this->inference_only());
     pooling_layers_[i]->SetUp(*pooling_bottom_vecs_[i], *pooling_top_vecs_[i]);
 
     // flatten layer output holders setup
@@ -159,10 +173,52 @@ void SPPLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   bottom_w_ = bottom[0]->width();
   reshaped_first_time_ = true;
   SPPParameter spp_param = this->layer_param_.spp_param();
+  // Where each input row and column falls in the bins of each level, for
+  // the CPU implementation.
+  bins_h_.resize(pyramid_height_);
+  bins_w_.resize(pyramid_height_);
+  level_offset_.resize(pyramid_height_ + 1);
+  bin_of_h_.resize(pyramid_height_ * bottom_h_);
+  bin_w_begin_.resize(pyramid_height_);
+  bin_size_.clear();
+  level_offset_[0] = 0;
+  for (int i = 0; i < pyramid_height_; i++) {
+    const PoolingParameter pool_param = GetPoolingParam(
+        i, bottom_h_, bottom_w_, spp_param).pooling_param();
+    const int kernel_h = pool_param.kernel_h();
+    const int kernel_w = pool_param.kernel_w();
+    const int pad_h = pool_param.pad_h();
+    const int pad_w = pool_param.pad_w();
+    bins_h_[i] = pooled_size(bottom_h_, kernel_h, pad_h);
+    bins_w_[i] = pooled_size(bottom_w_, kernel_w, pad_w);
+    level_offset_[i + 1] = level_offset_[i] + bins_h_[i] * bins_w_[i];
+    for (int h = 0; h < bottom_h_; ++h) {
+      bin_of_h_[i * bottom_h_ + h] = (h + pad_h) / kernel_h;
+    }
+    // The bins of a row are contiguous runs of columns.
+    bin_w_begin_[i].resize(bins_w_[i] + 1);
+    for (int pw = 0; pw < bins_w_[i]; ++pw) {
+      bin_w_begin_[i][pw] = max(pw * kernel_w - pad_w, 0);
+    }
+    bin_w_begin_[i][bins_w_[i]] = bottom_w_;
+    for (int ph = 0; ph < bins_h_[i]; ++ph) {
+      const int hstart = ph * kernel_h - pad_h;
+      const int hend = min(hstart + kernel_h, bottom_h_ + pad_h);
+      for (int pw = 0; pw < bins_w_[i]; ++pw) {
+        const int wstart = pw * kernel_w - pad_w;
+        const int wend = min(wstart + kernel_w, bottom_w_ + pad_w);
+        bin_size_.push_back((hend - hstart) * (wend - wstart));
+      }
+    }
+  }
+  if (spp_param.pool() == SPPParameter_PoolMethod_MAX && cpu_max_idx()) {
+    max_idx_.Reshape(num_, channels_ * level_offset_[pyramid_height_], 1, 1);
+  }
   if (pyramid_height_ == 1) {
     LayerParameter pooling_param = GetPoolingParam(0, bottom_h_, bottom_w_,
         spp_param);
     pooling_layers_[0].reset(new PoolingLayer<Dtype>(pooling_param));
+    pooling_layers_[0]->set_inference_only(this->inference_only());
     pooling_layers_[0]->SetUp(bottom, top);
     pooling_layers_[0]->Reshape(bottom, top);
     return;
@@ -174,6 +230,7 @@ void SPPLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
 
     pooling_layers_[i].reset(
         new PoolingLayer<Dtype>(pooling_param));
+    pooling_layers_[i]->set_inference_only(this->inference_only());
     pooling_layers_[i]->SetUp(
         *pooling_bottom_vecs_[i], *pooling_top_vecs_[i]);
     pooling_layers_[i]->Reshape(
@@ -184,9 +241,196 @@ void SPPLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   concat_layer_->Reshape(concat_bottom_vec_, top);
 }
 
+template <typename Dtype>
+void SPPLayer<Dtype>::pool_channel_cpu(const Dtype* bottom_data,
+    const int channels, const int c, Dtype* top_data, int* mask) const {
+  const bool max_pool = this->layer_param_.spp_param().pool() ==
+      SPPParameter_PoolMethod_MAX;
+  for (int i = 0; i < pyramid_height_; i++) {
+    const int bins = bins_h_[i] * bins_w_[i];
+    const int offset = channels * level_offset_[i] + c * bins;
+    std::fill(top_data + offset, top_data + offset + bins,
+        max_pool ? Dtype(-FLT_MAX) : Dtype(0));
+    if (mask) {
+      std::fill(mask + offset, mask + offset + bins, -1);
+    }
+  }
+  // Each input row updates a row of bins of every level while in cache.
+  for (int h = 0; h < bottom_h_; ++h) {
+    const Dtype* row = bottom_data + h * bottom_w_;
+    for (int i = 0; i < pyramid_height_; i++) {
+      const int offset = channels * level_offset_[i] +
+          c * bins_h_[i] * bins_w_[i] + bin_of_h_[i * bottom_h_ + h] *
+          bins_w_[i];
+      const int* begin = &bin_w_begin_[i][0];
+      const int width = bins_w_[i];
+      Dtype* out = top_data + offset;
+      int* row_mask = mask ? mask + offset : NULL;
+      for (int pw = 0; pw < width; ++pw) {
+        if (!max_pool) {
+          Dtype sum = 0;
+          for (int w = begin[pw]; w < begin[pw + 1]; ++w) {
+            sum += row[w];
+          }
+          out[pw] += sum;
+        } else {
+          const Dtype previous = out[pw];
+          Dtype value = previous;
+          for (int w = begin[pw]; w < begin[pw + 1]; ++w) {
+            value = row[w] > value ? row[w] : value;
+          }
+          if (row_mask) {
+            // Only the row of the maximum for now; see below. Whether a row
+            // raises the maximum is unpredictable, so this takes no branch.
+            const int max_h = row_mask[pw];
+            row_mask[pw] = max_h + (value > previous) * (h - max_h);
+          }
+          out[pw] = value;
+        }
+      }
+    }
+  }
+  if (mask) {
+    // Find each maximum in its row, first among equals as a scan would.
+    for (int i = 0; i < pyramid_height_; i++) {
+      const int bins = bins_h_[i] * bins_w_[i];
+      const int offset = channels * level_offset_[i] + c * bins;
+      const int* begin = &bin_w_begin_[i][0];
+      for (int b = 0; b < bins; ++b) {
+        const int h = mask[offset + b];
+        if (h >= 0) {
+          const Dtype* row = bottom_data + h * bottom_w_;
+          const int pw = b % bins_w_[i];
+          int index = 0;
+          for (int w = begin[pw + 1] - 1; w >= begin[pw]; --w) {
+            index = row[w] == top_data[offset + b] ? w : index;
+          }
+          mask[offset + b] = h * bottom_w_ + index;
+        }
+      }
+    }
+  }
+  if (!max_pool) {
+    for (int i = 0; i < pyramid_height_; i++) {
+      const int bins = bins_h_[i] * bins_w_[i];
+      Dtype* out = top_data + channels * level_offset_[i] + c * bins;
+      const int* bin_size = &bin_size_[level_offset_[i]];
+      for (int b = 0; b < bins; ++b) {
+        out[b] /= bin_size[b];
+      }
+    }
+  }
+}
+
 template <typename Dtype>
 void SPPLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+  const SPPParameter_PoolMethod pool = this->layer_param_.spp_param().pool();
+  if (pool == SPPParameter_PoolMethod_STOCHASTIC) {
+    NOT_IMPLEMENTED;
+  }
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  int* mask = pool == SPPParameter_PoolMethod_MAX && cpu_max_idx() ?
+      max_idx_.mutable_cpu_data() : NULL;
+  const int bottom_dim = bottom_h_ * bottom_w_;
+  const int top_dim = channels_ * level_offset_[pyramid_height_];
+  CHECK_EQ(top[0]->count(), num_ * top_dim);
+#ifdef _OPENMP
+  #pragma omp parallel for if (bottom[0]->count() >= kParallelMinInputs)
+#endif
+  for (int i = 0; i < num_ * channels_; ++i) {
+    const int n = i / channels_;
+    pool_channel_cpu(bottom_data + i * bottom_dim, channels_, i % channels_,
+        top_data + n * top_dim, mask ? mask + n * top_dim : NULL);
+  }
+}
+
+template <typename Dtype>
+void SPPLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  if (!propagate_down[0]) {
+    return;
+  }
+  const SPPParameter_PoolMethod pool = this->layer_param_.spp_param().pool();
+  if (pool == SPPParameter_PoolMethod_STOCHASTIC) {
+    NOT_IMPLEMENTED;
+  }
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  const Dtype* top_diff = top[0]->cpu_diff();
+  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+  const int* mask = pool == SPPParameter_PoolMethod_MAX && cpu_max_idx() ?
+      max_idx_.cpu_data() : NULL;
+  const int bottom_dim = bottom_h_ * bottom_w_;
+  const int top_dim = channels_ * level_offset_[pyramid_height_];
+#ifdef _OPENMP
+  #pragma omp parallel if (bottom[0]->count() >= kParallelMinInputs)
+#endif
+  {
+    // Where Forward kept no mask, each thread finds the maxima of its
+    // channels again in these.
+    vector<Dtype> maxima;
+    vector<int> channel_mask;
+    if (pool == SPPParameter_PoolMethod_MAX && !mask) {
+      maxima.resize(level_offset_[pyramid_height_]);
+      channel_mask.resize(level_offset_[pyramid_height_]);
+    }
+#ifdef _OPENMP
+    #pragma omp for
+#endif
+    for (int i = 0; i < num_ * channels_; ++i) {
+      const int n = i / channels_;
+      const int c = i % channels_;
+      const Dtype* image_diff = top_diff + n * top_dim;
+      Dtype* diff = bottom_diff + i * bottom_dim;
+      caffe_set(bottom_dim, Dtype(0), diff);
+      if (pool == SPPParameter_PoolMethod_MAX) {
+        const int* max_idx = mask ? mask + n * top_dim : NULL;
+        int mask_channels = channels_;
+        int mask_c = c;
+        if (!mask) {
+          pool_channel_cpu(bottom_data + i * bottom_dim, 1, 0, &maxima[0],
+              &channel_mask[0]);
+          max_idx = &channel_mask[0];
+          mask_channels = 1;
+          mask_c = 0;
+        }
+        for (int l = 0; l < pyramid_height_; l++) {
+          const int bins = bins_h_[l] * bins_w_[l];
+          const Dtype* level_diff = image_diff + channels_ * level_offset_[l] +
+              c * bins;
+          const int* level_mask = max_idx + mask_channels * level_offset_[l] +
+              mask_c * bins;
+          for (int b = 0; b < bins; ++b) {
+            diff[level_mask[b]] += level_diff[b];
+          }
+        }
+      } else {
+        for (int h = 0; h < bottom_h_; ++h) {
+          for (int l = 0; l < pyramid_height_; l++) {
+            const int bin_h = bin_of_h_[l * bottom_h_ + h];
+            const Dtype* level_diff = image_diff +
+                channels_ * level_offset_[l] +
+                (c * bins_h_[l] + bin_h) * bins_w_[l];
+            const int* bin_size = &bin_size_[level_offset_[l] +
+                bin_h * bins_w_[l]];
+            const int* begin = &bin_w_begin_[l][0];
+            for (int pw = 0; pw < bins_w_[l]; ++pw) {
+              const Dtype value = level_diff[pw] / bin_size[pw];
+              for (int w = begin[pw]; w < begin[pw + 1]; ++w) {
+                diff[h * bottom_w_ + w] += value;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void SPPLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
   if (pyramid_height_ == 1) {
     pooling_layers_[0]->Forward(bottom, top);
     return;
@@ -202,7 +446,7 @@ void SPPLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
 }
 
 template <typename Dtype>
-void SPPLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
+void SPPLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
   if (!propagate_down[0]) {
     return;
@@ -0,0 +1,306 @@
+#include <vector>
+
+#include "caffe/layers/winograd_conv_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/workspace.hpp"
+
+namespace caffe {
+
+// The transforms of F(2 x 2, 3 x 3) and F(4 x 4, 3 x 3) from Lavin and Gray.
+static const double kInputTransform2[4 * 4] = {
+  1,  0, -1,  0,
+  0,  1,  1,  0,
+  0, -1,  1,  0,
+  0,  1,  0, -1 };
+static const double kFilterTransform2[4 * 3] = {
+  1,    0,   0,
+  0.5,  0.5, 0.5,
+  0.5, -0.5, 0.5,
+  0,    0,   1 };
+static const double kOutputTransform2[2 * 4] = {
+  1, 1,  1,  0,
+  0, 1, -1, -1 };
+static const double kInputTransform4[6 * 6] = {
+  4,  0, -5,  0, 1, 0,
+  0, -4, -4,  1, 1, 0,
+  0,  4, -4, -1, 1, 0,
+  0, -2, -1,  2, 1, 0,
+  0,  2, -1, -2, 1, 0,
+  0,  4,  0, -5, 0, 1 };
+static const double kFilterTransform4[6 * 3] = {
+  1.0 / 4,         0,          0,
+  -1.0 / 6,  -1.0 / 6,  -1.0 / 6,
+  -1.0 / 6,   1.0 / 6,  -1.0 / 6,
+  1.0 / 24,  1.0 / 12,   1.0 / 6,
+  1.0 / 24, -1.0 / 12,   1.0 / 6,
+  0,                0,         1 };
+static const double kOutputTransform4[4 * 6] = {
+  1, 1,  1, 1,  1, 0,
+  0, 1, -1, 2, -2, 0,
+  0, 1,  1, 4,  4, 0,
+  0, 1, -1, 8, -8, 1 };
+
+// The largest input tile, alpha = 6 for F(4 x 4, 3 x 3).
+static const int kMaxAlpha = 6;
+
+// Computes out = left * in * left^T for a rows x inner matrix left and an
+// inner x inner matrix in, all row major.
+template <typename Dtype>
+static void transform_tile(const Dtype* left, const int rows, const int inner,
+    const Dtype* in, Dtype* out) {
+  Dtype tmp[kMaxAlpha * kMaxAlpha];
+  for (int r = 0; r < rows; ++r) {
+    for (int j = 0; j < inner; ++j) {
+      Dtype sum = 0;
+      for (int k = 0; k < inner; ++k) {
+        sum += left[r * inner + k] * in[k * inner + j];
+      }
+      tmp[r * inner + j] = sum;
+    }
+  }
+  for (int r = 0; r < rows; ++r) {
+    for (int c = 0; c < rows; ++c) {
+      Dtype sum = 0;
+      for (int k = 0; k < inner; ++k) {
+        sum += tmp[r * inner + k] * left[c * inner + k];
+      }
+      out[r * rows + c] = sum;
+    }
+  }
+}
+
+template <typename Dtype>
+WinogradConvolutionLayer<Dtype>::~WinogradConvolutionLayer() {
+  Workspace::Release(&transformed_filters_);
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  ConvolutionLayer<Dtype>::LayerSetUp(bottom, top);
+  tile_ = this->layer_param_.convolution_param().winograd_tile();
+  CHECK(tile_ == 2 || tile_ == 4) << "winograd_tile must be 2 or 4.";
+  alpha_ = tile_ + 2;
+  if (this->quantized() || this->half()) {
+    // The 8-bit and 16-bit weights are only read by the GEMM implementation.
+    use_winograd_ = false;
+    LOG(INFO) << "Layer " << this->layer_param_.name() << " has 8-bit or "
+        << "16-bit weights; falling back to GEMM.";
+    return;
+  }
+  use_winograd_ = this->num_spatial_axes_ == 2;
+  for (int i = 0; use_winograd_ && i < this->num_spatial_axes_; ++i) {
+    use_winograd_ = this->kernel_shape_.cpu_data()[i] == 3 &&
+        this->stride_.cpu_data()[i] == 1 &&
+        this->dilation_.cpu_data()[i] == 1;
+  }
+  if (!use_winograd_) {
+    LOG(INFO) << "Layer " << this->layer_param_.name() << " is not a 2D 3x3, "
+        << "stride 1, undilated convolution; falling back to GEMM.";
+    return;
+  }
+  const double* input_transform =
+      (tile_ == 2) ? kInputTransform2 : kInputTransform4;
+  const double* filter_transform =
+      (tile_ == 2) ? kFilterTransform2 : kFilterTransform4;
+  const double* output_transform =
+      (tile_ == 2) ? kOutputTransform2 : kOutputTransform4;
+  input_transform_.assign(input_transform, input_transform + alpha_ * alpha_);
+  filter_transform_.assign(filter_transform, filter_transform + alpha_ * 3);
+  output_transform_.assign(output_transform,
+      output_transform + tile_ * alpha_);
+  vector<int> transformed_shape(3);
+  transformed_shape[0] = alpha_ * alpha_;
+  transformed_shape[1] = this->num_output_;
+  transformed_shape[2] = this->channels_ / this->group_;
+  transformed_filters_.Reshape(transformed_shape);
+  transformed_weights_.reset();
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::Reshape(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  ConvolutionLayer<Dtype>::Reshape(bottom, top);
+  if (!use_winograd_) {
+    return;
+  }
+  tiles_h_ = (this->output_shape_[0] + tile_ - 1) / tile_;
+  tiles_w_ = (this->output_shape_[1] + tile_ - 1) / tile_;
+  const int num_tiles = tiles_h_ * tiles_w_;
+  Workspace::Get().Reserve(&transformed_filters_, sizeof(Dtype) *
+      alpha_ * alpha_ * num_tiles * (this->channels_ + this->num_output_) /
+      this->group_);
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::ShareDerivedParams(
+    Layer<Dtype>* source) {
+  ConvolutionLayer<Dtype>::ShareDerivedParams(source);
+  WinogradConvolutionLayer<Dtype>* layer =
+      dynamic_cast<WinogradConvolutionLayer<Dtype>*>(source);
+  CHECK(layer) << "Cannot share the params of a " << source->type()
+      << " layer.";
+  if (!use_winograd_) {
+    return;
+  }
+  // The transformed filters are up to 4x the size of the weights; source
+  // transforms them once, and executors read them from there.
+  transformed_filters_.ShareData(layer->transformed_filters_);
+  transformed_weights_ = layer->transformed_weights_;
+  transformed_weights_version_ = layer->transformed_weights_version_;
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::RefreshDerivedParams() {
+  if (use_winograd_) {
+    TransformFilters();
+  } else {
+    ConvolutionLayer<Dtype>::RefreshDerivedParams();
+  }
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::TransformFilters() {
+  const shared_ptr<SyncedMemory>& weights = this->blobs_[0]->data();
+  if (weights == transformed_weights_ &&
+      weights->version() == transformed_weights_version_) {
+    return;
+  }
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  Dtype* transformed = transformed_filters_.mutable_cpu_data();
+  const int channels_per_group = this->channels_ / this->group_;
+  const int filters = this->num_output_ * channels_per_group;
+  Dtype tile[kMaxAlpha * kMaxAlpha];
+  for (int f = 0; f < filters; ++f) {
+    transform_tile(&filter_transform_[0], alpha_, 3, weight + f * 9, tile);
+    for (int xi = 0; xi < alpha_ * alpha_; ++xi) {
+      transformed[xi * filters + f] = tile[xi];
+    }
+  }
+  transformed_weights_ = weights;
+  transformed_weights_version_ = weights->version();
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::TransformInput(const Dtype* input,
+    Dtype* transformed_input) {
+  const int channels_per_group = this->channels_ / this->group_;
+  const int height = this->input_shape(1);
+  const int width = this->input_shape(2);
+  const int pad_h = this->pad_.cpu_data()[0];
+  const int pad_w = this->pad_.cpu_data()[1];
+  const int num_tiles = tiles_h_ * tiles_w_;
+  const int stride = channels_per_group * num_tiles;
+  Dtype patch[kMaxAlpha * kMaxAlpha];
+  Dtype tile[kMaxAlpha * kMaxAlpha];
+  for (int c = 0; c < channels_per_group; ++c) {
+    const Dtype* channel = input + c * height * width;
+    for (int th = 0; th < tiles_h_; ++th) {
+      const int h_start = th * tile_ - pad_h;
+      for (int tw = 0; tw < tiles_w_; ++tw) {
+        const int w_start = tw * tile_ - pad_w;
+        // Read the (overlapping) input tile, zero outside the image.
+        for (int y = 0; y < alpha_; ++y) {
+          const int h = h_start + y;
+          for (int x = 0; x < alpha_; ++x) {
+            const int w = w_start + x;
+            patch[y * alpha_ + x] =
+                (h >= 0 && h < height && w >= 0 && w < width) ?
+                channel[h * width + w] : Dtype(0);
+          }
+        }
+        transform_tile(&input_transform_[0], alpha_, alpha_, patch, tile);
+        Dtype* out = transformed_input + c * num_tiles + th * tiles_w_ + tw;
+        for (int xi = 0; xi < alpha_ * alpha_; ++xi) {
+          out[xi * stride] = tile[xi];
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::TransformOutput(
+    const Dtype* transformed_output, Dtype* output) {
+  const int outputs_per_group = this->num_output_ / this->group_;
+  const int height_out = this->output_shape_[0];
+  const int width_out = this->output_shape_[1];
+  const int num_tiles = tiles_h_ * tiles_w_;
+  const int stride = outputs_per_group * num_tiles;
+  Dtype product[kMaxAlpha * kMaxAlpha];
+  Dtype tile[kMaxAlpha * kMaxAlpha];
+  for (int k = 0; k < outputs_per_group; ++k) {
+    Dtype* channel = output + k * height_out * width_out;
+    for (int th = 0; th < tiles_h_; ++th) {
+      for (int tw = 0; tw < tiles_w_; ++tw) {
+        const Dtype* in =
+            transformed_output + k * num_tiles + th * tiles_w_ + tw;
+        for (int xi = 0; xi < alpha_ * alpha_; ++xi) {
+          product[xi] = in[xi * stride];
+        }
+        transform_tile(&output_transform_[0], tile_, alpha_, product, tile);
+        // Edge tiles may extend past the output.
+        for (int y = 0; y < tile_ && th * tile_ + y < height_out; ++y) {
+          for (int x = 0; x < tile_ && tw * tile_ + x < width_out; ++x) {
+            channel[(th * tile_ + y) * width_out + tw * tile_ + x] =
+                tile[y * tile_ + x];
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  if (!use_winograd_) {
+    ConvolutionLayer<Dtype>::Forward_cpu(bottom, top);
+    return;
+  }
+  if (!this->shares_derived_params_) {
+    TransformFilters();
+  }
+  const int channels_per_group = this->channels_ / this->group_;
+  const int outputs_per_group = this->num_output_ / this->group_;
+  const int num_tiles = tiles_h_ * tiles_w_;
+  const int tile_elements = alpha_ * alpha_;
+  const shared_ptr<SyncedMemory> workspace = Workspace::Get().Reserve(
+      &transformed_filters_, sizeof(Dtype) * tile_elements * num_tiles *
+      (channels_per_group + outputs_per_group));
+  Dtype* transformed_input = static_cast<Dtype*>(workspace->mutable_cpu_data());
+  Dtype* transformed_output =
+      transformed_input + tile_elements * channels_per_group * num_tiles;
+  const Dtype* transformed_filters = transformed_filters_.cpu_data();
+  const int input_group_dim = channels_per_group * this->bottom_dim_ /
+      this->channels_;
+  const int output_group_dim = outputs_per_group * this->out_spatial_dim_;
+  for (int i = 0; i < bottom.size(); ++i) {
+    const Dtype* bottom_data = bottom[i]->cpu_data();
+    Dtype* top_data = top[i]->mutable_cpu_data();
+    for (int n = 0; n < this->num_; ++n) {
+      for (int g = 0; g < this->group_; ++g) {
+        TransformInput(bottom_data + n * this->bottom_dim_ +
+            g * input_group_dim, transformed_input);
+        // Each element of the transformed tiles is an independent product
+        // of the transformed filters and inputs over the channels.
+        for (int xi = 0; xi < tile_elements; ++xi) {
+          caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, outputs_per_group,
+              num_tiles, channels_per_group, (Dtype)1.,
+              transformed_filters + (xi * this->num_output_ +
+                  g * outputs_per_group) * channels_per_group,
+              transformed_input + xi * channels_per_group * num_tiles,
+              (Dtype)0., transformed_output + xi * outputs_per_group *
+                  num_tiles);
+        }
+        TransformOutput(transformed_output, top_data + n * this->top_dim_ +
+            g * output_group_dim);
+      }
+      this->forward_cpu_epilogue(top_data, n);
+    }
+  }
+}
+
+INSTANTIATE_CLASS(WinogradConvolutionLayer);
+
+}  // namespace caffe
@@ -1,4 +1,7 @@
 #include <algorithm>
+#include <climits>
+#include <cstring>
+#include <fstream>  // NOLINT(readability/streams)
 #include <map>
 #include <set>
 #include <string>
@@ -12,18 +15,46 @@
 #include "caffe/net.hpp"
 #include "caffe/parallel.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/channels_last.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/insert_splits.hpp"
 #include "caffe/util/math_functions.hpp"
 #include "caffe/util/upgrade_proto.hpp"
+#include "caffe/util/workspace.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
 namespace caffe {
 
+// A mapped weights file starts with a MappedFileHeader, followed by a
+// serialized NetParameter index that lists the layers and the shapes of their
+// params (without values). The raw values of the params come next, in index
+// order, each starting at a multiple of kMappedFileAlignment bytes.
+static const char kMappedFileMagic[8] =
+    {'C', 'A', 'F', 'F', 'E', 'M', 'A', 'P'};
+static const uint32_t kMappedFileVersion = 1;
+static const size_t kMappedFileAlignment = 64;
+
+// Fused elementwise layers run on tiles of this many values, which stay in
+// the L1 or L2 cache from one layer to the next, and on several threads once
+// the blobs have kParallelMinInputs values.
+static const int kElementwiseTile = 1 << 12;
+
+struct MappedFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t dtype_size;
+  uint64_t index_size;
+};
+
+static size_t MappedFileAlign(size_t offset) {
+  return (offset + kMappedFileAlignment - 1) / kMappedFileAlignment
+      * kMappedFileAlignment;
+}
+
 template <typename Dtype>
 Net<Dtype>::Net(const NetParameter& param, const Net* root_net)
-    : root_net_(root_net) {
+    : root_net_(root_net), params_net_(NULL) {
   Init(param);
 }
 
@@ -31,7 +62,7 @@ template <typename Dtype>
 Net<Dtype>::Net(const string& param_file, Phase phase,
     const int level, const vector<string>* stages,
     const Net* root_net)
-    : root_net_(root_net) {
+    : root_net_(root_net), params_net_(NULL) {
   NetParameter param;
   ReadNetParamsFromTextFileOrDie(param_file, &param);
   // Set phase, stages and level
@@ -45,16 +76,80 @@ Net<Dtype>::Net(const string& param_file, Phase phase,
   Init(param);
 }
 
+template <typename Dtype>
+Net<Dtype>::Net(const Net* params_net, const NetParameter& param)
+    : root_net_(NULL), params_net_(params_net) {
+  Init(param);
+}
+
+template <typename Dtype>
+shared_ptr<Net<Dtype> > Net<Dtype>::CreateExecutor() const {
+  CHECK_EQ(phase_, TEST) << "Only TEST nets can have executors.";
+  // Settle where the params live now, so that concurrent reads of them never
+  // copy between host and device. Weights released for their 16-bit copies
+  // (see InnerProductParameter.weight_precision) are never read.
+  for (int i = 0; i < params_.size(); ++i) {
+    if (params_[i]->data()->head() == SyncedMemory::UNINITIALIZED) {
+      continue;
+    }
+    params_[i]->cpu_data();
+    if (Caffe::mode() == Caffe::GPU) {
+      params_[i]->gpu_data();
+    }
+  }
+  // Rebuild the parameters from the layers, which are already filtered, split
+  // and in the layout of the net.
+  NetParameter param;
+  param.set_name(name_);
+  param.mutable_state()->set_phase(TEST);
+  param.set_debug_info(debug_info_);
+  param.set_optimize_memory(optimize_memory_);
+  param.set_inference_only(true);
+  param.set_fuse_activations(fuse_activations_);
+  param.set_fuse_elementwise(fuse_elementwise_);
+  for (int i = 0; i < layers_.size(); ++i) {
+    LayerParameter* layer_param = param.add_layer();
+    layer_param->CopyFrom(layers_[i]->layer_param());
+    layer_param->clear_include();
+    layer_param->clear_exclude();
+    layer_param->clear_blobs();
+  }
+  return shared_ptr<Net<Dtype> >(new Net<Dtype>(this, param));
+}
+
+template <typename Dtype>
+void Net<Dtype>::RefreshDerivedParams() {
+  CHECK(!params_net_) << "Executors read the derived params of the net they "
+      << "were created from; refresh that net instead.";
+  for (int i = 0; i < layers_.size(); ++i) {
+    layers_[i]->RefreshDerivedParams();
+  }
+}
+
 template <typename Dtype>
 void Net<Dtype>::Init(const NetParameter& in_param) {
   CHECK(Caffe::root_solver() || root_net_)
       << "root_net_ needs to be set for all non-root solvers";
   // Set phase from the state.
   phase_ = in_param.state().phase();
+  inference_only_ = in_param.inference_only();
+  if (inference_only_) {
+    CHECK_EQ(phase_, TEST) << "Only TEST nets can be inference only.";
+    CHECK(!in_param.force_backward())
+        << "Inference-only nets cannot force backward.";
+  }
   // Filter layers based on their include/exclude rules and
   // the current NetState.
   NetParameter filtered_param;
   FilterNet(in_param, &filtered_param);
+  if (in_param.channels_last()) {
+    CHECK_EQ(phase_, TEST) << "Only TEST nets can run channels-last.";
+    CHECK(!in_param.force_backward())
+        << "Channels-last nets cannot force backward.";
+    NetParameter channels_last_param;
+    ConvertToChannelsLast(filtered_param, &channels_last_param);
+    filtered_param.Swap(&channels_last_param);
+  }
   LOG_IF(INFO, Caffe::root_solver())
       << "Initializing net from parameters: " << std::endl
       << filtered_param.DebugString();
@@ -95,6 +190,13 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
       layers_[layer_id]->SetShared(true);
     } else {
       layers_.push_back(LayerRegistry<Dtype>::CreateLayer(layer_param));
+      layers_[layer_id]->set_inference_only(inference_only_);
+      if (params_net_) {
+        // Hand the params of params_net_ to the layer, so that it skips
+        // filling params of its own.
+        CHECK_EQ(params_net_->layer_names_[layer_id], layer_param.name());
+        layers_[layer_id]->blobs() = params_net_->layers_[layer_id]->blobs();
+      }
     }
     layer_names_.push_back(layer_param.name());
     LOG_IF(INFO, Caffe::root_solver())
@@ -147,6 +249,24 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     } else {
       layers_[layer_id]->SetUp(bottom_vecs_[layer_id], top_vecs_[layer_id]);
     }
+    if (params_net_) {
+      // Layers that set up their params anyway (e.g. Recurrent) still share
+      // the values.
+      const vector<shared_ptr<Blob<Dtype> > >& source_blobs =
+          params_net_->layers_[layer_id]->blobs();
+      vector<shared_ptr<Blob<Dtype> > >& target_blobs =
+          layers_[layer_id]->blobs();
+      CHECK_EQ(target_blobs.size(), source_blobs.size())
+          << "Incompatible number of blobs for layer " << layer_param.name();
+      for (int j = 0; j < target_blobs.size(); ++j) {
+        if (target_blobs[j] != source_blobs[j]) {
+          CHECK(target_blobs[j]->shape() == source_blobs[j]->shape());
+          target_blobs[j]->ShareData(*source_blobs[j]);
+        }
+      }
+      layers_[layer_id]->ShareDerivedParams(
+          params_net_->layers_[layer_id].get());
+    }
     LOG_IF(INFO, Caffe::root_solver())
         << "Setting up " << layer_names_[layer_id];
     for (int top_id = 0; top_id < top_vecs_[layer_id].size(); ++top_id) {
@@ -172,7 +292,8 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     for (int param_id = 0; param_id < num_param_blobs; ++param_id) {
       const ParamSpec* param_spec = (param_id < param_size) ?
           &layer_param.param(param_id) : &default_param_spec;
-      const bool param_need_backward = param_spec->lr_mult() != 0;
+      const bool param_need_backward =
+          !inference_only_ && param_spec->lr_mult() != 0;
       need_backward |= param_need_backward;
       layers_[layer_id]->set_param_propagate_down(param_id,
                                                   param_need_backward);
@@ -181,6 +302,7 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
       AppendParam(param, layer_id, param_id);
     }
     // Finally, set the backward flag
+    need_backward &= !inference_only_;
     layer_need_backward_.push_back(need_backward);
     if (need_backward) {
       for (int top_id = 0; top_id < top_id_vecs_[layer_id].size(); ++top_id) {
@@ -280,6 +402,34 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
   }
   ShareWeights();
   debug_info_ = param.debug_info();
+  force_backward_ = param.force_backward();
+  layer_fused_.assign(layers_.size(), false);
+  fuse_activations_ = param.fuse_activations();
+  fuse_elementwise_ = param.fuse_elementwise();
+  if (fuse_activations_) {
+    FuseActivations();
+  }
+  forward_run_last_.resize(layers_.size());
+  backward_run_first_.resize(layers_.size());
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    forward_run_last_[layer_id] = layer_id;
+    backward_run_first_[layer_id] = layer_id;
+  }
+  if (fuse_elementwise_) {
+    FuseElementwise();
+  }
+  optimize_memory_ = param.optimize_memory();
+  if (optimize_memory_) {
+    PlanActivationMemory();
+  }
+  if (inference_only_) {
+    ReportInferenceSavings();
+  }
+  const Workspace& workspace = Workspace::Get();
+  LOG_IF(INFO, Caffe::root_solver() && workspace.saved_bytes() > 0)
+      << "Shared workspace: " << workspace.size() << " bytes serve "
+      << workspace.requested_bytes() << " bytes of layer scratch requests ("
+      << workspace.saved_bytes() << " bytes saved)";
   LOG_IF(INFO, Caffe::root_solver()) << "Network initialization done.";
 }
 
@@ -540,17 +690,212 @@ void Net<Dtype>::AppendParam(const NetParameter& param, const int layer_id,
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::ReportInferenceSavings() const {
+  // Count what training would have allocated: the diffs of the blobs each
+  // layer produces (in-place tops belong to the layer that made the blob)
+  // and of the params it owns, plus the backward-only state it left out.
+  size_t total_bytes = 0;
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    size_t diff_bytes = 0;
+    const vector<int>& bottom_ids = bottom_id_vecs_[layer_id];
+    for (int top_id = 0; top_id < top_id_vecs_[layer_id].size(); ++top_id) {
+      const int blob_id = top_id_vecs_[layer_id][top_id];
+      if (blob_loss_weights_[blob_id] == Dtype(0) &&
+          std::find(bottom_ids.begin(), bottom_ids.end(), blob_id) ==
+          bottom_ids.end()) {
+        diff_bytes += blobs_[blob_id]->count() * sizeof(Dtype);
+      }
+    }
+    for (int param_id = 0; param_id < param_id_vecs_[layer_id].size();
+         ++param_id) {
+      const int net_param_id = param_id_vecs_[layer_id][param_id];
+      if (param_owners_[net_param_id] == -1) {
+        diff_bytes += params_[net_param_id]->count() * sizeof(Dtype);
+      }
+    }
+    const size_t state_bytes = layers_[layer_id]->inference_saved_bytes();
+    LOG_IF(INFO, Caffe::root_solver() && diff_bytes + state_bytes > 0)
+        << "Inference only: " << layer_names_[layer_id] << " saves "
+        << diff_bytes + state_bytes << " bytes (" << diff_bytes
+        << " of diffs, " << state_bytes << " of backward state)";
+    total_bytes += diff_bytes + state_bytes;
+  }
+  LOG_IF(INFO, Caffe::root_solver())
+      << "Inference only: saves " << total_bytes << " bytes in total";
+}
+
+template <typename Dtype>
+void Net<Dtype>::FuseActivations() {
+  for (int i = 1; i < layers_.size(); ++i) {
+    const vector<Blob<Dtype>*>& bottom = bottom_vecs_[i];
+    const vector<Blob<Dtype>*>& top = top_vecs_[i];
+    // Only an in-place layer right after its input's producer sees exactly
+    // what that layer wrote.
+    if (bottom.size() != 1 || top.size() != 1 || bottom[0] != top[0] ||
+        top_vecs_[i - 1].size() != 1 || top_vecs_[i - 1][0] != top[0]) {
+      continue;
+    }
+    if (layers_[i - 1]->FuseActivation(layers_[i].get(),
+                                       layer_need_backward_[i])) {
+      layer_fused_[i] = true;
+      LOG_IF(INFO, Caffe::root_solver()) << "Fused " << layer_names_[i]
+          << " into " << layer_names_[i - 1];
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::FuseElementwise() {
+  const int num_layers = layers_.size();
+  // Whether each layer consumes the only top of the layer before, which
+  // itself has only one top of the same count.
+  vector<bool> chained(num_layers, false);
+  for (int i = 1; i < num_layers; ++i) {
+    const vector<Blob<Dtype>*>& bottom = bottom_vecs_[i];
+    const vector<Blob<Dtype>*>& top = top_vecs_[i];
+    if (top.size() != 1 || top_vecs_[i - 1].size() != 1) { continue; }
+    bool same_count = true;
+    for (int j = 0; j < bottom.size(); ++j) {
+      chained[i] = chained[i] || bottom[j] == top_vecs_[i - 1][0];
+      same_count = same_count && bottom[j]->count() == top[0]->count();
+    }
+    chained[i] = chained[i] && same_count;
+  }
+  vector<bool> forward(num_layers), backward(num_layers);
+  for (int i = 0; i < num_layers; ++i) {
+    Layer<Dtype>* layer = layers_[i].get();
+    const bool one_top = top_vecs_[i].size() == 1;
+    // Activations fused into the layer below do not run forward at all.
+    forward[i] = one_top && !layer_fused_[i] && layer->loss(0) == 0 &&
+        layer->ElementwiseForward(layer_need_backward_[i]);
+    backward[i] = one_top && bottom_vecs_[i].size() == 1 &&
+        layer_need_backward_[i] && bottom_need_backward_[i][0] &&
+        layer->ElementwiseBackward();
+  }
+  for (int first = 0, last; first < num_layers; first = last + 1) {
+    for (last = first; last + 1 < num_layers && forward[first] &&
+         forward[last + 1] && chained[last + 1]; ++last) {}
+    if (last > first) {
+      forward_run_last_[first] = last;
+      LOG_IF(INFO, Caffe::root_solver()) << "Fused the forward passes of "
+          << layer_names_[first] << " to " << layer_names_[last];
+    }
+  }
+  for (int first = 0, last; first < num_layers; first = last + 1) {
+    for (last = first; last + 1 < num_layers && backward[first] &&
+         backward[last + 1] && chained[last + 1]; ++last) {}
+    if (last > first) {
+      backward_run_first_[last] = first;
+      LOG_IF(INFO, Caffe::root_solver()) << "Fused the backward passes of "
+          << layer_names_[last] << " to " << layer_names_[first];
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::ForwardElementwise(const int first, const int last) {
+  for (int i = first; i <= last; ++i) {
+    layers_[i]->Reshape(bottom_vecs_[i], top_vecs_[i]);
+  }
+  const int count = top_vecs_[last][0]->count();
+  // Taken in layer order, so that in-place layers find their bottom data
+  // where their tops go.
+  vector<vector<const Dtype*> > bottom_data(last - first + 1);
+  vector<Dtype*> top_data(last - first + 1);
+  for (int i = first; i <= last; ++i) {
+    const vector<Blob<Dtype>*>& bottom = bottom_vecs_[i];
+    for (int j = 0; j < bottom.size(); ++j) {
+      CHECK_EQ(bottom[j]->count(), count) << "Layer " << layer_names_[i]
+          << " changed the count of the fused elementwise layers.";
+      bottom_data[i - first].push_back(bottom[j]->cpu_data());
+    }
+    CHECK_EQ(top_vecs_[i][0]->count(), count) << "Layer " << layer_names_[i]
+        << " changed the count of the fused elementwise layers.";
+    top_data[i - first] = top_vecs_[i][0]->mutable_cpu_data();
+  }
+  const int num_tiles = (count + kElementwiseTile - 1) / kElementwiseTile;
+#ifdef _OPENMP
+  #pragma omp parallel for if (count >= kParallelMinInputs)
+#endif
+  for (int tile = 0; tile < num_tiles; ++tile) {
+    const int begin = tile * kElementwiseTile;
+    const int end = std::min(count, begin + kElementwiseTile);
+    for (int i = first; i <= last; ++i) {
+      layers_[i]->ForwardElements(&bottom_data[i - first][0],
+          top_data[i - first], begin, end);
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::BackwardElementwise(const int first, const int last) {
+  const int count = top_vecs_[last][0]->count();
+  vector<const Dtype*> top_data, top_diff, bottom_data;
+  vector<Dtype*> bottom_diff;
+  for (int i = first; i <= last; ++i) {
+    Blob<Dtype>* top = top_vecs_[i][0];
+    Blob<Dtype>* bottom = bottom_vecs_[i][0];
+    CHECK_EQ(top->count(), count);
+    CHECK_EQ(bottom->count(), count);
+    top_data.push_back(top->cpu_data());
+    top_diff.push_back(top->cpu_diff());
+    bottom_data.push_back(bottom->cpu_data());
+    bottom_diff.push_back(bottom->mutable_cpu_diff());
+  }
+  const int num_tiles = (count + kElementwiseTile - 1) / kElementwiseTile;
+#ifdef _OPENMP
+  #pragma omp parallel for if (count >= kParallelMinInputs)
+#endif
+  for (int tile = 0; tile < num_tiles; ++tile) {
+    const int begin = tile * kElementwiseTile;
+    const int end = std::min(count, begin + kElementwiseTile);
+    for (int i = last; i >= first; --i) {
+      const int k = i - first;
+      layers_[i]->BackwardElements(top_data[k], top_diff[k], bottom_data[k],
+          bottom_diff[k], begin, end);
+    }
+  }
+}
+
 template <typename Dtype>
 Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
   CHECK_GE(start, 0);
   CHECK_LT(end, layers_.size());
+  // Ranges that split a layer from its fused activation run the two apart,
+  // as they would run unfused: a range ending at the layer leaves the
+  // activation out, and one starting at the activation runs it.
+  const bool split_fusion = end + 1 < layers_.size() &&
+      layer_fused_[end + 1] && Caffe::mode() == Caffe::CPU;
+  if (split_fusion) {
+    layers_[end]->SuspendFusedActivation(true);
+  }
   Dtype loss = 0;
   for (int i = start; i <= end; ++i) {
+    if (layer_fused_[i] && i > start && Caffe::mode() == Caffe::CPU) {
+      // The layer below already applied this one in its Forward_cpu; only
+      // its shapes still follow the input.
+      layers_[i]->Reshape(bottom_vecs_[i], top_vecs_[i]);
+      continue;
+    }
+    const int last = forward_run_last_[i];
+    if (last > i && last <= end && Caffe::mode() == Caffe::CPU) {
+      // Layers with a loss never join a run, so it adds none.
+      ForwardElementwise(i, last);
+      if (debug_info_) {
+        for (int j = i; j <= last; ++j) { ForwardDebugInfo(j); }
+      }
+      i = last;
+      continue;
+    }
     // LOG(ERROR) << "Forwarding " << layer_names_[i];
     Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
     loss += layer_loss;
     if (debug_info_) { ForwardDebugInfo(i); }
   }
+  if (split_fusion) {
+    layers_[end]->SuspendFusedActivation(false);
+  }
   return loss;
 }
 
@@ -588,9 +933,19 @@ const vector<Blob<Dtype>*>& Net<Dtype>::Forward(
 
 template <typename Dtype>
 void Net<Dtype>::BackwardFromTo(int start, int end) {
+  CHECK(!inference_only_) << "Cannot run an inference-only net backward.";
   CHECK_GE(end, 0);
   CHECK_LT(start, layers_.size());
   for (int i = start; i >= end; --i) {
+    const int first = backward_run_first_[i];
+    if (first < i && first >= end && Caffe::mode() == Caffe::CPU) {
+      BackwardElementwise(first, i);
+      if (debug_info_) {
+        for (int j = i; j >= first; --j) { BackwardDebugInfo(j); }
+      }
+      i = first;
+      continue;
+    }
     if (layer_need_backward_[i]) {
       layers_[i]->Backward(
           top_vecs_[i], bottom_need_backward_[i], bottom_vecs_[i]);
@@ -599,6 +954,150 @@ void Net<Dtype>::BackwardFromTo(int start, int end) {
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::PlanActivationMemory() {
+  // TEST nets are never run backward (unless forced to); other nets qualify
+  // only if none of their layers needs backward.
+  if (phase_ != TEST || force_backward_) {
+    for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+      if (layer_need_backward_[layer_id]) {
+        LOG(WARNING) << "Ignoring optimize_memory: layer "
+            << layer_names_[layer_id] << " needs backward computation.";
+        optimize_memory_ = false;
+        return;
+      }
+    }
+  }
+  // Blobs whose contents must survive the forward pass: the net inputs and
+  // outputs, the tops of layers without bottoms, as data layers may point
+  // their tops at memory of their own, and loss blobs, whose diffs hold the
+  // loss weights. Layers that share data with blobs of their own keep their
+  // tops and bottoms too, as moving those would leave the internal blobs
+  // behind.
+  vector<bool> blob_keep(blobs_.size(), false);
+  for (int blob_id = 0; blob_id < blob_loss_weights_.size(); ++blob_id) {
+    blob_keep[blob_id] = blob_loss_weights_[blob_id] != Dtype(0);
+  }
+  for (int i = 0; i < net_input_blob_indices_.size(); ++i) {
+    blob_keep[net_input_blob_indices_[i]] = true;
+  }
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    blob_keep[net_output_blob_indices_[i]] = true;
+  }
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    const bool shares_internal_data = layers_[layer_id]->SharesInternalData();
+    if (bottom_vecs_[layer_id].empty() || shares_internal_data) {
+      for (int top_id = 0; top_id < top_id_vecs_[layer_id].size(); ++top_id) {
+        blob_keep[top_id_vecs_[layer_id][top_id]] = true;
+      }
+    }
+    if (shares_internal_data) {
+      for (int i = 0; i < bottom_id_vecs_[layer_id].size(); ++i) {
+        blob_keep[bottom_id_vecs_[layer_id][i]] = true;
+      }
+    }
+  }
+  // Blobs that already share their data (e.g. the tops of Split, Flatten or
+  // Reshape layers and their bottoms) form one group that is placed as a
+  // whole, living from the first to the last use of any of its members.
+  map<SyncedMemory*, int> memory_to_group;
+  vector<int> blob_group(blobs_.size());
+  vector<size_t> group_bytes;
+  vector<bool> group_keep;
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    SyncedMemory* memory = blobs_[blob_id]->data().get();
+    map<SyncedMemory*, int>::iterator it = memory_to_group.find(memory);
+    int group;
+    if (it == memory_to_group.end()) {
+      group = group_bytes.size();
+      memory_to_group[memory] = group;
+      group_bytes.push_back(0);
+      group_keep.push_back(false);
+    } else {
+      group = it->second;
+    }
+    blob_group[blob_id] = group;
+    group_bytes[group] = std::max(group_bytes[group],
+        blobs_[blob_id]->count() * sizeof(Dtype));
+    group_keep[group] = group_keep[group] || blob_keep[blob_id];
+  }
+  const int num_groups = group_bytes.size();
+  vector<int> group_first(num_groups, layers_.size());
+  vector<int> group_last(num_groups, -1);
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    for (int i = 0; i < bottom_id_vecs_[layer_id].size(); ++i) {
+      const int group = blob_group[bottom_id_vecs_[layer_id][i]];
+      group_first[group] = std::min(group_first[group], layer_id);
+      group_last[group] = std::max(group_last[group], layer_id);
+    }
+    for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+      const int group = blob_group[top_id_vecs_[layer_id][i]];
+      group_first[group] = std::min(group_first[group], layer_id);
+      group_last[group] = std::max(group_last[group], layer_id);
+    }
+  }
+  vector<pair<int, int> > groups_by_first;
+  for (int group = 0; group < num_groups; ++group) {
+    if (!group_keep[group] && group_last[group] >= 0) {
+      groups_by_first.push_back(make_pair(group_first[group], group));
+    }
+  }
+  std::sort(groups_by_first.begin(), groups_by_first.end());
+  // Greedily assign each group, in order of first use, to an arena that is
+  // free by then: the smallest one that is already large enough, or else the
+  // largest one, grown to fit.
+  vector<size_t> arena_bytes;
+  vector<int> arena_busy_until;
+  vector<int> group_arena(num_groups, -1);
+  size_t planned_bytes = 0;
+  for (int i = 0; i < groups_by_first.size(); ++i) {
+    const int group = groups_by_first[i].second;
+    const size_t bytes = group_bytes[group];
+    planned_bytes += bytes;
+    int best = -1;
+    for (int arena = 0; arena < arena_bytes.size(); ++arena) {
+      if (arena_busy_until[arena] >= group_first[group]) { continue; }
+      if (best < 0) {
+        best = arena;
+      } else if (arena_bytes[best] >= bytes) {
+        if (arena_bytes[arena] >= bytes &&
+            arena_bytes[arena] < arena_bytes[best]) {
+          best = arena;
+        }
+      } else if (arena_bytes[arena] > arena_bytes[best]) {
+        best = arena;
+      }
+    }
+    if (best < 0) {
+      best = arena_bytes.size();
+      arena_bytes.push_back(0);
+      arena_busy_until.push_back(-1);
+    }
+    arena_bytes[best] = std::max(arena_bytes[best], bytes);
+    arena_busy_until[best] = group_last[group];
+    group_arena[group] = best;
+  }
+  // Allocating the arenas lazily releases the blobs' previous memory once
+  // they are pointed at them.
+  activation_arenas_.clear();
+  size_t arena_total_bytes = 0;
+  for (int arena = 0; arena < arena_bytes.size(); ++arena) {
+    activation_arenas_.push_back(shared_ptr<SyncedMemory>(
+        new SyncedMemory(arena_bytes[arena])));
+    arena_total_bytes += arena_bytes[arena];
+  }
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    const int arena = group_arena[blob_group[blob_id]];
+    if (arena >= 0) {
+      blobs_[blob_id]->set_data(activation_arenas_[arena]);
+    }
+  }
+  LOG_IF(INFO, Caffe::root_solver())
+      << "Shared " << groups_by_first.size() << " activations ("
+      << planned_bytes << " bytes) in " << activation_arenas_.size()
+      << " arenas (" << arena_total_bytes << " bytes).";
+}
+
 template <typename Dtype>
 void Net<Dtype>::ForwardDebugInfo(const int layer_id) {
   for (int top_id = 0; top_id < top_vecs_[layer_id].size(); ++top_id) {
@@ -741,9 +1240,27 @@ void Net<Dtype>::Backward() {
 
 template <typename Dtype>
 void Net<Dtype>::Reshape() {
+  if (optimize_memory_) {
+    // Give the planned blobs memory of their own again, so that the layers
+    // re-establish which blobs alias each other before planning anew.
+    set<SyncedMemory*> arenas;
+    for (int i = 0; i < activation_arenas_.size(); ++i) {
+      arenas.insert(activation_arenas_[i].get());
+    }
+    for (int i = 0; i < blobs_.size(); ++i) {
+      if (arenas.count(blobs_[i]->data().get())) {
+        blobs_[i]->set_data(shared_ptr<SyncedMemory>(
+            new SyncedMemory(blobs_[i]->count() * sizeof(Dtype))));
+      }
+    }
+    activation_arenas_.clear();
+  }
   for (int i = 0; i < layers_.size(); ++i) {
     layers_[i]->Reshape(bottom_vecs_[i], top_vecs_[i]);
   }
+  if (optimize_memory_) {
+    PlanActivationMemory();
+  }
 }
 
 template <typename Dtype>
@@ -778,17 +1295,22 @@ void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
             << "To learn this layer's parameters from scratch rather than "
             << "copying from a saved net, rename the layer.";
       }
-      const bool kReshape = false;
-      target_blobs[j]->FromProto(source_layer.blobs(j), kReshape);
+      layers_[target_layer_id]->ParamFromProto(j, source_layer.blobs(j));
     }
   }
 }
 
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFrom(const string trained_filename) {
+  const string kMappedExtension = ".caffeweights";
   if (trained_filename.size() >= 3 &&
       trained_filename.compare(trained_filename.size() - 3, 3, ".h5") == 0) {
     CopyTrainedLayersFromHDF5(trained_filename);
+  } else if (trained_filename.size() >= kMappedExtension.size() &&
+      trained_filename.compare(trained_filename.size() -
+          kMappedExtension.size(), kMappedExtension.size(),
+          kMappedExtension) == 0) {
+    CopyTrainedLayersFromMappedFile(trained_filename);
   } else {
     CopyTrainedLayersFromBinaryProto(trained_filename);
   }
@@ -852,8 +1374,95 @@ void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
   H5Fclose(file_hid);
 }
 
+template <typename Dtype>
+void Net<Dtype>::CopyTrainedLayersFromMappedFile(
+    const string trained_filename) {
+  shared_ptr<MappedFile> file(new MappedFile(trained_filename));
+  char* data = static_cast<char*>(file->data());
+  CHECK_GE(file->size(), sizeof(MappedFileHeader))
+      << "Error reading weights from " << trained_filename;
+  const MappedFileHeader& header =
+      *reinterpret_cast<const MappedFileHeader*>(data);
+  CHECK_EQ(memcmp(header.magic, kMappedFileMagic, sizeof(header.magic)), 0)
+      << trained_filename << " is not a mapped weights file.";
+  CHECK_EQ(header.version, kMappedFileVersion)
+      << "Unsupported mapped weights version in " << trained_filename;
+  CHECK_EQ(header.dtype_size, sizeof(Dtype))
+      << trained_filename << " holds params of a different data type.";
+  // Bound the sizes read from the file before adding them to offsets, so
+  // that a corrupt file cannot make them wrap around.
+  CHECK_LE(header.index_size, file->size() - sizeof(header))
+      << "Error reading weights from " << trained_filename;
+  CHECK_LE(header.index_size, static_cast<uint64_t>(INT_MAX))
+      << "Error reading weights from " << trained_filename;
+  NetParameter index;
+  CHECK(index.ParseFromArray(data + sizeof(header), header.index_size))
+      << "Error reading weights from " << trained_filename;
+  size_t offset = sizeof(header) + header.index_size;
+  mapped_files_.resize(layers_.size());
+  for (int i = 0; i < index.layer_size(); ++i) {
+    const LayerParameter& source_layer = index.layer(i);
+    const string& source_layer_name = source_layer.name();
+    // Work out where the params of the source layer lie even if it is ignored.
+    vector<size_t> offsets(source_layer.blobs_size());
+    for (int j = 0; j < source_layer.blobs_size(); ++j) {
+      offsets[j] = MappedFileAlign(offset);
+      Blob<Dtype> source_blob;
+      source_blob.Reshape(source_layer.blobs(j).shape());
+      const uint64_t bytes =
+          static_cast<uint64_t>(source_blob.count()) * sizeof(Dtype);
+      CHECK(offsets[j] <= file->size() && bytes <= file->size() - offsets[j])
+          << "Error reading weights from " << trained_filename;
+      offset = offsets[j] + bytes;
+    }
+    if (!layer_names_index_.count(source_layer_name)) {
+      LOG(INFO) << "Ignoring source layer " << source_layer_name;
+      continue;
+    }
+    int target_layer_id = layer_names_index_[source_layer_name];
+    DLOG(INFO) << "Mapping source layer " << source_layer_name;
+    vector<shared_ptr<Blob<Dtype> > >& target_blobs =
+        layers_[target_layer_id]->blobs();
+    CHECK_EQ(target_blobs.size(), source_layer.blobs_size())
+        << "Incompatible number of blobs for layer " << source_layer_name;
+    mapped_files_[target_layer_id].resize(target_blobs.size());
+    for (int j = 0; j < target_blobs.size(); ++j) {
+      if (!target_blobs[j]->ShapeEquals(source_layer.blobs(j))) {
+        Blob<Dtype> source_blob;
+        source_blob.Reshape(source_layer.blobs(j).shape());
+        LOG(FATAL) << "Cannot copy param " << j << " weights from layer '"
+            << source_layer_name << "'; shape mismatch.  Source param shape is "
+            << source_blob.shape_string() << "; target param shape is "
+            << target_blobs[j]->shape_string() << ". "
+            << "To learn this layer's parameters from scratch rather than "
+            << "copying from a saved net, rename the layer.";
+      }
+      const int target_net_param_id = param_id_vecs_[target_layer_id][j];
+      if (param_owners_[target_net_param_id] != -1) {
+        // Weight-shared params take their values from their owner.
+        continue;
+      }
+      target_blobs[j]->set_cpu_data(
+          reinterpret_cast<Dtype*>(data + offsets[j]));
+      // The file the param pointed into before is unmapped once no other
+      // param does.
+      mapped_files_[target_layer_id][j] = file;
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::CheckParamsHeld() const {
+  for (int i = 0; i < layers_.size(); ++i) {
+    CHECK(!layers_[i]->ParamsReleased()) << "Layer " << layer_names_[i]
+        << " freed its weights in this inference-only net; load them again "
+        << "before saving the net.";
+  }
+}
+
 template <typename Dtype>
 void Net<Dtype>::ToProto(NetParameter* param, bool write_diff) const {
+  CheckParamsHeld();
   param->Clear();
   param->set_name(name_);
   // Add bottom and top
@@ -866,6 +1475,7 @@ void Net<Dtype>::ToProto(NetParameter* param, bool write_diff) const {
 
 template <typename Dtype>
 void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
+  CheckParamsHeld();
   hid_t file_hid = H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
       H5P_DEFAULT);
   CHECK_GE(file_hid, 0)
@@ -921,8 +1531,57 @@ void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
   H5Fclose(file_hid);
 }
 
+template <typename Dtype>
+void Net<Dtype>::ToMappedFile(const string& filename) const {
+  CheckParamsHeld();
+  NetParameter index;
+  index.set_name(name_);
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    LayerParameter* layer_param = index.add_layer();
+    layer_param->set_name(layer_names_[layer_id]);
+    const vector<shared_ptr<Blob<Dtype> > >& blobs =
+        layers_[layer_id]->blobs();
+    for (int param_id = 0; param_id < blobs.size(); ++param_id) {
+      BlobShape* shape = layer_param->add_blobs()->mutable_shape();
+      for (int i = 0; i < blobs[param_id]->num_axes(); ++i) {
+        shape->add_dim(blobs[param_id]->shape(i));
+      }
+    }
+  }
+  string index_string;
+  CHECK(index.SerializeToString(&index_string));
+  MappedFileHeader header;
+  std::copy(kMappedFileMagic, kMappedFileMagic + sizeof(header.magic),
+      header.magic);
+  header.version = kMappedFileVersion;
+  header.dtype_size = sizeof(Dtype);
+  header.index_size = index_string.size();
+  std::ofstream file(filename.c_str(),
+      std::ios::out | std::ios::binary | std::ios::trunc);
+  CHECK(file.good()) << "Couldn't open " << filename << " to save weights.";
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(index_string.data(), index_string.size());
+  size_t offset = sizeof(header) + index_string.size();
+  const char padding[kMappedFileAlignment] = {0};
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    const vector<shared_ptr<Blob<Dtype> > >& blobs =
+        layers_[layer_id]->blobs();
+    for (int param_id = 0; param_id < blobs.size(); ++param_id) {
+      const size_t aligned_offset = MappedFileAlign(offset);
+      file.write(padding, aligned_offset - offset);
+      const size_t bytes = blobs[param_id]->count() * sizeof(Dtype);
+      file.write(reinterpret_cast<const char*>(blobs[param_id]->cpu_data()),
+          bytes);
+      offset = aligned_offset + bytes;
+    }
+  }
+  file.close();
+  CHECK(!file.fail()) << "Error saving weights to " << filename << ".";
+}
+
 template <typename Dtype>
 void Net<Dtype>::Update() {
+  CHECK(!inference_only_) << "Cannot update an inference-only net.";
   for (int i = 0; i < learnable_params_.size(); ++i) {
     learnable_params_[i]->Update();
   }
@@ -930,6 +1589,7 @@ void Net<Dtype>::Update() {
 
 template <typename Dtype>
 void Net<Dtype>::ClearParamDiffs() {
+  CHECK(!inference_only_) << "Inference-only nets have no param diffs.";
   for (int i = 0; i < learnable_params_.size(); ++i) {
     Blob<Dtype>* blob = learnable_params_[i];
     switch (Caffe::mode()) {
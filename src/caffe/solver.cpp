@@ -5,8 +5,10 @@
 
 #include "caffe/solver.hpp"
 #include "caffe/util/format.hpp"
+#include "caffe/util/half.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/sparse.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 namespace caffe {
@@ -415,11 +417,19 @@ void Solver<Dtype>::Snapshot() {
     model_filename = SnapshotToBinaryProto();
     break;
   case caffe::SolverParameter_SnapshotFormat_HDF5:
+    LOG_IF(WARNING, param_.snapshot_precision() != FLOAT32 ||
+        param_.snapshot_sparse())
+        << "HDF5 snapshots keep dense, full precision weights.";
     model_filename = SnapshotToHDF5();
     break;
   default:
     LOG(FATAL) << "Unsupported snapshot format.";
   }
+  if (param_.snapshot_mapped_weights()) {
+    string mapped_filename = SnapshotFilename(".caffeweights");
+    LOG(INFO) << "Snapshotting to mapped weights file " << mapped_filename;
+    net_->ToMappedFile(mapped_filename);
+  }
 
   SnapshotSolverState(model_filename);
 }
@@ -454,6 +464,21 @@ string Solver<Dtype>::SnapshotToBinaryProto() {
   LOG(INFO) << "Snapshotting to binary proto file " << model_filename;
   NetParameter net_param;
   net_->ToProto(&net_param, param_.snapshot_diff());
+  for (int i = 0; i < net_param.layer_size(); ++i) {
+    LayerParameter* layer = net_param.mutable_layer(i);
+    for (int j = 0; j < layer->blobs_size(); ++j) {
+      BlobProto* blob = layer->mutable_blobs(j);
+      if (param_.snapshot_sparse() && SparseBlobProto(blob)) {
+        continue;
+      }
+      if (param_.snapshot_precision() != FLOAT32 &&
+          !HalfBlobProto(param_.snapshot_precision(), blob)) {
+        LOG(WARNING) << "Snapshotting blob " << j << " of layer "
+            << layer->name() << " in 32 bits, out of the range of "
+            << Precision_Name(param_.snapshot_precision());
+      }
+    }
+  }
   WriteProtoToBinaryFile(net_param, model_filename);
   return model_filename;
 }
@@ -1,3 +1,5 @@
+#include <cmath>
+#include <string>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -5,6 +7,10 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/util/half.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/quantization.hpp"
+#include "caffe/util/sparse.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -112,6 +118,158 @@ TYPED_TEST(BlobSimpleTest, TestLegacyBlobProtoShapeEquals) {
   EXPECT_FALSE(this->blob_->ShapeEquals(blob_proto));
 }
 
+TYPED_TEST(BlobSimpleTest, TestQuantizedBlobProto) {
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  filler.Fill(this->blob_preshaped_);
+  BlobProto blob_proto;
+  this->blob_preshaped_->ToProto(&blob_proto);
+  QuantizeBlobProto(&blob_proto);
+  EXPECT_EQ(0, blob_proto.data_size());
+  EXPECT_EQ(0, blob_proto.double_data_size());
+  ASSERT_EQ(2, blob_proto.int8_scale_size());
+  this->blob_->FromProto(blob_proto);
+  ASSERT_TRUE(this->blob_->ShapeEquals(blob_proto));
+  // Each value is off by at most half a step of its slice.
+  const int slice_size = this->blob_->count(1);
+  for (int i = 0; i < this->blob_->count(); ++i) {
+    EXPECT_NEAR(this->blob_preshaped_->cpu_data()[i],
+        this->blob_->cpu_data()[i],
+        blob_proto.int8_scale(i / slice_size) * 0.5001);
+  }
+  // The layers recover the stored 8-bit values from the loaded blob.
+  QuantizedWeights<TypeParam> weights;
+  weights.Update(*this->blob_, 2, false);
+  for (int i = 0; i < this->blob_->count(); ++i) {
+    EXPECT_EQ(static_cast<int8_t>(blob_proto.int8_data()[i]),
+        weights.data()[i]);
+  }
+}
+
+TYPED_TEST(BlobSimpleTest, TestQuantizedWeightsFromProto) {
+  BlobProto blob_proto;
+  blob_proto.mutable_shape()->add_dim(2);
+  blob_proto.mutable_shape()->add_dim(3);
+  // Quantizing these values again would stretch each row to +-127.
+  const int8_t values[] = { -5, 3, 100, 7, -60, 1 };
+  blob_proto.set_int8_data(string(reinterpret_cast<const char*>(values), 6));
+  blob_proto.add_int8_scale(0.1);
+  blob_proto.add_int8_scale(0.37);
+  vector<int> shape(1, 2);
+  shape.push_back(3);
+  for (int keep_weights = 0; keep_weights < 2; ++keep_weights) {
+    Blob<TypeParam> blob(shape);
+    QuantizedWeights<TypeParam> weights;
+    ASSERT_TRUE(weights.FromProto(blob_proto, 2, false, keep_weights, &blob));
+    EXPECT_EQ(!keep_weights, weights.released());
+    // The loaded values are current, so Update keeps them.
+    weights.Update(blob, 2, false);
+    EXPECT_EQ(!keep_weights, weights.released());
+    for (int i = 0; i < 6; ++i) {
+      EXPECT_EQ(values[i], weights.data()[i]);
+    }
+    for (int i = 0; i < 2; ++i) {
+      EXPECT_EQ(TypeParam(blob_proto.int8_scale(i)), weights.scales()[i]);
+    }
+    if (keep_weights) {
+      for (int i = 0; i < 6; ++i) {
+        EXPECT_EQ(values[i] * TypeParam(blob_proto.int8_scale(i / 3)),
+            blob.cpu_data()[i]);
+      }
+    } else {
+      EXPECT_EQ(SyncedMemory::UNINITIALIZED, blob.data()->head());
+    }
+  }
+  // The scales of transpose weights are not those of the outputs.
+  Blob<TypeParam> blob(shape);
+  QuantizedWeights<TypeParam> weights;
+  EXPECT_FALSE(weights.FromProto(blob_proto, 3, true, true, &blob));
+}
+
+TYPED_TEST(BlobSimpleTest, TestHalfBlobProto) {
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  filler.Fill(this->blob_preshaped_);
+  const Precision precisions[] = { FLOAT16, BFLOAT16 };
+  const TypeParam tolerances[] = { 1. / 2000, 1. / 250 };
+  for (int p = 0; p < 2; ++p) {
+    BlobProto blob_proto;
+    this->blob_preshaped_->ToProto(&blob_proto);
+    EXPECT_TRUE(HalfBlobProto(precisions[p], &blob_proto));
+    EXPECT_EQ(0, blob_proto.data_size());
+    EXPECT_EQ(2 * this->blob_preshaped_->count(),
+        blob_proto.half_data().size());
+    this->blob_->FromProto(blob_proto);
+    ASSERT_TRUE(this->blob_->ShapeEquals(blob_proto));
+    for (int i = 0; i < this->blob_->count(); ++i) {
+      const TypeParam x = this->blob_preshaped_->cpu_data()[i];
+      EXPECT_NEAR(x, this->blob_->cpu_data()[i],
+          std::fabs(x) * tolerances[p] + 1e-6);
+    }
+  }
+}
+
+TYPED_TEST(BlobSimpleTest, TestHalfBlobProtoOutOfRange) {
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  filler.Fill(this->blob_preshaped_);
+  // Like the running sums of a BatchNorm layer, past the largest half.
+  this->blob_preshaped_->mutable_cpu_data()[0] = 1e5;
+  BlobProto blob_proto;
+  this->blob_preshaped_->ToProto(&blob_proto);
+  EXPECT_FALSE(HalfBlobProto(FLOAT16, &blob_proto));
+  EXPECT_EQ(this->blob_preshaped_->count(),
+      blob_proto.data_size() + blob_proto.double_data_size());
+  EXPECT_FALSE(blob_proto.has_half_data());
+  EXPECT_TRUE(HalfBlobProto(BFLOAT16, &blob_proto));
+  EXPECT_TRUE(blob_proto.has_half_data());
+}
+
+TYPED_TEST(BlobSimpleTest, TestSparseBlobProto) {
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  filler.Fill(this->blob_preshaped_);
+  BlobProto blob_proto;
+  this->blob_preshaped_->ToProto(&blob_proto);
+  EXPECT_FALSE(SparseBlobProto(&blob_proto));
+  EXPECT_FALSE(blob_proto.sparse());
+  // Prune all but every fourth value, starting with the second.
+  TypeParam* data = this->blob_preshaped_->mutable_cpu_data();
+  for (int i = 0; i < this->blob_preshaped_->count(); ++i) {
+    if (i % 4 != 1) {
+      data[i] = 0;
+    }
+  }
+  this->blob_preshaped_->ToProto(&blob_proto);
+  EXPECT_TRUE(SparseBlobProto(&blob_proto));
+  EXPECT_TRUE(blob_proto.sparse());
+  EXPECT_EQ(0, blob_proto.data_size());
+  EXPECT_EQ(this->blob_preshaped_->count() / 4, blob_proto.sparse_data_size());
+  this->blob_->FromProto(blob_proto);
+  ASSERT_TRUE(this->blob_->ShapeEquals(blob_proto));
+  for (int i = 0; i < this->blob_->count(); ++i) {
+    EXPECT_EQ(data[i], this->blob_->cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(BlobSimpleTest, TestSparseBlobProtoDouble) {
+  // Neither value fits in a float.
+  TypeParam* data = this->blob_preshaped_->mutable_cpu_data();
+  caffe_set(this->blob_preshaped_->count(), TypeParam(0), data);
+  data[1] = TypeParam(1) + TypeParam(1e-12);
+  data[7] = TypeParam(0.1);
+  BlobProto blob_proto;
+  this->blob_preshaped_->ToProto(&blob_proto);
+  EXPECT_TRUE(SparseBlobProto(&blob_proto));
+  const bool double_data = sizeof(TypeParam) == sizeof(double);
+  EXPECT_EQ(double_data ? 2 : 0, blob_proto.sparse_double_data_size());
+  EXPECT_EQ(double_data ? 0 : 2, blob_proto.sparse_data_size());
+  this->blob_->FromProto(blob_proto);
+  for (int i = 0; i < this->blob_->count(); ++i) {
+    EXPECT_EQ(data[i], this->blob_->cpu_data()[i]);
+  }
+}
+
 template <typename TypeParam>
 class BlobMathTest : public MultiDeviceTest<TypeParam> {
   typedef typename TypeParam::Dtype Dtype;
@@ -1,3 +1,4 @@
+#include <boost/thread.hpp>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -5,7 +6,13 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/layer_factory.hpp"
 #include "caffe/layers/conv_layer.hpp"
+#include "caffe/layers/fft_conv_layer.hpp"
+#include "caffe/layers/layout_layer.hpp"
+#include "caffe/layers/winograd_conv_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/workspace.hpp"
 
 #ifdef USE_CUDNN
 #include "caffe/layers/cudnn_conv_layer.hpp"
@@ -13,6 +20,7 @@
 
 #include "caffe/test/test_caffe_main.hpp"
 #include "caffe/test/test_gradient_check_util.hpp"
+#include "caffe/test/test_layer_variant_util.hpp"
 
 namespace caffe {
 
@@ -181,6 +189,30 @@ class ConvolutionLayerTest : public MultiDeviceTest<TypeParam> {
     return this->ref_blob_top_.get();
   }
 
+  // The convolutions that quantized and sparse ones are checked against,
+  // with and without groups, the 1x1 shortcut, and depthwise, on a 2x4x7x6
+  // bottom.
+  static const int kNumVariantConfigs = 4;
+  LayerParameter VariantParam(const int config) {
+    // kernel, pad, stride, num_output, group
+    const int kConfigs[kNumVariantConfigs][5] = {
+      { 3, 1, 1, 4, 1 },
+      { 3, 1, 2, 6, 2 },
+      { 1, 0, 1, 6, 2 },
+      { 3, 1, 1, 4, 4 } };
+    LayerParameter layer_param;
+    ConvolutionParameter* convolution_param =
+        layer_param.mutable_convolution_param();
+    convolution_param->add_kernel_size(kConfigs[config][0]);
+    convolution_param->add_pad(kConfigs[config][1]);
+    convolution_param->add_stride(kConfigs[config][2]);
+    convolution_param->set_num_output(kConfigs[config][3]);
+    convolution_param->set_group(kConfigs[config][4]);
+    convolution_param->mutable_weight_filler()->set_type("gaussian");
+    convolution_param->mutable_bias_filler()->set_type("gaussian");
+    return layer_param;
+  }
+
   Blob<Dtype>* const blob_bottom_;
   Blob<Dtype>* const blob_bottom_2_;
   Blob<Dtype>* const blob_top_;
@@ -264,6 +296,116 @@ TYPED_TEST(ConvolutionLayerTest, TestSimpleConvolution) {
   }
 }
 
+TYPED_TEST(ConvolutionLayerTest, TestSharedWorkspace) {
+  typedef typename TypeParam::Dtype Dtype;
+  const size_t requested = Workspace::Get().requested_bytes();
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->set_num_output(4);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  LayerParameter layer_param_2(layer_param);
+  layer_param_2.mutable_convolution_param()->set_kernel_size(0, 2);
+  vector<Blob<Dtype>*> blob_top_vec_2(1, this->blob_top_2_);
+  {
+    ConvolutionLayer<Dtype> layer(layer_param);
+    ConvolutionLayer<Dtype> layer_2(layer_param_2);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer_2.SetUp(this->blob_bottom_vec_, blob_top_vec_2);
+    // 3 * 3 * 3 x 4 * 2 and 3 * 2 * 2 x 5 * 3 column buffers.
+    const size_t bytes = 216 * sizeof(Dtype);
+    const size_t bytes_2 = 180 * sizeof(Dtype);
+    EXPECT_EQ(Workspace::Get().requested_bytes(), requested + bytes + bytes_2);
+    // One buffer, as large as the largest request, serves both layers.
+    EXPECT_GE(Workspace::Get().size(), bytes);
+    // Interleaved use of the shared buffer must not change the results.
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer_2.Forward(this->blob_bottom_vec_, blob_top_vec_2);
+    caffe_conv(this->blob_bottom_, convolution_param, layer.blobs(),
+        this->MakeReferenceTop(this->blob_top_));
+    const Dtype* top_data = this->blob_top_->cpu_data();
+    const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+    for (int i = 0; i < this->blob_top_->count(); ++i) {
+      EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-4);
+    }
+    caffe_conv(this->blob_bottom_, layer_param_2.mutable_convolution_param(),
+        layer_2.blobs(), this->MakeReferenceTop(this->blob_top_2_));
+    top_data = this->blob_top_2_->cpu_data();
+    ref_top_data = this->ref_blob_top_->cpu_data();
+    for (int i = 0; i < this->blob_top_2_->count(); ++i) {
+      EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-4);
+    }
+  }
+  EXPECT_EQ(Workspace::Get().requested_bytes(), requested);
+}
+
+template <typename Dtype>
+static void DeleteLayer(Layer<Dtype>* layer) {
+  delete layer;
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestWorkspaceReleasedOnOtherThread) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Executors may be destroyed on another thread than the one they ran on.
+  const size_t requested = Workspace::Get().requested_bytes();
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->set_num_output(4);
+  Layer<Dtype>* layer = new ConvolutionLayer<Dtype>(layer_param);
+  layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_GT(Workspace::Get().requested_bytes(), requested);
+  boost::thread thread(DeleteLayer<Dtype>, layer);
+  thread.join();
+  EXPECT_EQ(Workspace::Get().requested_bytes(), requested);
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestBatchedLowering) {
+  typedef typename TypeParam::Dtype Dtype;
+  Blob<Dtype> bottom(5, 18, 6, 4);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&bottom);
+  vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_num_output(4);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  // Lower 2 images, 2 images and 1 image. A 3x3 convolution has
+  // 18 * 3 * 3 x 4 * 2 columns and 4 x 4 * 2 outputs per image; a grouped 1x1
+  // convolution 18 x 6 * 4 columns and 4 x 6 * 4 outputs and no column buffer.
+  const int kernel_sizes[] = {3, 1};
+  const int groups[] = {1, 2};
+  const size_t image_counts[] = {1296 + 32, 432 + 96};
+  const size_t col_counts[] = {1296, 0};
+  for (int c = 0; c < 2; ++c) {
+    convolution_param->clear_kernel_size();
+    convolution_param->add_kernel_size(kernel_sizes[c]);
+    convolution_param->set_group(groups[c]);
+    convolution_param->set_batch_lowering_bytes(
+        (2 * image_counts[c] + 1) * sizeof(Dtype));
+    const size_t requested = Workspace::Get().requested_bytes();
+    ConvolutionLayer<Dtype> layer(layer_param);
+    layer.SetUp(bottom_vec, this->blob_top_vec_);
+    EXPECT_EQ(Workspace::Get().requested_bytes(), requested +
+        (col_counts[c] + 2 * image_counts[c]) * sizeof(Dtype));
+    layer.Forward(bottom_vec, this->blob_top_vec_);
+    // Check against reference convolution.
+    caffe_conv(&bottom, convolution_param, layer.blobs(),
+        this->MakeReferenceTop(this->blob_top_));
+    const Dtype* top_data = this->blob_top_->cpu_data();
+    const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+    for (int i = 0; i < this->blob_top_->count(); ++i) {
+      EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-4);
+    }
+  }
+}
+
 TYPED_TEST(ConvolutionLayerTest, TestDilatedConvolution) {
   typedef typename TypeParam::Dtype Dtype;
   vector<int> bottom_shape;
@@ -495,6 +637,75 @@ TYPED_TEST(ConvolutionLayerTest, TestSimpleConvolutionGroup) {
   }
 }
 
+TYPED_TEST(ConvolutionLayerTest, TestDepthwiseConvolution) {
+  typedef typename TypeParam::Dtype Dtype;
+  Blob<Dtype> bottom(2, 4, 9, 7);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&bottom);
+  vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(1);
+  convolution_param->add_pad(1);
+  convolution_param->add_dilation(1);
+  convolution_param->set_num_output(8);
+  convolution_param->set_group(4);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  // One channel per group, two outputs per channel, computed directly with
+  // and without striding, padding and dilation.
+  for (int step = 1; step <= 2; ++step) {
+    convolution_param->set_stride(0, step);
+    convolution_param->set_pad(0, step);
+    convolution_param->set_dilation(0, step);
+    ConvolutionLayer<Dtype> layer(layer_param);
+    layer.SetUp(bottom_vec, this->blob_top_vec_);
+    layer.Forward(bottom_vec, this->blob_top_vec_);
+    // Check against reference convolution.
+    caffe_conv(&bottom, convolution_param, layer.blobs(),
+        this->MakeReferenceTop(this->blob_top_));
+    const Dtype* top_data = this->blob_top_->cpu_data();
+    const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+    for (int i = 0; i < this->blob_top_->count(); ++i) {
+      EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-4);
+    }
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestSmallGroupConvolution) {
+  typedef typename TypeParam::Dtype Dtype;
+  Blob<Dtype> bottom(2, 6, 8, 7);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&bottom);
+  vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_kernel_h(3);
+  convolution_param->set_kernel_w(2);
+  convolution_param->add_stride(2);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(4);
+  convolution_param->set_group(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ConvolutionLayer<Dtype> layer(layer_param);
+  layer.SetUp(bottom_vec, this->blob_top_vec_);
+  layer.Forward(bottom_vec, this->blob_top_vec_);
+  // Check against reference convolution.
+  caffe_conv(&bottom, convolution_param, layer.blobs(),
+      this->MakeReferenceTop(this->blob_top_));
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-4);
+  }
+}
+
 TYPED_TEST(ConvolutionLayerTest, TestSobelConvolution) {
   // Test separable convolution by computing the Sobel operator
   // as a single filter then comparing the result
@@ -811,6 +1022,568 @@ TYPED_TEST(ConvolutionLayerTest, TestGradientGroup) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(ConvolutionLayerTest, TestGradientDepthwise) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->add_dilation(2);
+  convolution_param->set_num_output(6);
+  convolution_param->set_group(3);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ConvolutionLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestGradientSmallGroup) {
+  typedef typename TypeParam::Dtype Dtype;
+  Blob<Dtype> bottom(2, 4, 5, 4);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&bottom);
+  vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(4);
+  convolution_param->set_group(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ConvolutionLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, bottom_vec, this->blob_top_vec_);
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestGradientBatchedLowering) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(3);
+  convolution_param->set_batch_lowering_bytes(1 << 20);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ConvolutionLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestGradient1x1BatchedLowering) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(1);
+  convolution_param->set_num_output(2);
+  convolution_param->set_batch_lowering_bytes(1 << 20);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ConvolutionLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestWinogradConvolution) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_vec_.push_back(this->blob_bottom_2_);
+  this->blob_top_vec_.push_back(this->blob_top_2_);
+  LayerParameter layer_param;
+  layer_param.set_type("Convolution");
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(4);
+  convolution_param->set_engine(ConvolutionParameter_Engine_WINOGRAD);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  // The 6 x 4 outputs only partially cover the edge tiles for either size.
+  for (int tile = 2; tile <= 4; tile += 2) {
+    convolution_param->set_winograd_tile(tile);
+    shared_ptr<Layer<Dtype> > layer =
+        LayerRegistry<Dtype>::CreateLayer(layer_param);
+    EXPECT_TRUE(dynamic_cast<WinogradConvolutionLayer<Dtype>*>(layer.get()));
+    layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    // Check against reference convolution.
+    const Dtype* top_data;
+    const Dtype* ref_top_data;
+    caffe_conv(this->blob_bottom_, convolution_param, layer->blobs(),
+        this->MakeReferenceTop(this->blob_top_));
+    top_data = this->blob_top_->cpu_data();
+    ref_top_data = this->ref_blob_top_->cpu_data();
+    for (int i = 0; i < this->blob_top_->count(); ++i) {
+      EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-4);
+    }
+    caffe_conv(this->blob_bottom_2_, convolution_param, layer->blobs(),
+        this->MakeReferenceTop(this->blob_top_2_));
+    top_data = this->blob_top_2_->cpu_data();
+    ref_top_data = this->ref_blob_top_->cpu_data();
+    for (int i = 0; i < this->blob_top_->count(); ++i) {
+      EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-4);
+    }
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestWinogradConvolutionGroup) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->set_num_output(6);
+  convolution_param->set_group(3);
+  convolution_param->set_winograd_tile(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  WinogradConvolutionLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Check against reference convolution.
+  caffe_conv(this->blob_bottom_, convolution_param, layer.blobs(),
+      this->MakeReferenceTop(this->blob_top_));
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-4);
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestWinogradWeightUpdate) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->set_num_output(4);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("constant");
+  WinogradConvolutionLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Changing the weights must invalidate the cached transformed filters.
+  caffe_scal(layer.blobs()[0]->count(), Dtype(-2),
+      layer.blobs()[0]->mutable_cpu_data());
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  caffe_conv(this->blob_bottom_, convolution_param, layer.blobs(),
+      this->MakeReferenceTop(this->blob_top_));
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-4);
+  }
+  // So must sharing another blob's weights.
+  Blob<Dtype> weights;
+  weights.ReshapeLike(*layer.blobs()[0]);
+  caffe_set(weights.count(), Dtype(1), weights.mutable_cpu_data());
+  layer.blobs()[0]->ShareData(weights);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  caffe_conv(this->blob_bottom_, convolution_param, layer.blobs(),
+      this->MakeReferenceTop(this->blob_top_));
+  top_data = this->blob_top_->cpu_data();
+  ref_top_data = this->ref_blob_top_->cpu_data();
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-4);
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestWinogradGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(2);
+  // The rounding error of F(4 x 4, 3 x 3) in single precision is too large
+  // for finite differences with this step size.
+  convolution_param->set_winograd_tile(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  WinogradConvolutionLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestFFTConvolution) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_->Reshape(2, 3, 22, 22);
+  this->blob_bottom_2_->Reshape(2, 3, 22, 22);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  filler.Fill(this->blob_bottom_2_);
+  this->blob_bottom_vec_.push_back(this->blob_bottom_2_);
+  this->blob_top_vec_.push_back(this->blob_top_2_);
+  LayerParameter layer_param;
+  layer_param.set_type("Convolution");
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(11);
+  convolution_param->add_pad(5);
+  convolution_param->set_num_output(4);
+  convolution_param->set_engine(ConvolutionParameter_Engine_FFT);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  shared_ptr<Layer<Dtype> > layer =
+      LayerRegistry<Dtype>::CreateLayer(layer_param);
+  FFTConvolutionLayer<Dtype>* fft_layer =
+      dynamic_cast<FFTConvolutionLayer<Dtype>*>(layer.get());
+  ASSERT_TRUE(fft_layer);
+  layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_TRUE(fft_layer->use_fft());
+  layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Check against reference convolution.
+  const Dtype* top_data;
+  const Dtype* ref_top_data;
+  caffe_conv(this->blob_bottom_, convolution_param, layer->blobs(),
+      this->MakeReferenceTop(this->blob_top_));
+  top_data = this->blob_top_->cpu_data();
+  ref_top_data = this->ref_blob_top_->cpu_data();
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-3);
+  }
+  caffe_conv(this->blob_bottom_2_, convolution_param, layer->blobs(),
+      this->MakeReferenceTop(this->blob_top_2_));
+  top_data = this->blob_top_2_->cpu_data();
+  ref_top_data = this->ref_blob_top_->cpu_data();
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-3);
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestFFTConvolutionDilatedGroup) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_->Reshape(2, 32, 20, 20);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(7);
+  convolution_param->add_dilation(2);
+  convolution_param->add_pad(6);
+  convolution_param->set_num_output(32);
+  convolution_param->set_group(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  FFTConvolutionLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_TRUE(layer.use_fft());
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Check against reference convolution.
+  caffe_conv(this->blob_bottom_, convolution_param, layer.blobs(),
+      this->MakeReferenceTop(this->blob_top_));
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-3);
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestFFTConvolutionStrided) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_->Reshape(1, 48, 22, 22);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(11);
+  convolution_param->add_stride(2);
+  convolution_param->add_pad(5);
+  convolution_param->set_num_output(48);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  FFTConvolutionLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_TRUE(layer.use_fft());
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Check against reference convolution.
+  caffe_conv(this->blob_bottom_, convolution_param, layer.blobs(),
+      this->MakeReferenceTop(this->blob_top_));
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-2);
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestFFTCostModel) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(11);
+  convolution_param->add_pad(5);
+  convolution_param->set_num_output(4);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  FFTConvolutionLayer<Dtype> layer(layer_param);
+  // The 6 x 4 inputs have too few outputs to pay for the transforms...
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_FALSE(layer.use_fft());
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  caffe_conv(this->blob_bottom_, convolution_param, layer.blobs(),
+      this->MakeReferenceTop(this->blob_top_));
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-4);
+  }
+  // ...while larger inputs switch to the FFT on reshape.
+  this->blob_bottom_->Reshape(2, 3, 22, 22);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  layer.Reshape(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_TRUE(layer.use_fft());
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  caffe_conv(this->blob_bottom_, convolution_param, layer.blobs(),
+      this->MakeReferenceTop(this->blob_top_));
+  top_data = this->blob_top_->cpu_data();
+  ref_top_data = this->ref_blob_top_->cpu_data();
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-3);
+  }
+  // Small kernels always stay on GEMM.
+  convolution_param->clear_kernel_size();
+  convolution_param->add_kernel_size(3);
+  convolution_param->clear_pad();
+  convolution_param->add_pad(1);
+  FFTConvolutionLayer<Dtype> small_layer(layer_param);
+  small_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_FALSE(small_layer.use_fft());
+  // So do layers whose filter spectra would not fit in memory, though the
+  // FFT would take fewer multiply-adds.
+  this->blob_bottom_->Reshape(1, 64, 64, 64);
+  convolution_param->clear_kernel_size();
+  convolution_param->add_kernel_size(11);
+  convolution_param->clear_pad();
+  convolution_param->add_pad(5);
+  convolution_param->set_num_output(64);
+  FFTConvolutionLayer<Dtype> wide_layer(layer_param);
+  wide_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_FALSE(wide_layer.use_fft());
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestFFTWeightUpdate) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_->Reshape(2, 3, 22, 22);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(11);
+  convolution_param->add_pad(5);
+  convolution_param->set_num_output(4);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("constant");
+  FFTConvolutionLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  ASSERT_TRUE(layer.use_fft());
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Changing the weights must invalidate the cached filter spectra.
+  caffe_scal(layer.blobs()[0]->count(), Dtype(-2),
+      layer.blobs()[0]->mutable_cpu_data());
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  caffe_conv(this->blob_bottom_, convolution_param, layer.blobs(),
+      this->MakeReferenceTop(this->blob_top_));
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  const Dtype* ref_top_data = this->ref_blob_top_->cpu_data();
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-3);
+  }
+  // So must sharing another blob's weights.
+  Blob<Dtype> weights;
+  weights.ReshapeLike(*layer.blobs()[0]);
+  caffe_set(weights.count(), Dtype(1), weights.mutable_cpu_data());
+  layer.blobs()[0]->ShareData(weights);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  caffe_conv(this->blob_bottom_, convolution_param, layer.blobs(),
+      this->MakeReferenceTop(this->blob_top_));
+  top_data = this->blob_top_->cpu_data();
+  ref_top_data = this->ref_blob_top_->cpu_data();
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(top_data[i], ref_top_data[i], 1e-3);
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestChannelsLastConvolution) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_->Reshape(2, 4, 7, 6);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter to_nhwc_param;
+  to_nhwc_param.set_layout(NHWC);
+  LayoutLayer<Dtype> to_nhwc(to_nhwc_param);
+  LayoutLayer<Dtype> to_nchw((LayerParameter()));
+  Blob<Dtype> bottom_nhwc, top_nhwc, top;
+  vector<Blob<Dtype>*> bottom_nhwc_vec(1, &bottom_nhwc);
+  vector<Blob<Dtype>*> top_nhwc_vec(1, &top_nhwc);
+  vector<Blob<Dtype>*> top_vec(1, &top);
+  to_nhwc.SetUp(this->blob_bottom_vec_, bottom_nhwc_vec);
+  to_nhwc.Forward(this->blob_bottom_vec_, bottom_nhwc_vec);
+  // kernel, pad, stride, dilation, num_output, group: implicit GEMM with and
+  // without groups, the 1x1 shortcut, and depthwise with one and two outputs
+  // per channel.
+  const int kConfigs[][6] = {
+    { 3, 1, 1, 1, 4, 1 },
+    { 3, 1, 2, 1, 6, 2 },
+    { 1, 0, 1, 1, 6, 2 },
+    { 1, 0, 2, 1, 3, 1 },
+    { 3, 1, 1, 1, 4, 4 },
+    { 3, 2, 1, 2, 8, 4 } };
+  for (int i = 0; i < sizeof(kConfigs) / sizeof(kConfigs[0]); ++i) {
+    LayerParameter layer_param;
+    ConvolutionParameter* convolution_param =
+        layer_param.mutable_convolution_param();
+    convolution_param->add_kernel_size(kConfigs[i][0]);
+    convolution_param->add_pad(kConfigs[i][1]);
+    convolution_param->add_stride(kConfigs[i][2]);
+    convolution_param->add_dilation(kConfigs[i][3]);
+    convolution_param->set_num_output(kConfigs[i][4]);
+    convolution_param->set_group(kConfigs[i][5]);
+    convolution_param->mutable_weight_filler()->set_type("gaussian");
+    convolution_param->mutable_bias_filler()->set_type("gaussian");
+    ConvolutionLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer_param.set_layout(NHWC);
+    ConvolutionLayer<Dtype> nhwc_layer(layer_param);
+    nhwc_layer.SetUp(bottom_nhwc_vec, top_nhwc_vec);
+    ASSERT_EQ(4, top_nhwc.num_axes());
+    EXPECT_EQ(this->blob_top_->shape(1), top_nhwc.shape(3));
+    for (int j = 0; j < layer.blobs().size(); ++j) {
+      nhwc_layer.blobs()[j]->CopyFrom(*layer.blobs()[j]);
+    }
+    nhwc_layer.Forward(bottom_nhwc_vec, top_nhwc_vec);
+    to_nchw.SetUp(top_nhwc_vec, top_vec);
+    to_nchw.Forward(top_nhwc_vec, top_vec);
+    ASSERT_EQ(this->blob_top_->shape(), top.shape());
+    for (int j = 0; j < top.count(); ++j) {
+      EXPECT_NEAR(this->blob_top_->cpu_data()[j], top.cpu_data()[j], 1e-4);
+    }
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestQuantizedConvolution) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_->Reshape(2, 4, 7, 6);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  for (int i = 0; i < this->kNumVariantConfigs; ++i) {
+    LayerParameter layer_param = this->VariantParam(i);
+    ConvolutionLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer_param.mutable_quantization_param();
+    ConvolutionLayer<Dtype> quantized_layer(layer_param);
+    // Each 8-bit product is off by about 1% of the largest inputs and
+    // weights.
+    CheckLayerVariant<Dtype>(&layer, &quantized_layer, this->blob_bottom_vec_,
+        0.02, true);
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestSparseConvolution) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_->Reshape(2, 4, 7, 6);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  for (int i = 0; i < this->kNumVariantConfigs; ++i) {
+    LayerParameter layer_param = this->VariantParam(i);
+    ConvolutionParameter* convolution_param =
+        layer_param.mutable_convolution_param();
+    convolution_param->set_sparse_threshold(0);
+    ConvolutionLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    // Prune 80% of the weights.
+    Dtype* weights = layer.blobs()[0]->mutable_cpu_data();
+    for (int j = 0; j < layer.blobs()[0]->count(); ++j) {
+      if (j % 5 != 2) {
+        weights[j] = 0;
+      }
+    }
+    convolution_param->set_sparse_threshold(0.25);
+    ConvolutionLayer<Dtype> sparse_layer(layer_param);
+    CheckLayerVariant<Dtype>(&layer, &sparse_layer, this->blob_bottom_vec_,
+        1e-4);
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestHalfWeightsConvolution) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_->Reshape(2, 4, 7, 6);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  const Precision precisions[] = { FLOAT16, BFLOAT16 };
+  const Dtype tolerances[] = { 1e-2, 5e-2 };
+  for (int p = 0; p < 2; ++p) {
+    for (int i = 0; i < this->kNumVariantConfigs; ++i) {
+      LayerParameter layer_param = this->VariantParam(i);
+      ConvolutionLayer<Dtype> layer(layer_param);
+      layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+      layer_param.mutable_convolution_param()->set_weight_precision(
+          precisions[p]);
+      ConvolutionLayer<Dtype> half_layer(layer_param);
+      CheckLayerVariant<Dtype>(&layer, &half_layer, this->blob_bottom_vec_,
+          tolerances[p], true);
+    }
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestHalfWeightsReleased) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) {
+    return;
+  }
+  this->blob_bottom_->Reshape(2, 4, 7, 6);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param = this->VariantParam(1);
+  layer_param.mutable_convolution_param()->set_weight_precision(FLOAT16);
+  ConvolutionLayer<Dtype> layer(layer_param);
+  layer.set_inference_only(true);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_FALSE(layer.ParamsReleased());
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> top;
+  top.CopyFrom(*this->blob_top_, false, true);
+  // Only the 16-bit weights remain, and they give the same outputs.
+  EXPECT_EQ(SyncedMemory::UNINITIALIZED, layer.blobs()[0]->data()->head());
+  EXPECT_TRUE(layer.ParamsReleased());
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(SyncedMemory::UNINITIALIZED, layer.blobs()[0]->data()->head());
+  for (int i = 0; i < top.count(); ++i) {
+    EXPECT_EQ(top.cpu_data()[i], this->blob_top_->cpu_data()[i]);
+  }
+  // Loading the weights again makes them hold values.
+  filler.Fill(layer.blobs()[0].get());
+  EXPECT_FALSE(layer.ParamsReleased());
+}
+
 #ifdef USE_CUDNN
 
 template <typename Dtype>
@@ -0,0 +1,78 @@
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/fft.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class FFTTest : public ::testing::Test {
+ protected:
+  FFTTest() : blob_(new Blob<Dtype>(2, 1, 8, 16)) {}
+  virtual void SetUp() {
+    Caffe::set_random_seed(1701);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_);
+  }
+  virtual ~FFTTest() { delete blob_; }
+
+  // The real part, then the imaginary part, of an 8 x 16 matrix.
+  Blob<Dtype>* const blob_;
+};
+
+TYPED_TEST_CASE(FFTTest, TestDtypes);
+
+TYPED_TEST(FFTTest, TestRoundUp) {
+  EXPECT_EQ(1, FFT<TypeParam>::RoundUp(1));
+  EXPECT_EQ(8, FFT<TypeParam>::RoundUp(5));
+  EXPECT_EQ(8, FFT<TypeParam>::RoundUp(8));
+  EXPECT_EQ(32, FFT<TypeParam>::RoundUp(17));
+}
+
+TYPED_TEST(FFTTest, TestTransform2D) {
+  const int height = 8;
+  const int width = 16;
+  const int size = height * width;
+  const vector<TypeParam> input(this->blob_->cpu_data(),
+      this->blob_->cpu_data() + 2 * size);
+  FFT<TypeParam> row_fft(width);
+  FFT<TypeParam> col_fft(height);
+  TypeParam* real = this->blob_->mutable_cpu_data();
+  TypeParam* imag = real + size;
+  fft_2d(row_fft, col_fft, real, imag, false);
+  // Compare with the definition of the discrete Fourier transform.
+  for (int u = 0; u < height; ++u) {
+    for (int v = 0; v < width; ++v) {
+      double expected_real = 0;
+      double expected_imag = 0;
+      for (int h = 0; h < height; ++h) {
+        for (int w = 0; w < width; ++w) {
+          const double angle = -2 * M_PI *
+              (static_cast<double>(u * h) / height +
+               static_cast<double>(v * w) / width);
+          const double x_real = input[h * width + w];
+          const double x_imag = input[size + h * width + w];
+          expected_real += x_real * std::cos(angle) - x_imag * std::sin(angle);
+          expected_imag += x_real * std::sin(angle) + x_imag * std::cos(angle);
+        }
+      }
+      EXPECT_NEAR(expected_real, real[u * width + v], 1e-4);
+      EXPECT_NEAR(expected_imag, imag[u * width + v], 1e-4);
+    }
+  }
+  // The unscaled inverse transform recovers size times the input.
+  fft_2d(row_fft, col_fft, real, imag, true);
+  for (int i = 0; i < 2 * size; ++i) {
+    EXPECT_NEAR(input[i] * size, real[i], 1e-3);
+  }
+}
+
+}  // namespace caffe
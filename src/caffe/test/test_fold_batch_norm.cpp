@@ -0,0 +1,140 @@
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/fold_batch_norm.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class FoldBatchNormTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  virtual void SetUp() {
+    Caffe::set_random_seed(1701);
+    const string proto =
+        "layer { name: 'data' type: 'Input' top: 'data' "
+        "  input_param { shape { dim: 2 dim: 3 dim: 6 dim: 5 } } } "
+        // In place, with a Scale layer learning a bias.
+        "layer { name: 'conv1' type: 'Convolution' bottom: 'data' "
+        "  top: 'conv1' convolution_param { num_output: 4 kernel_size: 3 "
+        "  pad: 1 bias_term: false weight_filler { type: 'gaussian' } } } "
+        "layer { name: 'bn1' type: 'BatchNorm' bottom: 'conv1' top: 'conv1' } "
+        "layer { name: 'scale1' type: 'Scale' bottom: 'conv1' top: 'conv1' "
+        "  scale_param { bias_term: true } } "
+        "layer { name: 'relu1' type: 'ReLU' bottom: 'conv1' top: 'conv1' } "
+        // Out of place, with a separate Bias layer.
+        "layer { name: 'ip1' type: 'InnerProduct' bottom: 'conv1' top: 'ip1' "
+        "  inner_product_param { num_output: 5 "
+        "  weight_filler { type: 'gaussian' std: 0.1 } "
+        "  bias_filler { type: 'gaussian' } } } "
+        "layer { name: 'bn2' type: 'BatchNorm' bottom: 'ip1' top: 'ip1_bn' "
+        "  batch_norm_param { use_global_stats: true eps: 0.001 } } "
+        "layer { name: 'scale2' type: 'Scale' bottom: 'ip1_bn' "
+        "  top: 'ip1_scale' } "
+        "layer { name: 'bias2' type: 'Bias' bottom: 'ip1_scale' "
+        "  top: 'ip1_out' } "
+        // The convolution output is also read elsewhere.
+        "layer { name: 'conv2' type: 'Convolution' bottom: 'data' "
+        "  top: 'conv2' convolution_param { num_output: 4 kernel_size: 3 "
+        "  pad: 1 weight_filler { type: 'gaussian' } } } "
+        "layer { name: 'bn3' type: 'BatchNorm' bottom: 'conv2' top: 'bn3' } "
+        "layer { name: 'sum' type: 'Eltwise' bottom: 'conv2' bottom: 'bn3' "
+        "  top: 'sum' } ";
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param_));
+  }
+
+  // Fills the parameters of the normalization layers of the net.
+  void FillNormalization(Net<Dtype>* net) {
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> gaussian(filler_param);
+    filler_param.set_min(0.5);
+    filler_param.set_max(2);
+    UniformFiller<Dtype> uniform(filler_param);
+    for (int i = 0; i < net->layers().size(); ++i) {
+      const string type = net->layers()[i]->type();
+      const vector<shared_ptr<Blob<Dtype> > >& blobs =
+          net->layers()[i]->blobs();
+      if (type == "BatchNorm") {
+        gaussian.Fill(blobs[0].get());
+        uniform.Fill(blobs[1].get());
+        blobs[2]->mutable_cpu_data()[0] = 0.5;
+      } else if (type == "Scale" || type == "Bias") {
+        for (int j = 0; j < blobs.size(); ++j) {
+          gaussian.Fill(blobs[j].get());
+        }
+      }
+    }
+  }
+
+  // The index of the named layer in param, or -1.
+  int LayerIndex(const NetParameter& param, const string& name) {
+    for (int i = 0; i < param.layer_size(); ++i) {
+      if (param.layer(i).name() == name) {
+        return i;
+      }
+    }
+    return -1;
+  }
+
+  NetParameter param_;
+};
+
+TYPED_TEST_CASE(FoldBatchNormTest, TestDtypesAndDevices);
+
+TYPED_TEST(FoldBatchNormTest, TestFold) {
+  typedef typename TypeParam::Dtype Dtype;
+  Net<Dtype> net(this->param_);
+  this->FillNormalization(&net);
+  net.Forward();
+  NetParameter trained_param;
+  net.ToProto(&trained_param);
+  NetParameter folded_param;
+  // The net also has split layers.
+  EXPECT_EQ(5, FoldBatchNorm(trained_param, &folded_param));
+  EXPECT_EQ(trained_param.layer_size() - 5, folded_param.layer_size());
+  const int conv1 = this->LayerIndex(folded_param, "conv1");
+  ASSERT_GE(conv1, 0);
+  EXPECT_TRUE(folded_param.layer(conv1).convolution_param().bias_term());
+  const int ip1 = this->LayerIndex(folded_param, "ip1");
+  ASSERT_GE(ip1, 0);
+  EXPECT_EQ("ip1_out", folded_param.layer(ip1).top(0));
+  EXPECT_GE(this->LayerIndex(folded_param, "bn3"), 0);
+  Net<Dtype> folded_net(folded_param);
+  folded_net.Forward();
+  const char* kOutputs[] = { "ip1_out", "sum" };
+  for (int i = 0; i < 2; ++i) {
+    const Blob<Dtype>& expected = *net.blob_by_name(kOutputs[i]);
+    const Blob<Dtype>& actual = *folded_net.blob_by_name(kOutputs[i]);
+    ASSERT_EQ(expected.shape(), actual.shape());
+    for (int j = 0; j < expected.count(); ++j) {
+      EXPECT_NEAR(expected.cpu_data()[j], actual.cpu_data()[j], 1e-4);
+    }
+  }
+}
+
+TYPED_TEST(FoldBatchNormTest, TestBatchStatisticsNotFolded) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->param_.mutable_layer(2)->mutable_batch_norm_param()->
+      set_use_global_stats(false);
+  Net<Dtype> net(this->param_);
+  this->FillNormalization(&net);
+  NetParameter trained_param;
+  net.ToProto(&trained_param);
+  NetParameter folded_param;
+  // Neither bn1 nor the Scale layer after it folds.
+  EXPECT_EQ(3, FoldBatchNorm(trained_param, &folded_param));
+  EXPECT_GE(this->LayerIndex(folded_param, "bn1"), 0);
+  EXPECT_GE(this->LayerIndex(folded_param, "scale1"), 0);
+}
+
+}  // namespace caffe
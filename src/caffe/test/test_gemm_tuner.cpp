@@ -0,0 +1,165 @@
+#include <cmath>
+#include <fstream>  // NOLINT(readability/streams)
+#include <map>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/gemm_tuner.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class GemmTunerTest : public ::testing::Test {
+ protected:
+  GemmTunerTest() {
+    Caffe::set_random_seed(1701);
+  }
+  virtual ~GemmTunerTest() {
+    // Leave the process-wide tuner as the other tests expect it.
+    GemmTuner::Get().set_enabled(false);
+    GemmTuner::Get().set_cache_file("");
+    GemmTuner::Get().Clear();
+  }
+
+  // Operands of the product of (M x K) by (K x N) matrices, whose rows are
+  // padded, as when they are blocks of larger ones.
+  void Fill(const bool trans_a, const bool trans_b, const int M, const int N,
+      const int K) {
+    lda_ = (trans_a ? M : K) + 3;
+    ldb_ = (trans_b ? K : N) + 2;
+    ldc_ = N + 1;
+    a_.resize((trans_a ? K : M) * lda_);
+    b_.resize((trans_b ? N : K) * ldb_);
+    c_.resize(M * ldc_);
+    caffe_rng_gaussian<Dtype>(a_.size(), 0, 1, &a_[0]);
+    caffe_rng_gaussian<Dtype>(b_.size(), 0, 1, &b_[0]);
+    caffe_rng_gaussian<Dtype>(c_.size(), 0, 1, &c_[0]);
+  }
+
+  void ExpectNear(const vector<Dtype>& expected, const vector<Dtype>& actual,
+      const int K) {
+    ASSERT_EQ(expected.size(), actual.size());
+    for (int i = 0; i < expected.size(); ++i) {
+      EXPECT_NEAR(expected[i], actual[i], 1e-4 * K);
+    }
+  }
+
+  int lda_, ldb_, ldc_;
+  vector<Dtype> a_, b_, c_;
+};
+
+TYPED_TEST_CASE(GemmTunerTest, TestDtypes);
+
+TYPED_TEST(GemmTunerTest, TestKernelsMatchBlas) {
+  // Across the transposes, scalings and a K over a chunk of the small kernels.
+  const int Ms[] = {1, 5, 6};
+  const int Ns[] = {7, 1, 4};
+  const int Ks[] = {9, 300, 1};
+  const TypeParam betas[] = {0, 1, 0.5};
+  for (int shape = 0; shape < 3; ++shape) {
+    const int M = Ms[shape], N = Ns[shape], K = Ks[shape];
+    for (int trans = 0; trans < 4; ++trans) {
+      const CBLAS_TRANSPOSE TransA = trans & 1 ? CblasTrans : CblasNoTrans;
+      const CBLAS_TRANSPOSE TransB = trans & 2 ? CblasTrans : CblasNoTrans;
+      this->Fill(trans & 1, trans & 2, M, N, K);
+      const TypeParam beta = betas[(shape + trans) % 3];
+      vector<TypeParam> expected(this->c_);
+      GemmTuner::RunKernel<TypeParam>(GemmTuner::BLAS, TransA, TransB, M, N,
+          K, 1.5, &this->a_[0], this->lda_, &this->b_[0], this->ldb_, beta,
+          &expected[0], this->ldc_);
+      GemmShape gemm_shape;
+      gemm_shape.M = M;
+      gemm_shape.N = N;
+      gemm_shape.K = K;
+      for (int k = 1; k < GemmTuner::kNumKernels; ++k) {
+        const GemmTuner::Kernel kernel = static_cast<GemmTuner::Kernel>(k);
+        if (!GemmTuner::Candidate(kernel, gemm_shape)) {
+          continue;
+        }
+        vector<TypeParam> actual(this->c_);
+        GemmTuner::RunKernel<TypeParam>(kernel, TransA, TransB, M, N, K, 1.5,
+            &this->a_[0], this->lda_, &this->b_[0], this->ldb_, beta,
+            &actual[0], this->ldc_);
+        this->ExpectNear(expected, actual, K);
+      }
+    }
+  }
+}
+
+TYPED_TEST(GemmTunerTest, TestTuneAndCache) {
+  string cache_file;
+  MakeTempFilename(&cache_file);
+  GemmTuner& tuner = GemmTuner::Get();
+  tuner.set_enabled(true);
+  tuner.set_cache_file(cache_file);
+  EXPECT_EQ(tuner.decisions().size(), 0);
+
+  const int M = 6, N = 5, K = 8;
+  this->Fill(false, true, M, N, K);
+  vector<TypeParam> expected(this->c_);
+  GemmTuner::RunKernel<TypeParam>(GemmTuner::BLAS, CblasNoTrans, CblasTrans,
+      M, N, K, 1., &this->a_[0], this->lda_, &this->b_[0], this->ldb_, 0.5,
+      &expected[0], this->ldc_);
+  // The first call tunes its shape, and computes the product only once.
+  for (int i = 0; i < 2; ++i) {
+    vector<TypeParam> actual(this->c_);
+    caffe_cpu_gemm<TypeParam>(CblasNoTrans, CblasTrans, M, N, K, 1.,
+        &this->a_[0], this->lda_, &this->b_[0], this->ldb_, 0.5, &actual[0],
+        this->ldc_);
+    this->ExpectNear(expected, actual, K);
+  }
+  std::map<GemmShape, GemmTuner::Kernel> decisions = tuner.decisions();
+  ASSERT_EQ(decisions.size(), 1);
+  const GemmShape& shape = decisions.begin()->first;
+  EXPECT_EQ(shape.is_double, sizeof(TypeParam) == sizeof(double));
+  EXPECT_FALSE(shape.trans_a);
+  EXPECT_TRUE(shape.trans_b);
+  EXPECT_EQ(shape.M, M);
+  EXPECT_EQ(shape.N, N);
+  EXPECT_EQ(shape.K, K);
+  const GemmTuner::Kernel kernel = decisions.begin()->second;
+
+  // A later run finds the choice in the cache file.
+  tuner.Clear();
+  EXPECT_EQ(tuner.decisions().size(), 0);
+  tuner.set_cache_file(cache_file);
+  decisions = tuner.decisions();
+  ASSERT_EQ(decisions.size(), 1);
+  EXPECT_FALSE(decisions.begin()->first < shape);
+  EXPECT_FALSE(shape < decisions.begin()->first);
+  EXPECT_EQ(decisions.begin()->second, kernel);
+}
+
+TYPED_TEST(GemmTunerTest, TestCacheFileSkipsBadLines) {
+  string cache_file;
+  MakeTempFilename(&cache_file);
+  {
+    std::ofstream file(cache_file.c_str());
+    file << "# comment\n"
+         << "float NN 2 3 4 small\n"
+         << "double TN 5 6 7 blas\n"
+         << "float NN 2 3 kernel\n"
+         << "half NN 2 3 4 blas\n"
+         << "float NN 2 3 5 fastest\n";
+  }
+  GemmTuner& tuner = GemmTuner::Get();
+  tuner.set_cache_file(cache_file);
+  const std::map<GemmShape, GemmTuner::Kernel> decisions = tuner.decisions();
+  ASSERT_EQ(decisions.size(), 2);
+  std::map<GemmShape, GemmTuner::Kernel>::const_iterator it =
+      decisions.begin();
+  EXPECT_EQ(it->first.ToString(), "float NN 2x3x4");
+  EXPECT_EQ(it->second, GemmTuner::SMALL);
+  ++it;
+  EXPECT_EQ(it->first.ToString(), "double TN 5x6x7");
+  EXPECT_EQ(it->second, GemmTuner::BLAS);
+}
+
+}  // namespace caffe
@@ -0,0 +1,75 @@
+#include <cmath>
+#include <limits>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/half.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class HalfTest : public ::testing::Test {};
+
+TEST_F(HalfTest, TestFloatToHalf) {
+  EXPECT_EQ(0x0000, float_to_half(0.f));
+  EXPECT_EQ(0x8000, float_to_half(-0.f));
+  EXPECT_EQ(0x3c00, float_to_half(1.f));
+  EXPECT_EQ(0xc000, float_to_half(-2.f));
+  EXPECT_EQ(0x3555, float_to_half(1.f / 3));
+  // The largest half, and the smallest float that overflows it.
+  EXPECT_EQ(0x7bff, float_to_half(65504.f));
+  EXPECT_EQ(0x7bff, float_to_half(65519.f));
+  EXPECT_EQ(0x7c00, float_to_half(65520.f));
+  EXPECT_EQ(0xfc00, float_to_half(-1e10f));
+  EXPECT_EQ(0x7c00, float_to_half(std::numeric_limits<float>::infinity()));
+  EXPECT_EQ(0x7e00,
+      float_to_half(std::numeric_limits<float>::quiet_NaN()) & 0x7e00);
+  // The smallest normal and subnormal halves, and what rounds to them.
+  EXPECT_EQ(0x0400, float_to_half(std::pow(2.f, -14)));
+  EXPECT_EQ(0x0001, float_to_half(std::pow(2.f, -24)));
+  EXPECT_EQ(0x0001, float_to_half(0.75f * std::pow(2.f, -24)));
+  EXPECT_EQ(0x0000, float_to_half(0.5f * std::pow(2.f, -24)));
+  EXPECT_EQ(0x0002, float_to_half(1.5f * std::pow(2.f, -24)));
+}
+
+TEST_F(HalfTest, TestRoundToNearestEven) {
+  const float ulp = std::pow(2.f, -10);
+  EXPECT_EQ(0x3c00, float_to_half(1 + 0.5f * ulp));
+  EXPECT_EQ(0x3c02, float_to_half(1 + 1.5f * ulp));
+  EXPECT_EQ(0x3c01, float_to_half(1 + 0.51f * ulp));
+  EXPECT_EQ(0x3f80, float_to_bfloat16(1 + std::pow(2.f, -8)));
+  EXPECT_EQ(0x3f82, float_to_bfloat16(1 + 3 * std::pow(2.f, -8)));
+}
+
+TEST_F(HalfTest, TestHalfRoundTrip) {
+  for (int i = 0; i < 0x10000; ++i) {
+    const uint16_t half = i;
+    const float x = half_to_float(half);
+    if ((half & 0x7c00) == 0x7c00 && (half & 0x03ff)) {
+      EXPECT_TRUE(std::isnan(x));
+    } else {
+      EXPECT_EQ(half, float_to_half(x));
+    }
+  }
+  EXPECT_EQ(1.f, half_to_float(0x3c00));
+  EXPECT_EQ(std::pow(2.f, -24), half_to_float(0x0001));
+  EXPECT_EQ(65504.f, half_to_float(0x7bff));
+}
+
+TEST_F(HalfTest, TestBFloat16RoundTrip) {
+  for (int i = 0; i < 0x10000; ++i) {
+    const uint16_t half = i;
+    const float x = bfloat16_to_float(half);
+    if ((half & 0x7f80) == 0x7f80 && (half & 0x007f)) {
+      EXPECT_TRUE(std::isnan(x));
+      EXPECT_TRUE(std::isnan(bfloat16_to_float(float_to_bfloat16(x))));
+    } else {
+      EXPECT_EQ(half, float_to_bfloat16(x));
+    }
+  }
+  EXPECT_EQ(-2.f, bfloat16_to_float(0xc000));
+}
+
+}  // namespace caffe
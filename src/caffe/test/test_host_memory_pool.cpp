@@ -0,0 +1,128 @@
+#include <algorithm>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/syncedmem.hpp"
+#include "caffe/util/host_memory_pool.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class HostMemoryPoolTest : public ::testing::Test {
+ protected:
+  HostMemoryPoolTest() : pool_(HostMemoryPool::Get(false)) {}
+  virtual void SetUp() {
+    saved_max_cached_bytes_ = pool_.max_cached_bytes();
+    pool_.set_max_cached_bytes(1 << 20);
+    pool_.Trim();
+    pool_.ResetStats();
+  }
+  virtual void TearDown() {
+    pool_.set_max_cached_bytes(saved_max_cached_bytes_);
+  }
+
+  HostMemoryPool& pool_;
+  size_t saved_max_cached_bytes_;
+};
+
+TEST_F(HostMemoryPoolTest, TestSizeClass) {
+  EXPECT_EQ(HostMemoryPool::SizeClass(0), 64);
+  EXPECT_EQ(HostMemoryPool::SizeClass(1), 64);
+  EXPECT_EQ(HostMemoryPool::SizeClass(64), 64);
+  EXPECT_EQ(HostMemoryPool::SizeClass(65), 80);
+  EXPECT_EQ(HostMemoryPool::SizeClass(128), 128);
+  EXPECT_EQ(HostMemoryPool::SizeClass(129), 160);
+  EXPECT_EQ(HostMemoryPool::SizeClass(1000), 1024);
+  EXPECT_EQ(HostMemoryPool::SizeClass(1025), 1280);
+  for (size_t size = 1; size < 100000; size += 37) {
+    const size_t class_size = HostMemoryPool::SizeClass(size);
+    EXPECT_GE(class_size, size);
+    EXPECT_LE(class_size, std::max<size_t>(64, size + size / 4));
+  }
+}
+
+TEST_F(HostMemoryPoolTest, TestReuse) {
+  const size_t live = pool_.stats().bytes_live;
+  void* ptr = pool_.Allocate(1000);
+  EXPECT_TRUE(ptr);
+  EXPECT_EQ(pool_.stats().misses, 1);
+  EXPECT_EQ(pool_.stats().bytes_live, live + 1024);
+  pool_.Deallocate(ptr, 1000);
+  EXPECT_EQ(pool_.stats().bytes_live, live);
+  EXPECT_EQ(pool_.stats().bytes_cached, 1024);
+  // A request in the same size class gets the cached block back.
+  void* ptr2 = pool_.Allocate(1010);
+  EXPECT_EQ(ptr, ptr2);
+  HostMemoryPoolStats stats = pool_.stats();
+  EXPECT_EQ(stats.hits, 1);
+  EXPECT_EQ(stats.misses, 1);
+  EXPECT_EQ(stats.bytes_cached, 0);
+  EXPECT_DOUBLE_EQ(stats.hit_rate(), 0.5);
+  pool_.Deallocate(ptr2, 1010);
+}
+
+TEST_F(HostMemoryPoolTest, TestTrim) {
+  void* small = pool_.Allocate(100);
+  void* large = pool_.Allocate(10000);
+  pool_.Deallocate(small, 100);
+  pool_.Deallocate(large, 10000);
+  const size_t small_class = HostMemoryPool::SizeClass(100);
+  const size_t large_class = HostMemoryPool::SizeClass(10000);
+  EXPECT_EQ(pool_.stats().bytes_cached, small_class + large_class);
+  // Trimming releases the largest blocks first.
+  EXPECT_EQ(pool_.Trim(small_class), large_class);
+  EXPECT_EQ(pool_.stats().bytes_cached, small_class);
+  EXPECT_EQ(pool_.Trim(), small_class);
+  EXPECT_EQ(pool_.stats().bytes_cached, 0);
+  EXPECT_EQ(pool_.stats().releases, 2);
+}
+
+TEST_F(HostMemoryPoolTest, TestCacheOffByDefault) {
+  EXPECT_EQ(saved_max_cached_bytes_, 0);
+}
+
+TEST_F(HostMemoryPoolTest, TestCacheLimit) {
+  pool_.set_max_cached_bytes(0);
+  void* ptr = pool_.Allocate(1000);
+  pool_.Deallocate(ptr, 1000);
+  EXPECT_EQ(pool_.stats().bytes_cached, 0);
+  EXPECT_EQ(pool_.stats().releases, 1);
+}
+
+TEST_F(HostMemoryPoolTest, TestSyncedMemory) {
+  const size_t live = pool_.stats().bytes_live;
+  {
+    SyncedMemory mem(1000);
+    char* data = static_cast<char*>(mem.mutable_cpu_data());
+    EXPECT_EQ(pool_.stats().bytes_live, live + 1024);
+    for (int i = 0; i < mem.size(); ++i) {
+      data[i] = 1;
+    }
+  }
+  EXPECT_EQ(pool_.stats().bytes_live, live);
+  // A recycled block is still zero-initialized.
+  SyncedMemory mem(1000);
+  const char* data = static_cast<const char*>(mem.cpu_data());
+  EXPECT_EQ(pool_.stats().hits, 1);
+  for (int i = 0; i < mem.size(); ++i) {
+    EXPECT_EQ(data[i], 0);
+  }
+}
+
+TEST_F(HostMemoryPoolTest, TestSyncedMemoryWithoutCache) {
+  pool_.set_max_cached_bytes(0);
+  const size_t live = pool_.stats().bytes_live;
+  {
+    SyncedMemory mem(1000);
+    mem.mutable_cpu_data();
+    EXPECT_EQ(pool_.stats().bytes_live, live);
+    EXPECT_EQ(pool_.stats().misses, 0);
+    // The block goes back to the system even once caching is enabled.
+    pool_.set_max_cached_bytes(1 << 20);
+  }
+  EXPECT_EQ(pool_.stats().bytes_cached, 0);
+}
+
+}  // namespace caffe
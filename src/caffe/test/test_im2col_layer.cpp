@@ -6,6 +6,7 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/im2col_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 #include "caffe/test/test_gradient_check_util.hpp"
@@ -143,6 +144,66 @@ TYPED_TEST(Im2colLayerTest, TestDilatedGradientForceND) {
                                   this->blob_top_vec_);
 }
 
+TYPED_TEST(Im2colLayerTest, TestPaddedForwardAndBackward) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Large enough to run in parallel where threads are available.
+  Blob<Dtype> bottom(1, 16, 40, 37);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&bottom);
+  vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_kernel_h(3);
+  convolution_param->set_kernel_w(4);
+  convolution_param->set_pad_h(3);
+  convolution_param->set_pad_w(2);
+  convolution_param->set_stride_h(1);
+  convolution_param->set_stride_w(2);
+  convolution_param->add_dilation(2);
+  Im2colLayer<Dtype> layer(layer_param);
+  layer.SetUp(bottom_vec, this->blob_top_vec_);
+  layer.Forward(bottom_vec, this->blob_top_vec_);
+  // Check every column against the definition.
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  const int height_out = this->blob_top_->height();
+  const int width_out = this->blob_top_->width();
+  for (int c = 0; c < this->blob_top_->channels(); ++c) {
+    for (int h = 0; h < height_out; ++h) {
+      for (int w = 0; w < width_out; ++w) {
+        const int h_im = h - 3 + (c / 4 % 3) * 2;
+        const int w_im = w * 2 - 2 + (c % 4) * 2;
+        const Dtype expected = (h_im >= 0 && h_im < 40 && w_im >= 0 &&
+            w_im < 37) ? bottom.data_at(0, c / 12, h_im, w_im) : Dtype(0);
+        EXPECT_EQ(expected, top_data[(c * height_out + h) * width_out + w]);
+      }
+    }
+  }
+  // The 2D and N-D kernels must agree.
+  convolution_param->set_force_nd_im2col(true);
+  Im2colLayer<Dtype> layer_nd(layer_param);
+  Blob<Dtype> top_nd;
+  vector<Blob<Dtype>*> top_vec_nd(1, &top_nd);
+  layer_nd.SetUp(bottom_vec, top_vec_nd);
+  layer_nd.Forward(bottom_vec, top_vec_nd);
+  for (int i = 0; i < top_nd.count(); ++i) {
+    EXPECT_EQ(top_data[i], top_nd.cpu_data()[i]);
+  }
+  filler.Fill(this->blob_top_);
+  caffe_copy(this->blob_top_->count(), this->blob_top_->cpu_data(),
+      this->blob_top_->mutable_cpu_diff());
+  vector<bool> propagate_down(1, true);
+  layer.Backward(this->blob_top_vec_, propagate_down, bottom_vec);
+  Blob<Dtype> bottom_diff;
+  bottom_diff.CopyFrom(bottom, true, true);
+  top_nd.CopyFrom(*this->blob_top_, true);
+  layer_nd.Backward(top_vec_nd, propagate_down, bottom_vec);
+  for (int i = 0; i < bottom.count(); ++i) {
+    EXPECT_NEAR(bottom_diff.cpu_diff()[i], bottom.cpu_diff()[i], 1e-5);
+  }
+}
+
 TYPED_TEST(Im2colLayerTest, TestRect) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
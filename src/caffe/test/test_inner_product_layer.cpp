@@ -6,9 +6,11 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/inner_product_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 #include "caffe/test/test_gradient_check_util.hpp"
+#include "caffe/test/test_layer_variant_util.hpp"
 
 namespace caffe {
 
@@ -239,6 +241,84 @@ TYPED_TEST(InnerProductLayerTest, TestForwardNoBatch) {
   }
 }
 
+TYPED_TEST(InnerProductLayerTest, TestForwardQuantized) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_vec_.push_back(this->blob_bottom_);
+  for (int transpose = 0; transpose < 2; ++transpose) {
+    LayerParameter layer_param;
+    InnerProductParameter* inner_product_param =
+        layer_param.mutable_inner_product_param();
+    inner_product_param->set_num_output(10);
+    inner_product_param->set_transpose(transpose);
+    inner_product_param->mutable_weight_filler()->set_type("gaussian");
+    inner_product_param->mutable_bias_filler()->set_type("gaussian");
+    InnerProductLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    // The inputs are uniform in [0, 1].
+    layer_param.mutable_quantization_param()->set_input_range(1);
+    InnerProductLayer<Dtype> quantized_layer(layer_param);
+    CheckLayerVariant<Dtype>(&layer, &quantized_layer, this->blob_bottom_vec_,
+        0.02, true);
+  }
+}
+
+TYPED_TEST(InnerProductLayerTest, TestForwardHalfWeights) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_vec_.push_back(this->blob_bottom_);
+  const Precision precisions[] = { FLOAT16, BFLOAT16 };
+  const Dtype tolerances[] = { 1e-2, 1e-1 };
+  for (int p = 0; p < 2; ++p) {
+    for (int transpose = 0; transpose < 2; ++transpose) {
+      LayerParameter layer_param;
+      InnerProductParameter* inner_product_param =
+          layer_param.mutable_inner_product_param();
+      inner_product_param->set_num_output(10);
+      inner_product_param->set_transpose(transpose);
+      inner_product_param->mutable_weight_filler()->set_type("gaussian");
+      inner_product_param->mutable_bias_filler()->set_type("gaussian");
+      InnerProductLayer<Dtype> layer(layer_param);
+      layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+      inner_product_param->set_weight_precision(precisions[p]);
+      InnerProductLayer<Dtype> half_layer(layer_param);
+      CheckLayerVariant<Dtype>(&layer, &half_layer, this->blob_bottom_vec_,
+          tolerances[p]);
+    }
+  }
+}
+
+TYPED_TEST(InnerProductLayerTest, TestForwardSparse) {
+  typedef typename TypeParam::Dtype Dtype;
+  FillerParameter filler_param;
+  UniformFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_nobatch_);
+  Blob<Dtype>* bottoms[] = { this->blob_bottom_, this->blob_bottom_nobatch_ };
+  for (int b = 0; b < 2; ++b) {
+    vector<Blob<Dtype>*> bottom_vec(1, bottoms[b]);
+    for (int transpose = 0; transpose < 2; ++transpose) {
+      LayerParameter layer_param;
+      InnerProductParameter* inner_product_param =
+          layer_param.mutable_inner_product_param();
+      inner_product_param->set_num_output(10);
+      inner_product_param->set_transpose(transpose);
+      inner_product_param->mutable_weight_filler()->set_type("gaussian");
+      inner_product_param->mutable_bias_filler()->set_type("gaussian");
+      inner_product_param->set_sparse_threshold(0);
+      InnerProductLayer<Dtype> layer(layer_param);
+      layer.SetUp(bottom_vec, this->blob_top_vec_);
+      // Prune 90% of the weights.
+      Dtype* weights = layer.blobs()[0]->mutable_cpu_data();
+      for (int i = 0; i < layer.blobs()[0]->count(); ++i) {
+        if (i % 10 != 3) {
+          weights[i] = 0;
+        }
+      }
+      inner_product_param->set_sparse_threshold(0.1);
+      InnerProductLayer<Dtype> sparse_layer(layer_param);
+      CheckLayerVariant<Dtype>(&layer, &sparse_layer, bottom_vec, 1e-4);
+    }
+  }
+}
+
 TYPED_TEST(InnerProductLayerTest, TestGradient) {
   typedef typename TypeParam::Dtype Dtype;
   this->blob_bottom_vec_.push_back(this->blob_bottom_);
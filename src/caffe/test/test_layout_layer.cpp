@@ -0,0 +1,122 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/layout_layer.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class LayoutLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  LayoutLayerTest()
+      : blob_bottom_(new Blob<Dtype>(2, 3, 4, 5)),
+        blob_top_(new Blob<Dtype>()),
+        blob_top_nchw_(new Blob<Dtype>()) {
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+    blob_top_nchw_vec_.push_back(blob_top_nchw_);
+  }
+  virtual ~LayoutLayerTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+    delete blob_top_nchw_;
+  }
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  Blob<Dtype>* const blob_top_nchw_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+  vector<Blob<Dtype>*> blob_top_nchw_vec_;
+};
+
+TYPED_TEST_CASE(LayoutLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(LayoutLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.set_layout(NHWC);
+  LayoutLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(2, this->blob_top_->shape(0));
+  EXPECT_EQ(4, this->blob_top_->shape(1));
+  EXPECT_EQ(5, this->blob_top_->shape(2));
+  EXPECT_EQ(3, this->blob_top_->shape(3));
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int n = 0; n < 2; ++n) {
+    for (int c = 0; c < 3; ++c) {
+      for (int h = 0; h < 4; ++h) {
+        for (int w = 0; w < 5; ++w) {
+          EXPECT_EQ(this->blob_bottom_->data_at(n, c, h, w),
+              this->blob_top_->data_at(n, h, w, c));
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(LayoutLayerTest, TestRoundTrip) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.set_layout(NHWC);
+  LayoutLayer<Dtype> to_nhwc(layer_param);
+  to_nhwc.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  to_nhwc.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  LayoutLayer<Dtype> to_nchw((LayerParameter()));
+  to_nchw.SetUp(this->blob_top_vec_, this->blob_top_nchw_vec_);
+  to_nchw.Forward(this->blob_top_vec_, this->blob_top_nchw_vec_);
+  ASSERT_EQ(this->blob_bottom_->shape(), this->blob_top_nchw_->shape());
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    EXPECT_EQ(this->blob_bottom_->cpu_data()[i],
+        this->blob_top_nchw_->cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(LayoutLayerTest, TestForward2D) {
+  typedef typename TypeParam::Dtype Dtype;
+  vector<int> shape(2);
+  shape[0] = 6;
+  shape[1] = 20;
+  this->blob_bottom_->Reshape(shape);
+  LayerParameter layer_param;
+  layer_param.set_layout(NHWC);
+  LayoutLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  ASSERT_EQ(this->blob_bottom_->shape(), this->blob_top_->shape());
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    EXPECT_EQ(this->blob_bottom_->cpu_data()[i],
+        this->blob_top_->cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(LayoutLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.set_layout(NHWC);
+  LayoutLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(LayoutLayerTest, TestGradientToNCHW) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayoutLayer<Dtype> layer((LayerParameter()));
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+}  // namespace caffe
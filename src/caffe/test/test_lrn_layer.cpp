@@ -250,6 +250,60 @@ TYPED_TEST(LRNLayerTest, TestGradientWithinChannel) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(LRNLayerTest, TestForwardPhasesAndPowers) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_->Reshape(2, 7, 9, 10);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  const LRNParameter_NormRegion kRegions[] = {
+    LRNParameter_NormRegion_ACROSS_CHANNELS,
+    LRNParameter_NormRegion_WITHIN_CHANNEL };
+  const Phase kPhases[] = { TRAIN, TEST };
+  // 0.75 takes square roots rather than pow.
+  const float kBetas[] = { 0.75, 0.6 };
+  for (int r = 0; r < 2; ++r) {
+    for (int p = 0; p < 2; ++p) {
+      for (int b = 0; b < 2; ++b) {
+        LayerParameter layer_param;
+        layer_param.set_phase(kPhases[p]);
+        layer_param.mutable_lrn_param()->set_norm_region(kRegions[r]);
+        layer_param.mutable_lrn_param()->set_local_size(5);
+        layer_param.mutable_lrn_param()->set_beta(kBetas[b]);
+        LRNLayer<Dtype> layer(layer_param);
+        layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+        layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+        Blob<Dtype> top_reference;
+        this->ReferenceLRNForward(*(this->blob_bottom_), layer_param,
+            &top_reference);
+        for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+          EXPECT_NEAR(this->blob_top_->cpu_data()[i],
+              top_reference.cpu_data()[i], this->epsilon_);
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(LRNLayerTest, TestGradientTestPhase) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Outside TRAIN Forward keeps no scale, and Backward computes it again.
+  const LRNParameter_NormRegion kRegions[] = {
+    LRNParameter_NormRegion_ACROSS_CHANNELS,
+    LRNParameter_NormRegion_WITHIN_CHANNEL };
+  for (int r = 0; r < 2; ++r) {
+    LayerParameter layer_param;
+    layer_param.set_phase(TEST);
+    layer_param.mutable_lrn_param()->set_norm_region(kRegions[r]);
+    layer_param.mutable_lrn_param()->set_local_size(3);
+    LRNLayer<Dtype> layer(layer_param);
+    GradientChecker<Dtype> checker(1e-2, 1e-2);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+        this->blob_top_vec_);
+  }
+}
+
 #ifdef USE_CUDNN
 template <typename Dtype>
 class CuDNNLRNLayerTest : public GPUDeviceTest<Dtype> {
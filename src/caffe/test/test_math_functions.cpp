@@ -1,6 +1,8 @@
 #include <stdint.h>  // for uint32_t & uint64_t
 #include <time.h>
+#include <algorithm>
 #include <cmath>  // for std::fabs
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -119,6 +121,80 @@ TYPED_TEST(CPUMathFunctionsTest, TestCopy) {
   }
 }
 
+TYPED_TEST(CPUMathFunctionsTest, TestAmax) {
+  int n = this->blob_bottom_->count();
+  const TypeParam* x = this->blob_bottom_->cpu_data();
+  TypeParam std_amax = 0;
+  for (int i = 0; i < n; ++i) {
+    std_amax = std::max(std_amax, TypeParam(std::fabs(x[i])));
+  }
+  EXPECT_EQ(std_amax, caffe_cpu_amax<TypeParam>(n, x));
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestQuantize) {
+  const int kCount = 7;
+  const TypeParam x[kCount] = {0, 0.1, 0.2, -0.3, 31.7, -40, 100};
+  const int8_t expected[kCount] = {0, 0, 1, -1, 127, -127, 127};
+  int8_t y[kCount];
+  caffe_cpu_quantize<TypeParam>(kCount, 0.25, x, y);
+  for (int i = 0; i < kCount; ++i) {
+    EXPECT_EQ(expected[i], y[i]);
+  }
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestGemmS8) {
+  // Sizes that exercise both the blocked and the remainder loops.
+  const int M = 5, N = 7, K = 300;
+  vector<int8_t> A(M * K), B(N * K);
+  for (int i = 0; i < M * K; ++i) {
+    A[i] = (i * 37) % 255 - 127;
+  }
+  for (int i = 0; i < N * K; ++i) {
+    B[i] = (i * 91) % 255 - 127;
+  }
+  vector<int32_t> C(M * N);
+  caffe_cpu_gemm_s8(M, N, K, &A[0], &B[0], &C[0]);
+  for (int m = 0; m < M; ++m) {
+    for (int n = 0; n < N; ++n) {
+      int32_t expected = 0;
+      for (int k = 0; k < K; ++k) {
+        expected += A[m * K + k] * B[n * K + k];
+      }
+      EXPECT_EQ(expected, C[m * N + n]);
+    }
+  }
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestCsrmm) {
+  // A 5 x 7 sparse matrix with an empty row, times 7 x N dense matrices.
+  const int M = 5, K = 7;
+  vector<TypeParam> A(M * K, 0);
+  vector<TypeParam> values;
+  vector<int> columns, row_begin;
+  for (int m = 0; m < M; ++m) {
+    row_begin.push_back(values.size());
+    for (int k = 0; k < K; ++k) {
+      if (m != 2 && (m + k) % 3 == 0) {
+        A[m * K + k] = m - k + 0.5;
+        values.push_back(A[m * K + k]);
+        columns.push_back(k);
+      }
+    }
+  }
+  row_begin.push_back(values.size());
+  for (int N = 1; N <= 3; ++N) {
+    const TypeParam* B = this->blob_bottom_->cpu_data();
+    vector<TypeParam> C(M * N, -1), expected(M * N);
+    caffe_cpu_csrmm(M, N, K, &values[0], &columns[0], &row_begin[0], B,
+        &C[0]);
+    caffe_cpu_gemm<TypeParam>(CblasNoTrans, CblasNoTrans, M, N, K, 1, &A[0],
+        B, 0, &expected[0]);
+    for (int i = 0; i < M * N; ++i) {
+      EXPECT_NEAR(expected[i], C[i], 1e-4);
+    }
+  }
+}
+
 #ifndef CPU_ONLY
 
 template <typename Dtype>
@@ -1,3 +1,6 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <fstream>  // NOLINT(readability/streams)
 #include <string>
 #include <utility>
 #include <vector>
@@ -564,8 +567,10 @@ class NetTest : public MultiDeviceTest<TypeParam> {
     InitNetFromProtoString(proto);
   }
 
-  virtual void InitReshapableNet() {
-    const string& proto =
+  virtual void InitReshapableNet(const bool optimize_memory = false,
+                                 const bool force_backward = false,
+                                 const bool inference_only = false) {
+    string proto =
         "name: 'ReshapableNetwork' "
         "layer { "
         "  name: 'data' "
@@ -626,6 +631,365 @@ class NetTest : public MultiDeviceTest<TypeParam> {
         "  bottom: 'norm1' "
         "  top: 'softmax' "
         "} ";
+    if (optimize_memory) {
+      proto += "optimize_memory: true ";
+    }
+    if (force_backward) {
+      proto += "force_backward: true ";
+    }
+    if (inference_only) {
+      proto += "inference_only: true ";
+    }
+    InitNetFromProtoString(proto);
+  }
+
+  virtual void InitRecurrentNet(const bool optimize_memory) {
+    string proto =
+        "name: 'RecurrentNetwork' "
+        "state { phase: TEST } "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  top: 'cont' "
+        "  input_param { "
+        "  shape: { dim: 3 dim: 2 dim: 4 } "
+        "  shape: { dim: 3 dim: 2 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'ip1' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'data' "
+        "  top: 'ip1' "
+        "  inner_product_param { "
+        "    num_output: 5 "
+        "    axis: 2 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.5 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'lstm' "
+        "  type: 'LSTM' "
+        "  bottom: 'ip1' "
+        "  bottom: 'cont' "
+        "  top: 'lstm' "
+        "  recurrent_param { "
+        "    num_output: 6 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.5 "
+        "    } "
+        "    bias_filler { "
+        "      type: 'constant' "
+        "      value: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'ip2' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'lstm' "
+        "  top: 'ip2' "
+        "  inner_product_param { "
+        "    num_output: 3 "
+        "    axis: 2 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.5 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'tanh' "
+        "  type: 'TanH' "
+        "  bottom: 'ip2' "
+        "  top: 'tanh' "
+        "} ";
+    if (optimize_memory) {
+      proto += "optimize_memory: true ";
+    }
+    InitNetFromProtoString(proto);
+  }
+
+  virtual void InitChannelsLastNet(const bool channels_last) {
+    string proto =
+        "name: 'ChannelsLastNetwork' "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { "
+        "  shape: { dim: 2 dim: 4 dim: 11 dim: 9 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'conv1' "
+        "  type: 'Convolution' "
+        "  bottom: 'data' "
+        "  top: 'conv1' "
+        "  convolution_param { "
+        "    num_output: 6 "
+        "    kernel_size: 3 "
+        "    pad: 1 "
+        "    weight_filler { type: 'gaussian' } "
+        "    bias_filler { type: 'gaussian' } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv1' "
+        "  top: 'conv1' "
+        "} "
+        "layer { "
+        "  name: 'pool1' "
+        "  type: 'Pooling' "
+        "  bottom: 'conv1' "
+        "  top: 'pool1' "
+        "  pooling_param { "
+        "    pool: MAX "
+        "    kernel_size: 3 "
+        "    stride: 2 "
+        "    pad: 1 "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'conv2a' "
+        "  type: 'Convolution' "
+        "  bottom: 'pool1' "
+        "  top: 'conv2a' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 1 "
+        "    weight_filler { type: 'gaussian' } "
+        "    bias_filler { type: 'gaussian' } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'conv2b' "
+        "  type: 'Convolution' "
+        "  bottom: 'pool1' "
+        "  top: 'conv2b' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    pad: 1 "
+        "    group: 2 "
+        "    weight_filler { type: 'gaussian' } "
+        "    bias_filler { type: 'gaussian' } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'sum' "
+        "  type: 'Eltwise' "
+        "  bottom: 'conv2a' "
+        "  bottom: 'conv2b' "
+        "  top: 'sum' "
+        "} "
+        "layer { "
+        "  name: 'concat' "
+        "  type: 'Concat' "
+        "  bottom: 'conv2a' "
+        "  bottom: 'conv2b' "
+        "  top: 'concat' "
+        "} "
+        "layer { "
+        "  name: 'scale' "
+        "  type: 'Scale' "
+        "  bottom: 'concat' "
+        "  top: 'concat' "
+        "  scale_param { "
+        "    filler { type: 'gaussian' } "
+        "    bias_term: true "
+        "    bias_filler { type: 'gaussian' } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'pool2' "
+        "  type: 'Pooling' "
+        "  bottom: 'concat' "
+        "  top: 'pool2' "
+        "  pooling_param { "
+        "    pool: AVE "
+        "    global_pooling: true "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'pool2' "
+        "  top: 'ip' "
+        "  inner_product_param { "
+        "    num_output: 3 "
+        "    weight_filler { type: 'gaussian' } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'prob' "
+        "  type: 'Softmax' "
+        "  bottom: 'ip' "
+        "  top: 'prob' "
+        "} ";
+    if (channels_last) {
+      proto += "channels_last: true ";
+    }
+    InitNetFromProtoString(proto);
+  }
+
+  virtual void InitFusedActivationNet(const bool fuse_activations) {
+    string proto =
+        "name: 'FusedActivationNetwork' "
+        "force_backward: true "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { "
+        "  shape: { dim: 2 dim: 4 dim: 7 dim: 6 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'conv1' "
+        "  type: 'Convolution' "
+        "  bottom: 'data' "
+        "  top: 'conv1' "
+        "  convolution_param { "
+        "    num_output: 6 "
+        "    kernel_size: 3 "
+        "    pad: 1 "
+        "    weight_filler { type: 'gaussian' } "
+        "    bias_filler { type: 'gaussian' } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv1' "
+        "  top: 'conv1' "
+        "  relu_param { negative_slope: 0.1 } "
+        "} "
+        "layer { "
+        "  name: 'conv2' "
+        "  type: 'Convolution' "
+        "  bottom: 'conv1' "
+        "  top: 'conv2' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    group: 2 "
+        "    bias_term: false "
+        "    weight_filler { type: 'gaussian' } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'prelu2' "
+        "  type: 'PReLU' "
+        "  bottom: 'conv2' "
+        "  top: 'conv2' "
+        "  prelu_param { filler { type: 'gaussian' } } "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'conv2' "
+        "  top: 'ip' "
+        "  inner_product_param { "
+        "    num_output: 5 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "    bias_filler { type: 'gaussian' } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'prelu3' "
+        "  type: 'PReLU' "
+        "  bottom: 'ip' "
+        "  top: 'ip' "
+        "  loss_weight: 1 "
+        "  prelu_param { "
+        "    channel_shared: true "
+        "    filler { type: 'constant' value: -0.5 } "
+        "  } "
+        "} ";
+    if (fuse_activations) {
+      proto += "fuse_activations: true ";
+    }
+    InitNetFromProtoString(proto);
+  }
+
+  virtual void InitFusedElementwiseNet(const bool fuse_elementwise) {
+    string proto =
+        "name: 'FusedElementwiseNetwork' "
+        "force_backward: true "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  top: 'other' "
+        "  input_param { "
+        "    shape: { dim: 2 dim: 4 dim: 25 dim: 23 } "
+        "    shape: { dim: 2 dim: 4 dim: 25 dim: 23 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'scale' "
+        "  type: 'Scale' "
+        "  bottom: 'data' "
+        "  top: 'scaled' "
+        "  scale_param { "
+        "    filler { type: 'gaussian' } "
+        "    bias_term: true "
+        "    bias_filler { type: 'gaussian' } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU' "
+        "  bottom: 'scaled' "
+        "  top: 'scaled' "
+        "  relu_param { negative_slope: 0.1 } "
+        "} "
+        "layer { "
+        "  name: 'sum' "
+        "  type: 'Eltwise' "
+        "  bottom: 'scaled' "
+        "  bottom: 'other' "
+        "  top: 'sum' "
+        "  eltwise_param { operation: SUM coeff: 1 coeff: -0.5 } "
+        "} "
+        "layer { "
+        "  name: 'relu2' "
+        "  type: 'ReLU' "
+        "  bottom: 'sum' "
+        "  top: 'sum' "
+        "} "
+        "layer { "
+        "  name: 'power' "
+        "  type: 'Power' "
+        "  bottom: 'sum' "
+        "  top: 'power' "
+        "  power_param { power: 2 scale: 0.5 shift: 1 } "
+        "} "
+        "layer { "
+        "  name: 'exp' "
+        "  type: 'Exp' "
+        "  bottom: 'power' "
+        "  top: 'exp' "
+        "  exp_param { scale: -0.1 } "
+        "} "
+        "layer { "
+        "  name: 'tanh' "
+        "  type: 'TanH' "
+        "  bottom: 'exp' "
+        "  top: 'out' "
+        "  loss_weight: 1 "
+        "} ";
+    if (fuse_elementwise) {
+      proto += "fuse_elementwise: true ";
+    }
     InitNetFromProtoString(proto);
   }
 
@@ -1342,6 +1706,75 @@ TYPED_TEST(NetTest, TestSharedWeightsResume) {
   }
 }
 
+// The number of mappings of filename the process has, or -1 where the
+// system does not list them in /proc/self/maps.
+static int CountMappings(const string& filename) {
+  std::ifstream maps("/proc/self/maps");
+  if (!maps) {
+    return -1;
+  }
+  int count = 0;
+  string line;
+  while (std::getline(maps, line)) {
+    count += line.find(filename) != string::npos;
+  }
+  return count;
+}
+
+TYPED_TEST(NetTest, TestMappedWeights) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Train a net with weight sharing for one step and write it out.
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataSharedWeightsNet();
+  this->net_->ForwardBackward();
+  this->net_->Update();
+  string filename;
+  MakeTempFilename(&filename);
+  filename += ".caffeweights";
+  this->net_->ToMappedFile(filename);
+  shared_ptr<Net<Dtype> > trained_net = this->net_;
+
+  // Map the weights into a fresh net.
+  this->InitDiffDataSharedWeightsNet();
+  this->net_->CopyTrainedLayersFrom(filename);
+  const vector<shared_ptr<Blob<Dtype> > >& trained_params =
+      trained_net->params();
+  const vector<shared_ptr<Blob<Dtype> > >& params = this->net_->params();
+  ASSERT_EQ(trained_params.size(), params.size());
+  for (int i = 0; i < params.size(); ++i) {
+    ASSERT_EQ(trained_params[i]->shape(), params[i]->shape());
+    const Dtype* data = params[i]->cpu_data();
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(data) % 64, 0);
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_EQ(trained_params[i]->cpu_data()[j], data[j]);
+    }
+  }
+  // Shared weights still share memory.
+  Blob<Dtype>* ip1_weights = this->net_->layers()[1]->blobs()[0].get();
+  Blob<Dtype>* ip2_weights = this->net_->layers()[2]->blobs()[0].get();
+  EXPECT_EQ(ip1_weights->cpu_data(), ip2_weights->cpu_data());
+  // Writes go to private copies of the pages, so the net can still train.
+  this->net_->ForwardBackward();
+  this->net_->Update();
+  this->net_->CopyTrainedLayersFrom(filename);
+  for (int i = 0; i < params.size(); ++i) {
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_EQ(trained_params[i]->cpu_data()[j], params[i]->cpu_data()[j]);
+    }
+  }
+  // Mapping another file in place of the first unmaps it.
+  string other_filename;
+  MakeTempFilename(&other_filename);
+  other_filename += ".caffeweights";
+  this->net_->ToMappedFile(other_filename);
+  this->net_->CopyTrainedLayersFrom(other_filename);
+  const int mappings = CountMappings(filename);
+  if (mappings >= 0) {
+    EXPECT_EQ(mappings, 0);
+    EXPECT_GT(CountMappings(other_filename), 0);
+  }
+}
+
 TYPED_TEST(NetTest, TestParamPropagateDown) {
   typedef typename TypeParam::Dtype Dtype;
   const bool kBiasTerm = true, kForceBackward = false;
@@ -2446,6 +2879,542 @@ TYPED_TEST(NetTest, TestReshape) {
   EXPECT_FALSE(same_spatial_shape);
 }
 
+TYPED_TEST(NetTest, TestOptimizeMemory) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitReshapableNet();
+  shared_ptr<Net<Dtype> > ref_net = this->net_;
+  Caffe::set_random_seed(this->seed_);
+  this->InitReshapableNet(true);
+  // conv1 is dead once pool1 has run, so norm1 can take its memory.
+  EXPECT_EQ(this->net_->blob_by_name("conv1")->data(),
+            this->net_->blob_by_name("norm1")->data());
+  EXPECT_NE(this->net_->blob_by_name("conv1")->data(),
+            this->net_->blob_by_name("pool1")->data());
+  EXPECT_NE(this->net_->blob_by_name("norm1")->data(),
+            this->net_->blob_by_name("softmax")->data());
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> blob1(2, 3, 12, 10);
+  Blob<Dtype> blob2(4, 3, 9, 11);
+  filler.Fill(&blob1);
+  filler.Fill(&blob2);
+  for (int i = 0; i < 3; ++i) {
+    const Blob<Dtype>& input = (i == 1) ? blob2 : blob1;
+    Net<Dtype>* nets[] = { ref_net.get(), this->net_.get() };
+    for (int j = 0; j < 2; ++j) {
+      nets[j]->input_blobs()[0]->ReshapeLike(input);
+      caffe_copy(input.count(), input.cpu_data(),
+                 nets[j]->input_blobs()[0]->mutable_cpu_data());
+      nets[j]->Reshape();
+      nets[j]->Forward();
+    }
+    EXPECT_EQ(this->net_->blob_by_name("conv1")->data(),
+              this->net_->blob_by_name("norm1")->data());
+    const Blob<Dtype>* ref_output = ref_net->output_blobs()[0];
+    const Blob<Dtype>* output = this->net_->output_blobs()[0];
+    ASSERT_EQ(ref_output->shape(), output->shape());
+    for (int k = 0; k < output->count(); ++k) {
+      EXPECT_EQ(ref_output->cpu_data()[k], output->cpu_data()[k]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestOptimizeMemoryIgnoredWithBackward) {
+  this->InitReshapableNet(true, true);
+  EXPECT_NE(this->net_->blob_by_name("conv1")->data(),
+            this->net_->blob_by_name("norm1")->data());
+}
+
+TYPED_TEST(NetTest, TestOptimizeMemoryRecurrent) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitRecurrentNet(false);
+  shared_ptr<Net<Dtype> > ref_net = this->net_;
+  Caffe::set_random_seed(this->seed_);
+  this->InitRecurrentNet(true);
+  // The LSTM layer shares its bottom and top with its unrolled net, so they
+  // keep their memory.
+  EXPECT_NE(this->net_->blob_by_name("ip1")->data(),
+            this->net_->blob_by_name("ip2")->data());
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> data(this->net_->input_blobs()[0]->shape());
+  filler.Fill(&data);
+  for (int i = 0; i < 2; ++i) {
+    Net<Dtype>* nets[] = { ref_net.get(), this->net_.get() };
+    for (int j = 0; j < 2; ++j) {
+      Blob<Dtype>* cont = nets[j]->input_blobs()[1];
+      caffe_copy(data.count(), data.cpu_data(),
+                 nets[j]->input_blobs()[0]->mutable_cpu_data());
+      // Start the sequences at the first timestep and continue them after.
+      caffe_set(cont->count(), Dtype(1), cont->mutable_cpu_data());
+      caffe_set(cont->shape(1), Dtype(0), cont->mutable_cpu_data());
+      nets[j]->Reshape();
+      nets[j]->Forward();
+    }
+    const Blob<Dtype>* ref_output = ref_net->output_blobs()[0];
+    const Blob<Dtype>* output = this->net_->output_blobs()[0];
+    ASSERT_EQ(ref_output->shape(), output->shape());
+    for (int k = 0; k < output->count(); ++k) {
+      EXPECT_EQ(ref_output->cpu_data()[k], output->cpu_data()[k]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestInferenceOnly) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitReshapableNet();
+  shared_ptr<Net<Dtype> > ref_net = this->net_;
+  Caffe::set_random_seed(this->seed_);
+  this->InitReshapableNet(false, false, true);
+  EXPECT_TRUE(this->net_->inference_only());
+  for (int i = 0; i < this->net_->layers().size(); ++i) {
+    EXPECT_FALSE(this->net_->layer_need_backward()[i]);
+  }
+  // Max pooling keeps no mask; LRN keeps the scale of one image only.
+  EXPECT_GT(this->net_->layer_by_name("pool1")->inference_saved_bytes(), 0);
+  EXPECT_EQ(this->net_->layer_by_name("norm1")->inference_saved_bytes(), 0);
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> blob1(2, 3, 12, 10);
+  Blob<Dtype> blob2(4, 3, 9, 11);
+  filler.Fill(&blob1);
+  filler.Fill(&blob2);
+  for (int i = 0; i < 2; ++i) {
+    const Blob<Dtype>& input = (i == 1) ? blob2 : blob1;
+    Net<Dtype>* nets[] = { ref_net.get(), this->net_.get() };
+    for (int j = 0; j < 2; ++j) {
+      nets[j]->input_blobs()[0]->ReshapeLike(input);
+      caffe_copy(input.count(), input.cpu_data(),
+                 nets[j]->input_blobs()[0]->mutable_cpu_data());
+      nets[j]->Reshape();
+      nets[j]->Forward();
+    }
+    EXPECT_GT(this->net_->layer_by_name("norm1")->inference_saved_bytes(), 0);
+    const Blob<Dtype>* ref_output = ref_net->output_blobs()[0];
+    const Blob<Dtype>* output = this->net_->output_blobs()[0];
+    ASSERT_EQ(ref_output->shape(), output->shape());
+    for (int k = 0; k < output->count(); ++k) {
+      EXPECT_NEAR(ref_output->cpu_data()[k], output->cpu_data()[k], 1e-6);
+    }
+  }
+  // No blob or param ever got a diff.
+  for (int i = 0; i < this->net_->blobs().size(); ++i) {
+    EXPECT_EQ(this->net_->blobs()[i]->diff()->head(),
+              SyncedMemory::UNINITIALIZED);
+  }
+  for (int i = 0; i < this->net_->params().size(); ++i) {
+    EXPECT_EQ(this->net_->params()[i]->diff()->head(),
+              SyncedMemory::UNINITIALIZED);
+  }
+}
+
+TYPED_TEST(NetTest, TestChannelsLast) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitChannelsLastNet(false);
+  shared_ptr<Net<Dtype> > ref_net = this->net_;
+  this->InitChannelsLastNet(true);
+  NetParameter trained;
+  ref_net->ToProto(&trained);
+  this->net_->CopyTrainedLayersFrom(trained);
+  // Convolution and pooling run NHWC, and so do the layers in between...
+  EXPECT_EQ(NHWC, this->net_->layer_by_name("conv1")->layer_param().layout());
+  EXPECT_EQ(NHWC, this->net_->layer_by_name("relu1")->layer_param().layout());
+  EXPECT_EQ(NHWC, this->net_->layer_by_name("pool2")->layer_param().layout());
+  EXPECT_EQ(NHWC, this->net_->layer_by_name("concat")->layer_param().layout());
+  EXPECT_EQ(NHWC, this->net_->layer_by_name("scale")->layer_param().layout());
+  EXPECT_EQ(NCHW, this->net_->layer_by_name("ip")->layer_param().layout());
+  EXPECT_TRUE(this->net_->has_blob("conv1_nhwc"));
+  EXPECT_EQ("Layout",
+            string(this->net_->layer_by_name("data_to_nhwc")->type()));
+  // ...while the outputs are NCHW under their own names.
+  ASSERT_EQ(ref_net->output_blobs().size(),
+            this->net_->output_blobs().size());
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> input(2, 4, 11, 9);
+  filler.Fill(&input);
+  Net<Dtype>* nets[] = { ref_net.get(), this->net_.get() };
+  for (int j = 0; j < 2; ++j) {
+    nets[j]->input_blobs()[0]->CopyFrom(input);
+    nets[j]->Forward();
+  }
+  const char* outputs[] = { "sum", "prob" };
+  for (int i = 0; i < 2; ++i) {
+    const Blob<Dtype>* ref_output = ref_net->blob_by_name(outputs[i]).get();
+    const Blob<Dtype>* output = this->net_->blob_by_name(outputs[i]).get();
+    ASSERT_EQ(ref_output->shape(), output->shape());
+    for (int k = 0; k < output->count(); ++k) {
+      EXPECT_NEAR(ref_output->cpu_data()[k], output->cpu_data()[k], 1e-4);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestFuseActivations) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitFusedActivationNet(false);
+  shared_ptr<Net<Dtype> > ref_net = this->net_;
+  this->InitFusedActivationNet(true);
+  NetParameter trained;
+  ref_net->ToProto(&trained);
+  this->net_->CopyTrainedLayersFrom(trained);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> input(2, 4, 7, 6);
+  filler.Fill(&input);
+  Net<Dtype>* nets[] = { ref_net.get(), this->net_.get() };
+  for (int j = 0; j < 2; ++j) {
+    nets[j]->input_blobs()[0]->CopyFrom(input);
+    nets[j]->ClearParamDiffs();
+    nets[j]->ForwardBackward();
+  }
+  // The fused net computes the same outputs...
+  const Blob<Dtype>* ref_output = ref_net->blob_by_name("ip").get();
+  const Blob<Dtype>* output = this->net_->blob_by_name("ip").get();
+  for (int k = 0; k < output->count(); ++k) {
+    EXPECT_NEAR(ref_output->cpu_data()[k], output->cpu_data()[k], 1e-4);
+  }
+  // ...and gradients, through the PReLU slopes too.
+  ASSERT_EQ(ref_net->params().size(), this->net_->params().size());
+  for (int i = 0; i < ref_net->params().size(); ++i) {
+    const Blob<Dtype>* ref_param = ref_net->params()[i].get();
+    const Blob<Dtype>* param = this->net_->params()[i].get();
+    for (int k = 0; k < param->count(); ++k) {
+      EXPECT_NEAR(ref_param->cpu_diff()[k], param->cpu_diff()[k], 1e-4);
+    }
+  }
+  const Blob<Dtype>* ref_data = ref_net->blob_by_name("data").get();
+  const Blob<Dtype>* data = this->net_->blob_by_name("data").get();
+  for (int k = 0; k < data->count(); ++k) {
+    EXPECT_NEAR(ref_data->cpu_diff()[k], data->cpu_diff()[k], 1e-4);
+  }
+}
+
+TYPED_TEST(NetTest, TestFuseActivationsGrowInput) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitFusedActivationNet(false);
+  shared_ptr<Net<Dtype> > ref_net = this->net_;
+  this->InitFusedActivationNet(true);
+  NetParameter trained;
+  ref_net->ToProto(&trained);
+  this->net_->CopyTrainedLayersFrom(trained);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  Net<Dtype>* nets[] = { ref_net.get(), this->net_.get() };
+  // The input grows between forward passes, without a Net::Reshape; the
+  // fused PReLU layers keep their inputs for Backward all the same.
+  const int nums[] = { 2, 5 };
+  for (int n = 0; n < 2; ++n) {
+    Blob<Dtype> input(nums[n], 4, 7, 6);
+    filler.Fill(&input);
+    for (int j = 0; j < 2; ++j) {
+      nets[j]->input_blobs()[0]->CopyFrom(input, false, true);
+      nets[j]->ClearParamDiffs();
+      nets[j]->ForwardBackward();
+    }
+    const Blob<Dtype>* ref_output = ref_net->blob_by_name("ip").get();
+    const Blob<Dtype>* output = this->net_->blob_by_name("ip").get();
+    ASSERT_EQ(ref_output->shape(), output->shape());
+    for (int k = 0; k < output->count(); ++k) {
+      EXPECT_NEAR(ref_output->cpu_data()[k], output->cpu_data()[k], 1e-4);
+    }
+    for (int i = 0; i < ref_net->params().size(); ++i) {
+      const Blob<Dtype>* ref_param = ref_net->params()[i].get();
+      const Blob<Dtype>* param = this->net_->params()[i].get();
+      for (int k = 0; k < param->count(); ++k) {
+        EXPECT_NEAR(ref_param->cpu_diff()[k], param->cpu_diff()[k], 1e-4);
+      }
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestFuseActivationsQuantized) {
+  typedef typename TypeParam::Dtype Dtype;
+  // In GPU mode, the quantized layers run Forward_cpu and the net runs the
+  // fused PReLU layers, which must then see their inputs only once.
+  const string proto =
+      "name: 'FusedQuantizedNetwork' "
+      "state { phase: TEST } "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  input_param { shape: { dim: 2 dim: 4 dim: 7 dim: 6 } } "
+      "} "
+      "layer { "
+      "  name: 'conv' "
+      "  type: 'Convolution' "
+      "  bottom: 'data' "
+      "  top: 'conv' "
+      "  quantization_param { } "
+      "  convolution_param { "
+      "    num_output: 6 "
+      "    kernel_size: 3 "
+      "    weight_filler { type: 'gaussian' } "
+      "    bias_filler { type: 'gaussian' } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'prelu1' "
+      "  type: 'PReLU' "
+      "  bottom: 'conv' "
+      "  top: 'conv' "
+      "  prelu_param { filler { type: 'constant' value: -0.5 } } "
+      "} "
+      "layer { "
+      "  name: 'ip' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'conv' "
+      "  top: 'ip' "
+      "  quantization_param { } "
+      "  inner_product_param { "
+      "    num_output: 5 "
+      "    weight_filler { type: 'gaussian' std: 0.1 } "
+      "    bias_filler { type: 'gaussian' } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'prelu2' "
+      "  type: 'PReLU' "
+      "  bottom: 'ip' "
+      "  top: 'ip' "
+      "  prelu_param { "
+      "    channel_shared: true "
+      "    filler { type: 'constant' value: -0.5 } "
+      "  } "
+      "} ";
+  this->InitNetFromProtoString(proto);
+  shared_ptr<Net<Dtype> > ref_net = this->net_;
+  this->InitNetFromProtoString(proto + "fuse_activations: true ");
+  NetParameter trained;
+  ref_net->ToProto(&trained);
+  this->net_->CopyTrainedLayersFrom(trained);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> input(2, 4, 7, 6);
+  filler.Fill(&input);
+  Net<Dtype>* nets[] = { ref_net.get(), this->net_.get() };
+  for (int j = 0; j < 2; ++j) {
+    nets[j]->input_blobs()[0]->CopyFrom(input);
+    nets[j]->Forward();
+  }
+  const char* outputs[] = { "conv", "ip" };
+  for (int i = 0; i < 2; ++i) {
+    const Blob<Dtype>* ref_output = ref_net->blob_by_name(outputs[i]).get();
+    const Blob<Dtype>* output = this->net_->blob_by_name(outputs[i]).get();
+    for (int k = 0; k < output->count(); ++k) {
+      EXPECT_NEAR(ref_output->cpu_data()[k], output->cpu_data()[k], 1e-4);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestFuseActivationsForwardTo) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitFusedActivationNet(false);
+  shared_ptr<Net<Dtype> > ref_net = this->net_;
+  this->InitFusedActivationNet(true);
+  NetParameter trained;
+  ref_net->ToProto(&trained);
+  this->net_->CopyTrainedLayersFrom(trained);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> input(2, 4, 7, 6);
+  filler.Fill(&input);
+  // conv2, into which prelu2 is fused.
+  const int end = 3;
+  ASSERT_EQ("conv2", this->net_->layer_names()[end]);
+  Net<Dtype>* nets[] = { ref_net.get(), this->net_.get() };
+  for (int j = 0; j < 2; ++j) {
+    nets[j]->input_blobs()[0]->CopyFrom(input);
+    nets[j]->ForwardTo(end);
+  }
+  // Stopping at conv2 leaves its outputs before the activation...
+  const Blob<Dtype>* ref_output = ref_net->blob_by_name("conv2").get();
+  const Blob<Dtype>* output = this->net_->blob_by_name("conv2").get();
+  for (int k = 0; k < output->count(); ++k) {
+    EXPECT_NEAR(ref_output->cpu_data()[k], output->cpu_data()[k], 1e-4);
+  }
+  // ...and later passes fuse it again.
+  for (int j = 0; j < 2; ++j) {
+    nets[j]->Forward();
+  }
+  for (int k = 0; k < output->count(); ++k) {
+    EXPECT_NEAR(ref_output->cpu_data()[k], output->cpu_data()[k], 1e-4);
+  }
+}
+
+TYPED_TEST(NetTest, TestFuseActivationsForwardFrom) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitFusedActivationNet(false);
+  shared_ptr<Net<Dtype> > ref_net = this->net_;
+  this->InitFusedActivationNet(true);
+  NetParameter trained;
+  ref_net->ToProto(&trained);
+  this->net_->CopyTrainedLayersFrom(trained);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  Net<Dtype>* nets[] = { ref_net.get(), this->net_.get() };
+  for (int j = 0; j < 2; ++j) {
+    nets[j]->Forward();
+  }
+  Blob<Dtype> conv2;
+  conv2.ReshapeLike(*this->net_->blob_by_name("conv2"));
+  filler.Fill(&conv2);
+  // prelu2, which is fused into conv2.
+  const int start = 4;
+  ASSERT_EQ("prelu2", this->net_->layer_names()[start]);
+  for (int j = 0; j < 2; ++j) {
+    nets[j]->blob_by_name("conv2")->CopyFrom(conv2);
+    nets[j]->ForwardFrom(start);
+  }
+  // Starting at prelu2 applies it to the given inputs.
+  const char* outputs[] = { "conv2", "ip" };
+  for (int i = 0; i < 2; ++i) {
+    const Blob<Dtype>* ref_output = ref_net->blob_by_name(outputs[i]).get();
+    const Blob<Dtype>* output = this->net_->blob_by_name(outputs[i]).get();
+    for (int k = 0; k < output->count(); ++k) {
+      EXPECT_NEAR(ref_output->cpu_data()[k], output->cpu_data()[k], 1e-4);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestFuseElementwise) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitFusedElementwiseNet(false);
+  shared_ptr<Net<Dtype> > ref_net = this->net_;
+  this->InitFusedElementwiseNet(true);
+  NetParameter trained;
+  ref_net->ToProto(&trained);
+  this->net_->CopyTrainedLayersFrom(trained);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> data(2, 4, 25, 23);
+  Blob<Dtype> other(2, 4, 25, 23);
+  filler.Fill(&data);
+  filler.Fill(&other);
+  Net<Dtype>* nets[] = { ref_net.get(), this->net_.get() };
+  Dtype loss[2];
+  for (int j = 0; j < 2; ++j) {
+    nets[j]->input_blobs()[0]->CopyFrom(data);
+    nets[j]->input_blobs()[1]->CopyFrom(other);
+    nets[j]->ClearParamDiffs();
+    loss[j] = nets[j]->ForwardBackward();
+  }
+  EXPECT_NEAR(loss[0], loss[1], 1e-3);
+  // The tiles cover the blobs exactly, in the fused runs Scale to Exp
+  // forward and ReLU to TanH backward...
+  const char* blob_names[] = { "scaled", "sum", "power", "exp", "out" };
+  for (int i = 0; i < 5; ++i) {
+    const Blob<Dtype>* ref_blob = ref_net->blob_by_name(blob_names[i]).get();
+    const Blob<Dtype>* blob = this->net_->blob_by_name(blob_names[i]).get();
+    for (int k = 0; k < blob->count(); ++k) {
+      EXPECT_EQ(ref_blob->cpu_data()[k], blob->cpu_data()[k]);
+      EXPECT_EQ(ref_blob->cpu_diff()[k], blob->cpu_diff()[k]);
+    }
+  }
+  // ...and the layers outside the backward runs see the same top diffs.
+  ASSERT_EQ(ref_net->params().size(), this->net_->params().size());
+  for (int i = 0; i < ref_net->params().size(); ++i) {
+    const Blob<Dtype>* ref_param = ref_net->params()[i].get();
+    const Blob<Dtype>* param = this->net_->params()[i].get();
+    for (int k = 0; k < param->count(); ++k) {
+      EXPECT_NEAR(ref_param->cpu_diff()[k], param->cpu_diff()[k], 1e-4);
+    }
+  }
+  for (int i = 0; i < 2; ++i) {
+    const Blob<Dtype>* ref_input = ref_net->input_blobs()[i];
+    const Blob<Dtype>* input = this->net_->input_blobs()[i];
+    for (int k = 0; k < input->count(); ++k) {
+      EXPECT_EQ(ref_input->cpu_diff()[k], input->cpu_diff()[k]);
+    }
+  }
+}
+
+template <typename Dtype>
+static void ForwardOnThread(Net<Dtype>* net, Caffe::Brew mode) {
+  Caffe::set_mode(mode);
+  net->Forward();
+}
+
+TYPED_TEST(NetTest, TestExecutors) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitReshapableNet();
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  const int kNumExecutors = 3;
+  vector<shared_ptr<Net<Dtype> > > executors;
+  vector<shared_ptr<Blob<Dtype> > > inputs;
+  for (int i = 0; i < kNumExecutors; ++i) {
+    executors.push_back(this->net_->CreateExecutor());
+    Net<Dtype>* executor = executors.back().get();
+    EXPECT_TRUE(executor->inference_only());
+    // The executors use the params of the net, not copies.
+    ASSERT_EQ(this->net_->params().size(), executor->params().size());
+    for (int j = 0; j < executor->params().size(); ++j) {
+      EXPECT_EQ(this->net_->params()[j]->cpu_data(),
+                executor->params()[j]->cpu_data());
+    }
+    inputs.push_back(shared_ptr<Blob<Dtype> >(
+        new Blob<Dtype>(2, 3, 12 + i, 10)));
+    filler.Fill(inputs.back().get());
+    executor->input_blobs()[0]->CopyFrom(*inputs.back(), false, true);
+    executor->Reshape();
+  }
+  // Run all executors at once.
+  boost::thread_group threads;
+  for (int i = 0; i < kNumExecutors; ++i) {
+    threads.create_thread(boost::bind(&ForwardOnThread<Dtype>,
+        executors[i].get(), Caffe::mode()));
+  }
+  threads.join_all();
+  // Check against the net, run on one input after the other.
+  for (int i = 0; i < kNumExecutors; ++i) {
+    this->net_->input_blobs()[0]->CopyFrom(*inputs[i], false, true);
+    this->net_->Reshape();
+    this->net_->Forward();
+    const Blob<Dtype>* ref_output = this->net_->output_blobs()[0];
+    const Blob<Dtype>* output = executors[i]->output_blobs()[0];
+    ASSERT_EQ(ref_output->shape(), output->shape());
+    for (int k = 0; k < output->count(); ++k) {
+      EXPECT_NEAR(ref_output->cpu_data()[k], output->cpu_data()[k], 1e-6);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestExecutorsRefreshDerivedParams) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitReshapableNet();
+  shared_ptr<Net<Dtype> > executor = this->net_->CreateExecutor();
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> input(2, 3, 12, 10);
+  filler.Fill(&input);
+  // Change the weights, and derive what the layers derive from them anew.
+  for (int i = 0; i < this->net_->learnable_params().size(); ++i) {
+    filler.Fill(this->net_->learnable_params()[i]);
+  }
+  this->net_->RefreshDerivedParams();
+  Net<Dtype>* nets[] = { this->net_.get(), executor.get() };
+  for (int j = 0; j < 2; ++j) {
+    nets[j]->input_blobs()[0]->CopyFrom(input, false, true);
+    nets[j]->Reshape();
+    nets[j]->Forward();
+  }
+  const Blob<Dtype>* ref_output = this->net_->output_blobs()[0];
+  const Blob<Dtype>* output = executor->output_blobs()[0];
+  ASSERT_EQ(ref_output->shape(), output->shape());
+  for (int k = 0; k < output->count(); ++k) {
+    EXPECT_NEAR(ref_output->cpu_data()[k], output->cpu_data()[k], 1e-6);
+  }
+}
+
 TYPED_TEST(NetTest, TestSkipPropagateDown) {
   // check bottom_need_backward if propagate_down is true
   this->InitSkipPropNet(false);
@@ -1,4 +1,6 @@
 #include <algorithm>
+#include <cmath>
+#include <limits>
 #include <vector>
 
 #include "google/protobuf/text_format.h"
@@ -249,6 +251,25 @@ TYPED_TEST(NeuronLayerTest, TestReLUWithNegativeSlope) {
   }
 }
 
+TYPED_TEST(NeuronLayerTest, TestReLUNaN) {
+  typedef typename TypeParam::Dtype Dtype;
+  // NaN inputs stay NaN, so that a diverging net does not go unnoticed.
+  Dtype* bottom_data = this->blob_bottom_->mutable_cpu_data();
+  bottom_data[0] = std::numeric_limits<Dtype>::quiet_NaN();
+  bottom_data[1] = -std::numeric_limits<Dtype>::quiet_NaN();
+  const char* params[] = { "", "relu_param { negative_slope: 0.01 }" };
+  for (int p = 0; p < 2; ++p) {
+    LayerParameter layer_param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(params[p],
+        &layer_param));
+    ReLULayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    EXPECT_TRUE(std::isnan(this->blob_top_->cpu_data()[0]));
+    EXPECT_TRUE(std::isnan(this->blob_top_->cpu_data()[1]));
+  }
+}
+
 TYPED_TEST(NeuronLayerTest, TestReLUGradientWithNegativeSlope) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cfloat>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -5,6 +7,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/layers/layout_layer.hpp"
 #include "caffe/layers/pooling_layer.hpp"
 
 #ifdef USE_CUDNN
@@ -609,6 +612,147 @@ TYPED_TEST(PoolingLayerTest, TestGradientAvePadded) {
   }
 }
 
+TYPED_TEST(PoolingLayerTest, TestForwardChannelsLast) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter to_nhwc_param;
+  to_nhwc_param.set_layout(NHWC);
+  LayoutLayer<Dtype> to_nhwc(to_nhwc_param);
+  LayoutLayer<Dtype> to_nchw((LayerParameter()));
+  Blob<Dtype> bottom_nhwc, top_nhwc, top;
+  vector<Blob<Dtype>*> bottom_nhwc_vec(1, &bottom_nhwc);
+  vector<Blob<Dtype>*> top_nhwc_vec(1, &top_nhwc);
+  vector<Blob<Dtype>*> top_vec(1, &top);
+  to_nhwc.SetUp(this->blob_bottom_vec_, bottom_nhwc_vec);
+  to_nhwc.Forward(this->blob_bottom_vec_, bottom_nhwc_vec);
+  // kernel, stride, pad, global pooling
+  const int kConfigs[][4] = {
+    { 2, 2, 0, 0 },
+    { 3, 2, 1, 0 },
+    { 3, 1, 1, 0 },
+    { 0, 1, 0, 1 } };
+  const PoolingParameter_PoolMethod kMethods[] = {
+    PoolingParameter_PoolMethod_MAX, PoolingParameter_PoolMethod_AVE };
+  for (int i = 0; i < sizeof(kConfigs) / sizeof(kConfigs[0]); ++i) {
+    for (int m = 0; m < 2; ++m) {
+      LayerParameter layer_param;
+      PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+      if (kConfigs[i][3]) {
+        pooling_param->set_global_pooling(true);
+      } else {
+        pooling_param->set_kernel_size(kConfigs[i][0]);
+        pooling_param->set_stride(kConfigs[i][1]);
+        pooling_param->set_pad(kConfigs[i][2]);
+      }
+      pooling_param->set_pool(kMethods[m]);
+      PoolingLayer<Dtype> layer(layer_param);
+      layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      layer_param.set_layout(NHWC);
+      PoolingLayer<Dtype> nhwc_layer(layer_param);
+      nhwc_layer.SetUp(bottom_nhwc_vec, top_nhwc_vec);
+      nhwc_layer.Forward(bottom_nhwc_vec, top_nhwc_vec);
+      to_nchw.SetUp(top_nhwc_vec, top_vec);
+      to_nchw.Forward(top_nhwc_vec, top_vec);
+      ASSERT_EQ(this->blob_top_->shape(), top.shape());
+      for (int j = 0; j < top.count(); ++j) {
+        EXPECT_NEAR(this->blob_top_->cpu_data()[j], top.cpu_data()[j], 1e-6);
+      }
+    }
+  }
+}
+
+TYPED_TEST(PoolingLayerTest, TestForwardStridedAndGlobal) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Odd sizes leave clipped windows at the bottom and right.
+  this->blob_bottom_->Reshape(2, 3, 7, 9);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  // kernel, stride, pad, global pooling
+  const int kConfigs[][4] = {
+    { 2, 2, 0, 0 },
+    { 3, 2, 0, 0 },
+    { 3, 2, 1, 0 },
+    { 2, 1, 0, 0 },
+    { 0, 1, 0, 1 } };
+  const PoolingParameter_PoolMethod kMethods[] = {
+    PoolingParameter_PoolMethod_MAX, PoolingParameter_PoolMethod_AVE };
+  const Phase kPhases[] = { TRAIN, TEST };
+  const Blob<Dtype>& bottom = *this->blob_bottom_;
+  for (int i = 0; i < sizeof(kConfigs) / sizeof(kConfigs[0]); ++i) {
+    const int kernel_h = kConfigs[i][3] ? bottom.height() : kConfigs[i][0];
+    const int kernel_w = kConfigs[i][3] ? bottom.width() : kConfigs[i][0];
+    const int stride = kConfigs[i][1];
+    const int pad = kConfigs[i][2];
+    for (int m = 0; m < 2; ++m) {
+      for (int p = 0; p < 2; ++p) {
+        LayerParameter layer_param;
+        layer_param.set_phase(kPhases[p]);
+        PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+        if (kConfigs[i][3]) {
+          pooling_param->set_global_pooling(true);
+        } else {
+          pooling_param->set_kernel_size(kernel_h);
+          pooling_param->set_stride(stride);
+          pooling_param->set_pad(pad);
+        }
+        pooling_param->set_pool(kMethods[m]);
+        PoolingLayer<Dtype> layer(layer_param);
+        layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+        layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+        const Blob<Dtype>& top = *this->blob_top_;
+        for (int n = 0; n < top.num(); ++n) {
+          for (int c = 0; c < top.channels(); ++c) {
+            for (int ph = 0; ph < top.height(); ++ph) {
+              for (int pw = 0; pw < top.width(); ++pw) {
+                const int hstart = ph * stride - pad;
+                const int wstart = pw * stride - pad;
+                const int hend = std::min(hstart + kernel_h,
+                    bottom.height() + pad);
+                const int wend = std::min(wstart + kernel_w,
+                    bottom.width() + pad);
+                Dtype expected = m == 0 ? -FLT_MAX : 0;
+                for (int h = std::max(hstart, 0);
+                     h < std::min(hend, bottom.height()); ++h) {
+                  for (int w = std::max(wstart, 0);
+                       w < std::min(wend, bottom.width()); ++w) {
+                    const Dtype value = bottom.data_at(n, c, h, w);
+                    expected = m == 0 ? std::max(expected, value) :
+                        expected + value;
+                  }
+                }
+                if (m == 1) {
+                  expected /= (hend - hstart) * (wend - wstart);
+                }
+                EXPECT_NEAR(expected, top.data_at(n, c, ph, pw), 1e-5);
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(PoolingLayerTest, TestGradientMaxTestPhase) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Outside TRAIN max pooling keeps no mask, and Backward finds the maxima
+  // again.
+  for (int stride = 1; stride <= 2; stride++) {
+    LayerParameter layer_param;
+    layer_param.set_phase(TEST);
+    PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+    pooling_param->set_kernel_size(3);
+    pooling_param->set_stride(stride);
+    pooling_param->set_pad(stride - 1);
+    pooling_param->set_pool(PoolingParameter_PoolMethod_MAX);
+    PoolingLayer<Dtype> layer(layer_param);
+    GradientChecker<Dtype> checker(1e-4, 1e-2);
+    checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+        this->blob_top_vec_);
+  }
+}
+
 #ifdef USE_CUDNN
 template <typename Dtype>
 class CuDNNPoolingLayerTest : public GPUDeviceTest<Dtype> {
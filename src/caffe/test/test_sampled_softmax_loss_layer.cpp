@@ -0,0 +1,229 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/inner_product_layer.hpp"
+#include "caffe/layers/sampled_softmax_loss_layer.hpp"
+#include "caffe/layers/softmax_loss_layer.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class SampledSoftmaxLossLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  SampledSoftmaxLossLayerTest()
+      : blob_bottom_data_(new Blob<Dtype>(6, 3, 2, 1)),
+        blob_bottom_label_(new Blob<Dtype>(6, 1, 1, 1)),
+        blob_top_loss_(new Blob<Dtype>()) {
+    // fill the values
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_data_);
+    blob_bottom_vec_.push_back(blob_bottom_data_);
+    for (int i = 0; i < blob_bottom_label_->count(); ++i) {
+      blob_bottom_label_->mutable_cpu_data()[i] = caffe_rng_rand() % 10;
+    }
+    blob_bottom_vec_.push_back(blob_bottom_label_);
+    blob_top_vec_.push_back(blob_top_loss_);
+  }
+  virtual ~SampledSoftmaxLossLayerTest() {
+    delete blob_bottom_data_;
+    delete blob_bottom_label_;
+    delete blob_top_loss_;
+  }
+
+  LayerParameter LayerParam(const Phase phase) {
+    LayerParameter layer_param;
+    layer_param.set_phase(phase);
+    SampledSoftmaxParameter* param =
+        layer_param.mutable_sampled_softmax_param();
+    param->set_num_output(10);
+    param->set_num_sampled(5);
+    param->mutable_weight_filler()->set_type("gaussian");
+    param->mutable_bias_filler()->set_type("gaussian");
+    return layer_param;
+  }
+
+  Blob<Dtype>* const blob_bottom_data_;
+  Blob<Dtype>* const blob_bottom_label_;
+  Blob<Dtype>* const blob_top_loss_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(SampledSoftmaxLossLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(SampledSoftmaxLossLayerTest, TestSetUp) {
+  typedef typename TypeParam::Dtype Dtype;
+  SampledSoftmaxLossLayer<Dtype> layer(this->LayerParam(TRAIN));
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  ASSERT_EQ(layer.blobs().size(), 2);
+  EXPECT_EQ(layer.blobs()[0]->num_axes(), 2);
+  EXPECT_EQ(layer.blobs()[0]->shape(0), 10);
+  EXPECT_EQ(layer.blobs()[0]->shape(1), 6);
+  EXPECT_EQ(layer.blobs()[1]->count(), 10);
+  EXPECT_EQ(this->blob_top_loss_->count(), 1);
+}
+
+TYPED_TEST(SampledSoftmaxLossLayerTest, TestForwardTestMatchesSoftmax) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Outside TRAIN, the loss is that of an InnerProductLayer with the same
+  // weights followed by a SoftmaxWithLossLayer.
+  LayerParameter layer_param = this->LayerParam(TEST);
+  layer_param.mutable_loss_param()->set_ignore_label(3);
+  SampledSoftmaxLossLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Dtype loss = this->blob_top_loss_->cpu_data()[0];
+
+  LayerParameter ip_param;
+  ip_param.mutable_inner_product_param()->set_num_output(10);
+  InnerProductLayer<Dtype> ip_layer(ip_param);
+  Blob<Dtype> logits;
+  vector<Blob<Dtype>*> ip_bottom(1, this->blob_bottom_data_);
+  vector<Blob<Dtype>*> ip_top(1, &logits);
+  ip_layer.SetUp(ip_bottom, ip_top);
+  ip_layer.blobs()[0]->CopyFrom(*layer.blobs()[0]);
+  ip_layer.blobs()[1]->CopyFrom(*layer.blobs()[1]);
+  ip_layer.Forward(ip_bottom, ip_top);
+  LayerParameter softmax_param;
+  softmax_param.mutable_loss_param()->set_ignore_label(3);
+  SoftmaxWithLossLayer<Dtype> softmax_layer(softmax_param);
+  vector<Blob<Dtype>*> softmax_bottom(1, &logits);
+  softmax_bottom.push_back(this->blob_bottom_label_);
+  softmax_layer.SetUp(softmax_bottom, this->blob_top_vec_);
+  softmax_layer.Forward(softmax_bottom, this->blob_top_vec_);
+  EXPECT_NEAR(this->blob_top_loss_->cpu_data()[0], loss, 1e-4 * loss);
+}
+
+TYPED_TEST(SampledSoftmaxLossLayerTest, TestForwardNormalization) {
+  typedef typename TypeParam::Dtype Dtype;
+  // The loss summed over the examples with a label other than 3, of which
+  // the first is not.
+  this->blob_bottom_label_->mutable_cpu_data()[0] = 3;
+  int valid_count = 0;
+  for (int i = 0; i < this->blob_bottom_label_->count(); ++i) {
+    valid_count += this->blob_bottom_label_->cpu_data()[i] != 3;
+  }
+  LayerParameter layer_param = this->LayerParam(TEST);
+  layer_param.mutable_loss_param()->set_ignore_label(3);
+  layer_param.mutable_loss_param()->set_normalization(
+      LossParameter_NormalizationMode_NONE);
+  SampledSoftmaxLossLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Dtype loss = this->blob_top_loss_->cpu_data()[0];
+  const LossParameter_NormalizationMode modes[] = {
+    LossParameter_NormalizationMode_FULL,
+    LossParameter_NormalizationMode_VALID,
+    LossParameter_NormalizationMode_BATCH_SIZE };
+  const int normalizers[] = { 6, valid_count, 6 };
+  for (int i = 0; i < 3; ++i) {
+    layer_param.mutable_loss_param()->set_normalization(modes[i]);
+    SampledSoftmaxLossLayer<Dtype> normalized_layer(layer_param);
+    normalized_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    normalized_layer.blobs()[0]->CopyFrom(*layer.blobs()[0]);
+    normalized_layer.blobs()[1]->CopyFrom(*layer.blobs()[1]);
+    normalized_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    EXPECT_NEAR(this->blob_top_loss_->cpu_data()[0] * normalizers[i], loss,
+        1e-4 * loss);
+  }
+}
+
+TYPED_TEST(SampledSoftmaxLossLayerTest, TestSamples) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param = this->LayerParam(TRAIN);
+  layer_param.mutable_sampled_softmax_param()->set_num_sampled(1000);
+  for (int sampler = 0; sampler < 2; ++sampler) {
+    layer_param.mutable_sampled_softmax_param()->set_sampler(
+        static_cast<SampledSoftmaxParameter_Sampler>(sampler));
+    SampledSoftmaxLossLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    const vector<int>& samples = layer.samples();
+    ASSERT_EQ(samples.size(), 1000);
+    int low = 0;
+    for (int s = 0; s < samples.size(); ++s) {
+      EXPECT_GE(samples[s], 0);
+      EXPECT_LT(samples[s], 10);
+      low += samples[s] < 5;
+    }
+    // Log-uniform samples classes below 5 with probability log(6) / log(11).
+    const int expected_low = sampler ? 747 : 500;
+    EXPECT_NEAR(low, expected_low, 75);
+  }
+}
+
+TYPED_TEST(SampledSoftmaxLossLayerTest, TestForwardAllAccidentalHits) {
+  typedef typename TypeParam::Dtype Dtype;
+  // With a single class every sample is an accidental hit, so the softmax
+  // covers the label alone: the masked logits must not turn the loss NaN.
+  LayerParameter layer_param = this->LayerParam(TRAIN);
+  layer_param.mutable_sampled_softmax_param()->set_num_output(1);
+  caffe_set(this->blob_bottom_label_->count(), Dtype(0),
+      this->blob_bottom_label_->mutable_cpu_data());
+  SampledSoftmaxLossLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(Dtype(0), this->blob_top_loss_->cpu_data()[0]);
+}
+
+TYPED_TEST(SampledSoftmaxLossLayerTest, TestGradientTest) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param = this->LayerParam(TEST);
+  layer_param.add_loss_weight(3);
+  SampledSoftmaxLossLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-2, 1701);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
+TYPED_TEST(SampledSoftmaxLossLayerTest, TestGradientTrain) {
+  typedef typename TypeParam::Dtype Dtype;
+  // The checker reseeds before each forward pass, so the samples stay put.
+  LayerParameter layer_param = this->LayerParam(TRAIN);
+  layer_param.add_loss_weight(3);
+  for (int sampler = 0; sampler < 2; ++sampler) {
+    layer_param.mutable_sampled_softmax_param()->set_sampler(
+        static_cast<SampledSoftmaxParameter_Sampler>(sampler));
+    SampledSoftmaxLossLayer<Dtype> layer(layer_param);
+    GradientChecker<Dtype> checker(1e-2, 1e-2, 1701);
+    checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+        this->blob_top_vec_, 0);
+  }
+}
+
+TYPED_TEST(SampledSoftmaxLossLayerTest, TestGradientTrainUnnormalized) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param = this->LayerParam(TRAIN);
+  layer_param.mutable_loss_param()->set_normalization(
+      LossParameter_NormalizationMode_NONE);
+  SampledSoftmaxLossLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-2, 1701);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
+TYPED_TEST(SampledSoftmaxLossLayerTest, TestGradientTrainIgnoreLabel) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param = this->LayerParam(TRAIN);
+  layer_param.mutable_loss_param()->set_ignore_label(0);
+  layer_param.mutable_sampled_softmax_param()->set_bias_term(false);
+  layer_param.mutable_sampled_softmax_param()->set_remove_accidental_hits(
+      false);
+  this->blob_bottom_label_->mutable_cpu_data()[0] = 0;
+  SampledSoftmaxLossLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-2, 1701);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
+}  // namespace caffe
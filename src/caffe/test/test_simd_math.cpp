@@ -0,0 +1,205 @@
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/simd_math.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class SimdMathTest : public ::testing::Test {
+ protected:
+  // Every kStride-th float, in both signs, including infinities and NaNs.
+  static const int64_t kStride = 4099;
+
+  SimdMathTest() {
+    for (int64_t bits = 0; bits < (int64_t(1) << 32); bits += kStride) {
+      const uint32_t value = static_cast<uint32_t>(bits);
+      float x;
+      memcpy(&x, &value, sizeof(x));  // NOLINT(caffe/alt_fn)
+      x_.push_back(x);
+    }
+    y_.resize(x_.size());
+  }
+
+  // The error of y in units in the last place of the float nearest to ref,
+  // with infinities one ULP beyond the largest float.
+  static double UlpError(const float y, const double ref) {
+    if (std::isnan(ref)) {
+      return std::isnan(y) ? 0 : std::numeric_limits<double>::infinity();
+    }
+    const double max = std::numeric_limits<float>::max();
+    const double top_ulp = std::ldexp(1., 104);
+    const double y_value = std::isinf(y) ? (y > 0 ? 1 : -1) * (max + top_ulp) :
+        static_cast<double>(y);
+    const double ref_value = std::isinf(ref) || std::fabs(ref) > max + top_ulp ?
+        (ref > 0 ? 1 : -1) * (max + top_ulp) : ref;
+    if (y_value == ref_value) {
+      return 0;
+    }
+    const int exponent = ref_value == 0 ? -126 :
+        std::max(std::ilogb(ref_value), -126);
+    return std::fabs(y_value - ref_value) / std::ldexp(1., exponent - 23);
+  }
+
+  // The largest error of y_ against reference(x_).
+  double MaxUlpError(double (*reference)(double)) const {
+    double max_error = 0;
+    for (int i = 0; i < x_.size(); ++i) {
+      max_error = std::max(max_error, UlpError(y_[i], reference(x_[i])));
+    }
+    return max_error;
+  }
+
+  int count() const { return x_.size(); }
+
+  vector<float> x_;
+  vector<float> y_;
+};
+
+static double Sigmoid(const double x) { return 1. / (1. + std::exp(-x)); }
+
+static double Exp(const double x) { return std::exp(x); }
+static double Log(const double x) { return std::log(x); }
+static double TanH(const double x) { return std::tanh(x); }
+
+TEST_F(SimdMathTest, TestExp) {
+  caffe_simd_exp(count(), &x_[0], &y_[0]);
+  EXPECT_LE(MaxUlpError(Exp), 1.03);
+}
+
+TEST_F(SimdMathTest, TestLog) {
+  caffe_simd_log(count(), &x_[0], &y_[0]);
+  EXPECT_LE(MaxUlpError(Log), 0.83);
+}
+
+TEST_F(SimdMathTest, TestTanH) {
+  caffe_simd_tanh(count(), &x_[0], &y_[0]);
+  EXPECT_LE(MaxUlpError(TanH), 1.51);
+}
+
+TEST_F(SimdMathTest, TestSigmoid) {
+  caffe_simd_sigmoid(count(), &x_[0], &y_[0]);
+  EXPECT_LE(MaxUlpError(Sigmoid), 2.41);
+}
+
+TEST_F(SimdMathTest, TestPowx) {
+  const float exponents[] = {-11.f, -0.75f, 0.3333f, 1.5f, 7.3f};
+  for (int e = 0; e < sizeof(exponents) / sizeof(exponents[0]); ++e) {
+    const float b = exponents[e];
+    caffe_simd_powx(count(), &x_[0], b, &y_[0]);
+    double max_error = 0;
+    for (int i = 0; i < count(); ++i) {
+      if (std::isnan(x_[i])) {
+        // Left to libm, which may treat signaling NaNs differently from the
+        // quiet NaNs they become in double precision.
+        continue;
+      }
+      const double ref = std::pow(static_cast<double>(x_[i]), b);
+      const double error = UlpError(y_[i], ref);
+      EXPECT_LE(error, 1.93) << "x = " << x_[i] << ", b = " << b;
+      max_error = std::max(max_error, error);
+    }
+    LOG(INFO) << "pow(x, " << b << "): " << max_error << " ULP";
+  }
+}
+
+TEST_F(SimdMathTest, TestSpecialValues) {
+  const float inf = std::numeric_limits<float>::infinity();
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  const float denorm = std::numeric_limits<float>::denorm_min();
+  const float x[] = {0.f, -0.f, inf, -inf, nan, denorm, -denorm, 88.72283f,
+      88.7229f, -87.33654f, -103.2789f, -103.9721f, -104.f, 1.f};
+  const int n = sizeof(x) / sizeof(x[0]);
+  vector<float> y(n);
+  caffe_simd_exp(n, x, &y[0]);
+  for (int i = 0; i < n; ++i) {
+    const float expected = std::exp(x[i]);
+    if (std::isnan(expected)) {
+      EXPECT_TRUE(std::isnan(y[i]));
+    } else {
+      EXPECT_LE(UlpError(y[i], std::exp(static_cast<double>(x[i]))), 1.03)
+          << "exp(" << x[i] << ") = " << y[i];
+    }
+  }
+  EXPECT_EQ(inf, y[2]);
+  EXPECT_EQ(0, y[3]);
+  EXPECT_EQ(inf, y[8]);
+  EXPECT_EQ(1, y[0]);
+  caffe_simd_log(n, x, &y[0]);
+  EXPECT_EQ(-inf, y[0]);
+  EXPECT_EQ(-inf, y[1]);
+  EXPECT_EQ(inf, y[2]);
+  EXPECT_TRUE(std::isnan(y[3]));
+  EXPECT_TRUE(std::isnan(y[4]));
+  EXPECT_FLOAT_EQ(std::log(denorm), y[5]);
+  EXPECT_TRUE(std::isnan(y[6]));
+  EXPECT_EQ(0, y[13]);
+  caffe_simd_tanh(n, x, &y[0]);
+  EXPECT_EQ(0, y[0]);
+  EXPECT_EQ(1, y[2]);
+  EXPECT_EQ(-1, y[3]);
+  EXPECT_TRUE(std::isnan(y[4]));
+  EXPECT_EQ(denorm, y[5]);
+  caffe_simd_sigmoid(n, x, &y[0]);
+  EXPECT_EQ(0.5, y[0]);
+  EXPECT_EQ(1, y[2]);
+  EXPECT_EQ(0, y[3]);
+  EXPECT_TRUE(std::isnan(y[4]));
+}
+
+TEST_F(SimdMathTest, TestPowxSpecialBases) {
+  const float inf = std::numeric_limits<float>::infinity();
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  const float x[] = {0.f, -0.f, inf, -inf, nan, -2.f, -0.5f, 1.f, 4.f};
+  const int n = sizeof(x) / sizeof(x[0]);
+  const float exponents[] = {-3.f, -2.5f, 0.f, 0.5f, 1.f, 2.f, 3.f};
+  vector<float> y(n);
+  for (int e = 0; e < sizeof(exponents) / sizeof(exponents[0]); ++e) {
+    const float b = exponents[e];
+    caffe_simd_powx(n, x, b, &y[0]);
+    for (int i = 0; i < n; ++i) {
+      const float expected = std::pow(x[i], b);
+      if (std::isnan(expected)) {
+        EXPECT_TRUE(std::isnan(y[i])) << "pow(" << x[i] << ", " << b << ")";
+      } else {
+        EXPECT_EQ(expected, y[i]) << "pow(" << x[i] << ", " << b << ")";
+      }
+    }
+  }
+}
+
+TEST_F(SimdMathTest, TestMathFunctions) {
+  // caffe_tanh and caffe_sigmoid agree with libm for both types.
+  const int n = 1000;
+  vector<float> x(n);
+  vector<double> x_double(n);
+  vector<float> y(n);
+  vector<double> y_double(n);
+  for (int i = 0; i < n; ++i) {
+    x[i] = (i - n / 2) / 50.f;
+    x_double[i] = x[i];
+  }
+  caffe_tanh(n, &x[0], &y[0]);
+  caffe_tanh(n, &x_double[0], &y_double[0]);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_NEAR(std::tanh(x[i]), y[i], 1e-6);
+    EXPECT_NEAR(std::tanh(x_double[i]), y_double[i], 1e-15);
+  }
+  caffe_sigmoid(n, &x[0], &y[0]);
+  caffe_sigmoid(n, &x_double[0], &y_double[0]);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_NEAR(Sigmoid(x[i]), y[i], 1e-6);
+    EXPECT_NEAR(Sigmoid(x_double[i]), y_double[i], 1e-15);
+  }
+}
+
+}  // namespace caffe
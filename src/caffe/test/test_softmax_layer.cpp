@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cmath>
 #include <vector>
 
@@ -83,6 +84,57 @@ TYPED_TEST(SoftmaxLayerTest, TestGradient) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(SoftmaxLayerTest, TestForwardContiguous) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Without spatial axes, each row is contiguous; make it span a few chunks.
+  vector<int> shape(2);
+  shape[0] = 3;
+  shape[1] = 1000;
+  this->blob_bottom_->Reshape(shape);
+  FillerParameter filler_param;
+  filler_param.set_std(10);
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  SoftmaxLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Dtype* bottom_data = this->blob_bottom_->cpu_data();
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  for (int i = 0; i < shape[0]; ++i) {
+    const Dtype* x = bottom_data + i * shape[1];
+    double max = x[0];
+    for (int j = 1; j < shape[1]; ++j) {
+      max = std::max(max, static_cast<double>(x[j]));
+    }
+    double sum = 0;
+    for (int j = 0; j < shape[1]; ++j) {
+      sum += exp(x[j] - max);
+    }
+    for (int j = 0; j < shape[1]; ++j) {
+      const double expected = exp(x[j] - max) / sum;
+      EXPECT_NEAR(expected, top_data[i * shape[1] + j], 1e-5 * expected + 1e-9)
+          << "debug: " << i << " " << j;
+    }
+  }
+}
+
+TYPED_TEST(SoftmaxLayerTest, TestGradientContiguous) {
+  typedef typename TypeParam::Dtype Dtype;
+  vector<int> shape(2);
+  shape[0] = 2;
+  shape[1] = 10;
+  this->blob_bottom_->Reshape(shape);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  SoftmaxLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
 #ifdef USE_CUDNN
 template <typename Dtype>
 class CuDNNSoftmaxLayerTest : public GPUDeviceTest<Dtype> {
@@ -105,4 +105,57 @@ TYPED_TEST(SoftmaxWithLossLayerTest, TestGradientUnnormalized) {
       this->blob_top_vec_, 0);
 }
 
+TYPED_TEST(SoftmaxWithLossLayerTest, TestLossOnlyMatchesProb) {
+  typedef typename TypeParam::Dtype Dtype;
+  // With the probabilities as a second output or without them, which the CPU
+  // computes differently, for spatial and for contiguous predictions.
+  vector<int> contiguous_shape(2);
+  contiguous_shape[0] = 4;
+  contiguous_shape[1] = 1000;
+  vector<int> label_shape(1, contiguous_shape[0]);
+  for (int contiguous = 0; contiguous < 2; ++contiguous) {
+    if (contiguous) {
+      this->blob_bottom_data_->Reshape(contiguous_shape);
+      FillerParameter filler_param;
+      filler_param.set_std(10);
+      GaussianFiller<Dtype> filler(filler_param);
+      filler.Fill(this->blob_bottom_data_);
+      this->blob_bottom_label_->Reshape(label_shape);
+      for (int i = 0; i < label_shape[0]; ++i) {
+        this->blob_bottom_label_->mutable_cpu_data()[i] =
+            caffe_rng_rand() % contiguous_shape[1];
+      }
+    }
+    const int count = this->blob_bottom_data_->count();
+    LayerParameter layer_param;
+    layer_param.add_loss_weight(1);
+    layer_param.mutable_loss_param()->set_ignore_label(0);
+    SoftmaxWithLossLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    const Dtype loss = this->blob_top_loss_->cpu_data()[0];
+    vector<bool> propagate_down(2, false);
+    propagate_down[0] = true;
+    layer.Backward(this->blob_top_vec_, propagate_down,
+        this->blob_bottom_vec_);
+    vector<Dtype> diff(this->blob_bottom_data_->cpu_diff(),
+        this->blob_bottom_data_->cpu_diff() + count);
+
+    Blob<Dtype> prob;
+    vector<Blob<Dtype>*> top_vec(this->blob_top_vec_);
+    top_vec.push_back(&prob);
+    LayerParameter prob_layer_param(layer_param);
+    prob_layer_param.add_loss_weight(0);
+    SoftmaxWithLossLayer<Dtype> prob_layer(prob_layer_param);
+    prob_layer.SetUp(this->blob_bottom_vec_, top_vec);
+    prob_layer.Forward(this->blob_bottom_vec_, top_vec);
+    EXPECT_NEAR(this->blob_top_loss_->cpu_data()[0], loss, 1e-4 * loss);
+    prob_layer.Backward(top_vec, propagate_down, this->blob_bottom_vec_);
+    const Dtype* prob_diff = this->blob_bottom_data_->cpu_diff();
+    for (int i = 0; i < count; ++i) {
+      EXPECT_NEAR(prob_diff[i], diff[i], 1e-6);
+    }
+  }
+}
+
 }  // namespace caffe
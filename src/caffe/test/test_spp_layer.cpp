@@ -130,5 +130,91 @@ TYPED_TEST(SPPLayerTest, TestGradient) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(SPPLayerTest, TestForwardMatchesPooling) {
+  typedef typename TypeParam::Dtype Dtype;
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_3_);
+  const SPPParameter_PoolMethod kMethods[] = {
+    SPPParameter_PoolMethod_MAX, SPPParameter_PoolMethod_AVE };
+  const Phase kPhases[] = { TRAIN, TEST };
+  vector<Blob<Dtype>*>* kBottoms[] = {
+    &this->blob_bottom_vec_, &this->blob_bottom_vec_3_ };
+  for (int b = 0; b < 2; ++b) {
+    const Blob<Dtype>& bottom = *(*kBottoms[b])[0];
+    for (int m = 0; m < 2; ++m) {
+      for (int p = 0; p < 2; ++p) {
+        LayerParameter layer_param;
+        layer_param.set_phase(kPhases[p]);
+        layer_param.mutable_spp_param()->set_pyramid_height(3);
+        layer_param.mutable_spp_param()->set_pool(kMethods[m]);
+        SPPLayer<Dtype> layer(layer_param);
+        layer.SetUp(*kBottoms[b], this->blob_top_vec_);
+        layer.Forward(*kBottoms[b], this->blob_top_vec_);
+        // Each level pools like a PoolingLayer with windows that cover the
+        // image, and the levels follow each other in the top.
+        int offset = 0;
+        for (int level = 0; level < 3; ++level) {
+          const int bins = 1 << level;
+          const int kernel_h = (bottom.height() + bins - 1) / bins;
+          const int kernel_w = (bottom.width() + bins - 1) / bins;
+          LayerParameter pooling_layer_param;
+          PoolingParameter* pooling_param =
+              pooling_layer_param.mutable_pooling_param();
+          pooling_param->set_kernel_h(kernel_h);
+          pooling_param->set_kernel_w(kernel_w);
+          pooling_param->set_stride_h(kernel_h);
+          pooling_param->set_stride_w(kernel_w);
+          pooling_param->set_pad_h((kernel_h * bins - bottom.height() + 1) / 2);
+          pooling_param->set_pad_w((kernel_w * bins - bottom.width() + 1) / 2);
+          pooling_param->set_pool(m == 0 ? PoolingParameter_PoolMethod_MAX :
+              PoolingParameter_PoolMethod_AVE);
+          PoolingLayer<Dtype> pooling_layer(pooling_layer_param);
+          Blob<Dtype> pooled;
+          vector<Blob<Dtype>*> pooled_vec(1, &pooled);
+          pooling_layer.SetUp(*kBottoms[b], pooled_vec);
+          pooling_layer.Forward(*kBottoms[b], pooled_vec);
+          const int dim = pooled.count(1);
+          for (int n = 0; n < pooled.num(); ++n) {
+            for (int i = 0; i < dim; ++i) {
+              EXPECT_NEAR(pooled.cpu_data()[n * dim + i],
+                  this->blob_top_->cpu_data()[
+                      n * this->blob_top_->count(1) + offset + i], 1e-5);
+            }
+          }
+          offset += dim;
+        }
+        EXPECT_EQ(this->blob_top_->count(1), offset);
+      }
+    }
+  }
+}
+
+TYPED_TEST(SPPLayerTest, TestGradientAve) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  SPPParameter* spp_param = layer_param.mutable_spp_param();
+  spp_param->set_pyramid_height(3);
+  spp_param->set_pool(SPPParameter_PoolMethod_AVE);
+  SPPLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-2);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(SPPLayerTest, TestGradientTestPhase) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Outside TRAIN max pooling keeps no mask, and Backward finds the maxima
+  // again.
+  LayerParameter layer_param;
+  layer_param.set_phase(TEST);
+  layer_param.mutable_spp_param()->set_pyramid_height(3);
+  SPPLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-4, 1e-2);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
 
 }  // namespace caffe
@@ -0,0 +1,197 @@
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+
+#include "caffe/common.hpp"
+#include "caffe/util/channels_last.hpp"
+
+namespace caffe {
+
+// Whether the layer runs faster on NHWC blobs.
+static bool PrefersChannelsLast(const LayerParameter& layer) {
+  if (layer.type() == "Convolution") {
+    return layer.convolution_param().axis() == 1;
+  }
+  if (layer.type() == "Pooling") {
+    const PoolingParameter_PoolMethod pool = layer.pooling_param().pool();
+    return layer.top_size() == 1 &&
+        (pool == PoolingParameter_PoolMethod_MAX ||
+         pool == PoolingParameter_PoolMethod_AVE);
+  }
+  return false;
+}
+
+// Whether the layer computes the same in either layout once its channel axis,
+// if any, moves to the end.
+static bool IgnoresLayout(const LayerParameter& layer) {
+  static const char* kElementwiseTypes[] = { "AbsVal", "BNLL", "Dropout",
+      "ELU", "Eltwise", "Exp", "Log", "Power", "ReLU", "Sigmoid", "TanH",
+      "Threshold" };
+  for (int i = 0; i < sizeof(kElementwiseTypes) / sizeof(const char*); ++i) {
+    if (layer.type() == kElementwiseTypes[i]) {
+      return true;
+    }
+  }
+  if (layer.type() == "Concat") {
+    const ConcatParameter& concat = layer.concat_param();
+    const int axis = concat.has_concat_dim() ? concat.concat_dim() :
+        concat.axis();
+    return axis == 0 || axis == 1;
+  }
+  if (layer.type() == "Scale") {
+    const ScaleParameter& scale = layer.scale_param();
+    return layer.bottom_size() == 1 && scale.axis() == 1 &&
+        scale.num_axes() == 1;
+  }
+  if (layer.type() == "Bias") {
+    const BiasParameter& bias = layer.bias_param();
+    return layer.bottom_size() == 1 && bias.axis() == 1 &&
+        bias.num_axes() == 1;
+  }
+  return false;
+}
+
+// Moves the channel axis 1 of an NCHW layer to the last axis, which is also
+// the channel axis of 2D (num, channels) blobs.
+static void MoveChannelAxis(LayerParameter* layer) {
+  if (layer->type() == "Concat") {
+    ConcatParameter* concat = layer->mutable_concat_param();
+    const int axis = concat->has_concat_dim() ? concat->concat_dim() :
+        concat->axis();
+    concat->clear_concat_dim();
+    concat->set_axis(axis == 1 ? -1 : axis);
+  } else if (layer->type() == "Scale") {
+    layer->mutable_scale_param()->set_axis(-1);
+  } else if (layer->type() == "Bias") {
+    layer->mutable_bias_param()->set_axis(-1);
+  }
+}
+
+namespace {
+
+class ChannelsLastConverter {
+ public:
+  explicit ChannelsLastConverter(NetParameter* param) : param_(param) {}
+
+  void Convert(const NetParameter& in_param) {
+    for (int i = 0; i < in_param.input_size(); ++i) {
+      current_[in_param.input(i)] = make_pair(in_param.input(i), NCHW);
+      blobs_.insert(in_param.input(i));
+    }
+    for (int i = 0; i < in_param.layer_size(); ++i) {
+      AddLayer(in_param.layer(i));
+    }
+    // Convert the NHWC outputs back.
+    for (set<string>::const_iterator it = unread_.begin();
+         it != unread_.end(); ++it) {
+      const pair<string, Layout>& blob = current_[*it];
+      if (blob.second == NHWC) {
+        ConvertBlob(blob.first, NCHW);
+      }
+    }
+  }
+
+ private:
+  void AddLayer(const LayerParameter& in_layer) {
+    LayerParameter layer(in_layer);
+    Layout layout = NCHW;
+    if (PrefersChannelsLast(layer)) {
+      layout = NHWC;
+    } else if (IgnoresLayout(layer) && layer.bottom_size() > 0 &&
+               current_.count(layer.bottom(0))) {
+      layout = current_[layer.bottom(0)].second;
+    }
+    for (int j = 0; j < layer.bottom_size(); ++j) {
+      const string& name = in_layer.bottom(j);
+      // Net::Init reports unknown bottoms.
+      if (!current_.count(name)) {
+        continue;
+      }
+      const pair<string, Layout>& blob = current_[name];
+      layer.set_bottom(j, blob.second == layout ? blob.first :
+          ConvertBlob(blob.first, layout));
+      unread_.erase(name);
+    }
+    for (int j = 0; j < layer.top_size(); ++j) {
+      const string& name = in_layer.top(j);
+      string blob = (layout == NHWC) ? UniqueName(name + "_nhwc") : name;
+      for (int k = 0; k < in_layer.bottom_size(); ++k) {
+        if (in_layer.bottom(k) == name) {
+          // In place: the converted copies of the bottom go stale.
+          blob = layer.bottom(k);
+          converted_.erase(blob);
+        }
+      }
+      layer.set_top(j, blob);
+      blobs_.insert(blob);
+      current_[name] = make_pair(blob, layout);
+      unread_.insert(name);
+    }
+    if (layout == NHWC) {
+      layer.set_layout(NHWC);
+      MoveChannelAxis(&layer);
+    }
+    param_->add_layer()->CopyFrom(layer);
+  }
+
+  // Adds a Layout layer converting blob into layout, unless an up-to-date
+  // copy exists, and returns the name of the copy.
+  string ConvertBlob(const string& blob, Layout layout) {
+    map<string, string>::const_iterator it = converted_.find(blob);
+    if (it != converted_.end()) {
+      return it->second;
+    }
+    string top;
+    const string suffix = "_nhwc";
+    if (layout == NHWC) {
+      top = UniqueName(blob + suffix);
+    } else if (blob.size() > suffix.size() &&
+        blob.compare(blob.size() - suffix.size(), suffix.size(), suffix) == 0
+        && !blobs_.count(blob.substr(0, blob.size() - suffix.size()))) {
+      // Give converted outputs their original names.
+      top = blob.substr(0, blob.size() - suffix.size());
+    } else {
+      top = UniqueName(blob + "_nchw");
+    }
+    LayerParameter* layer = param_->add_layer();
+    layer->set_name(blob + (layout == NHWC ? "_to_nhwc" : "_to_nchw"));
+    layer->set_type("Layout");
+    layer->add_bottom(blob);
+    layer->add_top(top);
+    layer->set_layout(layout);
+    blobs_.insert(top);
+    converted_[blob] = top;
+    return top;
+  }
+
+  string UniqueName(const string& name) const {
+    string unique = name;
+    while (blobs_.count(unique)) {
+      unique += "_";
+    }
+    return unique;
+  }
+
+  NetParameter* param_;
+  // The blob holding the current value of each blob name, and its layout.
+  map<string, pair<string, Layout> > current_;
+  // The up-to-date copies of blobs in the other layout.
+  map<string, string> converted_;
+  // The blob names whose current values no layer has read.
+  set<string> unread_;
+  // All the blobs of the converted net.
+  set<string> blobs_;
+};
+
+}  // namespace
+
+void ConvertToChannelsLast(const NetParameter& param,
+    NetParameter* param_channels_last) {
+  param_channels_last->CopyFrom(param);
+  param_channels_last->clear_layer();
+  ChannelsLastConverter converter(param_channels_last);
+  converter.Convert(param);
+}
+
+}  // namespace caffe
@@ -0,0 +1,95 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "caffe/util/fft.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+FFT<Dtype>::FFT(int size)
+    : size_(size), bit_reverse_(size), cos_(size / 2), sin_(size / 2) {
+  CHECK_GT(size, 0);
+  CHECK_EQ(size & (size - 1), 0) << "FFT size must be a power of two.";
+  int bits = 0;
+  while ((1 << bits) < size) {
+    ++bits;
+  }
+  for (int i = 0; i < size; ++i) {
+    int reversed = 0;
+    for (int b = 0; b < bits; ++b) {
+      reversed |= ((i >> b) & 1) << (bits - 1 - b);
+    }
+    bit_reverse_[i] = reversed;
+  }
+  for (int t = 0; t < size / 2; ++t) {
+    const double angle = 2 * M_PI * t / size;
+    cos_[t] = std::cos(angle);
+    sin_[t] = std::sin(angle);
+  }
+}
+
+template <typename Dtype>
+int FFT<Dtype>::RoundUp(int n) {
+  int size = 1;
+  while (size < n) {
+    size <<= 1;
+  }
+  return size;
+}
+
+template <typename Dtype>
+void FFT<Dtype>::Transform(Dtype* real, Dtype* imag, int width,
+    bool inverse) const {
+  for (int i = 0; i < size_; ++i) {
+    const int j = bit_reverse_[i];
+    if (i < j) {
+      std::swap_ranges(real + i * width, real + (i + 1) * width,
+          real + j * width);
+      std::swap_ranges(imag + i * width, imag + (i + 1) * width,
+          imag + j * width);
+    }
+  }
+  const Dtype sign = inverse ? 1 : -1;
+  for (int length = 2; length <= size_; length <<= 1) {
+    const int half = length / 2;
+    const int step = size_ / length;
+    for (int start = 0; start < size_; start += length) {
+      for (int k = 0; k < half; ++k) {
+        const Dtype w_real = cos_[k * step];
+        const Dtype w_imag = sign * sin_[k * step];
+        Dtype* a_real = real + (start + k) * width;
+        Dtype* a_imag = imag + (start + k) * width;
+        Dtype* b_real = a_real + half * width;
+        Dtype* b_imag = a_imag + half * width;
+        for (int j = 0; j < width; ++j) {
+          const Dtype t_real = w_real * b_real[j] - w_imag * b_imag[j];
+          const Dtype t_imag = w_real * b_imag[j] + w_imag * b_real[j];
+          b_real[j] = a_real[j] - t_real;
+          b_imag[j] = a_imag[j] - t_imag;
+          a_real[j] += t_real;
+          a_imag[j] += t_imag;
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void fft_2d(const FFT<Dtype>& row_fft, const FFT<Dtype>& col_fft,
+    Dtype* real, Dtype* imag, bool inverse) {
+  const int width = row_fft.size();
+  for (int h = 0; h < col_fft.size(); ++h) {
+    row_fft.Transform(real + h * width, imag + h * width, 1, inverse);
+  }
+  col_fft.Transform(real, imag, width, inverse);
+}
+
+INSTANTIATE_CLASS(FFT);
+
+template void fft_2d<float>(const FFT<float>& row_fft,
+    const FFT<float>& col_fft, float* real, float* imag, bool inverse);
+template void fft_2d<double>(const FFT<double>& row_fft,
+    const FFT<double>& col_fft, double* real, double* imag, bool inverse);
+
+}  // namespace caffe
@@ -0,0 +1,302 @@
+#include <cmath>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/fold_batch_norm.hpp"
+#include "caffe/util/half.hpp"
+
+namespace caffe {
+
+// The values of a blob, in whichever precision it holds them.
+static vector<double> BlobValues(const BlobProto& blob) {
+  if (blob.has_int8_data()) {
+    const string& data = blob.int8_data();
+    const int slice_size = data.size() / blob.int8_scale_size();
+    vector<double> values(data.size());
+    for (int i = 0; i < data.size(); ++i) {
+      values[i] = static_cast<int8_t>(data[i]) *
+          static_cast<double>(blob.int8_scale(i / slice_size));
+    }
+    return values;
+  }
+  if (blob.sparse()) {
+    int count = 1;
+    if (blob.has_num() || blob.has_channels() || blob.has_height() ||
+        blob.has_width()) {
+      count = blob.num() * blob.channels() * blob.height() * blob.width();
+    } else {
+      for (int i = 0; i < blob.shape().dim_size(); ++i) {
+        count *= blob.shape().dim(i);
+      }
+    }
+    vector<double> values(count, 0);
+    const bool double_data = blob.sparse_double_data_size() > 0;
+    int index = 0;
+    for (int i = 0; i < blob.sparse_gap_size(); ++i) {
+      index += blob.sparse_gap(i);
+      values[index] = double_data ? blob.sparse_double_data(i) :
+          blob.sparse_data(i);
+    }
+    return values;
+  }
+  if (blob.has_half_data()) {
+    vector<double> values(blob.half_data().size() / sizeof(uint16_t));
+    if (!values.empty()) {
+      caffe_cpu_from_half(values.size(),
+          reinterpret_cast<const uint16_t*>(blob.half_data().data()),
+          blob.half_precision(), &values[0]);
+    }
+    return values;
+  }
+  if (blob.double_data_size() > 0) {
+    return vector<double>(blob.double_data().begin(),
+        blob.double_data().end());
+  }
+  return vector<double>(blob.data().begin(), blob.data().end());
+}
+
+// Overwrites the values of a blob, keeping its precision (8- and 16-bit and
+// sparse blobs go back to dense single precision, or double for sparse
+// double blobs, since folding changes their scales).
+static void SetBlobValues(const vector<double>& values, BlobProto* blob) {
+  const bool double_data = blob->double_data_size() > 0 ||
+      blob->sparse_double_data_size() > 0;
+  blob->clear_sparse();
+  blob->clear_sparse_data();
+  blob->clear_sparse_gap();
+  blob->clear_sparse_double_data();
+  blob->clear_int8_data();
+  blob->clear_int8_scale();
+  blob->clear_half_data();
+  blob->clear_half_precision();
+  if (double_data) {
+    blob->clear_double_data();
+    for (int i = 0; i < values.size(); ++i) {
+      blob->add_double_data(values[i]);
+    }
+  } else {
+    blob->clear_data();
+    for (int i = 0; i < values.size(); ++i) {
+      blob->add_data(values[i]);
+    }
+  }
+}
+
+// The number of outputs of a layer whose weights can absorb a per-channel
+// affine map of its output, or 0.
+static int FoldableOutputs(const LayerParameter& layer) {
+  if (layer.top_size() != 1 || layer.blobs_size() == 0) {
+    return 0;
+  }
+  if (layer.type() == "Convolution" && layer.convolution_param().axis() == 1) {
+    return layer.convolution_param().num_output();
+  }
+  if (layer.type() == "InnerProduct" &&
+      layer.inner_product_param().axis() == 1) {
+    return layer.inner_product_param().num_output();
+  }
+  return 0;
+}
+
+// The per-channel affine map y = scale * x + shift computed by a BatchNorm,
+// Scale or Bias layer with the given number of channels, if it has one.
+static bool ChannelAffine(const LayerParameter& layer, const bool test_phase,
+    const int channels, vector<double>* scale, vector<double>* shift) {
+  if (layer.bottom_size() != 1 || layer.top_size() != 1) {
+    return false;
+  }
+  vector<vector<double> > blobs(layer.blobs_size());
+  for (int i = 0; i < layer.blobs_size(); ++i) {
+    blobs[i] = BlobValues(layer.blobs(i));
+  }
+  scale->assign(channels, 1);
+  shift->assign(channels, 0);
+  if (layer.type() == "BatchNorm") {
+    const BatchNormParameter& param = layer.batch_norm_param();
+    const bool use_global_stats = param.has_use_global_stats() ?
+        param.use_global_stats() : test_phase;
+    if (!use_global_stats || blobs.size() != 3 ||
+        blobs[0].size() != channels || blobs[1].size() != channels ||
+        blobs[2].size() != 1) {
+      return false;
+    }
+    const double scale_factor = blobs[2][0] == 0 ? 0 : 1 / blobs[2][0];
+    for (int c = 0; c < channels; ++c) {
+      (*scale)[c] = 1 / std::sqrt(blobs[1][c] * scale_factor + param.eps());
+      (*shift)[c] = -blobs[0][c] * scale_factor * (*scale)[c];
+    }
+    return true;
+  }
+  if (layer.type() == "Scale") {
+    const ScaleParameter& param = layer.scale_param();
+    if (param.axis() != 1 || param.num_axes() != 1 ||
+        blobs.size() != 1 + param.bias_term() || blobs[0].size() != channels ||
+        (param.bias_term() && blobs[1].size() != channels)) {
+      return false;
+    }
+    *scale = blobs[0];
+    if (param.bias_term()) {
+      *shift = blobs[1];
+    }
+    return true;
+  }
+  if (layer.type() == "Bias") {
+    const BiasParameter& param = layer.bias_param();
+    if (param.axis() != 1 || param.num_axes() != 1 || blobs.size() != 1 ||
+        blobs[0].size() != channels) {
+      return false;
+    }
+    *shift = blobs[0];
+    return true;
+  }
+  return false;
+}
+
+// Applies y = scale * x + shift to the output of a Convolution or
+// InnerProduct layer by rewriting its weights and bias.
+static void FoldIntoWeights(const vector<double>& scale,
+    const vector<double>& shift, LayerParameter* layer) {
+  const int channels = scale.size();
+  vector<double> weights = BlobValues(layer->blobs(0));
+  const int inputs = weights.size() / channels;
+  const bool transpose = layer->type() == "InnerProduct" &&
+      layer->inner_product_param().transpose();
+  for (int c = 0; c < channels; ++c) {
+    for (int i = 0; i < inputs; ++i) {
+      // Transposed inner product weights are inputs x channels.
+      weights[transpose ? i * channels + c : c * inputs + i] *= scale[c];
+    }
+  }
+  SetBlobValues(weights, layer->mutable_blobs(0));
+  const bool bias_term = layer->type() == "Convolution" ?
+      layer->convolution_param().bias_term() :
+      layer->inner_product_param().bias_term();
+  vector<double> bias(channels, 0);
+  if (bias_term) {
+    bias = BlobValues(layer->blobs(1));
+  } else if (shift == bias) {
+    return;
+  } else {
+    if (layer->type() == "Convolution") {
+      layer->mutable_convolution_param()->set_bias_term(true);
+    } else {
+      layer->mutable_inner_product_param()->set_bias_term(true);
+    }
+    BlobProto* bias_blob = layer->add_blobs();
+    bias_blob->mutable_shape()->add_dim(channels);
+    if (layer->blobs(0).double_data_size() > 0) {
+      bias_blob->add_double_data(0);
+    }
+  }
+  for (int c = 0; c < channels; ++c) {
+    bias[c] = scale[c] * bias[c] + shift[c];
+  }
+  SetBlobValues(bias, layer->mutable_blobs(1));
+}
+
+// Whether any layer strictly between first and last reads or writes blob.
+static bool BlobUsedBetween(const NetParameter& param, const int first,
+    const int last, const string& blob) {
+  for (int i = first + 1; i < last; ++i) {
+    const LayerParameter& layer = param.layer(i);
+    for (int j = 0; j < layer.bottom_size(); ++j) {
+      if (layer.bottom(j) == blob) { return true; }
+    }
+    for (int j = 0; j < layer.top_size(); ++j) {
+      if (layer.top(j) == blob) { return true; }
+    }
+  }
+  return false;
+}
+
+int FoldBatchNorm(const NetParameter& param, NetParameter* param_folded) {
+  const int num_layers = param.layer_size();
+  const bool test_phase = param.state().phase() == TEST;
+  // The layer that produced each bottom (-1 for net inputs), and the number
+  // of layers reading each top.
+  vector<vector<int> > producers(num_layers);
+  vector<vector<int> > num_readers(num_layers);
+  map<string, pair<int, int> > latest;
+  for (int i = 0; i < num_layers; ++i) {
+    const LayerParameter& layer = param.layer(i);
+    for (int j = 0; j < layer.bottom_size(); ++j) {
+      map<string, pair<int, int> >::const_iterator it =
+          latest.find(layer.bottom(j));
+      if (it == latest.end()) {
+        producers[i].push_back(-1);
+      } else {
+        producers[i].push_back(it->second.first);
+        ++num_readers[it->second.first][it->second.second];
+      }
+    }
+    num_readers[i].resize(layer.top_size(), 0);
+    for (int j = 0; j < layer.top_size(); ++j) {
+      latest[layer.top(j)] = make_pair(i, j);
+    }
+  }
+  // Fold layers into the Convolution or InnerProduct layer computing their
+  // input, accumulating a per-channel affine map of its output.
+  vector<LayerParameter> layers(param.layer().begin(), param.layer().end());
+  vector<int> folded_into(num_layers, -1);
+  vector<vector<double> > scales(num_layers);
+  vector<vector<double> > shifts(num_layers);
+  int num_folded = 0;
+  for (int i = 0; i < num_layers; ++i) {
+    const LayerParameter& layer = param.layer(i);
+    if (layer.include_size() || layer.exclude_size()) {
+      continue;
+    }
+    if (FoldableOutputs(layer)) {
+      folded_into[i] = i;
+      continue;
+    }
+    if (layer.bottom_size() != 1 || producers[i][0] < 0) {
+      continue;
+    }
+    const int producer = producers[i][0];
+    const int target = folded_into[producer];
+    vector<double> scale, shift;
+    if (target < 0 || num_readers[producer][0] != 1 ||
+        !ChannelAffine(layer, test_phase, FoldableOutputs(layers[target]),
+                       &scale, &shift)) {
+      continue;
+    }
+    // The target will write this layer's top from its own position.
+    if (layer.top(0) != layers[target].top(0) &&
+        BlobUsedBetween(param, target, i, layer.top(0))) {
+      continue;
+    }
+    vector<double>& target_scale = scales[target];
+    vector<double>& target_shift = shifts[target];
+    if (target_scale.empty()) {
+      target_scale.assign(scale.size(), 1);
+      target_shift.assign(scale.size(), 0);
+    }
+    for (int c = 0; c < scale.size(); ++c) {
+      target_scale[c] *= scale[c];
+      target_shift[c] = scale[c] * target_shift[c] + shift[c];
+    }
+    layers[target].set_top(0, layer.top(0));
+    folded_into[i] = target;
+    LOG(INFO) << "Folding " << layer.name() << " into "
+              << layers[target].name();
+    ++num_folded;
+  }
+  param_folded->CopyFrom(param);
+  param_folded->clear_layer();
+  for (int i = 0; i < num_layers; ++i) {
+    if (folded_into[i] >= 0 && folded_into[i] != i) {
+      continue;
+    }
+    if (!scales[i].empty()) {
+      FoldIntoWeights(scales[i], shifts[i], &layers[i]);
+    }
+    param_folded->add_layer()->CopyFrom(layers[i]);
+  }
+  return num_folded;
+}
+
+}  // namespace caffe
@@ -0,0 +1,73 @@
+#include <algorithm>
+#include <string>
+
+#include "caffe/layers/prelu_layer.hpp"
+#include "caffe/util/fused_activation.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+bool FusedActivation<Dtype>::Fuse(Layer<Dtype>* activation,
+    const int channels, const bool need_backward) {
+  const string type = activation->type();
+  if (type == "ReLU") {
+    negative_slope_ = activation->layer_param().relu_param().negative_slope();
+  } else if (type == "PReLU") {
+    PReLULayer<Dtype>* prelu = dynamic_cast<PReLULayer<Dtype>*>(activation);
+    CHECK(prelu);
+    channel_shared_ = activation->layer_param().prelu_param().channel_shared();
+    if (!channel_shared_ && activation->blobs()[0]->count() != channels) {
+      return false;
+    }
+    slopes_ = activation->blobs()[0];
+    bottom_memory_ = need_backward ? prelu->bottom_memory() : NULL;
+  } else {
+    return false;
+  }
+  fused_ = true;
+  return true;
+}
+
+template <typename Dtype>
+void FusedActivation<Dtype>::Forward(const int num, const int channels,
+    const int inner_dim, const Dtype* bias, Dtype* data,
+    const int offset) const {
+  if (!fused()) {
+    if (bias) {
+      for (int n = 0; n < num; ++n) {
+        for (int c = 0; c < channels; ++c) {
+          Dtype* x = data + (n * channels + c) * inner_dim;
+          for (int i = 0; i < inner_dim; ++i) {
+            x[i] += bias[c];
+          }
+        }
+      }
+    }
+    return;
+  }
+  const Dtype* slopes = slopes_ ? slopes_->cpu_data() : NULL;
+  Dtype* bottom_memory = bottom_memory_ ?
+      bottom_memory_->mutable_cpu_data() + offset : NULL;
+  for (int n = 0; n < num; ++n) {
+    for (int c = 0; c < channels; ++c) {
+      const Dtype b = bias ? bias[c] : Dtype(0);
+      const Dtype slope = !slopes ? negative_slope_ :
+          slopes[channel_shared_ ? 0 : c];
+      const int index = (n * channels + c) * inner_dim;
+      Dtype* x = data + index;
+      if (bottom_memory) {
+        for (int i = 0; i < inner_dim; ++i) {
+          bottom_memory[index + i] = x[i] + b;
+        }
+      }
+      for (int i = 0; i < inner_dim; ++i) {
+        const Dtype value = x[i] + b;
+        x[i] = std::max(value, Dtype(0)) + slope * std::min(value, Dtype(0));
+      }
+    }
+  }
+}
+
+INSTANTIATE_CLASS(FusedActivation);
+
+}  // namespace caffe
@@ -0,0 +1,453 @@
+#include <boost/thread.hpp>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <algorithm>
+#include <cfloat>
+#include <fstream>  // NOLINT(readability/streams)
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/gemm_tuner.hpp"
+
+namespace caffe {
+
+// Only products of up to this many multiply-adds try the small kernels.
+static const int64_t kSmallGemmMaxMultiplyAdds = int64_t(1) << 24;
+// The small kernels scale this many values of a row of A at a time.
+static const int kSmallGemmChunk = 256;
+// Each candidate is timed over this many rounds, keeping the fastest, of
+// enough calls to take about kTuneRoundMicroSeconds (at most kMaxTuneCalls).
+static const int kTuneRounds = 3;
+static const float kTuneRoundMicroSeconds = 500;
+static const int kMaxTuneCalls = 1000;
+// A candidate this many times slower than the best so far after a round is
+// not timed further.
+static const float kTuneGiveUpRatio = 2;
+
+bool GemmShape::operator<(const GemmShape& other) const {
+  if (is_double != other.is_double) { return is_double < other.is_double; }
+  if (trans_a != other.trans_a) { return trans_a < other.trans_a; }
+  if (trans_b != other.trans_b) { return trans_b < other.trans_b; }
+  if (M != other.M) { return M < other.M; }
+  if (N != other.N) { return N < other.N; }
+  return K < other.K;
+}
+
+string GemmShape::ToString() const {
+  std::ostringstream stream;
+  stream << (is_double ? "double " : "float ") << (trans_a ? 'T' : 'N')
+      << (trans_b ? 'T' : 'N') << ' ' << M << 'x' << N << 'x' << K;
+  return stream.str();
+}
+
+static inline void blas_gemm(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const float alpha, const float* A, const int lda, const float* B,
+    const int ldb, const float beta, float* C, const int ldc) {
+  cblas_sgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B, ldb,
+      beta, C, ldc);
+}
+
+static inline void blas_gemm(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const double alpha, const double* A, const int lda, const double* B,
+    const int ldb, const double beta, double* C, const int ldc) {
+  cblas_dgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B, ldb,
+      beta, C, ldc);
+}
+
+// Row m of C = alpha op(A) op(B) + beta C, a chunk of alpha op(A) at a time.
+// Without transposing B, the chunk adds up scaled rows of B, four at a time,
+// so the inner loop streams through contiguous memory; with it, the chunk
+// takes dot products with four rows of B at a time.
+template <typename Dtype>
+static void gemm_small_row(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int m, const int N, const int K,
+    const Dtype alpha, const Dtype* A, const int lda, const Dtype* B,
+    const int ldb, const Dtype beta, Dtype* C, const int ldc) {
+  Dtype* c = C + static_cast<int64_t>(m) * ldc;
+  if (beta == 0) {
+    std::fill(c, c + N, Dtype(0));
+  } else if (beta != 1) {
+    for (int n = 0; n < N; ++n) {
+      c[n] *= beta;
+    }
+  }
+  Dtype a[kSmallGemmChunk];
+  for (int k0 = 0; k0 < K; k0 += kSmallGemmChunk) {
+    const int count = std::min(kSmallGemmChunk, K - k0);
+    if (TransA == CblasNoTrans) {
+      const Dtype* a_m = A + static_cast<int64_t>(m) * lda + k0;
+      for (int k = 0; k < count; ++k) {
+        a[k] = alpha * a_m[k];
+      }
+    } else {
+      const Dtype* a_m = A + static_cast<int64_t>(k0) * lda + m;
+      for (int k = 0; k < count; ++k) {
+        a[k] = alpha * a_m[static_cast<int64_t>(k) * lda];
+      }
+    }
+    if (TransB == CblasNoTrans) {
+      const Dtype* b = B + static_cast<int64_t>(k0) * ldb;
+      int k = 0;
+      for (; k + 4 <= count; k += 4) {
+        const Dtype a0 = a[k], a1 = a[k + 1], a2 = a[k + 2], a3 = a[k + 3];
+        const Dtype* b0 = b + static_cast<int64_t>(k) * ldb;
+        const Dtype* b1 = b0 + ldb;
+        const Dtype* b2 = b1 + ldb;
+        const Dtype* b3 = b2 + ldb;
+#ifdef _OPENMP
+        #pragma omp simd
+#endif
+        for (int n = 0; n < N; ++n) {
+          c[n] += a0 * b0[n] + a1 * b1[n] + a2 * b2[n] + a3 * b3[n];
+        }
+      }
+      for (; k < count; ++k) {
+        const Dtype a0 = a[k];
+        const Dtype* b0 = b + static_cast<int64_t>(k) * ldb;
+#ifdef _OPENMP
+        #pragma omp simd
+#endif
+        for (int n = 0; n < N; ++n) {
+          c[n] += a0 * b0[n];
+        }
+      }
+    } else {
+      int n = 0;
+      for (; n + 4 <= N; n += 4) {
+        const Dtype* b0 = B + static_cast<int64_t>(n) * ldb + k0;
+        const Dtype* b1 = b0 + ldb;
+        const Dtype* b2 = b1 + ldb;
+        const Dtype* b3 = b2 + ldb;
+        Dtype sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+#ifdef _OPENMP
+        #pragma omp simd reduction(+: sum0, sum1, sum2, sum3)
+#endif
+        for (int k = 0; k < count; ++k) {
+          sum0 += a[k] * b0[k];
+          sum1 += a[k] * b1[k];
+          sum2 += a[k] * b2[k];
+          sum3 += a[k] * b3[k];
+        }
+        c[n] += sum0;
+        c[n + 1] += sum1;
+        c[n + 2] += sum2;
+        c[n + 3] += sum3;
+      }
+      for (; n < N; ++n) {
+        const Dtype* b0 = B + static_cast<int64_t>(n) * ldb + k0;
+        Dtype sum0 = 0;
+#ifdef _OPENMP
+        #pragma omp simd reduction(+: sum0)
+#endif
+        for (int k = 0; k < count; ++k) {
+          sum0 += a[k] * b0[k];
+        }
+        c[n] += sum0;
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void GemmTuner::RunKernel(const Kernel kernel, const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const Dtype alpha, const Dtype* A, const int lda, const Dtype* B,
+    const int ldb, const Dtype beta, Dtype* C, const int ldc) {
+  switch (kernel) {
+  case BLAS:
+    blas_gemm(TransA, TransB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+    break;
+  case BLAS_SERIAL: {
+#ifdef USE_MKL
+    // The thread count is the calling thread's own, and 0 restores MKL's
+    // global one.
+    const int threads = mkl_set_num_threads_local(1);
+    blas_gemm(TransA, TransB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+    mkl_set_num_threads_local(threads);
+#else
+    LOG(FATAL) << "Serial BLAS calls need MKL.";
+#endif
+    break;
+  }
+  case SMALL:
+    for (int m = 0; m < M; ++m) {
+      gemm_small_row(TransA, TransB, m, N, K, alpha, A, lda, B, ldb, beta, C,
+          ldc);
+    }
+    break;
+  case SMALL_PARALLEL:
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for (int m = 0; m < M; ++m) {
+      gemm_small_row(TransA, TransB, m, N, K, alpha, A, lda, B, ldb, beta, C,
+          ldc);
+    }
+    break;
+  default:
+    LOG(FATAL) << "Unknown GEMM kernel " << kernel;
+  }
+}
+
+bool GemmTuner::Candidate(const Kernel kernel, const GemmShape& shape) {
+  const int64_t multiply_adds =
+      static_cast<int64_t>(shape.M) * shape.N * shape.K;
+  switch (kernel) {
+  case BLAS:
+    return true;
+  case BLAS_SERIAL:
+#ifdef USE_MKL
+    return true;
+#else
+    return false;
+#endif
+  case SMALL:
+    return multiply_adds <= kSmallGemmMaxMultiplyAdds;
+  case SMALL_PARALLEL:
+#ifdef _OPENMP
+    return shape.M > 1 && omp_get_max_threads() > 1 &&
+        multiply_adds <= kSmallGemmMaxMultiplyAdds;
+#else
+    return false;
+#endif
+  default:
+    return false;
+  }
+}
+
+const char* GemmTuner::KernelName(const Kernel kernel) {
+  switch (kernel) {
+  case BLAS:
+    return "blas";
+  case BLAS_SERIAL:
+    return "blas_serial";
+  case SMALL:
+    return "small";
+  case SMALL_PARALLEL:
+    return "small_parallel";
+  default:
+    LOG(FATAL) << "Unknown GEMM kernel " << kernel;
+  }
+  return "";
+}
+
+GemmTuner& GemmTuner::Get() {
+  // Leaked, like the host memory pools, so that calls during program exit
+  // still find it.
+  static GemmTuner* tuner = new GemmTuner();
+  return *tuner;
+}
+
+GemmTuner::GemmTuner()
+    : enabled_(false), cache_file_(), decisions_(), tuning_(),
+      mutex_(new boost::shared_mutex()) {
+}
+
+std::map<GemmShape, GemmTuner::Kernel> GemmTuner::decisions() const {
+  boost::shared_lock<boost::shared_mutex> lock(*mutex_);
+  return decisions_;
+}
+
+void GemmTuner::Clear() {
+  boost::unique_lock<boost::shared_mutex> lock(*mutex_);
+  decisions_.clear();
+}
+
+void GemmTuner::set_cache_file(const string& path) {
+  boost::unique_lock<boost::shared_mutex> lock(*mutex_);
+  cache_file_ = path;
+  if (!cache_file_.empty()) {
+    LoadCacheFile();
+  }
+}
+
+// The cache file has a line per shape: the type, the transposes of A and B,
+// M, N, K and the kernel, e.g. "float NT 64 128 27 small".
+void GemmTuner::LoadCacheFile() {
+  std::ifstream file(cache_file_.c_str());
+  if (!file) {
+    std::ofstream new_file(cache_file_.c_str());
+    if (new_file) {
+      new_file << "# caffe_cpu_gemm kernels: type transposes M N K kernel\n";
+    } else {
+      LOG(WARNING) << "Cannot create the GEMM tuning cache " << cache_file_;
+    }
+    return;
+  }
+  string line;
+  int loaded = 0;
+  while (std::getline(file, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::istringstream stream(line);
+    string type, trans, name;
+    GemmShape shape;
+    stream >> type >> trans >> shape.M >> shape.N >> shape.K >> name;
+    shape.is_double = type == "double";
+    shape.trans_a = trans.size() == 2 && trans[0] == 'T';
+    shape.trans_b = trans.size() == 2 && trans[1] == 'T';
+    int kernel = 0;
+    while (kernel < kNumKernels &&
+           name != KernelName(static_cast<Kernel>(kernel))) {
+      ++kernel;
+    }
+    if (stream.fail() || (type != "float" && type != "double") ||
+        trans.size() != 2 || kernel == kNumKernels ||
+        !Candidate(static_cast<Kernel>(kernel), shape)) {
+      LOG(WARNING) << "Skipping GEMM tuning cache line \"" << line << "\"";
+      continue;
+    }
+    decisions_[shape] = static_cast<Kernel>(kernel);
+    ++loaded;
+  }
+  LOG(INFO) << "Loaded " << loaded << " GEMM kernel choices from "
+      << cache_file_;
+}
+
+void GemmTuner::SaveDecision(const GemmShape& shape, const Kernel kernel) {
+  if (cache_file_.empty()) {
+    return;
+  }
+  std::ofstream file(cache_file_.c_str(), std::ios::app);
+  file << (shape.is_double ? "double " : "float ")
+      << (shape.trans_a ? 'T' : 'N') << (shape.trans_b ? 'T' : 'N') << ' '
+      << shape.M << ' ' << shape.N << ' ' << shape.K << ' '
+      << KernelName(kernel) << '\n';
+  if (!file) {
+    LOG(WARNING) << "Cannot write to the GEMM tuning cache " << cache_file_;
+  }
+}
+
+template <typename Dtype>
+GemmTuner::Kernel GemmTuner::Tune(const GemmShape& shape,
+    const CBLAS_TRANSPOSE TransA, const CBLAS_TRANSPOSE TransB,
+    const Dtype alpha, const Dtype* A, const int lda, const Dtype* B,
+    const int ldb, const Dtype beta, const Dtype* C, const int ldc) {
+  const int M = shape.M, N = shape.N, K = shape.K;
+  // The candidates write to a copy of C.
+  const int64_t span = static_cast<int64_t>(M - 1) * ldc + N;
+  vector<Dtype> scratch(span);
+  if (beta != 0) {
+    std::copy(C, C + span, scratch.begin());
+  }
+  Dtype* output = &scratch[0];
+  // Enough calls per round for the timer, from one warm call to BLAS.
+  CPUTimer timer;
+  RunKernel(BLAS, TransA, TransB, M, N, K, alpha, A, lda, B, ldb, beta,
+      output, ldc);
+  timer.Start();
+  RunKernel(BLAS, TransA, TransB, M, N, K, alpha, A, lda, B, ldb, beta,
+      output, ldc);
+  timer.Stop();
+  const int calls = std::max(1, std::min(kMaxTuneCalls, static_cast<int>(
+      kTuneRoundMicroSeconds / std::max(timer.MicroSeconds(), 0.1f))));
+  Kernel best = BLAS;
+  float best_time = FLT_MAX;
+  for (int k = 0; k < kNumKernels; ++k) {
+    const Kernel kernel = static_cast<Kernel>(k);
+    if (!Candidate(kernel, shape)) {
+      continue;
+    }
+    if (kernel != BLAS) {
+      RunKernel(kernel, TransA, TransB, M, N, K, alpha, A, lda, B, ldb, beta,
+          output, ldc);
+    }
+    float time = FLT_MAX;
+    for (int round = 0; round < kTuneRounds; ++round) {
+      timer.Start();
+      for (int i = 0; i < calls; ++i) {
+        RunKernel(kernel, TransA, TransB, M, N, K, alpha, A, lda, B, ldb,
+            beta, output, ldc);
+      }
+      timer.Stop();
+      time = std::min(time, timer.MicroSeconds() / calls);
+      if (time > kTuneGiveUpRatio * best_time) {
+        break;
+      }
+    }
+    if (time < best_time) {
+      best = kernel;
+      best_time = time;
+    }
+  }
+  return best;
+}
+
+template <typename Dtype>
+void GemmTuner::Gemm(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const Dtype alpha, const Dtype* A, const int lda, const Dtype* B,
+    const int ldb, const Dtype beta, Dtype* C, const int ldc) {
+  GemmShape shape;
+  shape.is_double = sizeof(Dtype) == sizeof(double);
+  shape.trans_a = TransA != CblasNoTrans;
+  shape.trans_b = TransB != CblasNoTrans;
+  shape.M = M;
+  shape.N = N;
+  shape.K = K;
+  bool tune = M > 0 && N > 0;
+#ifdef _OPENMP
+  tune = tune && !omp_in_parallel();
+#endif
+  Kernel kernel = BLAS;
+  bool found = false;
+  {
+    boost::shared_lock<boost::shared_mutex> lock(*mutex_);
+    std::map<GemmShape, Kernel>::const_iterator it = decisions_.find(shape);
+    if (it != decisions_.end()) {
+      kernel = it->second;
+      found = true;
+    }
+  }
+  if (!found && tune) {
+    // The first thread to reach a new shape tunes it, without the lock;
+    // calls of the shape meanwhile use BLAS.
+    {
+      boost::unique_lock<boost::shared_mutex> lock(*mutex_);
+      tune = decisions_.find(shape) == decisions_.end() &&
+          tuning_.insert(shape).second;
+    }
+    if (tune) {
+      kernel = Tune(shape, TransA, TransB, alpha, A, lda, B, ldb, beta, C,
+          ldc);
+      boost::unique_lock<boost::shared_mutex> lock(*mutex_);
+      tuning_.erase(shape);
+      decisions_[shape] = kernel;
+      SaveDecision(shape, kernel);
+      LOG(INFO) << "caffe_cpu_gemm " << shape.ToString() << ": "
+          << KernelName(kernel);
+    }
+  }
+  RunKernel(kernel, TransA, TransB, M, N, K, alpha, A, lda, B, ldb, beta, C,
+      ldc);
+}
+
+template void GemmTuner::Gemm<float>(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const float alpha, const float* A, const int lda, const float* B,
+    const int ldb, const float beta, float* C, const int ldc);
+template void GemmTuner::Gemm<double>(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const double alpha, const double* A, const int lda, const double* B,
+    const int ldb, const double beta, double* C, const int ldc);
+template void GemmTuner::RunKernel<float>(const Kernel kernel,
+    const CBLAS_TRANSPOSE TransA, const CBLAS_TRANSPOSE TransB, const int M,
+    const int N, const int K, const float alpha, const float* A,
+    const int lda, const float* B, const int ldb, const float beta, float* C,
+    const int ldc);
+template void GemmTuner::RunKernel<double>(const Kernel kernel,
+    const CBLAS_TRANSPOSE TransA, const CBLAS_TRANSPOSE TransB, const int M,
+    const int N, const int K, const double alpha, const double* A,
+    const int lda, const double* B, const int ldb, const double beta,
+    double* C, const int ldc);
+
+}  // namespace caffe
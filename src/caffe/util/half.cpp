@@ -0,0 +1,190 @@
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "caffe/util/half.hpp"
+
+namespace caffe {
+
+static inline uint32_t float_bits(const float x) {
+  uint32_t bits;
+  memcpy(&bits, &x, sizeof(bits));  // NOLINT(caffe/alt_fn)
+  return bits;
+}
+
+static inline float bits_float(const uint32_t bits) {
+  float x;
+  memcpy(&x, &bits, sizeof(x));  // NOLINT(caffe/alt_fn)
+  return x;
+}
+
+uint16_t float_to_half(const float x) {
+  const uint32_t bits = float_bits(x);
+  const uint16_t sign = (bits >> 16) & 0x8000;
+  uint32_t magnitude = bits & 0x7fffffff;
+  if (magnitude >= 0x47800000) {
+    // At least 2^16, which overflows, or infinite, or NaN.
+    return sign | (magnitude > 0x7f800000 ? 0x7e00 : 0x7c00);
+  }
+  if (magnitude < 0x38800000) {
+    // Below 2^-14, the smallest normal half: adding 0.5 lines the bits of
+    // the subnormal half up with the bottom of the mantissa, and the float
+    // addition does the rounding.
+    const float shifted = bits_float(magnitude) + 0.5f;
+    return sign | (float_bits(shifted) - 0x3f000000);
+  }
+  // Rebias the exponent from 127 to 15 and round the 13 dropped bits to
+  // nearest even; a carry out of the mantissa bumps the exponent, up to
+  // infinity.
+  const uint32_t odd = (magnitude >> 13) & 1;
+  magnitude += 0xc8000fff + odd;
+  return sign | (magnitude >> 13);
+}
+
+float half_to_float(const uint16_t x) {
+  // Shifting the exponent and mantissa into place and scaling by 2^112
+  // rebiases the exponent from 15 to 127, subnormals included, without
+  // branches, so that the conversion loops vectorize.
+  float y = bits_float(static_cast<uint32_t>(x & 0x7fff) << 13) *
+      bits_float((254 - 15) << 23);
+  uint32_t bits = float_bits(y);
+  if (y >= 65536.f) {
+    // Infinite or NaN: the exponent was all ones.
+    bits |= 0xff << 23;
+  }
+  return bits_float(bits | static_cast<uint32_t>(x & 0x8000) << 16);
+}
+
+uint16_t float_to_bfloat16(const float x) {
+  const uint32_t bits = float_bits(x);
+  if ((bits & 0x7fffffff) > 0x7f800000) {
+    // Keep NaNs quiet rather than rounding them to infinity.
+    return (bits >> 16) | 0x40;
+  }
+  return (bits + 0x7fff + ((bits >> 16) & 1)) >> 16;
+}
+
+float bfloat16_to_float(const uint16_t x) {
+  return bits_float(static_cast<uint32_t>(x) << 16);
+}
+
+template <typename Dtype>
+void caffe_cpu_to_half(const int n, const Dtype* x, const Precision precision,
+    uint16_t* y) {
+  if (precision == FLOAT16) {
+    for (int i = 0; i < n; ++i) {
+      y[i] = float_to_half(x[i]);
+    }
+  } else {
+    CHECK_EQ(precision, BFLOAT16) << "Unsupported 16-bit precision.";
+    for (int i = 0; i < n; ++i) {
+      y[i] = float_to_bfloat16(x[i]);
+    }
+  }
+}
+
+template void caffe_cpu_to_half<float>(const int n, const float* x,
+    const Precision precision, uint16_t* y);
+template void caffe_cpu_to_half<double>(const int n, const double* x,
+    const Precision precision, uint16_t* y);
+
+template <typename Dtype>
+void caffe_cpu_from_half(const int n, const uint16_t* x,
+    const Precision precision, Dtype* y) {
+  // These loops convert the weights HalfWeights::Unpack feeds to the GEMMs,
+  // so they have to keep up with reading memory.
+  if (precision == FLOAT16) {
+#ifdef _OPENMP
+    #pragma omp simd
+#endif
+    for (int i = 0; i < n; ++i) {
+      y[i] = half_to_float(x[i]);
+    }
+  } else {
+    CHECK_EQ(precision, BFLOAT16) << "Unsupported 16-bit precision.";
+#ifdef _OPENMP
+    #pragma omp simd
+#endif
+    for (int i = 0; i < n; ++i) {
+      y[i] = bfloat16_to_float(x[i]);
+    }
+  }
+}
+
+template void caffe_cpu_from_half<float>(const int n, const uint16_t* x,
+    const Precision precision, float* y);
+template void caffe_cpu_from_half<double>(const int n, const uint16_t* x,
+    const Precision precision, double* y);
+
+template <typename Dtype>
+void HalfWeights<Dtype>::Update(const Blob<Dtype>& weights,
+    const Precision precision) {
+  const shared_ptr<SyncedMemory>& source = weights.data();
+  if (source == source_ && source->version() == source_version_ &&
+      precision == precision_) {
+    return;
+  }
+  data_.resize(weights.count());
+  caffe_cpu_to_half(weights.count(), weights.cpu_data(), precision,
+      &data_[0]);
+  precision_ = precision;
+  source_ = source;
+  source_version_ = source->version();
+  released_ = false;
+}
+
+template <typename Dtype>
+void HalfWeights<Dtype>::Release(Blob<Dtype>* weights) {
+  CHECK(weights->data() == source_ &&
+        source_->version() == source_version_)
+      << "Only weights that were converted can be released.";
+  if (released_) {
+    return;
+  }
+  // A SyncedMemory allocates nothing until it is accessed.
+  source_.reset(new SyncedMemory(weights->count() * sizeof(Dtype)));
+  source_version_ = source_->version();
+  released_ = true;
+  weights->set_data(source_);
+}
+
+template <typename Dtype>
+void HalfWeights<Dtype>::Unpack(const int offset, const int count,
+    Dtype* y) const {
+  CHECK_LE(offset + count, static_cast<int>(data_.size()));
+  caffe_cpu_from_half(count, &data_[offset], precision_, y);
+}
+
+INSTANTIATE_CLASS(HalfWeights);
+
+bool HalfBlobProto(const Precision precision, BlobProto* proto) {
+  vector<float> values;
+  if (proto->double_data_size() > 0) {
+    values.assign(proto->double_data().begin(), proto->double_data().end());
+  } else {
+    values.assign(proto->data().begin(), proto->data().end());
+  }
+  // The largest finite value of each precision.
+  const float max_value = precision == FLOAT16 ? 65504.f : FLT_MAX;
+  for (int i = 0; i < values.size(); ++i) {
+    if (std::fabs(values[i]) > max_value) {
+      return false;
+    }
+  }
+  string data(values.size() * sizeof(uint16_t), 0);
+  if (!values.empty()) {
+    // The bytes of each value are little-endian, as on the hosts Caffe
+    // supports.
+    caffe_cpu_to_half(values.size(), &values[0], precision,
+        reinterpret_cast<uint16_t*>(&data[0]));
+  }
+  proto->clear_data();
+  proto->clear_double_data();
+  proto->set_half_precision(precision);
+  proto->set_half_data(data);
+  return true;
+}
+
+}  // namespace caffe
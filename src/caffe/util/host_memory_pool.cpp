@@ -0,0 +1,173 @@
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <vector>
+
+#include "caffe/util/host_memory_pool.hpp"
+
+namespace caffe {
+
+// Requests below this size share the smallest size class.
+static const size_t kMinSizeClass = 64;
+// Number of size classes per power of two.
+static const int kClassesPerDoubling = 4;
+
+HostMemoryPool& HostMemoryPool::Get(bool pinned) {
+  // The pools are intentionally leaked so that blobs with static storage
+  // duration can still return their memory during program exit.
+  static HostMemoryPool* pageable_pool = new HostMemoryPool(false);
+#ifndef CPU_ONLY
+  static HostMemoryPool* pinned_pool = new HostMemoryPool(true);
+  if (pinned) {
+    return *pinned_pool;
+  }
+#else
+  CHECK(!pinned) << "Pinned host memory requires a GPU build.";
+#endif
+  return *pageable_pool;
+}
+
+HostMemoryPool::HostMemoryPool(bool pinned)
+    : pinned_(pinned), max_cached_bytes_(0), caching_(false),
+      stats_(), free_blocks_(), mutex_(new boost::mutex()) {
+}
+
+size_t HostMemoryPool::SizeClass(size_t size) {
+  if (size <= kMinSizeClass) {
+    return kMinSizeClass;
+  }
+  // Split [2^k, 2^(k+1)) into kClassesPerDoubling equal steps.
+  size_t power = kMinSizeClass;
+  while (power * 2 < size) {
+    power *= 2;
+  }
+  const size_t step = power / kClassesPerDoubling;
+  return (size + step - 1) / step * step;
+}
+
+void* HostMemoryPool::SystemAllocate(size_t size) {
+  void* ptr = NULL;
+#ifndef CPU_ONLY
+  if (pinned_) {
+    CUDA_CHECK(cudaMallocHost(&ptr, size));
+    return ptr;
+  }
+#endif
+  ptr = malloc(size);
+  CHECK(ptr) << "host allocation of size " << size << " failed";
+  return ptr;
+}
+
+void HostMemoryPool::SystemFree(void* ptr) {
+#ifndef CPU_ONLY
+  if (pinned_) {
+    CUDA_CHECK(cudaFreeHost(ptr));
+    return;
+  }
+#endif
+  free(ptr);
+}
+
+void* HostMemoryPool::Allocate(size_t size) {
+  const size_t class_size = SizeClass(size);
+  {
+    boost::mutex::scoped_lock lock(*mutex_);
+    stats_.bytes_live += class_size;
+    stats_.peak_bytes_live = std::max(stats_.peak_bytes_live,
+                                      stats_.bytes_live);
+    std::map<size_t, std::vector<void*> >::iterator it =
+        free_blocks_.find(class_size);
+    if (it != free_blocks_.end() && !it->second.empty()) {
+      void* ptr = it->second.back();
+      it->second.pop_back();
+      stats_.bytes_cached -= class_size;
+      ++stats_.hits;
+      return ptr;
+    }
+    ++stats_.misses;
+  }
+  // Go to the system outside the lock; it may be slow.
+  return SystemAllocate(class_size);
+}
+
+void HostMemoryPool::Deallocate(void* ptr, size_t size) {
+  if (!ptr) {
+    return;
+  }
+  const size_t class_size = SizeClass(size);
+  {
+    boost::mutex::scoped_lock lock(*mutex_);
+    CHECK_GE(stats_.bytes_live, class_size)
+        << "Block was not allocated from this pool.";
+    stats_.bytes_live -= class_size;
+    if (stats_.bytes_cached + class_size <= max_cached_bytes_) {
+      free_blocks_[class_size].push_back(ptr);
+      stats_.bytes_cached += class_size;
+      return;
+    }
+    ++stats_.releases;
+  }
+  SystemFree(ptr);
+}
+
+size_t HostMemoryPool::TrimLocked(size_t target_bytes) {
+  size_t released = 0;
+  // Release the largest blocks first: they are the least likely to be reused
+  // and free the most memory per call to the system allocator.
+  std::map<size_t, std::vector<void*> >::reverse_iterator it =
+      free_blocks_.rbegin();
+  for (; it != free_blocks_.rend() && stats_.bytes_cached > target_bytes;
+       ++it) {
+    std::vector<void*>& blocks = it->second;
+    while (!blocks.empty() && stats_.bytes_cached > target_bytes) {
+      SystemFree(blocks.back());
+      blocks.pop_back();
+      stats_.bytes_cached -= it->first;
+      released += it->first;
+      ++stats_.releases;
+    }
+  }
+  return released;
+}
+
+size_t HostMemoryPool::Trim(size_t target_bytes) {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return TrimLocked(target_bytes);
+}
+
+size_t HostMemoryPool::TrimAll(size_t target_bytes) {
+  size_t released = Get(false).Trim(target_bytes);
+#ifndef CPU_ONLY
+  released += Get(true).Trim(target_bytes);
+#endif
+  return released;
+}
+
+HostMemoryPoolStats HostMemoryPool::stats() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return stats_;
+}
+
+void HostMemoryPool::ResetStats() {
+  boost::mutex::scoped_lock lock(*mutex_);
+  stats_.peak_bytes_live = stats_.bytes_live;
+  stats_.hits = 0;
+  stats_.misses = 0;
+  stats_.releases = 0;
+}
+
+size_t HostMemoryPool::max_cached_bytes() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return max_cached_bytes_;
+}
+
+void HostMemoryPool::set_max_cached_bytes(size_t bytes) {
+  boost::mutex::scoped_lock lock(*mutex_);
+  max_cached_bytes_ = bytes;
+  caching_ = bytes > 0;
+  TrimLocked(bytes);
+}
+
+}  // namespace caffe
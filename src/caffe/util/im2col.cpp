@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <vector>
 
 #include "caffe/util/im2col.hpp"
@@ -5,14 +6,34 @@
 
 namespace caffe {
 
-// Function uses casting from int to unsigned to compare if value of
-// parameter a is greater or equal to zero and lower than value of
-// parameter b. The b parameter is of type signed and is always positive,
-// therefore its value is always lower than 0x800... where casting
-// negative value of a parameter converts it to value higher than 0x800...
-// The casting allows to use one condition instead of two.
-inline bool is_a_ge_zero_and_a_lt_b(int a, int b) {
-  return static_cast<unsigned>(a) < static_cast<unsigned>(b);
+// Copies (im2col) or accumulates (col2im) the row of columns d in [0, count)
+// that reads the image values im[index + d * stride] for d in [begin, end).
+template <typename Dtype>
+inline void im2col_row(const Dtype* im, const int index, const int stride,
+    const int begin, const int end, const int count, Dtype* col_row) {
+  std::fill(col_row, col_row + begin, Dtype(0));
+  if (stride == 1) {
+    std::copy(im + index + begin, im + index + end, col_row + begin);
+  } else {
+    for (int d = begin; d < end; ++d) {
+      col_row[d] = im[index + d * stride];
+    }
+  }
+  std::fill(col_row + end, col_row + count, Dtype(0));
+}
+
+template <typename Dtype>
+inline void col2im_row(const Dtype* col_row, const int stride,
+    const int begin, const int end, const int index, Dtype* im) {
+  if (stride == 1) {
+    for (int d = begin; d < end; ++d) {
+      im[index + d] += col_row[d];
+    }
+  } else {
+    for (int d = begin; d < end; ++d) {
+      im[index + d * stride] += col_row[d];
+    }
+  }
 }
 
 template <typename Dtype>
@@ -27,30 +48,30 @@ void im2col_cpu(const Dtype* data_im, const int channels,
   const int output_w = (width + 2 * pad_w -
     (dilation_w * (kernel_w - 1) + 1)) / stride_w + 1;
   const int channel_size = height * width;
-  for (int channel = channels; channel--; data_im += channel_size) {
-    for (int kernel_row = 0; kernel_row < kernel_h; kernel_row++) {
-      for (int kernel_col = 0; kernel_col < kernel_w; kernel_col++) {
-        int input_row = -pad_h + kernel_row * dilation_h;
-        for (int output_rows = output_h; output_rows; output_rows--) {
-          if (!is_a_ge_zero_and_a_lt_b(input_row, height)) {
-            for (int output_cols = output_w; output_cols; output_cols--) {
-              *(data_col++) = 0;
-            }
-          } else {
-            int input_col = -pad_w + kernel_col * dilation_w;
-            for (int output_col = output_w; output_col; output_col--) {
-              if (is_a_ge_zero_and_a_lt_b(input_col, width)) {
-                *(data_col++) = data_im[input_row * width + input_col];
-              } else {
-                *(data_col++) = 0;
-              }
-              input_col += stride_w;
-            }
-          }
-          input_row += stride_h;
-        }
-      }
+  const int kernel_size = kernel_h * kernel_w;
+  const int channels_col = channels * kernel_size;
+  // Each row of the columns is written independently. Consecutive rows read
+  // the same input channel, which thus stays in cache.
+#ifdef _OPENMP
+  #pragma omp parallel for \
+      if (channels_col * output_h * output_w >= kParallelMinInputs)
+#endif
+  for (int c_col = 0; c_col < channels_col; ++c_col) {
+    const int kernel_row = c_col / kernel_w % kernel_h;
+    const int kernel_col = c_col % kernel_w;
+    const Dtype* channel_im = data_im + c_col / kernel_size * channel_size;
+    Dtype* col = data_col + c_col * output_h * output_w;
+    const int offset_h = -pad_h + kernel_row * dilation_h;
+    const int offset_w = -pad_w + kernel_col * dilation_w;
+    int h_begin, h_end, w_begin, w_end;
+    valid_output_range(offset_h, stride_h, height, output_h, &h_begin, &h_end);
+    valid_output_range(offset_w, stride_w, width, output_w, &w_begin, &w_end);
+    std::fill(col, col + h_begin * output_w, Dtype(0));
+    for (int h = h_begin; h < h_end; ++h) {
+      im2col_row(channel_im, (offset_h + h * stride_h) * width + offset_w,
+          stride_w, w_begin, w_end, output_w, col + h * output_w);
     }
+    std::fill(col + h_end * output_w, col + output_h * output_w, Dtype(0));
   }
 }
 
@@ -71,70 +92,86 @@ inline void im2col_nd_core_cpu(const Dtype* data_input, const bool im2col,
     const int num_spatial_axes, const int* im_shape, const int* col_shape,
     const int* kernel_shape, const int* pad, const int* stride,
     const int* dilation, Dtype* data_output) {
-  if (!im2col) {
-    int im_size = im_shape[0];
-    for (int i = 0; i < num_spatial_axes; ++i) {
-      im_size *= im_shape[1 + i];
-    }
-    caffe_set(im_size, Dtype(0), data_output);
-  }
   int kernel_size = 1;
+  int im_size = 1;
+  int col_size = 1;
   for (int i = 0; i < num_spatial_axes; ++i) {
     kernel_size *= kernel_shape[i];
+    im_size *= im_shape[1 + i];
+    col_size *= col_shape[1 + i];
   }
   const int channels_col = col_shape[0];
-  vector<int> d_offset(num_spatial_axes, 0);
-  vector<int> d_iter(num_spatial_axes, 0);
-  for (int c_col = 0; c_col < channels_col; ++c_col) {
-    // Loop over spatial axes in reverse order to compute a per-axis offset.
-    int offset = c_col;
-    for (int d_i = num_spatial_axes - 1; d_i >= 0; --d_i) {
-      if (d_i < num_spatial_axes - 1) {
-        offset /= kernel_shape[d_i + 1];
-      }
-      d_offset[d_i] = offset % kernel_shape[d_i];
+  const int channels_im = channels_col / kernel_size;
+  // The last spatial axis is handled a whole row at a time, with its padding
+  // hoisted out of the inner loop. A 0D "convolution" has rows of one value.
+  const int last = num_spatial_axes - 1;
+  const int im_row_size = (num_spatial_axes > 0) ? im_shape[1 + last] : 1;
+  const int col_row_size = (num_spatial_axes > 0) ? col_shape[1 + last] : 1;
+  const int last_stride = (num_spatial_axes > 0) ? stride[last] : 1;
+  const int col_rows = col_size / col_row_size;
+  // The columns of one image channel accumulate into the same image values
+  // in col2im, so the channels are distributed over the threads.
+#ifdef _OPENMP
+  #pragma omp parallel for if (channels_col * col_size >= kParallelMinInputs)
+#endif
+  for (int c_im = 0; c_im < channels_im; ++c_im) {
+    const int im_offset = c_im * im_size;
+    if (!im2col) {
+      caffe_set(im_size, Dtype(0), data_output + im_offset);
     }
-    for (bool incremented = true; incremented; ) {
-      // Loop over spatial axes in forward order to compute the indices in the
-      // image and column, and whether the index lies in the padding.
-      int index_col = c_col;
-      int index_im = c_col / kernel_size;
-      bool is_padding = false;
-      for (int d_i = 0; d_i < num_spatial_axes; ++d_i) {
-        const int d = d_iter[d_i];
-        const int d_im = d * stride[d_i] - pad[d_i] +
-            d_offset[d_i] * dilation[d_i];
-        is_padding |= d_im < 0 || d_im >= im_shape[d_i + 1];
-        index_col *= col_shape[d_i + 1];
-        index_col += d;
-        index_im *= im_shape[d_i + 1];
-        index_im += d_im;
-      }
-      if (im2col) {
-        if (is_padding) {
-          data_output[index_col] = 0;
-        } else {
-          data_output[index_col] = data_input[index_im];
+    vector<int> d_offset(num_spatial_axes, 0);
+    vector<int> d_iter(num_spatial_axes, 0);
+    for (int c_col = c_im * kernel_size; c_col < (c_im + 1) * kernel_size;
+         ++c_col) {
+      // Loop over spatial axes in reverse order to compute a per-axis offset.
+      int offset = c_col;
+      for (int d_i = num_spatial_axes - 1; d_i >= 0; --d_i) {
+        if (d_i < num_spatial_axes - 1) {
+          offset /= kernel_shape[d_i + 1];
         }
-      } else if (!is_padding) {  // col2im
-        data_output[index_im] += data_input[index_col];
+        d_offset[d_i] = offset % kernel_shape[d_i];
       }
-      // Loop over spatial axes in reverse order to choose an index,
-      // like counting.
-      incremented = false;
-      for (int d_i = num_spatial_axes - 1; d_i >= 0; --d_i) {
-        const int d_max = col_shape[d_i + 1];
-        DCHECK_LT(d_iter[d_i], d_max);
-        if (d_iter[d_i] == d_max - 1) {
+      const int row_offset = (num_spatial_axes > 0) ?
+          d_offset[last] * dilation[last] - pad[last] : 0;
+      int begin, end;
+      valid_output_range(row_offset, last_stride, im_row_size, col_row_size,
+          &begin, &end);
+      for (int row = 0; row < col_rows; ++row) {
+        // Loop over the other spatial axes in forward order to compute the
+        // index of the image row, and whether it lies in the padding.
+        int index_im = 0;
+        bool is_padding = false;
+        for (int d_i = 0; d_i < last; ++d_i) {
+          const int d_im = d_iter[d_i] * stride[d_i] - pad[d_i] +
+              d_offset[d_i] * dilation[d_i];
+          is_padding |= d_im < 0 || d_im >= im_shape[d_i + 1];
+          index_im = index_im * im_shape[d_i + 1] + d_im;
+        }
+        index_im = index_im * im_row_size + row_offset;
+        const int col_offset = c_col * col_size + row * col_row_size;
+        if (im2col) {
+          Dtype* col_row = data_output + col_offset;
+          if (is_padding) {
+            std::fill(col_row, col_row + col_row_size, Dtype(0));
+          } else {
+            im2col_row(data_input + im_offset, index_im, last_stride, begin,
+                end, col_row_size, col_row);
+          }
+        } else if (!is_padding) {  // col2im
+          col2im_row(data_input + col_offset, last_stride, begin, end,
+              index_im, data_output + im_offset);
+        }
+        // Loop over the other spatial axes in reverse order to choose the
+        // next row, like counting.
+        for (int d_i = last - 1; d_i >= 0; --d_i) {
+          if (++d_iter[d_i] < col_shape[d_i + 1]) {
+            break;
+          }
           d_iter[d_i] = 0;
-        } else {  // d_iter[d_i] < d_max - 1
-          ++d_iter[d_i];
-          incremented = true;
-          break;
         }
       }
-    }  // while(incremented) {
-  }  // for (int c = 0; c < channels_col; ++c) {
+    }
+  }
 }
 
 template <typename Dtype>
@@ -166,30 +203,36 @@ void col2im_cpu(const Dtype* data_col, const int channels,
     const int stride_h, const int stride_w,
     const int dilation_h, const int dilation_w,
     Dtype* data_im) {
-  caffe_set(height * width * channels, Dtype(0), data_im);
   const int output_h = (height + 2 * pad_h -
     (dilation_h * (kernel_h - 1) + 1)) / stride_h + 1;
   const int output_w = (width + 2 * pad_w -
     (dilation_w * (kernel_w - 1) + 1)) / stride_w + 1;
   const int channel_size = height * width;
-  for (int channel = channels; channel--; data_im += channel_size) {
+  const int kernel_size = kernel_h * kernel_w;
+  // All the rows of the columns of a channel accumulate into the same image
+  // channel, so the channels are distributed over the threads; the channel
+  // being accumulated stays in cache.
+#ifdef _OPENMP
+  #pragma omp parallel for \
+      if (channels * kernel_size * output_h * output_w >= kParallelMinInputs)
+#endif
+  for (int channel = 0; channel < channels; ++channel) {
+    Dtype* channel_im = data_im + channel * channel_size;
+    caffe_set(channel_size, Dtype(0), channel_im);
     for (int kernel_row = 0; kernel_row < kernel_h; kernel_row++) {
       for (int kernel_col = 0; kernel_col < kernel_w; kernel_col++) {
-        int input_row = -pad_h + kernel_row * dilation_h;
-        for (int output_rows = output_h; output_rows; output_rows--) {
-          if (!is_a_ge_zero_and_a_lt_b(input_row, height)) {
-            data_col += output_w;
-          } else {
-            int input_col = -pad_w + kernel_col * dilation_w;
-            for (int output_col = output_w; output_col; output_col--) {
-              if (is_a_ge_zero_and_a_lt_b(input_col, width)) {
-                data_im[input_row * width + input_col] += *data_col;
-              }
-              data_col++;
-              input_col += stride_w;
-            }
-          }
-          input_row += stride_h;
+        const Dtype* col = data_col + ((channel * kernel_h + kernel_row) *
+            kernel_w + kernel_col) * output_h * output_w;
+        const int offset_h = -pad_h + kernel_row * dilation_h;
+        const int offset_w = -pad_w + kernel_col * dilation_w;
+        int h_begin, h_end, w_begin, w_end;
+        valid_output_range(offset_h, stride_h, height, output_h,
+            &h_begin, &h_end);
+        valid_output_range(offset_w, stride_w, width, output_w,
+            &w_begin, &w_end);
+        for (int h = h_begin; h < h_end; ++h) {
+          col2im_row(col + h * output_w, stride_w, w_begin, w_end,
+              (offset_h + h * stride_h) * width + offset_w, channel_im);
         }
       }
     }
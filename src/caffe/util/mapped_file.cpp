@@ -0,0 +1,32 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "caffe/util/mapped_file.hpp"
+
+namespace caffe {
+
+MappedFile::MappedFile(const string& filename)
+    : filename_(filename), data_(NULL), size_(0) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  CHECK_NE(fd, -1) << "File not found: " << filename;
+  struct stat file_stat;
+  CHECK_EQ(fstat(fd, &file_stat), 0) << "Could not stat " << filename;
+  size_ = file_stat.st_size;
+  if (size_ > 0) {
+    data_ = mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    CHECK(data_ != MAP_FAILED) << "Could not map " << filename;
+  }
+  close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (data_) {
+    munmap(data_, size_);
+  }
+}
+
+}  // namespace caffe
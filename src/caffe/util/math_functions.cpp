@@ -1,11 +1,14 @@
 #include <boost/math/special_functions/next.hpp>
 #include <boost/random.hpp>
 
+#include <algorithm>
 #include <limits>
 
 #include "caffe/common.hpp"
+#include "caffe/util/gemm_tuner.hpp"
 #include "caffe/util/math_functions.hpp"
 #include "caffe/util/rng.hpp"
+#include "caffe/util/simd_math.hpp"
 
 namespace caffe {
 
@@ -16,6 +19,11 @@ void caffe_cpu_gemm<float>(const CBLAS_TRANSPOSE TransA,
     float* C) {
   int lda = (TransA == CblasNoTrans) ? K : M;
   int ldb = (TransB == CblasNoTrans) ? N : K;
+  if (GemmTuner::Get().enabled()) {
+    GemmTuner::Get().Gemm(TransA, TransB, M, N, K, alpha, A, lda, B, ldb,
+        beta, C, N);
+    return;
+  }
   cblas_sgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B,
       ldb, beta, C, N);
 }
@@ -27,10 +35,149 @@ void caffe_cpu_gemm<double>(const CBLAS_TRANSPOSE TransA,
     double* C) {
   int lda = (TransA == CblasNoTrans) ? K : M;
   int ldb = (TransB == CblasNoTrans) ? N : K;
+  if (GemmTuner::Get().enabled()) {
+    GemmTuner::Get().Gemm(TransA, TransB, M, N, K, alpha, A, lda, B, ldb,
+        beta, C, N);
+    return;
+  }
   cblas_dgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B,
       ldb, beta, C, N);
 }
 
+template<>
+void caffe_cpu_gemm<float>(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const float alpha, const float* A, const int lda, const float* B,
+    const int ldb, const float beta, float* C, const int ldc) {
+  if (GemmTuner::Get().enabled()) {
+    GemmTuner::Get().Gemm(TransA, TransB, M, N, K, alpha, A, lda, B, ldb,
+        beta, C, ldc);
+    return;
+  }
+  cblas_sgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B,
+      ldb, beta, C, ldc);
+}
+
+template<>
+void caffe_cpu_gemm<double>(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const double alpha, const double* A, const int lda, const double* B,
+    const int ldb, const double beta, double* C, const int ldc) {
+  if (GemmTuner::Get().enabled()) {
+    GemmTuner::Get().Gemm(TransA, TransB, M, N, K, alpha, A, lda, B, ldb,
+        beta, C, ldc);
+    return;
+  }
+  cblas_dgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B,
+      ldb, beta, C, ldc);
+}
+
+// The bytes of B that caffe_cpu_gemm_s8 keeps in cache while all the rows
+// of A pass over them.
+static const int kGemmS8BlockBytes = 1 << 16;
+
+// The dot product of two 8-bit vectors.
+static inline int32_t dot_s8(const int n, const int8_t* x, const int8_t* y) {
+  int32_t sum = 0;
+  for (int i = 0; i < n; ++i) {
+    sum += static_cast<int32_t>(x[i]) * y[i];
+  }
+  return sum;
+}
+
+void caffe_cpu_gemm_s8(const int M, const int N, const int K,
+    const int8_t* A, const int8_t* B, int32_t* C) {
+  const int block = std::max(4, kGemmS8BlockBytes / std::max(K, 1) / 4 * 4);
+  for (int n0 = 0; n0 < N; n0 += block) {
+    const int n1 = std::min(n0 + block, N);
+#ifdef _OPENMP
+    const bool parallel = static_cast<int64_t>(M) * (n1 - n0) * K >=
+        kParallelMinMultiplyAdds;
+    #pragma omp parallel for if (parallel)
+#endif
+    for (int m = 0; m < M; ++m) {
+      const int8_t* a = A + static_cast<int64_t>(m) * K;
+      int32_t* c = C + static_cast<int64_t>(m) * N;
+      int n = n0;
+      // Four rows of B at a time share the loads of the row of A.
+      for (; n + 4 <= n1; n += 4) {
+        const int8_t* b = B + static_cast<int64_t>(n) * K;
+        int32_t sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+        for (int k = 0; k < K; ++k) {
+          const int32_t x = a[k];
+          sum0 += x * b[k];
+          sum1 += x * b[K + k];
+          sum2 += x * b[2 * K + k];
+          sum3 += x * b[3 * K + k];
+        }
+        c[n] = sum0;
+        c[n + 1] = sum1;
+        c[n + 2] = sum2;
+        c[n + 3] = sum3;
+      }
+      for (; n < n1; ++n) {
+        c[n] = dot_s8(K, a, B + static_cast<int64_t>(n) * K);
+      }
+    }
+  }
+}
+
+// The bytes of B that caffe_cpu_csrmm keeps in cache while all the rows of A
+// pass over them.
+static const int kCsrmmBlockBytes = 1 << 18;
+
+template <typename Dtype>
+void caffe_cpu_csrmm(const int M, const int N, const int K,
+    const Dtype* values, const int* columns, const int* row_begin,
+    const Dtype* B, Dtype* C) {
+  if (N == 1) {
+    // Sparse dot products, as for an inner product of one input.
+    for (int m = 0; m < M; ++m) {
+      Dtype sum = 0;
+      for (int j = row_begin[m]; j < row_begin[m + 1]; ++j) {
+        sum += values[j] * B[columns[j]];
+      }
+      C[m] = sum;
+    }
+    return;
+  }
+  // Each nonzero adds a scaled row of B, so that the inner loop streams
+  // through contiguous memory; blocks of columns keep the rows in cache.
+  const int block = std::min(N, std::max(16,
+      kCsrmmBlockBytes / static_cast<int>(std::max(K, 1) * sizeof(Dtype))));
+  for (int n0 = 0; n0 < N; n0 += block) {
+    const int n1 = std::min(n0 + block, N);
+#ifdef _OPENMP
+    const bool parallel = static_cast<int64_t>(row_begin[M] - row_begin[0]) *
+        (n1 - n0) >= kParallelMinMultiplyAdds;
+    #pragma omp parallel for if (parallel)
+#endif
+    for (int m = 0; m < M; ++m) {
+      Dtype* c = C + static_cast<int64_t>(m) * N;
+      for (int n = n0; n < n1; ++n) {
+        c[n] = 0;
+      }
+      for (int j = row_begin[m]; j < row_begin[m + 1]; ++j) {
+        const Dtype value = values[j];
+        const Dtype* b = B + static_cast<int64_t>(columns[j]) * N;
+#ifdef _OPENMP
+        #pragma omp simd
+#endif
+        for (int n = n0; n < n1; ++n) {
+          c[n] += value * b[n];
+        }
+      }
+    }
+  }
+}
+
+template void caffe_cpu_csrmm<float>(const int M, const int N, const int K,
+    const float* values, const int* columns, const int* row_begin,
+    const float* B, float* C);
+template void caffe_cpu_csrmm<double>(const int M, const int N, const int K,
+    const double* values, const int* columns, const int* row_begin,
+    const double* B, double* C);
+
 template <>
 void caffe_cpu_gemv<float>(const CBLAS_TRANSPOSE TransA, const int M,
     const int N, const float alpha, const float* A, const float* x,
@@ -177,7 +324,11 @@ void caffe_div<double>(const int n, const double* a, const double* b,
 template <>
 void caffe_powx<float>(const int n, const float* a, const float b,
     float* y) {
+#ifdef USE_MKL
   vsPowx(n, a, b, y);
+#else
+  caffe_simd_powx(n, a, b, y);
+#endif
 }
 
 template <>
@@ -198,7 +349,11 @@ void caffe_sqr<double>(const int n, const double* a, double* y) {
 
 template <>
 void caffe_exp<float>(const int n, const float* a, float* y) {
+#ifdef USE_MKL
   vsExp(n, a, y);
+#else
+  caffe_simd_exp(n, a, y);
+#endif
 }
 
 template <>
@@ -208,7 +363,11 @@ void caffe_exp<double>(const int n, const double* a, double* y) {
 
 template <>
 void caffe_log<float>(const int n, const float* a, float* y) {
+#ifdef USE_MKL
   vsLn(n, a, y);
+#else
+  caffe_simd_log(n, a, y);
+#endif
 }
 
 template <>
@@ -216,6 +375,30 @@ void caffe_log<double>(const int n, const double* a, double* y) {
   vdLn(n, a, y);
 }
 
+template <>
+void caffe_tanh<float>(const int n, const float* a, float* y) {
+  caffe_simd_tanh(n, a, y);
+}
+
+template <>
+void caffe_tanh<double>(const int n, const double* a, double* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = tanh(a[i]);
+  }
+}
+
+template <>
+void caffe_sigmoid<float>(const int n, const float* a, float* y) {
+  caffe_simd_sigmoid(n, a, y);
+}
+
+template <>
+void caffe_sigmoid<double>(const int n, const double* a, double* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = 1. / (1. + exp(-a[i]));
+  }
+}
+
 template <>
 void caffe_abs<float>(const int n, const float* a, float* y) {
     vsAbs(n, a, y);
@@ -358,6 +541,34 @@ double caffe_cpu_asum<double>(const int n, const double* x) {
   return cblas_dasum(n, x, 1);
 }
 
+template <typename Dtype>
+Dtype caffe_cpu_amax(const int n, const Dtype* x) {
+  Dtype amax = 0;
+  for (int i = 0; i < n; ++i) {
+    amax = std::max(amax, std::fabs(x[i]));
+  }
+  return amax;
+}
+
+template float caffe_cpu_amax<float>(const int n, const float* x);
+template double caffe_cpu_amax<double>(const int n, const double* x);
+
+template <typename Dtype>
+void caffe_cpu_quantize(const int n, const Dtype scale, const Dtype* x,
+    int8_t* y) {
+  const Dtype inverse = 1 / scale;
+  for (int i = 0; i < n; ++i) {
+    const Dtype q = x[i] * inverse;
+    y[i] = q >= 127 ? 127 : q <= -127 ? -127 :
+        static_cast<int8_t>(q < 0 ? q - Dtype(0.5) : q + Dtype(0.5));
+  }
+}
+
+template void caffe_cpu_quantize<float>(const int n, const float scale,
+    const float* x, int8_t* y);
+template void caffe_cpu_quantize<double>(const int n, const double scale,
+    const double* x, int8_t* y);
+
 template <>
 void caffe_cpu_scale<float>(const int n, const float alpha, const float *x,
                             float* y) {
@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/quantization.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+Dtype QuantizationInputScale(const QuantizationParameter& param, const int n,
+    const Dtype* x) {
+  const Dtype range = param.input_range() > 0 ? param.input_range() :
+      caffe_cpu_amax(n, x);
+  return range > 0 ? range / kQuantizedMax : Dtype(1);
+}
+
+template float QuantizationInputScale<float>(
+    const QuantizationParameter& param, const int n, const float* x);
+template double QuantizationInputScale<double>(
+    const QuantizationParameter& param, const int n, const double* x);
+
+template <typename Dtype>
+void QuantizedWeights<Dtype>::Update(const Blob<Dtype>& weights,
+    const int outputs, const bool transpose) {
+  const shared_ptr<SyncedMemory>& source = weights.data();
+  if (source == source_ && source->version() == source_version_) {
+    return;
+  }
+  const int inputs = weights.count() / outputs;
+  const Dtype* weight = weights.cpu_data();
+  vector<Dtype> row;
+  if (transpose) {
+    row.resize(inputs);
+  }
+  data_.resize(weights.count());
+  scales_.resize(outputs);
+  for (int o = 0; o < outputs; ++o) {
+    const Dtype* w = weight + o * inputs;
+    if (transpose) {
+      for (int i = 0; i < inputs; ++i) {
+        row[i] = weight[i * outputs + o];
+      }
+      w = &row[0];
+    }
+    const Dtype amax = caffe_cpu_amax(inputs, w);
+    scales_[o] = amax > 0 ? amax / kQuantizedMax : Dtype(1);
+    caffe_cpu_quantize(inputs, scales_[o], w, &data_[o * inputs]);
+  }
+  source_ = source;
+  source_version_ = source->version();
+  released_ = false;
+}
+
+template <typename Dtype>
+bool QuantizedWeights<Dtype>::FromProto(const BlobProto& proto,
+    const int outputs, const bool transpose, const bool keep_weights,
+    Blob<Dtype>* weights) {
+  if (!proto.has_int8_data() || transpose ||
+      proto.int8_scale_size() != outputs) {
+    return false;
+  }
+  CHECK(weights->ShapeEquals(proto)) << "shape mismatch";
+  CHECK_EQ(weights->count(), proto.int8_data().size());
+  if (keep_weights) {
+    weights->FromProto(proto, false);
+  } else {
+    // A SyncedMemory allocates nothing until it is accessed.
+    weights->set_data(shared_ptr<SyncedMemory>(
+        new SyncedMemory(weights->count() * sizeof(Dtype))));
+  }
+  const int8_t* int8_data =
+      reinterpret_cast<const int8_t*>(proto.int8_data().data());
+  data_.assign(int8_data, int8_data + weights->count());
+  scales_.assign(proto.int8_scale().begin(), proto.int8_scale().end());
+  source_ = weights->data();
+  source_version_ = source_->version();
+  released_ = !keep_weights;
+  return true;
+}
+
+INSTANTIATE_CLASS(QuantizedWeights);
+
+void QuantizeBlobProto(BlobProto* proto) {
+  vector<float> values;
+  if (proto->double_data_size() > 0) {
+    values.assign(proto->double_data().begin(), proto->double_data().end());
+  } else {
+    values.assign(proto->data().begin(), proto->data().end());
+  }
+  int slices = 1;
+  if (proto->has_num()) {
+    slices = proto->num();
+  } else if (proto->shape().dim_size() > 0) {
+    slices = proto->shape().dim(0);
+  }
+  CHECK_GT(slices, 0);
+  CHECK_EQ(values.size() % slices, 0);
+  const int slice_size = values.size() / slices;
+  string data(values.size(), 0);
+  proto->clear_int8_scale();
+  for (int s = 0; s < slices; ++s) {
+    const float* x = &values[0] + s * slice_size;
+    const float amax = caffe_cpu_amax(slice_size, x);
+    const float scale = amax > 0 ? amax / kQuantizedMax : 1.f;
+    caffe_cpu_quantize(slice_size, scale, x,
+        reinterpret_cast<int8_t*>(&data[s * slice_size]));
+    proto->add_int8_scale(scale);
+  }
+  proto->clear_data();
+  proto->clear_double_data();
+  proto->set_int8_data(data);
+}
+
+}  // namespace caffe
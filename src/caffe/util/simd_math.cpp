@@ -0,0 +1,251 @@
+#include <stdint.h>
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "caffe/util/simd_math.hpp"
+
+#if defined(__GNUC__) && !defined(__clang__)
+// GCC only turns the selects of the kernels below into vector blends if
+// comparisons may not trap; these functions make no promises about
+// floating-point exception flags anyway.
+#pragma GCC optimize("no-trapping-math")
+#endif
+
+// Function multiversioning needs GCC and the loader's ifunc support.
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && \
+    defined(__linux__)
+#define CAFFE_SIMD_CLONES \
+    __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define CAFFE_SIMD_CLONES
+#endif
+
+// The loops only vectorize with the kernels inlined, however large.
+#ifdef __GNUC__
+#define CAFFE_SIMD_INLINE inline __attribute__((always_inline))
+#else
+#define CAFFE_SIMD_INLINE inline
+#endif
+
+namespace caffe {
+
+// The kernels below compute one value with selects instead of branches, so
+// that the loops calling them vectorize.
+
+static inline int32_t float_bits(const float x) {
+  int32_t bits;
+  memcpy(&bits, &x, sizeof(bits));  // NOLINT(caffe/alt_fn)
+  return bits;
+}
+
+static inline float bits_float(const int32_t bits) {
+  float x;
+  memcpy(&x, &bits, sizeof(x));  // NOLINT(caffe/alt_fn)
+  return x;
+}
+
+// ln(2) split into a part with few mantissa bits, so that n * kLn2Hi is exact
+// for the n exp meets, and the rest.
+static const float kLn2Hi = 0.693359375f;
+static const float kLn2Lo = -2.12194440e-4f;
+
+// exp(r) for |r| <= ln(2) / 2.
+static CAFFE_SIMD_INLINE float exp_reduced(const float r) {
+  return ((((((1.9875691500e-4f * r + 1.3981999507e-3f) * r +
+      8.3334519073e-3f) * r + 4.1665795894e-2f) * r + 1.6666665459e-1f) * r +
+      5.0000001201e-1f) * r * r + r) + 1.f;
+}
+
+// p 2^k for -150 <= k <= 128. Scaling in two steps keeps both factors
+// normal, for results that overflow or underflow gradually.
+static CAFFE_SIMD_INLINE float scale_pow2(const float p, const int32_t k) {
+  const int32_t k1 = k >> 1;
+  return p * bits_float((k1 + 127) << 23) * bits_float((k - k1 + 127) << 23);
+}
+
+static CAFFE_SIMD_INLINE float exp_kernel(const float x) {
+  // exp(x) = 2^n exp(r) with n = round(x / ln(2)) and |r| <= ln(2) / 2.
+  // Adding 1.5 * 2^23 rounds to an integer.
+  const float clamped = x < -104.f ? -104.f : (x > 89.f ? 89.f : x);
+  const float shifter = 12582912.f;
+  const float n = (clamped * 1.44269504089f + shifter) - shifter;
+  const float r = (clamped - n * kLn2Hi) - n * kLn2Lo;
+  const float y = scale_pow2(exp_reduced(r), static_cast<int32_t>(n));
+  return x > 88.7228394f ? std::numeric_limits<float>::infinity() :
+      (x != x ? x : y);
+}
+
+// Splits a positive, finite x into 2^e (1 + m) with
+// sqrt(1/2) <= 1 + m < sqrt(2), and returns m.
+static CAFFE_SIMD_INLINE float log_reduce(const float x, float* e) {
+  // Subnormal x are scaled into the normal range first.
+  const bool subnormal = x < 1.17549435e-38f;
+  const int32_t bits = float_bits(subnormal ? x * 8388608.f : x);
+  const int32_t exponent =
+      ((bits >> 23) & 0xff) - (subnormal ? 126 + 23 : 126);
+  const float m = bits_float((bits & 0x007fffff) | 0x3f000000);
+  const bool low = m < 0.707106781186547524f;
+  *e = static_cast<float>(low ? exponent - 1 : exponent);
+  return low ? m + m - 1.f : m - 1.f;
+}
+
+// log(1 + m) - m + m^2 / 2 for the m of log_reduce.
+static CAFFE_SIMD_INLINE float log_cubic(const float m) {
+  return ((((((((7.0376836292e-2f * m - 1.1514610310e-1f) * m +
+      1.1676998740e-1f) * m - 1.2420140846e-1f) * m + 1.4249322787e-1f) * m -
+      1.6668057665e-1f) * m + 2.0000714765e-1f) * m - 2.4999993993e-1f) * m +
+      3.3333331174e-1f) * m * (m * m);
+}
+
+static CAFFE_SIMD_INLINE float log_kernel(const float x) {
+  float e;
+  const float m = log_reduce(x, &e);
+  float y = log_cubic(m) + e * kLn2Lo;
+  y += -0.5f * (m * m);
+  y = (m + y) + e * kLn2Hi;
+  const float inf = std::numeric_limits<float>::infinity();
+  y = x == inf ? inf : y;
+  y = x == 0.f ? -inf : y;
+  return x < 0.f ? std::numeric_limits<float>::quiet_NaN() :
+      (x != x ? x : y);
+}
+
+static CAFFE_SIMD_INLINE float pow_kernel(const float x, const float b) {
+  // pow(x, b) = exp(b log(x)) for positive, finite x. Summing and scaling
+  // log(x) = e ln(2) + m + tail in double precision keeps the error of exp's
+  // argument, which the result inherits relative to its magnitude, from
+  // growing with it; the small tail may stay a float.
+  float e;
+  const float m = log_reduce(x, &e);
+  const double ln2 = 0.6931471805599453;
+  const float tail = log_cubic(m) - 0.5f * (m * m);
+  const double t = b * ((e * ln2 + m) + tail);
+  const double clamped = t < -104. ? -104. : (t > 89. ? 89. : t);
+  const double shifter = 6755399441055744.;
+  const double n = (clamped * 1.4426950408889634 + shifter) - shifter;
+  const float r = static_cast<float>(clamped - n * ln2);
+  const float y = scale_pow2(exp_reduced(r), static_cast<int32_t>(n));
+  return t > 88.72283905206835 ? std::numeric_limits<float>::infinity() : y;
+}
+
+static CAFFE_SIMD_INLINE float tanh_kernel(const float x) {
+  const float z = x * x;
+  const float small = ((((-5.70498872745e-3f * z + 2.06390887954e-2f) * z -
+      5.37397155531e-2f) * z + 1.33314422036e-1f) * z - 3.33332819422e-1f) *
+      z * x + x;
+  // tanh(|x|) = (1 - e) / (1 + e) with e = exp(-2|x|), which cannot overflow.
+  const float ax = x < 0.f ? -x : x;
+  const float e = exp_kernel(-2.f * ax);
+  const float large = (1.f - e) / (1.f + e);
+  return ax < 0.625f ? small : (x < 0.f ? -large : large);
+}
+
+static CAFFE_SIMD_INLINE float sigmoid_kernel(const float x) {
+  // With e = exp(-|x|), which cannot overflow, sigmoid(x) is 1 / (1 + e) for
+  // x >= 0 and e / (1 + e) otherwise, which stays accurate down to tiny
+  // results.
+  const float e = exp_kernel(x < 0.f ? x : -x);
+  return (x < 0.f ? e : 1.f) / (1.f + e);
+}
+
+CAFFE_SIMD_CLONES
+void caffe_simd_exp(const int n, const float* x, float* y) {
+#ifdef _OPENMP
+  #pragma omp simd
+#endif
+  for (int i = 0; i < n; ++i) {
+    y[i] = exp_kernel(x[i]);
+  }
+}
+
+CAFFE_SIMD_CLONES
+void caffe_simd_log(const int n, const float* x, float* y) {
+#ifdef _OPENMP
+  #pragma omp simd
+#endif
+  for (int i = 0; i < n; ++i) {
+    y[i] = log_kernel(x[i]);
+  }
+}
+
+CAFFE_SIMD_CLONES
+void caffe_simd_powx(const int n, const float* x, const float b, float* y) {
+  if (b == 2.f) {
+#ifdef _OPENMP
+    #pragma omp simd
+#endif
+    for (int i = 0; i < n; ++i) {
+      y[i] = x[i] * x[i];
+    }
+    return;
+  }
+  if (b == 1.f || b == 0.5f || b == 0.f) {
+    // Exact, or as accurate as libm's sqrt.
+    for (int i = 0; i < n; ++i) {
+      y[i] = std::pow(x[i], b);
+    }
+    return;
+  }
+  // libm takes the bases other than positive, finite ones, whose results
+  // depend on b in ways that do not vectorize.
+  int rest = 0;
+#ifdef _OPENMP
+  #pragma omp simd reduction(+: rest)
+#endif
+  for (int i = 0; i < n; ++i) {
+    const float value = x[i];
+    rest += !(value > 0.f && value < std::numeric_limits<float>::infinity());
+    y[i] = pow_kernel(value, b);
+  }
+  if (rest > 0) {
+    for (int i = 0; i < n; ++i) {
+      if (!(x[i] > 0.f && x[i] < std::numeric_limits<float>::infinity())) {
+        y[i] = std::pow(x[i], b);
+      }
+    }
+  }
+}
+
+CAFFE_SIMD_CLONES
+void caffe_simd_tanh(const int n, const float* x, float* y) {
+#ifdef _OPENMP
+  #pragma omp simd
+#endif
+  for (int i = 0; i < n; ++i) {
+    y[i] = tanh_kernel(x[i]);
+  }
+}
+
+CAFFE_SIMD_CLONES
+void caffe_simd_sigmoid(const int n, const float* x, float* y) {
+#ifdef _OPENMP
+  #pragma omp simd
+#endif
+  for (int i = 0; i < n; ++i) {
+    y[i] = sigmoid_kernel(x[i]);
+  }
+}
+
+const char* caffe_simd_isa() {
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && \
+    defined(__linux__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) { return "avx512f"; }
+  if (__builtin_cpu_supports("avx2")) { return "avx2"; }
+  return "sse2";
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+  return "neon";
+#elif defined(__AVX512F__)
+  return "avx512f";
+#elif defined(__AVX2__)
+  return "avx2";
+#elif defined(__SSE2__)
+  return "sse2";
+#else
+  return "scalar";
+#endif
+}
+
+}  // namespace caffe
@@ -0,0 +1,227 @@
+#include <algorithm>
+#include <cmath>
+
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/softmax.hpp"
+
+namespace caffe {
+
+// Contiguous rows are exponentiated this many values at a time; others in
+// blocks of this many rows, with the channels of each block in turn.
+static const int kSoftmaxChunk = 256;
+
+template <typename Dtype>
+static void softmax_row(const int channels, const Dtype* x, Dtype* y,
+    Dtype* log_sum_exp) {
+  Dtype max = x[0];
+  if (y) {
+#ifdef _OPENMP
+    #pragma omp simd reduction(max: max)
+#endif
+    for (int c = 0; c < channels; ++c) {
+      max = x[c] > max ? x[c] : max;
+    }
+  }
+  Dtype sum = 0;
+  Dtype buffer[kSoftmaxChunk];
+  for (int begin = 0; begin < channels; begin += kSoftmaxChunk) {
+    const int count = std::min(kSoftmaxChunk, channels - begin);
+    const Dtype* chunk = x + begin;
+    if (!y) {
+      // Single pass: rescale the sum so far whenever the max grows.
+      Dtype chunk_max = max;
+#ifdef _OPENMP
+      #pragma omp simd reduction(max: chunk_max)
+#endif
+      for (int c = 0; c < count; ++c) {
+        chunk_max = chunk[c] > chunk_max ? chunk[c] : chunk_max;
+      }
+      if (chunk_max > max) {
+        sum *= std::exp(max - chunk_max);
+        max = chunk_max;
+      }
+    }
+    Dtype* e = y ? y + begin : buffer;
+#ifdef _OPENMP
+    #pragma omp simd
+#endif
+    for (int c = 0; c < count; ++c) {
+      e[c] = chunk[c] - max;
+    }
+    caffe_exp(count, e, e);
+#ifdef _OPENMP
+    #pragma omp simd reduction(+: sum)
+#endif
+    for (int c = 0; c < count; ++c) {
+      sum += e[c];
+    }
+  }
+  if (y) {
+    const Dtype scale = 1 / sum;
+#ifdef _OPENMP
+    #pragma omp simd
+#endif
+    for (int c = 0; c < channels; ++c) {
+      y[c] *= scale;
+    }
+  }
+  if (log_sum_exp) {
+    *log_sum_exp = max + std::log(sum);
+  }
+}
+
+// The softmax of count rows whose channels are inner_num apart.
+template <typename Dtype>
+static void softmax_block(const int channels, const int inner_num,
+    const int count, const Dtype* x, Dtype* y, Dtype* log_sum_exp) {
+  Dtype max[kSoftmaxChunk];
+  Dtype sum[kSoftmaxChunk];
+  Dtype buffer[kSoftmaxChunk];
+  std::copy(x, x + count, max);
+  for (int c = 1; c < channels; ++c) {
+    const Dtype* x_c = x + c * inner_num;
+#ifdef _OPENMP
+    #pragma omp simd
+#endif
+    for (int i = 0; i < count; ++i) {
+      max[i] = x_c[i] > max[i] ? x_c[i] : max[i];
+    }
+  }
+  std::fill(sum, sum + count, Dtype(0));
+  for (int c = 0; c < channels; ++c) {
+    const Dtype* x_c = x + c * inner_num;
+    Dtype* e = y ? y + c * inner_num : buffer;
+#ifdef _OPENMP
+    #pragma omp simd
+#endif
+    for (int i = 0; i < count; ++i) {
+      e[i] = x_c[i] - max[i];
+    }
+    caffe_exp(count, e, e);
+#ifdef _OPENMP
+    #pragma omp simd
+#endif
+    for (int i = 0; i < count; ++i) {
+      sum[i] += e[i];
+    }
+  }
+  if (log_sum_exp) {
+    for (int i = 0; i < count; ++i) {
+      log_sum_exp[i] = max[i] + std::log(sum[i]);
+    }
+  }
+  if (y) {
+    for (int i = 0; i < count; ++i) {
+      buffer[i] = 1 / sum[i];
+    }
+    for (int c = 0; c < channels; ++c) {
+      Dtype* y_c = y + c * inner_num;
+#ifdef _OPENMP
+      #pragma omp simd
+#endif
+      for (int i = 0; i < count; ++i) {
+        y_c[i] *= buffer[i];
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void caffe_cpu_softmax(const int outer_num, const int channels,
+    const int inner_num, const Dtype* x, Dtype* y, Dtype* log_sum_exp) {
+  const int dim = channels * inner_num;
+  const int blocks = (inner_num + kSoftmaxChunk - 1) / kSoftmaxChunk;
+#ifdef _OPENMP
+  #pragma omp parallel for \
+      if (static_cast<int64_t>(outer_num) * dim >= kParallelMinInputs)
+#endif
+  for (int task = 0; task < outer_num * blocks; ++task) {
+    const int i = task / blocks;
+    const int begin = (task % blocks) * kSoftmaxChunk;
+    const int offset = i * dim + begin;
+    Dtype* block_y = y ? y + offset : NULL;
+    Dtype* block_log_sum_exp =
+        log_sum_exp ? log_sum_exp + i * inner_num + begin : NULL;
+    if (inner_num == 1) {
+      softmax_row(channels, x + offset, block_y, block_log_sum_exp);
+    } else {
+      softmax_block(channels, inner_num,
+          std::min(kSoftmaxChunk, inner_num - begin), x + offset, block_y,
+          block_log_sum_exp);
+    }
+  }
+}
+
+template void caffe_cpu_softmax<float>(const int outer_num,
+    const int channels, const int inner_num, const float* x, float* y,
+    float* log_sum_exp);
+template void caffe_cpu_softmax<double>(const int outer_num,
+    const int channels, const int inner_num, const double* x, double* y,
+    double* log_sum_exp);
+
+template <typename Dtype>
+void caffe_cpu_softmax_backward(const int outer_num, const int channels,
+    const int inner_num, const Dtype* y, const Dtype* dy, Dtype* dx) {
+  const int dim = channels * inner_num;
+  const int blocks = (inner_num + kSoftmaxChunk - 1) / kSoftmaxChunk;
+#ifdef _OPENMP
+  #pragma omp parallel for \
+      if (static_cast<int64_t>(outer_num) * dim >= kParallelMinInputs)
+#endif
+  for (int task = 0; task < outer_num * blocks; ++task) {
+    const int begin = (task % blocks) * kSoftmaxChunk;
+    const int offset = task / blocks * dim + begin;
+    const int count = std::min(kSoftmaxChunk, inner_num - begin);
+    const Dtype* block_y = y + offset;
+    const Dtype* block_dy = dy + offset;
+    Dtype* block_dx = dx + offset;
+    if (inner_num == 1) {
+      Dtype dot = 0;
+#ifdef _OPENMP
+      #pragma omp simd reduction(+: dot)
+#endif
+      for (int c = 0; c < channels; ++c) {
+        dot += block_dy[c] * block_y[c];
+      }
+#ifdef _OPENMP
+      #pragma omp simd
+#endif
+      for (int c = 0; c < channels; ++c) {
+        block_dx[c] = block_y[c] * (block_dy[c] - dot);
+      }
+      continue;
+    }
+    Dtype dot[kSoftmaxChunk];
+    std::fill(dot, dot + count, Dtype(0));
+    for (int c = 0; c < channels; ++c) {
+      const Dtype* y_c = block_y + c * inner_num;
+      const Dtype* dy_c = block_dy + c * inner_num;
+#ifdef _OPENMP
+      #pragma omp simd
+#endif
+      for (int i = 0; i < count; ++i) {
+        dot[i] += dy_c[i] * y_c[i];
+      }
+    }
+    for (int c = 0; c < channels; ++c) {
+      const Dtype* y_c = block_y + c * inner_num;
+      const Dtype* dy_c = block_dy + c * inner_num;
+      Dtype* dx_c = block_dx + c * inner_num;
+#ifdef _OPENMP
+      #pragma omp simd
+#endif
+      for (int i = 0; i < count; ++i) {
+        dx_c[i] = y_c[i] * (dy_c[i] - dot[i]);
+      }
+    }
+  }
+}
+
+template void caffe_cpu_softmax_backward<float>(const int outer_num,
+    const int channels, const int inner_num, const float* y, const float* dy,
+    float* dx);
+template void caffe_cpu_softmax_backward<double>(const int outer_num,
+    const int channels, const int inner_num, const double* y,
+    const double* dy, double* dx);
+
+}  // namespace caffe
@@ -0,0 +1,91 @@
+#include <vector>
+
+#include "caffe/util/sparse.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+bool SparseWeights<Dtype>::Update(const Blob<Dtype>& weights,
+    const int outputs, const bool transpose, const float threshold) {
+  const shared_ptr<SyncedMemory>& source = weights.data();
+  if (source == source_ && source->version() == source_version_ &&
+      threshold == threshold_) {
+    return sparse_;
+  }
+  source_ = source;
+  source_version_ = source->version();
+  threshold_ = threshold;
+  const int count = weights.count();
+  const Dtype* weight = weights.cpu_data();
+  int nonzeros = 0;
+  for (int i = 0; i < count; ++i) {
+    nonzeros += weight[i] != 0;
+  }
+  sparse_ = threshold > 0 && nonzeros <= threshold * count;
+  if (!sparse_) {
+    // Release the memory of earlier sparse weights.
+    vector<Dtype>().swap(values_);
+    vector<int>().swap(columns_);
+    vector<int>().swap(row_begin_);
+    return false;
+  }
+  const int inputs = count / outputs;
+  values_.resize(nonzeros);
+  columns_.resize(nonzeros);
+  row_begin_.resize(outputs + 1);
+  int j = 0;
+  for (int o = 0; o < outputs; ++o) {
+    row_begin_[o] = j;
+    for (int i = 0; i < inputs; ++i) {
+      const Dtype w = transpose ? weight[i * outputs + o] :
+          weight[o * inputs + i];
+      if (w != 0) {
+        values_[j] = w;
+        columns_[j] = i;
+        ++j;
+      }
+    }
+  }
+  row_begin_[outputs] = j;
+  return true;
+}
+
+INSTANTIATE_CLASS(SparseWeights);
+
+bool SparseBlobProto(BlobProto* proto) {
+  vector<double> values;
+  const bool double_data = proto->double_data_size() > 0;
+  if (double_data) {
+    values.assign(proto->double_data().begin(), proto->double_data().end());
+  } else {
+    values.assign(proto->data().begin(), proto->data().end());
+  }
+  int nonzeros = 0;
+  for (int i = 0; i < values.size(); ++i) {
+    nonzeros += values[i] != 0;
+  }
+  if (nonzeros > values.size() / 2) {
+    return false;
+  }
+  proto->clear_data();
+  proto->clear_double_data();
+  proto->set_sparse(true);
+  proto->clear_sparse_data();
+  proto->clear_sparse_gap();
+  proto->clear_sparse_double_data();
+  int previous = 0;
+  for (int i = 0; i < values.size(); ++i) {
+    if (values[i] != 0) {
+      if (double_data) {
+        proto->add_sparse_double_data(values[i]);
+      } else {
+        proto->add_sparse_data(values[i]);
+      }
+      proto->add_sparse_gap(i - previous);
+      previous = i;
+    }
+  }
+  return true;
+}
+
+}  // namespace caffe
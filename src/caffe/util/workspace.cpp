@@ -0,0 +1,75 @@
+#include <boost/thread.hpp>
+#include <map>
+#include <set>
+
+#include "caffe/util/workspace.hpp"
+
+namespace caffe {
+
+// Make sure each thread has its own workspace.
+static boost::thread_specific_ptr<Workspace> thread_workspace_;
+// The workspaces of all threads, for Release. They are intentionally leaked
+// so that workspaces destroyed during program exit can still leave them.
+static std::set<Workspace*>& workspaces() {
+  static std::set<Workspace*>* workspaces = new std::set<Workspace*>();
+  return *workspaces;
+}
+static boost::mutex& workspaces_mutex() {
+  static boost::mutex* mutex = new boost::mutex();
+  return *mutex;
+}
+
+Workspace& Workspace::Get() {
+  if (!thread_workspace_.get()) {
+    thread_workspace_.reset(new Workspace());
+  }
+  return *(thread_workspace_.get());
+}
+
+Workspace::Workspace()
+    : memory_(), requests_(), mutex_(new boost::mutex()) {
+  boost::mutex::scoped_lock lock(workspaces_mutex());
+  workspaces().insert(this);
+}
+
+Workspace::~Workspace() {
+  boost::mutex::scoped_lock lock(workspaces_mutex());
+  workspaces().erase(this);
+}
+
+const shared_ptr<SyncedMemory>& Workspace::Reserve(const void* client,
+    size_t size) {
+  {
+    boost::mutex::scoped_lock lock(*mutex_);
+    requests_[client] = size;
+  }
+  if (size > this->size()) {
+    // Clients still holding the old buffer keep it alive until they reserve
+    // again and switch over.
+    memory_.reset(new SyncedMemory(size));
+  } else if (!memory_) {
+    memory_.reset(new SyncedMemory(0));
+  }
+  return memory_;
+}
+
+void Workspace::Release(const void* client) {
+  boost::mutex::scoped_lock lock(workspaces_mutex());
+  for (std::set<Workspace*>::iterator it = workspaces().begin();
+       it != workspaces().end(); ++it) {
+    boost::mutex::scoped_lock workspace_lock(*(*it)->mutex_);
+    (*it)->requests_.erase(client);
+  }
+}
+
+size_t Workspace::requested_bytes() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  size_t requested = 0;
+  for (std::map<const void*, size_t>::const_iterator it = requests_.begin();
+       it != requests_.end(); ++it) {
+    requested += it->second;
+  }
+  return requested;
+}
+
+}  // namespace caffe
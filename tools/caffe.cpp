@@ -13,6 +13,8 @@ namespace bp = boost::python;
 
 #include "boost/algorithm/string.hpp"
 #include "caffe/caffe.hpp"
+#include "caffe/util/gemm_tuner.hpp"
+#include "caffe/util/host_memory_pool.hpp"
 #include "caffe/util/signal_handler.h"
 
 using caffe::Blob;
@@ -54,6 +56,15 @@ DEFINE_string(sigint_effect, "stop",
 DEFINE_string(sighup_effect, "snapshot",
              "Optional; action to take when a SIGHUP signal is received: "
              "snapshot, stop or none.");
+DEFINE_int32(host_cache_mb, 0,
+    "Optional; the megabytes of freed host memory each memory pool may keep "
+    "for reuse instead of returning them to the system.");
+DEFINE_bool(tune_gemm, false,
+    "Optional; time the CPU GEMM kernels on the first product of each shape "
+    "and use the fastest from then on.");
+DEFINE_string(gemm_cache, "",
+    "Optional; with -tune_gemm, the file that keeps the GEMM kernel choices "
+    "between runs.");
 
 // A simple registry for caffe commands.
 typedef int (*BrewFunction)();
@@ -416,6 +427,16 @@ int time() {
   LOG(INFO) << "Average Forward-Backward: " << total_timer.MilliSeconds() /
     FLAGS_iterations << " ms.";
   LOG(INFO) << "Total Time: " << total_timer.MilliSeconds() << " ms.";
+  if (FLAGS_tune_gemm) {
+    typedef std::map<caffe::GemmShape, caffe::GemmTuner::Kernel> Decisions;
+    const Decisions decisions = caffe::GemmTuner::Get().decisions();
+    LOG(INFO) << "GEMM kernels chosen: ";
+    for (Decisions::const_iterator it = decisions.begin();
+         it != decisions.end(); ++it) {
+      LOG(INFO) << std::setfill(' ') << std::setw(24) << it->first.ToString()
+        << "\t" << caffe::GemmTuner::KernelName(it->second);
+    }
+  }
   LOG(INFO) << "*** Benchmark ends ***";
   return 0;
 }
@@ -436,6 +457,17 @@ int main(int argc, char** argv) {
       "  time            benchmark model execution time");
   // Run tool or show usage.
   caffe::GlobalInit(&argc, &argv);
+  if (FLAGS_host_cache_mb > 0) {
+    const size_t bytes = static_cast<size_t>(FLAGS_host_cache_mb) << 20;
+    caffe::HostMemoryPool::Get(false).set_max_cached_bytes(bytes);
+#ifndef CPU_ONLY
+    caffe::HostMemoryPool::Get(true).set_max_cached_bytes(bytes);
+#endif
+  }
+  if (FLAGS_tune_gemm) {
+    caffe::GemmTuner::Get().set_enabled(true);
+    caffe::GemmTuner::Get().set_cache_file(FLAGS_gemm_cache);
+  }
   if (argc == 2) {
 #ifdef WITH_PYTHON_LAYER
     try {
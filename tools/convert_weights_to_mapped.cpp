@@ -0,0 +1,29 @@
+// This program converts trained weights (.caffemodel or .caffemodel.h5) into
+// a .caffeweights file that nets can memory-map instead of parsing and
+// copying, see Net::CopyTrainedLayersFromMappedFile.
+// Usage:
+//    convert_weights_to_mapped net_proto_file weights_file_in
+//        mapped_weights_file_out
+
+#include <string>
+
+#include "caffe/caffe.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;  // Print output to stderr (while still logging)
+  ::google::InitGoogleLogging(argv[0]);
+  if (argc != 4) {
+    LOG(ERROR) << "Usage: convert_weights_to_mapped net_proto_file "
+        << "weights_file_in mapped_weights_file_out";
+    return 1;
+  }
+
+  Net<float> net(argv[1], caffe::TEST);
+  net.CopyTrainedLayersFrom(argv[2]);
+  net.ToMappedFile(argv[3]);
+
+  LOG(INFO) << "Wrote mapped weights to " << argv[3];
+  return 0;
+}
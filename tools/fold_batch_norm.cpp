@@ -0,0 +1,64 @@
+// This is a script to fold the BatchNorm and Scale layers of a trained net
+// into the preceding convolution and inner product layers, for deployment.
+// Usage:
+//    fold_batch_norm net_proto_file_in weights_file_in
+//        net_proto_file_out weights_file_out
+// The net is read in the TEST phase.
+
+#include <map>
+#include <string>
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/fold_batch_norm.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using std::map;
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;  // Print output to stderr (while still logging)
+  ::google::InitGoogleLogging(argv[0]);
+  if (argc != 5) {
+    LOG(ERROR) << "Usage: "
+        << "fold_batch_norm net_proto_file_in weights_file_in "
+        << "net_proto_file_out weights_file_out";
+    return 1;
+  }
+
+  NetParameter net_param;
+  ReadNetParamsFromTextFileOrDie(string(argv[1]), &net_param);
+  NetParameter weights;
+  ReadNetParamsFromBinaryFileOrDie(string(argv[2]), &weights);
+  net_param.mutable_state()->set_phase(TEST);
+  NetParameter filtered_param;
+  Net<float>::FilterNet(net_param, &filtered_param);
+
+  // Attach the trained blobs to the layers of the same name.
+  map<string, int> weights_index;
+  for (int i = 0; i < weights.layer_size(); ++i) {
+    weights_index[weights.layer(i).name()] = i;
+  }
+  for (int i = 0; i < filtered_param.layer_size(); ++i) {
+    LayerParameter* layer = filtered_param.mutable_layer(i);
+    map<string, int>::const_iterator it = weights_index.find(layer->name());
+    if (it != weights_index.end()) {
+      layer->mutable_blobs()->CopyFrom(weights.layer(it->second).blobs());
+    }
+  }
+
+  NetParameter folded_param;
+  const int num_folded = FoldBatchNorm(filtered_param, &folded_param);
+  LOG(INFO) << "Folded " << num_folded << " layers";
+
+  WriteProtoToBinaryFile(folded_param, argv[4]);
+  for (int i = 0; i < folded_param.layer_size(); ++i) {
+    folded_param.mutable_layer(i)->clear_blobs();
+  }
+  WriteProtoToTextFile(folded_param, argv[3]);
+
+  LOG(INFO) << "Wrote folded NetParameter text proto to " << argv[3]
+            << " and weights to " << argv[4];
+  return 0;
+}
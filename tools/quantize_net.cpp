@@ -0,0 +1,138 @@
+// This is a script to quantize the convolution and inner product layers of a
+// trained net to 8-bit integers for CPU inference, calibrating the range of
+// their inputs over sample data from the net's own data layers.
+// Usage:
+//    quantize_net net_proto_file_in weights_file_in iterations
+//        net_proto_file_out weights_file_out
+// The net is read in the TEST phase. The tool runs the float and the
+// quantized nets for the same number of iterations and reports the mean of
+// each net output for both, so that the accuracy lost to quantization can be
+// checked before deploying. The weights are written as 8-bit integers.
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/quantization.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using std::map;
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+// Whether the quantized layers can run the layer with these parameters.
+static bool Quantizable(const LayerParameter& layer) {
+  return (layer.type() == "Convolution" && layer.layout() != NHWC) ||
+      layer.type() == "InnerProduct";
+}
+
+// Runs the net for the given number of iterations and returns the mean of
+// each of its outputs. If ranges is not NULL, also records the largest input
+// magnitude of each quantizable layer, by name.
+static vector<double> RunNet(Net<float>* net, const int iterations,
+    map<string, float>* ranges) {
+  const vector<shared_ptr<Layer<float> > >& layers = net->layers();
+  vector<double> means(net->num_outputs(), 0);
+  for (int iter = 0; iter < iterations; ++iter) {
+    if (ranges) {
+      for (int i = 0; i < layers.size(); ++i) {
+        const LayerParameter& layer = layers[i]->layer_param();
+        if (Quantizable(layer)) {
+          const Blob<float>* bottom = net->bottom_vecs()[i][0];
+          float& range = (*ranges)[layer.name()];
+          range = std::max(range,
+              caffe_cpu_amax(bottom->count(), bottom->cpu_data()));
+        }
+        net->ForwardFromTo(i, i);
+      }
+    } else {
+      net->Forward();
+    }
+    for (int j = 0; j < net->num_outputs(); ++j) {
+      const Blob<float>* output = net->output_blobs()[j];
+      const float* output_data = output->cpu_data();
+      for (int k = 0; k < output->count(); ++k) {
+        means[j] += output_data[k] / output->count() / iterations;
+      }
+    }
+  }
+  return means;
+}
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;  // Print output to stderr (while still logging)
+  ::google::InitGoogleLogging(argv[0]);
+  if (argc != 6) {
+    LOG(ERROR) << "Usage: "
+        << "quantize_net net_proto_file_in weights_file_in iterations "
+        << "net_proto_file_out weights_file_out";
+    return 1;
+  }
+  const int iterations = atoi(argv[3]);
+  CHECK_GT(iterations, 0) << "Calibrate over at least one iteration.";
+  Caffe::set_mode(Caffe::CPU);
+
+  NetParameter net_param;
+  ReadNetParamsFromTextFileOrDie(string(argv[1]), &net_param);
+  net_param.mutable_state()->set_phase(TEST);
+  NetParameter filtered_param;
+  Net<float>::FilterNet(net_param, &filtered_param);
+
+  Net<float> net(filtered_param);
+  net.CopyTrainedLayersFrom(string(argv[2]));
+  map<string, float> ranges;
+  const vector<double> means = RunNet(&net, iterations, &ranges);
+
+  NetParameter quantized_param(filtered_param);
+  int num_quantized = 0;
+  for (int i = 0; i < quantized_param.layer_size(); ++i) {
+    LayerParameter* layer = quantized_param.mutable_layer(i);
+    if (!Quantizable(*layer)) {
+      continue;
+    }
+    QuantizationParameter* param = layer->mutable_quantization_param();
+    if (ranges[layer->name()] > 0) {
+      param->set_input_range(ranges[layer->name()]);
+    }
+    LOG(INFO) << "Quantizing " << layer->name() << " with input range "
+              << param->input_range();
+    ++num_quantized;
+  }
+  LOG(INFO) << "Quantized " << num_quantized << " layers";
+
+  Net<float> quantized_net(quantized_param);
+  quantized_net.CopyTrainedLayersFrom(string(argv[2]));
+  const vector<double> quantized_means =
+      RunNet(&quantized_net, iterations, NULL);
+  for (int j = 0; j < means.size(); ++j) {
+    const string& name =
+        net.blob_names()[net.output_blob_indices()[j]];
+    LOG(INFO) << "Output " << name << ": float = " << means[j]
+              << ", 8-bit = " << quantized_means[j]
+              << ", delta = " << quantized_means[j] - means[j];
+  }
+
+  NetParameter weights;
+  quantized_net.ToProto(&weights, false);
+  for (int i = 0; i < weights.layer_size(); ++i) {
+    LayerParameter* layer = weights.mutable_layer(i);
+    // Transposed inner product weights run along the outputs, so their
+    // scales do not match the slices of the blob.
+    if (layer->has_quantization_param() && layer->blobs_size() > 0 &&
+        !(layer->type() == "InnerProduct" &&
+          layer->inner_product_param().transpose())) {
+      QuantizeBlobProto(layer->mutable_blobs(0));
+    }
+  }
+  WriteProtoToBinaryFile(weights, argv[5]);
+  WriteProtoToTextFile(quantized_param, argv[4]);
+
+  LOG(INFO) << "Wrote quantized NetParameter text proto to " << argv[4]
+            << " and weights to " << argv[5];
+  return 0;
+}
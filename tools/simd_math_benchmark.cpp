@@ -0,0 +1,97 @@
+// This is a script to measure the throughput of the vectorized math functions
+// that caffe_exp, caffe_log, caffe_powx, caffe_tanh and caffe_sigmoid use for
+// floats, against scalar libm loops.
+// Usage:
+//    simd_math_benchmark [values [iterations]]
+
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/simd_math.hpp"
+
+using std::vector;
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+static void LibmExp(const int n, const float* x, float* y) {
+  for (int i = 0; i < n; ++i) { y[i] = std::exp(x[i]); }
+}
+
+static void LibmLog(const int n, const float* x, float* y) {
+  for (int i = 0; i < n; ++i) { y[i] = std::log(x[i]); }
+}
+
+static void LibmPowx(const int n, const float* x, float* y) {
+  for (int i = 0; i < n; ++i) { y[i] = std::pow(x[i], 1.5f); }
+}
+
+static void SimdPowx(const int n, const float* x, float* y) {
+  caffe_simd_powx(n, x, 1.5f, y);
+}
+
+static void LibmTanH(const int n, const float* x, float* y) {
+  for (int i = 0; i < n; ++i) { y[i] = std::tanh(x[i]); }
+}
+
+static void LibmSigmoid(const int n, const float* x, float* y) {
+  for (int i = 0; i < n; ++i) { y[i] = 1.f / (1.f + std::exp(-x[i])); }
+}
+
+// Returns the millions of values per second function computes.
+static double Throughput(void (*function)(const int, const float*, float*),
+    const vector<float>& x, vector<float>* y, const int iterations) {
+  function(x.size(), &x[0], &(*y)[0]);  // Warm up.
+  CPUTimer timer;
+  timer.Start();
+  for (int i = 0; i < iterations; ++i) {
+    function(x.size(), &x[0], &(*y)[0]);
+  }
+  timer.Stop();
+  return static_cast<double>(x.size()) * iterations / timer.MicroSeconds();
+}
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;  // Print output to stderr (while still logging)
+  ::google::InitGoogleLogging(argv[0]);
+  const int count = argc > 1 ? atoi(argv[1]) : 1 << 16;
+  const int iterations = argc > 2 ? atoi(argv[2]) : 200;
+  if (argc > 3 || count <= 0 || iterations <= 0) {
+    LOG(ERROR) << "Usage: simd_math_benchmark [values [iterations]]";
+    return 1;
+  }
+
+  // Arguments in the ranges activations and log-probabilities take, which
+  // are positive where log and pow need them to be.
+  vector<float> signed_x(count);
+  vector<float> positive_x(count);
+  caffe_rng_uniform<float>(count, -10, 10, &signed_x[0]);
+  caffe_rng_uniform<float>(count, 1e-3, 100, &positive_x[0]);
+  vector<float> y(count);
+
+  struct Function {
+    const char* name;
+    void (*libm)(const int, const float*, float*);
+    void (*simd)(const int, const float*, float*);
+    const vector<float>* x;
+  };
+  const Function functions[] = {
+    {"exp", LibmExp, caffe_simd_exp, &signed_x},
+    {"log", LibmLog, caffe_simd_log, &positive_x},
+    {"pow(x, 1.5)", LibmPowx, SimdPowx, &positive_x},
+    {"tanh", LibmTanH, caffe_simd_tanh, &signed_x},
+    {"sigmoid", LibmSigmoid, caffe_simd_sigmoid, &signed_x},
+  };
+  LOG(INFO) << "Vectorized for " << caffe_simd_isa() << ", " << count
+      << " values, " << iterations << " iterations (Mvalues/s):";
+  for (int i = 0; i < sizeof(functions) / sizeof(functions[0]); ++i) {
+    const Function& f = functions[i];
+    const double libm = Throughput(f.libm, *f.x, &y, iterations);
+    const double simd = Throughput(f.simd, *f.x, &y, iterations);
+    LOG(INFO) << f.name << ": libm " << libm << ", simd " << simd << " ("
+        << simd / libm << "x)";
+  }
+  return 0;
+}